@@ -0,0 +1,224 @@
+#include "ri.h"
+
+#define BENCHRI_RUNS_ 5
+
+// Generates `count` functions resembling generated code: long identifiers, comments and indentation.
+static void
+benchri_generate_(CharArray* out, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        chararray_push_f(out,
+            "// Generated function %d.\n"
+            "// Computes a value from its arguments, nothing fancy.\n"
+            "func generated_function_number_%d(argument_first int32, argument_second int32) int32\n"
+            "{\n"
+            "    var accumulated_value_%d int32 = argument_first + %d;\n"
+            "    if (accumulated_value_%d <= argument_second) {\n"
+            "        return accumulated_value_%d - argument_second;   // Trailing comment.\n"
+            "    }\n"
+            "\n"
+            "    return generated_function_number_%d(argument_second, accumulated_value_%d);\n"
+            "}\n"
+            "\n",
+            i, i, i, i, i, i, i, i
+        );
+    }
+}
+
+// Generates `count` functions with `depth` nested `if` blocks referencing the arguments.
+static void
+benchri_generate_nested_(CharArray* out, int count, int depth)
+{
+    for (int i = 0; i < count; ++i) {
+        chararray_push_f(out, "func nested_%d(a int32, b int32) int32\n{\n", i);
+        for (int d = 0; d < depth; ++d) {
+            chararray_push_f(out, "%*sif (a <= b + %d) {\n", (d + 1) * 4, "", d);
+        }
+        chararray_push_f(out, "%*sreturn a - b;\n", (depth + 1) * 4, "");
+        for (int d = depth - 1; d >= 0; --d) {
+            chararray_push_f(out, "%*s}\n", (d + 1) * 4, "");
+        }
+        chararray_push_f(out, "    return b;\n}\n\n");
+    }
+}
+
+static void
+benchri_lex_(String source, iptr lines)
+{
+    double t_min = 1e9;
+    iptr tokens = 0;
+    for (int i = 0; i < BENCHRI_RUNS_; ++i) {
+        Ri ri;
+        ri_init(&ri);
+        double t = perf_get();
+        ASSERT(ri_stream_set_(&ri, source));
+        tokens = 0;
+        while (ri.token.kind != RiToken_End) {
+            ASSERT(ri_lex_next_(&ri));
+            ++tokens;
+        }
+        t = perf_get() - t;
+        ASSERT(ri.stream.line_index + 1 == lines);
+        t_min = MINIMUM(t_min, t);
+        ri_purge(&ri);
+    }
+
+    LOG("%-16s %12"PRIiPTR" tokens %9.3fms %9.1fMB/s %12.0f lines/s",
+        "lex",
+        tokens,
+        t_min * 1e3,
+        (source.count / t_min) / (1024.0 * 1024.0),
+        lines / t_min
+    );
+}
+
+static void
+benchri_lex_buffered_(String source)
+{
+    double t_min = 1e9;
+    RiTokens tokens = {0};
+    for (int i = 0; i < BENCHRI_RUNS_; ++i) {
+        Ri ri;
+        ri_init(&ri);
+        double t = perf_get();
+        ASSERT(ri_lex(&ri, source, &tokens));
+        t = perf_get() - t;
+        t_min = MINIMUM(t_min, t);
+        ri_purge(&ri);
+    }
+
+    iptr token_size = sizeof(uint8_t) + 4 * sizeof(uint32_t) + sizeof(RiTokenValue);
+    LOG("%-16s %12"PRIiPTR" tokens %9.3fms %9.1fMB/s %12"PRIiPTR" bytes/token",
+        "lex-buffered",
+        tokens.kind.count,
+        t_min * 1e3,
+        (source.count / t_min) / (1024.0 * 1024.0),
+        token_size
+    );
+    ri_tokens_purge(&tokens);
+}
+
+static void
+benchri_parse_(String source, bool buffered)
+{
+    double t_min = 1e9;
+    for (int i = 0; i < BENCHRI_RUNS_; ++i) {
+        Ri ri;
+        ri_init(&ri);
+        ri.lex_buffered = buffered;
+        double t = perf_get();
+        ASSERT(ri_parse(&ri, source, S("bench.ri")));
+        t = perf_get() - t;
+        t_min = MINIMUM(t_min, t);
+        ri_purge(&ri);
+    }
+
+    LOG("%-16s %9.3fms %9.1fMB/s",
+        buffered ? "parse-buffered" : "parse",
+        t_min * 1e3,
+        (source.count / t_min) / (1024.0 * 1024.0)
+    );
+}
+
+static void
+benchri_resolve_(String source, const char* name)
+{
+    double t_min = 1e9;
+    for (int i = 0; i < BENCHRI_RUNS_; ++i) {
+        Ri ri;
+        ri_init(&ri);
+        RiNode* node = ri_parse(&ri, source, S("bench.ri"));
+        ASSERT(node);
+        double t = perf_get();
+        ASSERT(ri_resolve(&ri, node));
+        t = perf_get() - t;
+        t_min = MINIMUM(t_min, t);
+        ri_purge(&ri);
+    }
+
+    LOG("%-16s %9.3fms", name, t_min * 1e3);
+}
+
+// Resolves and typechecks on `threads` threads, see `ri_build`.
+static void
+benchri_check_(String source, const char* name, int threads)
+{
+    double t_min = 1e9;
+    for (int i = 0; i < BENCHRI_RUNS_; ++i) {
+        Ri ri;
+        ri_init(&ri);
+        ri.threads = threads;
+        RiNode* node = ri_parse(&ri, source, S("bench.ri"));
+        ASSERT(node);
+        double t = perf_get();
+        if (threads > 1) {
+            ASSERT(ri_build_parallel_(&ri, node));
+        } else {
+            ASSERT(ri_resolve(&ri, node));
+            ASSERT(ri_typecheck(&ri, node));
+        }
+        t = perf_get() - t;
+        t_min = MINIMUM(t_min, t);
+        ri_purge(&ri);
+    }
+
+    LOG("%-16s %9.3fms %4d threads", name, t_min * 1e3, threads);
+}
+
+// Compares node bytes with what fixed-size `sizeof(RiNode)` nodes would take.
+static void
+benchri_ast_(String source, iptr lines)
+{
+    Ri ri;
+    ri_init(&ri);
+    iptr node_count = ri.index;
+    iptr node_bytes = ri.nodes.used;
+    ASSERT(ri_parse(&ri, source, S("bench.ri")));
+    node_count = ri.index - node_count;
+    node_bytes = ri.nodes.used - node_bytes;
+
+    LOG("%-16s %12"PRIiPTR" nodes %9.1f bytes/line (fixed %"PRIiPTR" bytes/node: %.1f bytes/line)",
+        "ast",
+        node_count,
+        (double)node_bytes / lines,
+        (iptr)sizeof(RiNode),
+        (double)(node_count * sizeof(RiNode)) / lines
+    );
+    ri_purge(&ri);
+}
+
+void
+benchri_main()
+{
+#if defined(RI_LEX_AVX2)
+    LOG("lexer: avx2");
+#elif defined(RI_LEX_SSE2)
+    LOG("lexer: sse2");
+#else
+    LOG("lexer: scalar");
+#endif
+
+    CharArray source = {0};
+    benchri_generate_(&source, 20000);
+    iptr lines = 1;
+    for (iptr i = 0; i < source.count; ++i) {
+        lines += source.items[i] == '\n';
+    }
+
+    benchri_lex_(source.slice, lines);
+    benchri_lex_buffered_(source.slice);
+    benchri_parse_(source.slice, false);
+    benchri_parse_(source.slice, true);
+    benchri_resolve_(source.slice, "resolve");
+    benchri_check_(source.slice, "check", 1);
+    benchri_check_(source.slice, "check-parallel", thread_hardware_count());
+    benchri_ast_(source.slice, lines);
+
+    array_clear(&source);
+    benchri_generate_nested_(&source, 2000, 24);
+    benchri_resolve_(source.slice, "resolve-nested");
+    benchri_check_(source.slice, "check-nested", 1);
+    benchri_check_(source.slice, "check-nested-par", thread_hardware_count());
+
+    array_purge(&source);
+}
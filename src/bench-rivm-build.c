@@ -0,0 +1,51 @@
+#include "rivm-build.h"
+
+// Full build, then updates with the body of one function changed.
+static void
+benchrivm_build_update_(int count)
+{
+    CharArray source = {0};
+    benchrivm_generate_(&source, count);
+
+    RiVmModule module;
+    rivm_module_init(&module);
+    RiVmBuild build;
+    rivm_build_init(&build, &module, S("bench.ri"));
+
+    double t_full = perf_get();
+    ASSERT(rivm_build_update(&build, source.slice));
+    t_full = perf_get() - t_full;
+    ASSERT(build.compiled_count == count);
+
+    // `return c - a;` of the function in the middle.
+    CharArray name = {0};
+    chararray_push_f(&name, "func generated_%d(", count / 2);
+    array_zero_term(&name);
+    array_zero_term(&source);
+    char* change = strstr(strstr(source.items, name.items), "c - a");
+    array_purge(&name);
+
+    double t_min = 1e9;
+    for (int i = 0; i < BENCHRIVM_RUNS_; ++i) {
+        change[2] = (i & 1) ? '-' : '+';
+        double t = perf_get();
+        ASSERT(rivm_build_update(&build, source.slice));
+        t = perf_get() - t;
+        ASSERT(build.compiled_count == 1);
+        t_min = MINIMUM(t_min, t);
+    }
+
+    LOG("%-16s %12d funcs full %9.3fms update %9.3fms",
+        "build-update", count, t_full * 1e3, t_min * 1e3);
+
+    rivm_build_purge(&build);
+    rivm_module_purge(&module);
+    array_purge(&source);
+}
+
+void
+benchrivm_build_main()
+{
+    benchrivm_build_update_(2000);
+    benchrivm_build_update_(20000);
+}
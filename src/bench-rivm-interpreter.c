@@ -0,0 +1,128 @@
+#include "rivm-compiler.h"
+#include "rivm-interpreter.h"
+
+#define BENCHRIVM_RUNS_ 5
+
+// Same as `rivm_compile_file`, but without dumping AST and code.
+static void
+benchrivm_compile_file_(const char* path, RiVmModule* module, RiVmOptLevel level)
+{
+    Ri ri;
+    ri_init(&ri);
+
+    ByteArray source = {0};
+    ASSERT(file_read(&source, path, 0));
+    RiNode* ast_module = ri_build(&ri, S((char*)source.items, source.count), S(path));
+    ASSERT(ast_module);
+    array_purge(&source);
+
+    RiVmCompiler compiler;
+    rivm_init(&compiler, &ri);
+    compiler.opt_level = level;
+    ASSERT(rivm_compile(&compiler, ast_module, module));
+    rivm_purge(&compiler);
+
+    ri_purge(&ri);
+}
+
+void
+benchrivm_interpreter_exec_file_(const char* name, RiVmOptLevel level)
+{
+    CharArray path = {0};
+    chararray_push_f(&path, "./src/test/vmi/%s.ri", name);
+    array_zero_term(&path);
+
+    RiVmModule module;
+    rivm_module_init(&module);
+    benchrivm_compile_file_(path.items, &module, level);
+
+    RiVmExec context;
+    rivm_exec_init(&context);
+
+    double t_min = 1e9;
+    double t_sum = 0;
+    RiVmValue value;
+    for (int i = 0; i < BENCHRIVM_RUNS_; ++i) {
+        double t = perf_get();
+        value = rivm_exec(&context, &module, array_at(&module.slot, 0), 0, 0);
+        t = perf_get() - t;
+        t_min = MINIMUM(t_min, t);
+        t_sum += t;
+    }
+
+    LOG("%-16s O%d %12"PRIi64" min %9.3fms avg %9.3fms",
+        name, level, value.i64, t_min * 1e3, (t_sum / BENCHRIVM_RUNS_) * 1e3);
+
+    rivm_exec_purge(&context);
+    rivm_module_purge(&module);
+    array_purge(&path);
+}
+
+// Generates `count` functions the code generator supports.
+static void
+benchrivm_generate_(CharArray* out, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        chararray_push_f(out,
+            "func generated_%d(a int32, b int32) int32\n"
+            "{\n"
+            "    var c int32;\n"
+            "    c = a * %d + b;\n"
+            "    if (c <= b) {\n"
+            "        return generated_%d(c, b);\n"
+            "    }\n"
+            "    return c - a;\n"
+            "}\n"
+            "\n",
+            i, i, (i + 1) % count
+        );
+    }
+}
+
+// Code generation only, on `threads` threads.
+static void
+benchrivm_compile_(String source, int threads, RiVmOptLevel level)
+{
+    double t_min = 1e9;
+    for (int i = 0; i < BENCHRIVM_RUNS_; ++i) {
+        Ri ri;
+        ri_init(&ri);
+        RiNode* ast_module = ri_build(&ri, source, S("bench.ri"));
+        ASSERT(ast_module);
+
+        RiVmModule module;
+        rivm_module_init(&module);
+        RiVmCompiler compiler;
+        rivm_init(&compiler, &ri);
+        compiler.threads = threads;
+        compiler.opt_level = level;
+        double t = perf_get();
+        ASSERT(rivm_compile(&compiler, ast_module, &module));
+        t = perf_get() - t;
+        t_min = MINIMUM(t_min, t);
+        rivm_purge(&compiler);
+        rivm_module_purge(&module);
+        ri_purge(&ri);
+    }
+
+    LOG("%-16s O%d %9.3fms %4d threads", threads > 1 ? "compile-parallel" : "compile", level, t_min * 1e3, threads);
+}
+
+void
+benchrivm_interpreter_main()
+{
+    CharArray source = {0};
+    benchrivm_generate_(&source, 20000);
+    for (int level = RiVmOpt_O0; level <= RiVmOpt_O2; ++level) {
+        benchrivm_compile_(source.slice, 1, level);
+    }
+    benchrivm_compile_(source.slice, thread_hardware_count(), RiVmOpt_O2);
+    array_purge(&source);
+
+    benchrivm_interpreter_exec_file_("fib34", RiVmOpt_O0);
+    benchrivm_interpreter_exec_file_("fib34", RiVmOpt_O2);
+    benchrivm_interpreter_exec_file_("loop", RiVmOpt_O0);
+    benchrivm_interpreter_exec_file_("loop", RiVmOpt_O2);
+    benchrivm_interpreter_exec_file_("switch", RiVmOpt_O0);
+    benchrivm_interpreter_exec_file_("switch", RiVmOpt_O2);
+}
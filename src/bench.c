@@ -0,0 +1,21 @@
+#include "ri-lib.c"
+
+#include "bench-ri.c"
+#include "bench-rivm-interpreter.c"
+#include "bench-rivm-build.c"
+
+int main(int argc, char** argv)
+{
+    benchri_main();
+    benchrivm_interpreter_main();
+    benchrivm_build_main();
+
+    return 0;
+}
+
+#if defined(SYSTEM_WINDOWS)
+void core_main()
+{
+    ExitProcess(main(0, 0));
+}
+#endif
@@ -11,8 +11,12 @@
     #define SYSTEM_PAGE_SIZE 4096
     int _fltused;
 #else
-    #include <sys/time.h>
+    #include <time.h>
+    #include <alloca.h>
     #include <sys/mman.h>
+    #include <pthread.h>
+    #include <unistd.h>
+    #define _alloca alloca
 #endif
 
 //
@@ -853,19 +857,13 @@ perf_get()
     QueryPerformanceCounter((LARGE_INTEGER *)&counter);
     return (double)((double)(counter-first) / frequency);
 #else
-    #define PERF_GET_FREQUENCY 1000000
-    static int first = 1;
-    static double first_value = 0;
-    struct timeval time;
-    gettimeofday(&time, NULL);
-    double value = ((time.tv_usec + time.tv_sec * PERF_GET_FREQUENCY) / (double)PERF_GET_FREQUENCY) - first_value;
-    if (first == 1) {
-        first = 0;
-        first_value = value;
-        value = 0;
-    }
-    #undef PERF_GET_FREQUENCY
-    return value;
+    static struct timespec first = {0};
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    if (first.tv_sec == 0 && first.tv_nsec == 0) {
+        first = time;
+    }
+    return (double)(time.tv_sec - first.tv_sec) + (double)(time.tv_nsec - first.tv_nsec) * 1e-9;
 #endif
 }
 
@@ -927,12 +925,11 @@ virtual_reserve(void* ptr, iptr size)
     ptr = VirtualAlloc(ptr, size, MEM_RESERVE, PAGE_NOACCESS);
     ASSERT(ptr);
 #else
-    ptr = mmap((void*)ptr, size,
+    ptr = mmap(ptr, size,
                PROT_NONE,
-               MAP_PRIVATE | MAP_ANON,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
                -1, 0);
     ASSERT(ptr != MAP_FAILED);
-    // msync(ptr, size, MS_SYNC|MS_INVALIDATE);
 #endif
     return ptr;
 }
@@ -944,14 +941,9 @@ virtual_commit(void* ptr, iptr size)
     ptr = VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE);
     ASSERT(ptr);
 #else
-    // TODO: MAP_PRIVATE or MAP_SHARED?
-    ptr = mmap(ptr, size,
-               PROT_READ | PROT_WRITE,
-               // MAP_ANONYMOUS | MAP_PRIVATE,
-               MAP_FIXED | MAP_SHARED | MAP_ANON,
-               -1, 0);
-    ASSERT(ptr != MAP_FAILED);
-    msync(ptr, size, MS_SYNC|MS_INVALIDATE);
+    // Pages are backed on first touch, so committing is just
+    // making the reserved range accessible.
+    ASSERT(mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0);
 #endif
     return ptr;
 }
@@ -962,14 +954,9 @@ virtual_decommit(void* ptr, iptr size)
 #if defined(SYSTEM_WINDOWS)
     VirtualFree(ptr, size, MEM_DECOMMIT);
 #else
-    // instead of unmapping the address, we're just gonna trick
-    // the TLB to mark this as a new mapped area which, due to
-    // demand paging, will not be committed until used.
-    mmap(ptr, size,
-         PROT_NONE,
-         MAP_FIXED | MAP_PRIVATE | MAP_ANON,
-         -1, 0);
-    msync(ptr, size, MS_SYNC|MS_INVALIDATE);
+    // Drop the physical pages, but keep the address range reserved.
+    madvise(ptr, size, MADV_DONTNEED);
+    mprotect(ptr, size, PROT_NONE);
 #endif
 }
 
@@ -980,7 +967,6 @@ virtual_free(void* ptr, iptr size)
     UNUSED(size);
     VirtualFree((void*)ptr, 0, MEM_RELEASE);
 #else
-    msync(ptr, size, MS_SYNC);
     munmap(ptr, size);
 #endif
 }
@@ -988,7 +974,204 @@ virtual_free(void* ptr, iptr size)
 void*
 virtual_alloc(void* ptr, iptr size)
 {
+#if defined(SYSTEM_WINDOWS)
     return virtual_commit(virtual_reserve(ptr, size), size);
+#else
+    // Single mapping instead of reserve + commit.
+    ptr = mmap(ptr, size,
+               PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS,
+               -1, 0);
+    ASSERT(ptr != MAP_FAILED);
+    return ptr;
+#endif
+}
+
+//
+// Threads
+//
+
+void
+thread_sleep(int ms)
+{
+#if defined(SYSTEM_WINDOWS)
+    Sleep(ms);
+#else
+    struct timespec t = {
+        .tv_sec = ms / 1000,
+        .tv_nsec = (ms % 1000) * 1000000L,
+    };
+    while (nanosleep(&t, &t) == -1) {}
+#endif
+}
+
+int
+thread_hardware_count()
+{
+#if defined(SYSTEM_WINDOWS)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return MAXIMUM(1, (int)info.dwNumberOfProcessors);
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+typedef struct ThreadFor_ {
+    ThreadForF* f;
+    void* user;
+    iptr count;
+    volatile iptr next;
+} ThreadFor_;
+
+typedef struct ThreadForWorker_ {
+    ThreadFor_* job;
+    int thread;
+} ThreadForWorker_;
+
+void*
+atomic_load_ptr(void* volatile* ptr)
+{
+#if defined(SYSTEM_WINDOWS)
+    return InterlockedCompareExchangePointer(ptr, NULL, NULL);
+#else
+    return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+#endif
+}
+
+void
+atomic_store_ptr(void* volatile* ptr, void* value)
+{
+#if defined(SYSTEM_WINDOWS)
+    InterlockedExchangePointer(ptr, value);
+#else
+    __atomic_store_n(ptr, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+int64_t
+atomic_load_i64(volatile int64_t* ptr)
+{
+#if defined(SYSTEM_WINDOWS)
+    return InterlockedCompareExchange64((volatile LONG64*)ptr, 0, 0);
+#else
+    return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+#endif
+}
+
+void
+atomic_store_i64(volatile int64_t* ptr, int64_t value)
+{
+#if defined(SYSTEM_WINDOWS)
+    InterlockedExchange64((volatile LONG64*)ptr, value);
+#else
+    __atomic_store_n(ptr, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+int64_t
+atomic_add_i64(volatile int64_t* ptr, int64_t value)
+{
+#if defined(SYSTEM_WINDOWS)
+    return InterlockedExchangeAdd64((volatile LONG64*)ptr, value);
+#else
+    return __atomic_fetch_add(ptr, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static iptr
+thread_for_next_(ThreadFor_* job)
+{
+#if defined(SYSTEM_WINDOWS)
+    return InterlockedExchangeAdd64((volatile LONG64*)&job->next, 1);
+#else
+    return __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+static void
+thread_for_run_(ThreadForWorker_* worker)
+{
+    ThreadFor_* job = worker->job;
+    for (iptr index = thread_for_next_(job); index < job->count; index = thread_for_next_(job)) {
+        job->f(job->user, index, worker->thread);
+    }
+}
+
+#if defined(SYSTEM_WINDOWS)
+static DWORD WINAPI
+thread_for_proc_(LPVOID worker)
+{
+    thread_for_run_(worker);
+    return 0;
+}
+#else
+static void*
+thread_for_proc_(void* worker)
+{
+    thread_for_run_(worker);
+    return NULL;
+}
+#endif
+
+void
+thread_for(int thread_count, iptr count, ThreadForF* f, void* user)
+{
+    ThreadFor_ job = {
+        .f = f,
+        .user = user,
+        .count = count,
+        .next = 0,
+    };
+
+    thread_count = (int)MINIMUM((iptr)thread_count, count);
+    if (thread_count <= 1) {
+        for (iptr index = 0; index < count; ++index) {
+            f(user, index, 0);
+        }
+        return;
+    }
+
+    ThreadForWorker_* workers = heap_alloc(thread_count * sizeof(ThreadForWorker_));
+#if defined(SYSTEM_WINDOWS)
+    HANDLE* handles = heap_alloc(thread_count * sizeof(HANDLE));
+#else
+    pthread_t* handles = heap_alloc(thread_count * sizeof(pthread_t));
+#endif
+
+    for (int i = 0; i < thread_count; ++i) {
+        workers[i] = (ThreadForWorker_){ .job = &job, .thread = i };
+    }
+
+    // Thread 0 is the calling thread. If a thread can't be created, the remaining ones pick up its share.
+    int started = 1;
+    for (int i = 1; i < thread_count; ++i) {
+#if defined(SYSTEM_WINDOWS)
+        handles[started] = CreateThread(NULL, 0, &thread_for_proc_, &workers[i], 0, NULL);
+        if (handles[started] != NULL) {
+            ++started;
+        }
+#else
+        if (pthread_create(&handles[started], NULL, &thread_for_proc_, &workers[i]) == 0) {
+            ++started;
+        }
+#endif
+    }
+
+    thread_for_run_(&workers[0]);
+
+    for (int i = 1; i < started; ++i) {
+#if defined(SYSTEM_WINDOWS)
+        WaitForSingleObject(handles[i], INFINITE);
+        CloseHandle(handles[i]);
+#else
+        pthread_join(handles[i], NULL);
+#endif
+    }
+
+    heap_free(handles);
+    heap_free(workers);
 }
 
 //
@@ -1293,7 +1476,7 @@ intern_put_r(Intern* I, const char* start, const char* end)
     ValueScalar key = { .u64 = hash ? hash : 1 };
     InternItem *intern = map_get(&I->map, key).ptr;
     for (InternItem *it = intern; it; it = it->next) {
-        if (it->length == length && (it->s == start || (strncmp(it->s, start, length) == 0))) {
+        if (it->length == length && (it->s == start || (memcmp(it->s, start, length) == 0))) {
             return it->s;
         }
     }
@@ -1324,7 +1507,7 @@ intern_has(Intern* I, String string) {
     ValueScalar key = { .u64 = hash ? hash : 1 };
     InternItem *intern = map_get(&I->map, key).ptr;
     for (InternItem *it = intern; it; it = it->next) {
-        if (it->length == string.count && (it->s == string.items || (strncmp(it->s, string.items, string.count) == 0))) {
+        if (it->length == string.count && (it->s == string.items || (memcmp(it->s, string.items, string.count) == 0))) {
             return 1;
         }
     }
@@ -1379,6 +1562,26 @@ arenablock_push_(Arena* arena)
 
 // TODO: Add support for global block pool.
 
+static void*
+arena_push_large_(Arena* arena, iptr size)
+{
+    void* ptr = virtual_alloc(0, size);
+    array_push(&arena->large, ((ArenaLarge){ .ptr = ptr, .size = size, .head = arena->head }));
+    // Pushes after it get a bigger head, so rewinding to them keeps it.
+    arena_push(arena, 1, 1);
+    return ptr;
+}
+
+// Frees large pushes made at `head` or after it.
+static void
+arena_free_large_(Arena* arena, iptr head)
+{
+    while (arena->large.count > 0 && array_last(&arena->large).head >= head) {
+        ArenaLarge large = array_pop(&arena->large);
+        virtual_free(large.ptr, large.size);
+    }
+}
+
 void
 arena_init(Arena* arena, iptr block_size)
 {
@@ -1391,13 +1594,7 @@ void
 arena_clear(Arena* arena)
 {
     // TODO: Keep the blocks alive.
-    void** ptr;
-    ptr = (void**)arena->blocks.items;
-    for (iptr i = 0; i < arena->blocks.count; ++i) {
-        virtual_free(ptr[i], arena->block_size);
-    }
-    array_clear(&arena->blocks);
-    memset(arena, 0, sizeof(Arena));
+    arena_purge(arena);
 }
 
 void
@@ -1408,7 +1605,14 @@ arena_purge(Arena* arena)
     for (iptr i = 0; i != arena->blocks.count; ++i) {
         virtual_free(ptr[i], arena->block_size);
     }
+    ptr = (void**)arena->blocks_pool.items;
+    for (iptr i = 0; i != arena->blocks_pool.count; ++i) {
+        virtual_free(ptr[i], arena->block_size);
+    }
+    arena_free_large_(arena, 0);
     array_purge(&arena->blocks);
+    array_purge(&arena->blocks_pool);
+    array_purge(&arena->large);
     memset(arena, 0, sizeof(Arena));
 }
 
@@ -1422,7 +1626,9 @@ arena_push(Arena* arena, iptr size, iptr align)
     CHECK(align <= 16);
     CHECK(iptr_is_power_of_two(align));
 
-    ASSERT(arena->begin == 0 || size <= arena->block_size);
+    if (size > arena->block_size) {
+        return arena_push_large_(arena, size);
+    }
 
     void* it = void_align_forward(arena->it, align);
     if (arena->begin == 0 || (void*)void_plus(it, size) > arena->end) {
@@ -1510,9 +1716,19 @@ void
 arena_rewind(Arena* arena, iptr head)
 {
     CHECK(head <= arena->head);
+    arena_free_large_(arena, head);
     iptr block_index  = head / arena->block_size;
-    uptr begin = array_at(&arena->blocks, block_index);
     iptr block_offset = head % arena->block_size;
+    if (block_index > 0 && block_index == arena->blocks.count) {
+        // At the very end of the last block.
+        --block_index;
+        block_offset = arena->block_size;
+    }
+    // Blocks after `head` go to the pool, so the pushes that follow reuse them in order.
+    while (arena->blocks.count > block_index + 1) {
+        arenablock_pool_(arena, array_pop(&arena->blocks));
+    }
+    uptr begin = array_at(&arena->blocks, block_index);
     CHECK(block_offset <= arena->block_size);
 
     arena->begin = CAST(void*, begin);
@@ -1522,9 +1738,31 @@ arena_rewind(Arena* arena, iptr head)
     arena->head = head;
 }
 
+void
+arena_array_grow_(Arena* arena, void** items, iptr count, iptr* capacity, iptr item_size, iptr new_count)
+{
+    if (new_count <= *capacity) {
+        return;
+    }
+    iptr align = MINIMUM(item_size & -item_size, 16);
+    iptr size = *capacity * item_size;
+    iptr new_capacity = (iptr)u64_next_power_of_two(MAXIMUM(new_count, 16));
+    iptr new_size = new_capacity * item_size;
+    if (*items && void_plus(*items, size) == arena->it && void_plus(*items, new_size) <= arena->end) {
+        // Last thing pushed, grows in place.
+        arena_push(arena, new_size - size, 1);
+    } else {
+        void* new_items = arena_push(arena, new_size, align);
+        memcpy(new_items, *items, count * item_size);
+        *items = new_items;
+    }
+    *capacity = new_capacity;
+}
+
 void
 arena_truncate(Arena* arena, iptr end)
 {
+    arena_free_large_(arena, end);
     iptr block = (end / arena->block_size) + 1;
     for (iptr i = block + 1; i < arena->blocks.count; ++i) {
         arenablock_pool_(arena, arena->blocks.items[i]);
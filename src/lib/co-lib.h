@@ -71,7 +71,9 @@
 //
 
 // TODO Set by platform.
-#define PAGE_SIZE 4096
+#ifndef PAGE_SIZE
+    #define PAGE_SIZE 4096
+#endif
 
 //
 // Types
@@ -99,6 +101,10 @@ typedef uintptr_t uptr;
     #define ATTR_ALIGN(x) __attribute__ ((aligned(x)))
 #endif
 
+#if defined(COMPILER_GCC) && !defined(__forceinline)
+    #define __forceinline inline __attribute__((always_inline))
+#endif
+
 #define UNUSED(x) (void)x
 #define COUNTOF(a) (sizeof(a) / sizeof((a)[0]))
 // NOTE: Signed variant of sizeof!
@@ -375,6 +381,24 @@ void* virtual_alloc(void* ptr, iptr size);
 
 void thread_sleep(int ms);
 int thread_is_main();
+int thread_hardware_count();
+
+// Called for every index in [0, count), `thread` is in [0, thread_count).
+#define THREAD_FOR_F(name) void name(void* user, iptr index, int thread)
+typedef THREAD_FOR_F(ThreadForF);
+
+// Runs `f` for indices [0, count) on `thread_count` threads (the calling thread is thread 0).
+// Indices are handed out one at a time, so jobs of uneven size balance out.
+// Returns after all indices are done.
+void thread_for(int thread_count, iptr count, ThreadForF* f, void* user);
+
+// Sequentially consistent atomic operations.
+void* atomic_load_ptr(void* volatile* ptr);
+void atomic_store_ptr(void* volatile* ptr, void* value);
+int64_t atomic_load_i64(volatile int64_t* ptr);
+void atomic_store_i64(volatile int64_t* ptr, int64_t value);
+// Returns the value before the addition.
+int64_t atomic_add_i64(volatile int64_t* ptr, int64_t value);
 
 //
 // Hashing
@@ -990,6 +1014,13 @@ int map_put(Map *map, const ValueScalar key, const ValueScalar val);
 // Arena
 //
 
+typedef struct ArenaLarge {
+    void* ptr;
+    iptr size;
+    // Head of the arena when it was pushed.
+    iptr head;
+} ArenaLarge;
+
 typedef struct Arena {
     // Size of a single block in bytes.
     iptr block_size;
@@ -997,6 +1028,8 @@ typedef struct Arena {
     Array(uptr) blocks;
     // Block pool.
     Array(uptr) blocks_pool;
+    // Pushes bigger than a block, each in its own allocation, by head.
+    Array(ArenaLarge) large;
     // Start of current block.
     void* begin;
     // End of current block.
@@ -1011,6 +1044,8 @@ typedef struct Arena {
 void arena_init(Arena* arena, iptr block_size);
 void arena_purge(Arena* arena);
 void arena_clear(Arena* arena);
+// Pushes bigger than the block size get their own allocation, that isn't reachable by index
+// (`arena_at`, `arena_copy`), and is freed when the arena is rewound before it.
 void* arena_push(Arena* arena, iptr size, iptr align);
 
 #define arena_push_t(Arena, Type) \
@@ -1023,9 +1058,23 @@ iptr arena_pour(Arena* arena, const void* data, iptr data_size, iptr align);
 iptr arena_copy(Arena* arena, void* buffer, iptr start, iptr count);
 // Moves writing head and frees all unused blocks.
 void arena_truncate(Arena* arena, iptr end);
-// Moves writing head forward.
+// Moves writing head back to `head`, blocks after it are kept for reuse.
 void arena_rewind(Arena* arena, iptr head);
 
+// Arrays with items in an arena, for scratch memory that's dropped with `arena_rewind`.
+// Growing leaves the old items in the arena, unless they're the last thing pushed.
+// Arrays bigger than the block size are large pushes (see `arena_push`).
+void arena_array_grow_(Arena* arena, void** items, iptr count, iptr* capacity, iptr item_size, iptr new_count);
+
+#define arena_array_reserve(arena, v, ...) \
+    arena_array_grow_(arena, (void**)(&((v)->items)), (v)->count, &(v)->capacity, sizeof(*(v)->items), __VA_ARGS__)
+
+#define arena_array_push(arena, v, ...) \
+    (arena_array_reserve(arena, v, (v)->count + 1), (v)->items[(v)->count++] = (__VA_ARGS__))
+
+#define arena_array_resize(arena, v, n) \
+    (arena_array_reserve(arena, v, n), (v)->count = (n))
+
 inline void* arena_at(Arena* arena, iptr index) {
     iptr block = index / arena->block_size;
     iptr block_index = index % arena->block_size;
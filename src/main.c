@@ -1,27 +1,35 @@
-#include <co-lib.c>
-
-#include "ri.c"
-#include "rivm.c"
-#include "rivm-compiler.c"
-#include "rivm-interpreter.c"
-#include "rivm-dump.c"
+#include "ri-lib.c"
 
 #include "test-ri.c"
 #include "test-rivm-compiler.c"
 #include "test-rivm-interpreter.c"
+#include "test-rivm-build.c"
+#include "test-rivm-ir.c"
 
 int main(int argc, char** argv)
 {
     // testri_main();
+    testri_lex();
+    testri_lex_keywords();
+    testri_lex_scan();
+    testri_lex_buffered();
+    testri_scope_table();
+    testri_lookup();
+    testri_build_parallel();
+    testri_nodes_copy();
     // testrivm_compiler_main();
+    testrivm_compiler_parallel();
     testrivm_interpreter_main();
+    testrivm_build_main();
+    testrivm_ir_main();
 
     return 0;
 }
 
-
+#if defined(SYSTEM_WINDOWS)
 void core_main()
 {
     // AttachConsole(ATTACH_PARENT_PROCESS);
     ExitProcess(main(0, 0));
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,12 @@
+// Unity build of the library part (everything except tests and entry points).
+
+#include <co-lib.c>
+
+#include "ri.c"
+#include "rivm.c"
+#include "rivm-ir.c"
+#include "rivm-opt.c"
+#include "rivm-compiler.c"
+#include "rivm-build.c"
+#include "rivm-interpreter.c"
+#include "rivm-dump.c"
@@ -4,6 +4,19 @@
 #include "ri.h"
 #include "ri-print.c"
 
+// Define RI_LEX_SCALAR to disable the vectorized scanners.
+#if !defined(RI_LEX_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+    #define RI_LEX_SSE2
+    #include <emmintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #endif
+    #if defined(__AVX2__)
+        #define RI_LEX_AVX2
+        #include <immintrin.h>
+    #endif
+#endif
+
 #define RI_TODO FAIL("todo")
 #define RI_POS_OUTSIDE (RiPos){ -1, -1 }
 #define RI_ID_NULL (String){ NULL, 0 }
@@ -55,7 +68,7 @@ static const struct {
     [RiToken_PipePipe]      = { .binary = RiNode_Expr_Binary_Numeric_Boolean_Or },
 };
 
-const char* RI_OP_NAMES_[] = {
+const char* RI_OP_NAMES_[RiNode_COUNT__] = {
     [RiNode_Expr_Unary_Positive] = "+",
     [RiNode_Expr_Unary_Negative] = "-",
     [RiNode_Expr_Unary_IncPost] = "_++",
@@ -85,8 +98,22 @@ const char* RI_OP_NAMES_[] = {
 //
 //
 
-inline String ri_make_id_0(Ri* ri, char* start, char* end);
-inline String ri_make_id_(Ri* ri, String string);
+static inline String ri_make_id_r_(Ri* ri, char* start, char* end);
+static inline String ri_make_id_(Ri* ri, String string);
+static RiNode* ri_get_spec_(Ri* ri, RiNodeRef ref);
+static inline RiNodeRef ri_node_ref_(Ri* ri, RiNode* node);
+static inline RiNode* ri_node_(Ri* ri, RiNodeRef ref);
+static inline RiNode* ri_nodes_at_(Ri* ri, RiNodeArray* array, iptr index);
+static void ri_nodes_push_(Ri* ri, RiNodeArray* array, RiNode* node);
+
+// Like `array_eachi`, for the nodes of a `RiNodeArray`.
+#define ri_nodes_eachi_(Ri, Array, It, Value)                                  \
+    for (iptr It = 0;                                                          \
+         It < (Array)->count && ((*(Value) = ri_nodes_at_(Ri, Array, It)), 1); \
+         It++)
+
+#define ri_nodes_each_(Ri, Array, Value) \
+    ri_nodes_eachi_(Ri, Array, i__, Value)
 
 //
 //
@@ -123,6 +150,25 @@ ri_error_set_unexpected_token_(Ri* ri, RiToken* token)
     );
 }
 
+// Name of a type in errors, `*` is prefixed by `ri_type_prefix_` for pointers.
+static inline String
+ri_type_name_(Ri* ri, RiNode* type)
+{
+    if (type->kind == RiNode_Spec_Type_Pointer) {
+        type = ri_get_spec_(ri, type->spec.type.pointer.base);
+    }
+    if (type->kind == RiNode_Spec_Type_Struct || !ri->node_meta[type->kind].node) {
+        return type->spec.id;
+    }
+    return ri_node_(ri, ri->node_meta[type->kind].node)->spec.id;
+}
+
+static inline const char*
+ri_type_prefix_(RiNode* type)
+{
+    return type->kind == RiNode_Spec_Type_Pointer ? "*" : "";
+}
+
 static inline void
 ri_error_set_mismatched_types_(Ri* ri, RiPos pos, RiNode* type0, RiNode* type1, const char* op)
 {
@@ -133,10 +179,10 @@ ri_error_set_mismatched_types_(Ri* ri, RiPos pos, RiNode* type0, RiNode* type1,
         op = "and";
     }
 
-    ri_error_set_(ri, RiError_Type, pos, "mismatched types %S %s %S",
-        ri->node_meta[type0->kind].node->spec.id,
+    ri_error_set_(ri, RiError_Type, pos, "mismatched types %s%S %s %s%S",
+        ri_type_prefix_(type0), ri_type_name_(ri, type0),
         op,
-        ri->node_meta[type1->kind].node->spec.id
+        ri_type_prefix_(type1), ri_type_name_(ri, type1)
     );
 }
 
@@ -179,6 +225,235 @@ ri_rune_is_number_(char c) {
     return (c >= '0' && c <= '9');
 }
 
+//
+// Scanners
+//
+
+// Scalar versions are the reference, vectorized versions must return the same results.
+// Vectorized loops only read within [it, end) and leave the tail to the scalar loop.
+
+// Returns first character that is not `ri_rune_is_id_`.
+static inline char*
+ri_scan_id_scalar_(char* it, char* end)
+{
+    while (it < end && ri_rune_is_id_(*it)) ++it;
+    return it;
+}
+
+// Returns first '\r' or '\n'.
+static inline char*
+ri_scan_line_scalar_(char* it, char* end)
+{
+    while (it < end && it[0] != '\r' && it[0] != '\n') ++it;
+    return it;
+}
+
+// Skips ' ', '\t', '\r' and '\n'.
+// Counts "\n", "\r\n" and "\r" as line breaks and sets `line` to start of the last line.
+static inline char*
+ri_scan_space_scalar_(char* it, char* end, iptr* line_index, char** line)
+{
+    while (it < end) {
+        switch (*it) {
+            case ' ': case '\t':
+                ++it;
+                break;
+            case '\r':
+                ++it;
+                if (it < end && it[0] == '\n') {
+                    ++it;
+                }
+                ++*line_index;
+                *line = it;
+                break;
+            case '\n':
+                ++it;
+                ++*line_index;
+                *line = it;
+                break;
+            default:
+                return it;
+        }
+    }
+    return it;
+}
+
+#ifdef RI_LEX_SSE2
+
+static inline int
+ri_bit_first_(uint32_t mask) {
+    RI_ASSERT(mask);
+#if defined(COMPILER_MSVC)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static inline int
+ri_bit_last_(uint32_t mask) {
+    RI_ASSERT(mask);
+#if defined(COMPILER_MSVC)
+    unsigned long index;
+    _BitScanReverse(&index, mask);
+    return (int)index;
+#else
+    return 31 - __builtin_clz(mask);
+#endif
+}
+
+static inline int
+ri_bit_count_(uint32_t mask) {
+    mask = mask - ((mask >> 1) & 0x55555555u);
+    mask = (mask & 0x33333333u) + ((mask >> 2) & 0x33333333u);
+    return (int)((((mask + (mask >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24);
+}
+
+// NOTE: Bytes >= 0x80 are negative for the signed compares, so they never match a range.
+static inline __m128i
+ri_scan_id_mask16_(__m128i v) {
+    // 'A'..'Z' | 0x20 gives 'a'..'z'; '@' and '[' map to '`' and '{' which are outside.
+    __m128i l = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(l, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(l, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(alpha, digit), under);
+}
+
+#ifdef RI_LEX_AVX2
+static inline __m256i
+ri_scan_id_mask32_(__m256i v) {
+    __m256i l = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(l, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), l));
+    __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+    __m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+    return _mm256_or_si256(_mm256_or_si256(alpha, digit), under);
+}
+#endif
+
+static inline char*
+ri_scan_id_simd_(char* it, char* end)
+{
+#ifdef RI_LEX_AVX2
+    while (end - it >= 32) {
+        __m256i v = _mm256_loadu_si256((__m256i*)it);
+        uint32_t stop = ~(uint32_t)_mm256_movemask_epi8(ri_scan_id_mask32_(v));
+        if (stop) {
+            return it + ri_bit_first_(stop);
+        }
+        it += 32;
+    }
+#endif
+    while (end - it >= 16) {
+        __m128i v = _mm_loadu_si128((__m128i*)it);
+        uint32_t stop = ~(uint32_t)_mm_movemask_epi8(ri_scan_id_mask16_(v)) & 0xFFFFu;
+        if (stop) {
+            return it + ri_bit_first_(stop);
+        }
+        it += 16;
+    }
+    return ri_scan_id_scalar_(it, end);
+}
+
+static inline char*
+ri_scan_line_simd_(char* it, char* end)
+{
+#ifdef RI_LEX_AVX2
+    while (end - it >= 32) {
+        __m256i v = _mm256_loadu_si256((__m256i*)it);
+        uint32_t stop = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+        if (stop) {
+            return it + ri_bit_first_(stop);
+        }
+        it += 32;
+    }
+#endif
+    while (end - it >= 16) {
+        __m128i v = _mm_loadu_si128((__m128i*)it);
+        uint32_t stop = (uint32_t)_mm_movemask_epi8(_mm_or_si128(
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+        if (stop) {
+            return it + ri_bit_first_(stop);
+        }
+        it += 16;
+    }
+    return ri_scan_line_scalar_(it, end);
+}
+
+// Line break mask is '\n' or '\r' not followed by '\n', so it needs one byte of lookahead.
+static inline char*
+ri_scan_space_simd_(char* it, char* end, iptr* line_index, char** line)
+{
+    uint32_t stop, breaks;
+    int count;
+#ifdef RI_LEX_AVX2
+    while (end - it >= 33) {
+        __m256i v = _mm256_loadu_si256((__m256i*)it);
+        __m256i v1 = _mm256_loadu_si256((__m256i*)(it + 1));
+        __m256i nl = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+        __m256i cr = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'));
+        __m256i space = _mm256_or_si256(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+        stop = ~(uint32_t)_mm256_movemask_epi8(_mm256_or_si256(space, _mm256_or_si256(nl, cr)));
+        breaks = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(nl,
+            _mm256_andnot_si256(_mm256_cmpeq_epi8(v1, _mm256_set1_epi8('\n')), cr)));
+        count = stop ? ri_bit_first_(stop) : 32;
+        if (count < 32) {
+            breaks &= (1u << count) - 1;
+        }
+        if (breaks) {
+            *line_index += ri_bit_count_(breaks);
+            *line = it + ri_bit_last_(breaks) + 1;
+        }
+        it += count;
+        if (stop) {
+            return it;
+        }
+    }
+#endif
+    while (end - it >= 17) {
+        __m128i v = _mm_loadu_si128((__m128i*)it);
+        __m128i v1 = _mm_loadu_si128((__m128i*)(it + 1));
+        __m128i nl = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+        __m128i cr = _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'));
+        __m128i space = _mm_or_si128(
+            _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+        stop = ~(uint32_t)_mm_movemask_epi8(_mm_or_si128(space, _mm_or_si128(nl, cr))) & 0xFFFFu;
+        breaks = (uint32_t)_mm_movemask_epi8(_mm_or_si128(nl,
+            _mm_andnot_si128(_mm_cmpeq_epi8(v1, _mm_set1_epi8('\n')), cr)));
+        count = stop ? ri_bit_first_(stop) : 16;
+        breaks &= (1u << count) - 1;
+        if (breaks) {
+            *line_index += ri_bit_count_(breaks);
+            *line = it + ri_bit_last_(breaks) + 1;
+        }
+        it += count;
+        if (stop) {
+            return it;
+        }
+    }
+    return ri_scan_space_scalar_(it, end, line_index, line);
+}
+
+#define ri_scan_id_ ri_scan_id_simd_
+#define ri_scan_line_ ri_scan_line_simd_
+#define ri_scan_space_ ri_scan_space_simd_
+
+#else
+
+#define ri_scan_id_ ri_scan_id_scalar_
+#define ri_scan_line_ ri_scan_line_scalar_
+#define ri_scan_space_ ri_scan_space_scalar_
+
+#endif
+
 static inline RiTokenKind
 ri_lex_one_or_two_(Ri* ri, char** it, char* end, enum RiTokenKind op0, char ch, enum RiTokenKind op1)
 {
@@ -268,11 +543,181 @@ ri_lex_number_(Ri* ri, char** it_, char* end, RiToken* token)
     return true;
 }
 
+#define RI_LEX_KEYWORD_(Literal, Kind, Id) \
+    if (start[0] == Literal[0] && memcmp(start, Literal, sizeof(Literal) - 1) == 0) { \
+        token->kind = Kind; \
+        token->id = (String){ .items = (char*)ri->Id, .count = sizeof(Literal) - 1 }; \
+        return true; \
+    }
+
+// Classifies keywords by length and first character, so only non-keywords get interned.
+static inline bool
+ri_lex_keyword_(Ri* ri, RiToken* token, char* start, iptr length)
+{
+    switch (length)
+    {
+        case 2:
+            RI_LEX_KEYWORD_("if", RiToken_Keyword_If, id_if);
+            break;
+        case 3:
+            RI_LEX_KEYWORD_("var", RiToken_Keyword_Variable, id_var);
+            RI_LEX_KEYWORD_("for", RiToken_Keyword_For, id_for);
+            RI_LEX_KEYWORD_("nil", RiToken_Keyword_Nil, id_nil);
+            break;
+        case 4:
+            RI_LEX_KEYWORD_("func", RiToken_Keyword_Func, id_func);
+            RI_LEX_KEYWORD_("type", RiToken_Keyword_Type, id_type);
+            RI_LEX_KEYWORD_("enum", RiToken_Keyword_Enum, id_enum);
+            RI_LEX_KEYWORD_("else", RiToken_Keyword_Else, id_else);
+            RI_LEX_KEYWORD_("case", RiToken_Keyword_Case, id_case);
+            RI_LEX_KEYWORD_("true", RiToken_Keyword_True, id_true);
+            break;
+        case 5:
+            RI_LEX_KEYWORD_("const", RiToken_Keyword_Const, id_const);
+            RI_LEX_KEYWORD_("union", RiToken_Keyword_Union, id_union);
+            RI_LEX_KEYWORD_("break", RiToken_Keyword_Break, id_break);
+            RI_LEX_KEYWORD_("false", RiToken_Keyword_False, id_false);
+            break;
+        case 6:
+            RI_LEX_KEYWORD_("struct", RiToken_Keyword_Struct, id_struct);
+            RI_LEX_KEYWORD_("return", RiToken_Keyword_Return, id_return);
+            RI_LEX_KEYWORD_("switch", RiToken_Keyword_Switch, id_switch);
+            break;
+        case 7:
+            RI_LEX_KEYWORD_("default", RiToken_Keyword_Default, id_default);
+            break;
+        case 8:
+            RI_LEX_KEYWORD_("continue", RiToken_Keyword_Continue, id_continue);
+            break;
+        case 11:
+            RI_LEX_KEYWORD_("fallthrough", RiToken_Keyword_Fallthrough, id_fallthrough);
+            break;
+    }
+    return false;
+}
+
+#undef RI_LEX_KEYWORD_
+
+// Rescans identifiers and numbers, other tokens have a fixed length.
+static char*
+ri_token_end_(RiTokenKind kind, char* start, char* end)
+{
+    char* it = start;
+    switch (kind)
+    {
+        case RiToken_End:
+            return start;
+
+        case RiToken_Integer:
+        case RiToken_Real:
+            while (it < end && ri_rune_is_number_(*it)) ++it;
+            if (it < end && *it == '.') {
+                ++it;
+                while (it < end && ri_rune_is_number_(*it)) ++it;
+            }
+            if (it < end && (*it == 'e' || *it == 'E')) {
+                ++it;
+                if (it < end && (*it == '+' || *it == '-')) ++it;
+                while (it < end && ri_rune_is_number_(*it)) ++it;
+            }
+            return it;
+
+        case RiToken_PlusPlus:
+        case RiToken_MinusMinus:
+        case RiToken_PlusEq:
+        case RiToken_MinusEq:
+        case RiToken_StarEq:
+        case RiToken_SlashEq:
+        case RiToken_PercentEq:
+        case RiToken_AmpEq:
+        case RiToken_PipeEq:
+        case RiToken_BeakEq:
+        case RiToken_LtEq:
+        case RiToken_GtEq:
+        case RiToken_EqEq:
+        case RiToken_BangEq:
+        case RiToken_LtLt:
+        case RiToken_GtGt:
+        case RiToken_AmpAmp:
+        case RiToken_PipePipe:
+            return start + 2;
+
+        default:
+            if (kind == RiToken_Identifier ||
+                (kind >= RiToken_Keyword_Func && kind <= RiToken_Keyword_Nil))
+            {
+                return ri_scan_id_(start + 1, end);
+            }
+            return start + 1;
+    }
+}
+
+// Counts line breaks from the last token read, or from the source start when going back.
+static RiPos
+ri_tokens_pos_(Ri* ri, char* start)
+{
+    char* source = ri->tokens->source.items;
+    char* it = ri->tokens_it;
+    char* line = ri->tokens_line;
+    iptr row = ri->tokens_row;
+    if (it == NULL || it < source || it > start) {
+        it = line = source;
+        row = 0;
+    }
+
+    for (; it < start; ++it) {
+        if (it[0] == '\n' || (it[0] == '\r' && (it + 1 == start || it[1] != '\n'))) {
+            ++row;
+            line = it + 1;
+        }
+    }
+
+    ri->tokens_it = start;
+    ri->tokens_line = line;
+    ri->tokens_row = row;
+    return (RiPos){ .row = (int32_t)row, .col = (int32_t)(start - line) };
+}
+
+static bool
+ri_lex_next_buffered_(Ri* ri)
+{
+    RiTokens* tokens = ri->tokens;
+    iptr i = ri->tokens_index;
+    RI_CHECK(i < tokens->kind.count);
+
+    RiToken* token = &ri->token;
+    token->kind = array_at(&tokens->kind, i);
+    token->start = tokens->source.items + array_at(&tokens->start, i);
+    token->end = ri_token_end_(token->kind, token->start, tokens->source.items + tokens->source.count);
+    token->pos = ri_tokens_pos_(ri, token->start);
+    switch (token->kind) {
+        case RiToken_Integer: token->integer = array_at(&tokens->value, i).integer; break;
+        case RiToken_Real: token->real = array_at(&tokens->value, i).real; break;
+        default:
+            token->id = (String){
+                .items = (char*)array_at(&tokens->value, i).id,
+                .count = token->end - token->start
+            };
+            break;
+    }
+
+    // Stays at `RiToken_End`.
+    if (token->kind != RiToken_End) {
+        ++ri->tokens_index;
+    }
+
+    return true;
+}
+
 static bool
 ri_lex_next_(Ri* ri)
 {
     ri_error_check_(ri);
 
+    if (ri->tokens) {
+        return ri_lex_next_buffered_(ri);
+    }
+
     RiStream* stream = &ri->stream;
     RiToken* token = &ri->token;
     char* it = stream->it;
@@ -294,25 +739,8 @@ next:
 
     switch (*it)
     {
-        case ' ': case '\t':
-            while (it < end && (it[0] == ' ' || it[0] == '\t')) {
-                ++it;
-            }
-            goto next;
-
-        case '\r':
-            ++it;
-            if (it < end && it[0] == '\n') {
-                ++it;
-            }
-            ++stream->line_index;
-            stream->line = it;
-            goto next;
-
-        case '\n':
-            ++it;
-            ++stream->line_index;
-            stream->line = it;
+        case ' ': case '\t': case '\r': case '\n':
+            it = ri_scan_space_(it, end, &stream->line_index, &stream->line);
             goto next;
 
         case '(': ++it; token->kind = RiToken_LP; break;
@@ -407,14 +835,13 @@ next:
 
         case '/':
             ++it;
+            token->kind = RiToken_Slash;
             if (it < end)
             {
                 switch (it[0])
                 {
                     case '/':
-                        while (it < end && it[0] != '\r' && it[0] != '\n') {
-                            ++it;
-                        }
+                        it = ri_scan_line_(it, end);
                         goto next;
                     case '*':
                         // TODO: Block comments.
@@ -424,10 +851,6 @@ next:
                         ++it;
                         token->kind = RiToken_SlashEq;
                         break;
-                    default:
-                        ++it;
-                        token->kind = RiToken_Slash;
-                        break;
                 }
             }
             break;
@@ -443,51 +866,9 @@ next:
         case 'V': case 'W': case 'X': case 'Y': case 'Z':
         case '_': {
             token->kind = RiToken_Identifier;
-            ++it;
-            while (it < end && ri_rune_is_id_(*it)) {
-                ++it;
-            }
-            token->id = ri_make_id_r_(ri, token->start, it);
-            if (token->id.items == ri->id_func) {
-                token->kind = RiToken_Keyword_Func;
-            } else if (token->id.items == ri->id_var) {
-                token->kind = RiToken_Keyword_Variable;
-            } else if (token->id.items == ri->id_const) {
-                token->kind = RiToken_Keyword_Const;
-            } else if (token->id.items == ri->id_type) {
-                token->kind = RiToken_Keyword_Type;
-            } else if (token->id.items == ri->id_struct) {
-                token->kind = RiToken_Keyword_Struct;
-            } else if (token->id.items == ri->id_union) {
-                token->kind = RiToken_Keyword_Union;
-            } else if (token->id.items == ri->id_enum) {
-                token->kind = RiToken_Keyword_Enum;
-            } else if (token->id.items == ri->id_return) {
-                token->kind = RiToken_Keyword_Return;
-            } else if (token->id.items == ri->id_if) {
-                token->kind = RiToken_Keyword_If;
-            } else if (token->id.items == ri->id_else) {
-                token->kind = RiToken_Keyword_Else;
-            } else if (token->id.items == ri->id_for) {
-                token->kind = RiToken_Keyword_For;
-            } else if (token->id.items == ri->id_switch) {
-                token->kind = RiToken_Keyword_Switch;
-            } else if (token->id.items == ri->id_case) {
-                token->kind = RiToken_Keyword_Case;
-            } else if (token->id.items == ri->id_default) {
-                token->kind = RiToken_Keyword_Default;
-            } else if (token->id.items == ri->id_break) {
-                token->kind = RiToken_Keyword_Break;
-            } else if (token->id.items == ri->id_continue) {
-                token->kind = RiToken_Keyword_Continue;
-            } else if (token->id.items == ri->id_fallthrough) {
-                token->kind = RiToken_Keyword_Fallthrough;
-            } else if (token->id.items == ri->id_true) {
-                token->kind = RiToken_Keyword_True;
-            } else if (token->id.items == ri->id_false) {
-                token->kind = RiToken_Keyword_False;
-            } else if (token->id.items == ri->id_nil) {
-                token->kind = RiToken_Keyword_Nil;
+            it = ri_scan_id_(it + 1, end);
+            if (!ri_lex_keyword_(ri, token, token->start, it - token->start)) {
+                token->id = ri_make_id_r_(ri, token->start, it);
             }
         } break;
 
@@ -593,25 +974,94 @@ ri_stream_set_(Ri* ri, String stream)
     ri->stream.end = stream.items + stream.count;
     ri->stream.it = stream.items;
     ri->stream.line = stream.items;
+    ri->stream.line_index = 0;
 
     return ri_lex_next_(ri);
 }
 
+bool
+ri_lex(Ri* ri, String stream, RiTokens* out_tokens)
+{
+    ri_error_check_(ri);
+    RI_CHECK(ri->tokens == NULL);
+    RI_CHECK(stream.count <= UINT32_MAX);
+    RI_CHECK(RiToken_COUNT__ <= UINT8_MAX);
+
+    RiTokens* tokens = out_tokens;
+    tokens->source = stream;
+    array_clear(&tokens->kind);
+    array_clear(&tokens->start);
+    array_clear(&tokens->value);
+
+    // Rough guess of one token per 4 bytes.
+    iptr capacity = stream.count / 4 + 1;
+    array_reserve(&tokens->kind, capacity);
+    array_reserve(&tokens->start, capacity);
+    array_reserve(&tokens->value, capacity);
+
+    if (!ri_stream_set_(ri, stream)) {
+        return false;
+    }
+
+    for (;;) {
+        RiToken* token = &ri->token;
+        RiTokenValue value;
+        switch (token->kind) {
+            case RiToken_Integer: value.integer = token->integer; break;
+            case RiToken_Real: value.real = token->real; break;
+            default:
+                if (token->kind == RiToken_Identifier ||
+                    (token->kind >= RiToken_Keyword_Func && token->kind <= RiToken_Keyword_Nil))
+                {
+                    value.id = token->id.items;
+                } else {
+                    value.id = NULL;
+                }
+                break;
+        }
+
+        array_push(&tokens->kind, (uint8_t)token->kind);
+        array_push(&tokens->start, (uint32_t)(token->start - stream.items));
+        array_push(&tokens->value, value);
+
+        if (token->kind == RiToken_End) {
+            break;
+        }
+
+        if (!ri_lex_next_(ri)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void
+ri_tokens_purge(RiTokens* tokens)
+{
+    array_purge(&tokens->kind);
+    array_purge(&tokens->start);
+    array_purge(&tokens->value);
+}
+
 //
 //
 //
 
 static RiNode*
-ri_get_spec_(Ri* ri, RiNode* node)
+ri_get_spec_(Ri* ri, RiNodeRef ref)
 {
-    RiNode* spec = node;
+    RiNode* spec = ri_node_(ri, ref);
     if (ri_is_in(spec->kind, RiNode_Value)) {
-        spec = node->value.spec;
+        spec = ri_node_(ri, spec->value.spec);
     }
     RI_CHECK(ri_is_in(spec->kind, RiNode_Spec));
     return spec;
 }
 
+static uint64_t ri_sizeof_(Ri* ri, RiPos pos, RiNode* type);
+static uint64_t ri_alignof_(Ri* ri, RiPos pos, RiNode* type);
+
 static RiNode*
 ri_complete_type_(Ri* ri, RiPos pos, RiNode* type)
 {
@@ -630,21 +1080,27 @@ ri_complete_type_(Ri* ri, RiPos pos, RiNode* type)
     switch (type->kind)
     {
         case RiNode_Spec_Type_Struct: {
-            RI_TODO;
-            // uint64_t offset = 0;
-            // RiNodeArray* declarations = &type->type.structure.scope->scope.declarations;
-            // for (iptr i = 0; i < declarations->count; ++i) {
-            //     RiNode* field = declarations->items[i];
-
-            //     RI_ASSERT(ri_is_value(field->declaration.node));
-            //     // NOTE: sizeof will complete the type as well.
-            //     iptr align = ri_alignof(ri, field->pos, field->declaration.node->value.type);
-            //     offset = iptr_align_forward(offset, align);
-            //     field->declaration.offset = offset;
-            //     iptr size = ri_sizeof(ri, field->pos, field->declaration.node->value.type);
-            //     offset += size;
-            // }
-            // type->type.structure.size = offset;
+            // Same as C: each field at the next offset aligned to its type, the size rounded
+            // up to the largest alignment, so host structs can be shared as they are.
+            iptr offset = 0;
+            iptr align = 1;
+            RiNode* it;
+            ri_nodes_each_(ri, &type->spec.type.compound.fields, &it) {
+                RiNode* field = ri_node_(ri, it->decl.spec);
+                RiNode* field_type = ri_get_spec_(ri, field->spec.var.type);
+                // NOTE: sizeof will complete the type as well.
+                iptr size = ri_sizeof_(ri, it->pos, field_type);
+                if (ri->error.kind) {
+                    return 0;
+                }
+                iptr field_align = ri_alignof_(ri, it->pos, field_type);
+                offset = iptr_align_forward(offset, field_align);
+                field->spec.var.offset = (uint32_t)offset;
+                offset += size;
+                align = MAXIMUM(align, field_align);
+            }
+            type->spec.type.compound.size = iptr_align_forward(offset, align);
+            type->spec.type.compound.align = align;
         } break;
         default:
             // ri_error_set_(ri, RiError_CompletingType, pos, "could not complete type");
@@ -664,17 +1120,18 @@ ri_retof_(Ri* ri, RiNode* node)
 
     if (ri_is_in(node->kind, RiNode_Expr_Binary_Comparison)) {
         // Always bool
-        return ri->node_meta[RiNode_Spec_Type_Number_Bool].node;
+        return ri_node_(ri, ri->node_meta[RiNode_Spec_Type_Number_Bool].node);
     } else if (ri_is_in(node->kind, RiNode_Expr_Binary_Numeric)) {
         // Same return value as zero argument.
-        return ri_retof_(ri, node->binary.argument0);
+        return ri_retof_(ri, ri_node_(ri, node->binary.argument0));
     } else {
         // RI_ASSERT(ri_is_rt(node));
         switch (node->kind)
         {
             case RiNode_Value_Var:
-                if (node->value.spec->kind == RiNode_Spec_Var) {
-                    return node->value.type;
+                if (ri_node_(ri, node->value.spec)->kind == RiNode_Spec_Var) {
+                    // Inferred when its declaration is typechecked, after it's resolved.
+                    return ri_get_spec_(ri, ri_node_(ri, node->value.spec)->spec.var.type);
                 } else {
                     ri_error_set_(ri, RiError_UnexpectedValue, node->pos, "variable expected");
                     return NULL;
@@ -682,50 +1139,50 @@ ri_retof_(Ri* ri, RiNode* node)
                 break;
             case RiNode_Value_Const:
                 RI_CHECK(node->value.type);
-                return node->value.type;
+                return ri_node_(ri, node->value.type);
             // case RiNode_Expr_Literal_Real:
             //     // TODO: Error: Untyped.
             //     // TODO: f32?
             //     return ri->node_meta[RiNode_Spec_Type_Number_Float64].node;
             case RiNode_Expr_Cast:
-                return array_at(&node->call.arguments, 0);
+                return ri_nodes_at_(ri, &node->call.arguments, 0);
             case RiNode_Expr_Call: {
-                RI_CHECK(node->call.func);
-                RI_CHECK(node->call.func->kind == RiNode_Value_Func);
-                RiNode* func_spec = node->call.func->value.spec;
-                RiNode* func_type = func_spec->spec.func.type;
+                RiNode* func = ri_node_(ri, node->call.func);
+                RI_CHECK(func);
+                RI_CHECK(func->kind == RiNode_Value_Func);
+                RiNode* func_spec = ri_node_(ri, func->value.spec);
+                RiNode* func_type = ri_node_(ri, func_spec->spec.func.type);
                 RI_CHECK(func_spec->spec.func.type);
                 RiNodeArray* outputs = &func_type->spec.type.func.outputs;
                 switch (outputs->count)
                 {
                     case 1: {
-                        RiNode* output = array_at(outputs, 0);
+                        RiNode* output = ri_nodes_at_(ri, outputs, 0);
                         RI_CHECK(output->kind == RiNode_Decl);
-                        RI_CHECK(output->decl.spec->kind == RiNode_Spec_Var);
-                        return ri_get_spec_(ri, output->decl.spec->spec.var.type);
-                    }
-                    case 0:
-                        return ri->node_meta[RiNode_Spec_Type_None].node;
-
-                    default: {
-                        // TODO: Multiple return arguments.
-                        RI_UNREACHABLE;
+                        RiNode* output_spec = ri_node_(ri, output->decl.spec);
+                        RI_CHECK(output_spec->kind == RiNode_Spec_Var);
+                        return ri_get_spec_(ri, output_spec->spec.var.type);
                     }
+                    default:
+                        // Multiple outputs are only assigned by `RiNode_St_Assign_Outputs`
+                        // or returned, the call itself isn't a value.
+                        return ri_node_(ri, ri->node_meta[RiNode_Spec_Type_None].node);
                 }
             } break;
 
+            case RiNode_Expr_Field:
+                return ri_get_spec_(ri, ri_node_(ri, node->field.spec)->spec.var.type);
+            case RiNode_Expr_AddrOf:
+                RI_CHECK(node->addr_of.type);
+                return ri_node_(ri, node->addr_of.type);
+
             default:
                 if (ri_is_in(node->kind, RiNode_Expr_Unary)) {
-                    return ri_retof_(ri, node->unary.argument);
+                    return ri_retof_(ri, ri_node_(ri, node->unary.argument));
                 // } else if (ri_is_in(node->kind, RiNode_Expr_Binary)) {
                 //     RI_ABORT("todo");
                 }
                 RI_CHECK(ri_is_in(node->kind, RiNode_Expr));
-
-            // TODO:
-            // case RiNode_Field:
-            //     RI_CHECK(expr->field.child);
-            //     return ri_retof_(ri, expr->field.child);
         }
         RI_ABORT("unknown expr type");
         return NULL;
@@ -757,8 +1214,8 @@ ri_sizeof_(Ri* ri, RiPos pos, RiNode* type)
         case RiNode_Spec_Type_Struct:
         case RiNode_Spec_Type_Union:
             type = ri_complete_type_(ri, pos, type);
-            return type->spec.type.compound.size;
-            break;
+            return type ? type->spec.type.compound.size : 0;
+        default: break;
     }
 
     ri_error_set_(ri, RiError_UnexpectedType, pos, "unexpected type");
@@ -771,6 +1228,8 @@ ri_alignof_(Ri* ri, RiPos pos, RiNode* type)
     switch (type->kind)
     {
         case RiNode_Spec_Type_Struct:
+            type = ri_complete_type_(ri, pos, type);
+            return type ? type->spec.type.compound.align : 0;
         case RiNode_Spec_Type_Union:
         case RiNode_Spec_Type_Pointer:
         case RiNode_Spec_Type_Number_Int64:
@@ -789,6 +1248,7 @@ ri_alignof_(Ri* ri, RiPos pos, RiNode* type)
         case RiNode_Spec_Type_Number_Int8:
         case RiNode_Spec_Type_Number_UInt8:
             return 1;
+        default: break;
     }
 
     ri_error_set_(ri, RiError_UnexpectedType, pos, "unexpected type");
@@ -799,18 +1259,212 @@ ri_alignof_(Ri* ri, RiPos pos, RiNode* type)
 //
 //
 
+#define RI_NODE_SIZE_(Member) \
+    (offsetof(RiNode, Member) + sizeof(((RiNode*)0)->Member))
+
+// Size of the node header and the union member used by `kind`.
+static iptr
+ri_node_size_(RiNodeKind kind)
+{
+    switch (kind)
+    {
+        case RiNode_Module: return RI_NODE_SIZE_(module);
+        case RiNode_Scope: return RI_NODE_SIZE_(scope);
+        // Identifiers are turned to values in resolve.
+        case RiNode_Id: return MAXIMUM(RI_NODE_SIZE_(id), RI_NODE_SIZE_(value));
+        case RiNode_Spec_Var: return RI_NODE_SIZE_(spec.var);
+        case RiNode_Spec_Func: return RI_NODE_SIZE_(spec.func);
+        case RiNode_Decl: return RI_NODE_SIZE_(decl);
+        // Calls are turned to casts in resolve.
+        case RiNode_Expr_Call:
+        case RiNode_Expr_Cast: return RI_NODE_SIZE_(call);
+        case RiNode_Expr_AddrOf: return RI_NODE_SIZE_(addr_of);
+        // Selects are turned to fields in resolve.
+        case RiNode_Expr_Field: return MAXIMUM(RI_NODE_SIZE_(field), RI_NODE_SIZE_(binary));
+        case RiNode_St_Expr: return RI_NODE_SIZE_(st_expr);
+        case RiNode_St_Return: return RI_NODE_SIZE_(st_return);
+        case RiNode_St_Assign_Outputs: return RI_NODE_SIZE_(st_assign_outputs);
+        case RiNode_St_If: return RI_NODE_SIZE_(st_if);
+        case RiNode_St_For: return RI_NODE_SIZE_(st_for);
+        case RiNode_St_Switch: return RI_NODE_SIZE_(st_switch);
+        case RiNode_St_Switch_Case: return RI_NODE_SIZE_(st_switch_case);
+        case RiNode_St_Switch_Default:
+        case RiNode_St_Switch_Fallthrough:
+        case RiNode_St_Break:
+        case RiNode_St_Continue: return offsetof(RiNode, id);
+        default:
+            if (ri_is_in(kind, RiNode_Spec_Type)) {
+                return RI_NODE_SIZE_(spec.type);
+            } else if (ri_is_in(kind, RiNode_Value)) {
+                return RI_NODE_SIZE_(value);
+            } else if (ri_is_in(kind, RiNode_Expr_Unary)) {
+                return RI_NODE_SIZE_(unary);
+            } else if (ri_is_in(kind, RiNode_Expr_Binary) || ri_is_in(kind, RiNode_St_Assign)) {
+                return RI_NODE_SIZE_(binary);
+            }
+            return sizeof(RiNode);
+    }
+}
+
+#undef RI_NODE_SIZE_
+
+//
+// Node heap
+//
+
+#ifndef RI_NODE_HEAP_RESERVE
+    #define RI_NODE_HEAP_RESERVE GIGABYTES((iptr)4)
+#endif
+#define RI_NODE_HEAP_COMMIT MEGABYTES(1)
+#define RI_NODE_ALIGN 8
+
+static void
+ri_node_heap_init_(RiNodeHeap* heap)
+{
+    // Handles address `RI_NODE_ALIGN` units.
+    RI_CHECK(RI_NODE_HEAP_RESERVE / RI_NODE_ALIGN <= UINT32_MAX);
+    RI_CHECK(ALIGNOF(RiNode) <= RI_NODE_ALIGN);
+    heap->reserved = RI_NODE_HEAP_RESERVE;
+    heap->base = virtual_reserve(0, heap->reserved);
+    heap->committed = 0;
+    // Skip first unit, so handle 0 is NULL.
+    heap->used = RI_NODE_ALIGN;
+}
+
+static void
+ri_node_heap_purge_(RiNodeHeap* heap)
+{
+    virtual_free(heap->base, heap->reserved);
+    memset(heap, 0, sizeof(RiNodeHeap));
+}
+
+static inline iptr
+ri_node_heap_size_(iptr size)
+{
+    return (size + RI_NODE_ALIGN - 1) & ~(iptr)(RI_NODE_ALIGN - 1);
+}
+
+static inline void*
+ri_node_heap_push_(RiNodeHeap* heap, iptr size)
+{
+    size = ri_node_heap_size_(size);
+    iptr used = heap->used + size;
+    if (used > heap->committed) {
+        RI_ASSERT(used <= heap->reserved);
+        iptr committed = MINIMUM(heap->reserved,
+            (used + RI_NODE_HEAP_COMMIT - 1) & ~(iptr)(RI_NODE_HEAP_COMMIT - 1));
+        virtual_commit(heap->base + heap->committed, committed - heap->committed);
+        heap->committed = committed;
+    }
+    void* ptr = heap->base + heap->used;
+    heap->used = used;
+    return ptr;
+}
+
+static inline RiNodeRef
+ri_node_ref_(Ri* ri, RiNode* node)
+{
+    if (node == NULL) {
+        return 0;
+    }
+    RI_CHECK((uint8_t*)node > ri->nodes.base && (uint8_t*)node < ri->nodes.base + ri->nodes.used);
+    return (RiNodeRef)(((uint8_t*)node - ri->nodes.base) / RI_NODE_ALIGN);
+}
+
+static inline RiNode*
+ri_node_(Ri* ri, RiNodeRef ref)
+{
+    return ref ? (RiNode*)(ri->nodes.base + (iptr)ref * RI_NODE_ALIGN) : NULL;
+}
+
+//
+//
+//
+
 static RiNode*
 ri_make_node_(Ri* ri, RiPos pos, RiNodeKind kind)
 {
-    RiNode* node = arena_push_t(&ri->arena, RiNode);
-    memset(node, 0, sizeof(RiNode));
+    iptr size = ri_node_size_(kind);
+    RiNode* node = ri_node_heap_push_(&ri->nodes, size);
+    memset(node, 0, size);
     node->kind = kind;
     node->owner = ri->scope;
     node->index = ++ri->index;
     node->pos = pos;
+    node->size = (uint32_t)ri_node_heap_size_(size);
     return node;
 }
 
+// Memory from the node heap that isn't a node, referenced by the handle of its header.
+static RiNodeRef
+ri_make_block_(Ri* ri, iptr size)
+{
+    iptr header = offsetof(RiNode, id);
+    RiNode* node = ri_node_heap_push_(&ri->nodes, header + size);
+    memset(node, 0, header);
+    node->kind = RiNode_Unknown;
+    node->size = (uint32_t)ri_node_heap_size_(header + size);
+    return ri_node_ref_(ri, node);
+}
+
+static inline void*
+ri_block_(Ri* ri, RiNodeRef block)
+{
+    return block ? (uint8_t*)ri_node_(ri, block) + offsetof(RiNode, id) : NULL;
+}
+
+//
+// Node arrays
+//
+
+static inline RiNodeRef*
+ri_nodes_items_(Ri* ri, RiNodeArray* array)
+{
+    return ri_block_(ri, array->items);
+}
+
+static inline RiNode*
+ri_nodes_at_(Ri* ri, RiNodeArray* array, iptr index)
+{
+    RI_CHECK(index >= 0 && index < array->count);
+    return ri_node_(ri, ri_nodes_items_(ri, array)[index]);
+}
+
+// Grows to at least `capacity`. The old block is left in the heap, like old scope tables.
+static void
+ri_nodes_reserve_(Ri* ri, RiNodeArray* array, iptr capacity)
+{
+    if (capacity <= array->capacity) {
+        return;
+    }
+    iptr grown = MAXIMUM(MAXIMUM(4, array->capacity * 2), capacity);
+    RI_ASSERT(grown <= UINT32_MAX);
+    RiNodeRef items = ri_make_block_(ri, grown * sizeof(RiNodeRef));
+    if (array->count) {
+        memcpy(ri_block_(ri, items), ri_nodes_items_(ri, array), array->count * sizeof(RiNodeRef));
+    }
+    array->items = items;
+    array->capacity = (uint32_t)grown;
+}
+
+static void
+ri_nodes_push_(Ri* ri, RiNodeArray* array, RiNode* node)
+{
+    ri_nodes_reserve_(ri, array, array->count + 1);
+    ri_nodes_items_(ri, array)[array->count++] = ri_node_ref_(ri, node);
+}
+
+static void
+ri_nodes_insert_(Ri* ri, RiNodeArray* array, iptr index, RiNode* node)
+{
+    RI_CHECK(index >= 0 && index <= array->count);
+    ri_nodes_reserve_(ri, array, array->count + 1);
+    RiNodeRef* items = ri_nodes_items_(ri, array);
+    memmove(items + index + 1, items + index, (array->count - index) * sizeof(RiNodeRef));
+    items[index] = ri_node_ref_(ri, node);
+    array->count++;
+}
+
 static RiNode*
 ri_make_scope_(Ri* ri, RiPos pos)
 {
@@ -818,6 +1472,18 @@ ri_make_scope_(Ri* ri, RiPos pos)
     return node;
 }
 
+// Resolve lists the declarations of their owner in `decl` (see `ri_resolve_node_`), room is made
+// when they're made, so the parallel phase doesn't allocate from the heap.
+static void
+ri_scope_own_(Ri* ri, RiNode* decl)
+{
+    RiNode* scope = ri_node_(ri, decl->owner);
+    if (scope) {
+        RI_CHECK(scope->kind == RiNode_Scope);
+        ri_nodes_reserve_(ri, &scope->scope.decl, ++scope->scope.owned);
+    }
+}
+
 static RiNode*
 ri_make_identifier_(Ri* ri, RiPos pos, String name)
 {
@@ -834,12 +1500,21 @@ ri_make_spec_var_(Ri* ri, RiPos pos, String id, RiNode* type, RiVarKind kind)
 {
     RiNode* spec = ri_make_node_(ri, pos, RiNode_Spec_Var);
     spec->spec.id = id;
-    spec->spec.var.type = type;
+    spec->spec.var.type = ri_node_ref_(ri, type);
     spec->spec.var.kind = kind;
     spec->spec.var.slot = RI_INVALID_SLOT;
     return spec;
 }
 
+static RiNode*
+ri_make_spec_type_pointer_(Ri* ri, RiPos pos, RiNode* base)
+{
+    RI_CHECK(base);
+    RiNode* node = ri_make_node_(ri, pos, RiNode_Spec_Type_Pointer);
+    node->spec.type.pointer.base = ri_node_ref_(ri, base);
+    return node;
+}
+
 static RiNode*
 ri_make_spec_type_func_(Ri* ri, RiPos pos, String id, RiNodeArray inputs, RiNodeArray outputs) {
     RiNode* node = ri_make_node_(ri, pos, RiNode_Spec_Type_Func);
@@ -849,6 +1524,17 @@ ri_make_spec_type_func_(Ri* ri, RiPos pos, String id, RiNodeArray inputs, RiNode
     return node;
 }
 
+// Also makes the pointer to the struct, so taking an address doesn't make nodes.
+static RiNode*
+ri_make_spec_type_struct_(Ri* ri, RiPos pos, String id, RiNodeArray fields)
+{
+    RiNode* node = ri_make_node_(ri, pos, RiNode_Spec_Type_Struct);
+    node->spec.id = id;
+    node->spec.type.compound.fields = fields;
+    node->spec.type.compound.pointer = ri_node_ref_(ri, ri_make_spec_type_pointer_(ri, pos, node));
+    return node;
+}
+
 static RiNode*
 ri_make_spec_type_number_(Ri* ri, RiPos pos, String id, RiNodeKind kind)
 {
@@ -868,8 +1554,8 @@ ri_make_spec_func_(Ri* ri, RiPos pos, String id, RiNode* type, RiNode* scope)
 
     RiNode* node = ri_make_node_(ri, pos, RiNode_Spec_Func);
     node->spec.id = id;
-    node->spec.func.type = type;
-    node->spec.func.scope = scope;
+    node->spec.func.type = ri_node_ref_(ri, type);
+    node->spec.func.scope = ri_node_ref_(ri, scope);
     node->spec.func.slot = RI_INVALID_SLOT;
     return node;
 }
@@ -881,7 +1567,8 @@ ri_make_decl_(Ri* ri, RiPos pos, RiNode* spec)
     RI_CHECK(ri_is_in(spec->kind, RiNode_Spec) || spec->kind == RiNode_Id);
 
     RiNode* node = ri_make_node_(ri, pos, RiNode_Decl);
-    node->decl.spec = spec;
+    node->decl.spec = ri_node_ref_(ri, spec);
+    ri_scope_own_(ri, node);
     return node;
 }
 
@@ -892,7 +1579,7 @@ ri_make_expr_call_(Ri* ri, RiPos pos, RiNode* func)
     // TODO: Check func node type?
 
     RiNode* node = ri_make_node_(ri, pos, RiNode_Expr_Call);
-    node->call.func = func;
+    node->call.func = ri_node_ref_(ri, func);
     return node;
 }
 
@@ -906,8 +1593,8 @@ ri_make_expr_binary_(Ri* ri, RiPos pos, RiNodeKind kind, RiNode* argument0, RiNo
     RI_CHECK(ri_is_expr_like(argument1->kind));
 
     RiNode* node = ri_make_node_(ri, pos, kind);
-    node->binary.argument0 = argument0;
-    node->binary.argument1 = argument1;
+    node->binary.argument0 = ri_node_ref_(ri, argument0);
+    node->binary.argument1 = ri_node_ref_(ri, argument1);
     return node;
 }
 
@@ -919,7 +1606,18 @@ ri_make_expr_unary_(Ri* ri, RiPos pos, RiNodeKind kind, RiNode* argument)
     RI_CHECK(ri_is_expr_like(argument->kind));
 
     RiNode* node = ri_make_node_(ri, pos, kind);
-    node->unary.argument = argument;
+    node->unary.argument = ri_node_ref_(ri, argument);
+    return node;
+}
+
+static RiNode*
+ri_make_expr_addr_of_(Ri* ri, RiPos pos, RiNode* argument)
+{
+    RI_CHECK(argument);
+    RI_CHECK(ri_is_expr_like(argument->kind));
+
+    RiNode* node = ri_make_node_(ri, pos, RiNode_Expr_AddrOf);
+    node->addr_of.argument = ri_node_ref_(ri, argument);
     return node;
 }
 
@@ -932,8 +1630,8 @@ ri_make_expr_cast_(Ri* ri, RiPos pos, RiNode* expr, RiNode* type_to)
         // TODO: Check if we can cast.
         // TODO: Check if we should cast.
         RiNode* node = ri_make_node_(ri, pos, RiNode_Expr_Cast);
-        array_push(&node->call.arguments, type_to);
-        array_push(&node->call.arguments, expr);
+        ri_nodes_push_(ri, &node->call.arguments, type_to);
+        ri_nodes_push_(ri, &node->call.arguments, expr);
         return node;
     }
     return expr;
@@ -947,14 +1645,14 @@ ri_make_st_assign_(Ri *ri, RiPos pos, RiNodeKind kind, RiNode* argument0, RiNode
     RI_CHECK(
         ri_is_expr_like(argument0->kind) ||
         argument0->kind == RiNode_Spec_Var ||
-        (argument0->kind == RiNode_Decl && argument0->decl.spec->kind == RiNode_Spec_Var)
+        (argument0->kind == RiNode_Decl && ri_node_(ri, argument0->decl.spec)->kind == RiNode_Spec_Var)
     );
     RI_CHECK(argument1);
     RI_CHECK(ri_is_expr_like(argument1->kind));
 
     RiNode* node = ri_make_node_(ri, pos, kind);
-    node->binary.argument0 = argument0;
-    node->binary.argument1 = argument1;
+    node->binary.argument0 = ri_node_ref_(ri, argument0);
+    node->binary.argument1 = ri_node_ref_(ri, argument1);
     return node;
 }
 
@@ -963,82 +1661,247 @@ ri_make_st_expr_(Ri* ri, RiPos pos, RiNode* expr)
 {
     RI_CHECK(ri_is_expr_like(expr->kind));
 
-    RiNode* node = ri_make_node_(ri, pos, RiNode_St_Expr);
-    node->st_expr = expr;
-    return node;
+    RiNode* node = ri_make_node_(ri, pos, RiNode_St_Expr);
+    node->st_expr = ri_node_ref_(ri, expr);
+    return node;
+}
+
+static RiNode*
+ri_make_st_assign_outputs_(Ri* ri, RiPos pos, RiNodeArray targets, RiNode* call)
+{
+    RI_CHECK(targets.count > 1);
+    RI_CHECK(call);
+
+    RiNode* node = ri_make_node_(ri, pos, RiNode_St_Assign_Outputs);
+    node->st_assign_outputs.targets = targets;
+    node->st_assign_outputs.call = ri_node_ref_(ri, call);
+    return node;
+}
+
+static RiNode*
+ri_make_st_return_(Ri* ri, RiPos pos, RiNodeArray arguments)
+{
+    RiNode* node = ri_make_node_(ri, pos, RiNode_St_Return);
+    node->st_return.arguments = arguments;
+    node->st_return.func_type = ri->func_type;
+    return node;
+}
+
+static RiNode*
+ri_make_st_if_(Ri* ri, RiPos pos, RiNode* pre, RiNode* condition, RiNode* scope)
+{
+    RI_CHECK(condition);
+    RI_CHECK(scope);
+    RI_CHECK(scope->scope.statements.count >= 0 && scope->scope.statements.count <= 2);
+
+    RiNode* node = ri_make_node_(ri, pos, RiNode_St_If);
+    node->st_if.pre = ri_node_ref_(ri, pre);
+    node->st_if.condition = ri_node_ref_(ri, condition);
+    node->st_if.scope = ri_node_ref_(ri, scope);
+    return node;
+}
+
+static RiNode*
+ri_make_st_for_(Ri* ri, RiPos pos, RiNode* pre, RiNode* condition, RiNode* post, RiNode* scope)
+{
+    RiNode* node = ri_make_node_(ri, pos, RiNode_St_For);
+    node->st_for.pre = ri_node_ref_(ri, pre);
+    node->st_for.condition = ri_node_ref_(ri, condition);
+    node->st_for.post = ri_node_ref_(ri, post);
+    node->st_for.scope = ri_node_ref_(ri, scope);
+    return node;
+}
+
+static RiNode*
+ri_make_st_switch_(Ri* ri, RiPos pos, RiNode* pre, RiNode* expr, RiNode* scope)
+{
+    RiNode* node = ri_make_node_(ri, pos, RiNode_St_Switch);
+    node->st_switch.pre = ri_node_ref_(ri, pre);
+    node->st_switch.expr = ri_node_ref_(ri, expr);
+    node->st_switch.scope = ri_node_ref_(ri, scope);
+    return node;
+}
+
+static RiNode*
+ri_make_st_switch_case_(Ri* ri, RiPos pos, RiNode* expr)
+{
+    RiNode* node = ri_make_node_(ri, pos, RiNode_St_Switch_Case);
+    node->st_switch_case.expr = ri_node_ref_(ri, expr);
+    return node;
+}
+
+static RiNode*
+ri_make_st_switch_default_(Ri* ri, RiPos pos)
+{
+    RiNode* node = ri_make_node_(ri, pos, RiNode_St_Switch_Default);
+    return node;
+}
+
+static RiNode*
+ri_make_st_switch_fallthrough_(Ri* ri, RiPos pos)
+{
+    RiNode* node = ri_make_node_(ri, pos, RiNode_St_Switch_Fallthrough);
+    return node;
+}
+
+static RiNode*
+ri_make_st_break_(Ri* ri, RiPos pos)
+{
+    RiNode* node = ri_make_node_(ri, pos, RiNode_St_Break);
+    return node;
+}
+
+static RiNode*
+ri_make_st_continue_(Ri* ri, RiPos pos)
+{
+    RiNode* node = ri_make_node_(ri, pos, RiNode_St_Continue);
+    return node;
+}
+
+//
+//
+//
+
+//
+// Scope table
+//
+
+#define RI_SCOPE_TABLE_LINEAR 8
+
+static inline uint32_t
+ri_scope_table_slot_(RiScopeTable* table, const char* id)
+{
+    return (uint32_t)hash_ptr(id) & (table->capacity - 1);
 }
 
-static RiNode*
-ri_make_st_return_(Ri* ri, RiPos pos, RiNode* argument)
+static inline const char**
+ri_scope_table_keys_(Ri* ri, RiScopeTable* table)
 {
-    RI_CHECK(argument == NULL || ri_is_expr_like(argument->kind));
-    RiNode* node = ri_make_node_(ri, pos, RiNode_St_Return);
-    node->st_return.argument = argument;
-    return node;
+    return ri_block_(ri, table->block);
 }
 
-static RiNode*
-ri_make_st_if_(Ri* ri, RiPos pos, RiNode* pre, RiNode* condition, RiNode* scope)
+static inline RiNodeRef*
+ri_scope_table_values_(Ri* ri, RiScopeTable* table)
 {
-    RI_CHECK(condition);
-    RI_CHECK(scope);
-    RI_CHECK(scope->scope.statements.count >= 0 && scope->scope.statements.count <= 2);
-
-    RiNode* node = ri_make_node_(ri, pos, RiNode_St_If);
-    node->st_if.pre = pre;
-    node->st_if.condition = condition;
-    node->st_if.scope = scope;
-    return node;
+    return (RiNodeRef*)(ri_scope_table_keys_(ri, table) + table->capacity);
 }
 
-static RiNode*
-ri_make_st_for_(Ri* ri, RiPos pos, RiNode* pre, RiNode* condition, RiNode* post, RiNode* scope)
+// Returns 0 if `id` is not in the table.
+static inline RiNodeRef
+ri_scope_table_get_(Ri* ri, RiScopeTable* table, const char* id)
 {
-    RiNode* node = ri_make_node_(ri, pos, RiNode_St_For);
-    node->st_for.pre = pre;
-    node->st_for.condition = condition;
-    node->st_for.post = post;
-    node->st_for.scope = scope;
-    return node;
+    RI_CHECK(id);
+    const char** keys = ri_scope_table_keys_(ri, table);
+    if (table->capacity <= RI_SCOPE_TABLE_LINEAR) {
+        for (uint32_t i = 0; i < table->count; ++i) {
+            if (keys[i] == id) {
+                return ri_scope_table_values_(ri, table)[i];
+            }
+        }
+    } else {
+        for (uint32_t i = ri_scope_table_slot_(table, id);; i = (i + 1) & (table->capacity - 1)) {
+            if (keys[i] == id) {
+                return ri_scope_table_values_(ri, table)[i];
+            } else if (keys[i] == NULL) {
+                break;
+            }
+        }
+    }
+    return 0;
 }
 
-static RiNode*
-ri_make_st_switch_(Ri* ri, RiPos pos, RiNode* pre, RiNode* expr, RiNode* scope)
+// Expects `id` to not be in the table, and the table to have a free slot.
+static inline void
+ri_scope_table_put_unchecked_(Ri* ri, RiScopeTable* table, const char* id, RiNodeRef value)
 {
-    RiNode* node = ri_make_node_(ri, pos, RiNode_St_Switch);
-    node->st_switch.pre = pre;
-    node->st_switch.expr = expr;
-    node->st_switch.scope = scope;
-    return node;
+    const char** keys = ri_scope_table_keys_(ri, table);
+    uint32_t i;
+    if (table->capacity <= RI_SCOPE_TABLE_LINEAR) {
+        i = table->count;
+    } else {
+        i = ri_scope_table_slot_(table, id);
+        while (keys[i] != NULL) {
+            i = (i + 1) & (table->capacity - 1);
+        }
+    }
+    keys[i] = id;
+    ri_scope_table_values_(ri, table)[i] = value;
+    ++table->count;
 }
 
-static RiNode*
-ri_make_st_switch_case_(Ri* ri, RiPos pos, RiNode* expr)
+// Makes room for `count` entries in total, hash tables are kept at most half full.
+static void
+ri_scope_table_reserve_(Ri* ri, RiScopeTable* table, iptr count)
 {
-    RiNode* node = ri_make_node_(ri, pos, RiNode_St_Switch_Case);
-    node->st_switch_case.expr = expr;
-    return node;
+    RI_CHECK(count <= UINT32_MAX / 2);
+    uint32_t capacity = RI_SCOPE_TABLE_LINEAR;
+    while (count > (capacity > RI_SCOPE_TABLE_LINEAR ? capacity / 2 : capacity)) {
+        capacity *= 2;
+    }
+    if (capacity <= table->capacity) {
+        return;
+    }
+
+    RiScopeTable old = *table;
+    const char** old_keys = ri_scope_table_keys_(ri, &old);
+    RiNodeRef* old_values = ri_scope_table_values_(ri, &old);
+    table->block = ri_make_block_(ri, capacity * (sizeof(const char*) + sizeof(RiNodeRef)));
+    table->capacity = capacity;
+    table->count = 0;
+    memset(ri_scope_table_keys_(ri, table), 0, capacity * sizeof(const char*));
+
+    for (uint32_t i = 0; i < old.capacity; ++i) {
+        if (old_keys[i] != NULL) {
+            ri_scope_table_put_unchecked_(ri, table, old_keys[i], old_values[i]);
+        }
+    }
 }
 
-static RiNode*
-ri_make_st_switch_default_(Ri* ri, RiPos pos)
+// Returns false if `id` is already in the table.
+static bool
+ri_scope_table_put_(Ri* ri, RiScopeTable* table, const char* id, RiNode* value)
 {
-    RiNode* node = ri_make_node_(ri, pos, RiNode_St_Switch_Default);
-    return node;
+    RI_CHECK(id);
+    if (ri_scope_table_get_(ri, table, id)) {
+        return false;
+    }
+    ri_scope_table_reserve_(ri, table, table->count + 1);
+    ri_scope_table_put_unchecked_(ri, table, id, ri_node_ref_(ri, value));
+    return true;
 }
 
-static RiNode*
-ri_make_st_break_(Ri* ri, RiPos pos)
+// Nearest enclosing scope of `scope` that has declarations.
+// Scopes without declarations (most `if` and `for` blocks) are skipped, and the result is
+// stored in the scope, so lookups in deeply nested blocks only visit scopes that declare something.
+// NOTE: Expects the scope tables of enclosing scopes to be complete (parsed).
+static RiNodeRef
+ri_lookup_owner_(Ri* ri, RiNode* scope)
 {
-    RiNode* node = ri_make_node_(ri, pos, RiNode_St_Break);
-    return node;
+    RI_CHECK(scope->kind == RiNode_Scope);
+    if (scope->scope.lookup_owner == 0 && scope->owner != 0) {
+        RiNode* owner = ri_node_(ri, scope->owner);
+        if (owner->scope.table.count) {
+            scope->scope.lookup_owner = scope->owner;
+        } else {
+            scope->scope.lookup_owner = ri_lookup_owner_(ri, owner);
+        }
+    }
+    return scope->scope.lookup_owner;
 }
 
+// Finds declaration of `id` visible from `scope`.
 static RiNode*
-ri_make_st_continue_(Ri* ri, RiPos pos)
+ri_lookup_(Ri* ri, RiNodeRef scope, const char* id)
 {
-    RiNode* node = ri_make_node_(ri, pos, RiNode_St_Continue);
-    return node;
+    RiNode* it = ri_node_(ri, scope);
+    while (it) {
+        RiNodeRef decl = ri_scope_table_get_(ri, &it->scope.table, id);
+        if (decl) {
+            return ri_node_(ri, decl);
+        }
+        it = ri_node_(ri, ri_lookup_owner_(ri, it));
+    }
+    return NULL;
 }
 
 //
@@ -1049,15 +1912,14 @@ static bool
 ri_scope_set_(Ri* ri, RiNode* decl)
 {
     RI_CHECK(decl);
-    RI_CHECK(decl->decl.spec);
-    RI_CHECK(ri_is_in(decl->decl.spec->kind, RiNode_Spec));
-    ValueScalar id_ = { .ptr = decl->decl.spec->spec.id.items };
-    RiNode* decl_found = map_get(&ri->scope->scope.map, id_).ptr;
-    if (decl_found != NULL) {
-        ri_error_set_(ri, RiError_Declared, decl->pos, "'%S' is already declared", decl->decl.spec->spec.id);
+    RiNode* spec = ri_node_(ri, decl->decl.spec);
+    RI_CHECK(spec);
+    RI_CHECK(ri_is_in(spec->kind, RiNode_Spec));
+    RiNode* scope = ri_node_(ri, ri->scope);
+    if (!ri_scope_table_put_(ri, &scope->scope.table, spec->spec.id.items, decl)) {
+        ri_error_set_(ri, RiError_Declared, decl->pos, "'%S' is already declared", spec->spec.id);
         return false;
     }
-    map_put(&ri->scope->scope.map, id_, (ValueScalar){ .ptr = decl });
     return decl;
 }
 
@@ -1124,6 +1986,7 @@ ri_parse_expr_operand_(Ri* ri)
             }
             return NULL;
         } break;
+        default: break;
     }
 
     ri_error_set_unexpected_token_(ri, &ri->token);
@@ -1156,7 +2019,7 @@ ri_parse_expr_call_arguments_(Ri* ri, RiNode* call)
         if (!expr) {
             return false;
         }
-        array_push(&call->call.arguments, expr);
+        ri_nodes_push_(ri, &call->call.arguments, expr);
         if (ri_lex_next_if_(ri, RiToken_Comma) == RiLexNextIf_Error) {
             return false;
         }
@@ -1196,10 +2059,14 @@ ri_parse_expr_operator_unary_(Ri* ri)
             if (ri_lex_next_(ri)) {
                 RiNode* R = ri_parse_expr_operator_unary_(ri);
                 if (R) {
+                    if (token.kind == RiToken_Amp) {
+                        return ri_make_expr_addr_of_(ri, token.pos, R);
+                    }
                     return ri_make_expr_unary_(ri, token.pos, RI_TOKEN_TO_OP_[token.kind].unary, R);
                 }
             }
         } return NULL;
+        default: break;
     }
     return ri_parse_expr_call_(ri);
 }
@@ -1385,6 +2252,16 @@ ri_parse_type_(Ri* ri)
                 return NULL;
             }
             return ri_make_identifier_(ri, token.pos, token.id);
+        case RiToken_Star: {
+            if (!ri_lex_next_(ri)) {
+                return NULL;
+            }
+            RiNode* base = ri_parse_type_(ri);
+            if (!base) {
+                return NULL;
+            }
+            return ri_make_spec_type_pointer_(ri, token.pos, base);
+        }
         default:
             ri_error_set_unexpected_token_(ri, &token);
             return NULL;
@@ -1411,7 +2288,7 @@ ri_parse_decl_variable_(Ri* ri)
         // if (!ri_lex_next_(ri)) {
         //     return NULL;
         // }
-        type = ri->node_meta[RiNode_Spec_Type_Infer].node;
+        type = ri_node_(ri, ri->node_meta[RiNode_Spec_Type_Infer].node);
     } else {
         type = ri_parse_type_(ri);
         if (!type) {
@@ -1462,7 +2339,7 @@ ri_parse_decl_type_func_input_arg_list_(Ri* ri, RiNodeArray* list)
         if (!decl_arg) {
             return false;
         }
-        array_push(list, decl_arg);
+        ri_nodes_push_(ri, list, decl_arg);
         if (ri_lex_next_if_(ri, RiToken_Comma) == RiLexNextIf_Error) {
             return false;
         }
@@ -1475,23 +2352,46 @@ ri_parse_decl_type_func_input_arg_list_(Ri* ri, RiNodeArray* list)
 }
 
 static bool
-ri_parse_decl_type_func_output_arg_(Ri* ri, RiNodeArray* outputs)
+ri_parse_decl_type_func_output_(Ri* ri, RiNodeArray* outputs)
 {
-    if (ri->token.kind == RiToken_Semicolon) {
-        return true;
-    }
-
     RiNode* type = ri_parse_type_(ri);
     if (type) {
         RiNode* spec = ri_make_spec_var_(ri, type->pos, (String){0}, type, RiVar_Output);
         RiNode* decl = ri_make_decl_(ri, type->pos, spec);
-        array_push(outputs, decl);
+        ri_nodes_push_(ri, outputs, decl);
         return true;
     }
 
     return false;
 }
 
+// Nothing, a type, or `(type, type...)` for multiple outputs.
+static bool
+ri_parse_decl_type_func_output_arg_(Ri* ri, RiNodeArray* outputs)
+{
+    if (ri->token.kind == RiToken_Semicolon) {
+        return true;
+    }
+
+    if (ri->token.kind == RiToken_LP) {
+        if (!ri_lex_next_(ri)) {
+            return false;
+        }
+        while (ri_lex_next_if_(ri, RiToken_RP) == RiLexNextIf_NoMatch) {
+            if (!ri_parse_decl_type_func_output_(ri, outputs)) {
+                return false;
+            }
+            if (ri_lex_next_if_(ri, RiToken_Comma) == RiLexNextIf_Error) {
+                return false;
+            }
+        }
+        ri_error_check_(ri);
+        return true;
+    }
+
+    return ri_parse_decl_type_func_output_(ri, outputs);
+}
+
 static RiNode*
 ri_parse_spec_partial_func_type_(Ri* ri, RiPos pos)
 {
@@ -1521,7 +2421,7 @@ ri_parse_spec_partial_func_(Ri* ri, RiPos pos, String id)
     // NOTE: Starting and setting scope here, so all the nodes
     // created within have owner set to the scope.
     RiNode* scope = ri_make_scope_(ri, pos);
-    ri->scope = scope;
+    ri->scope = ri_node_ref_(ri, scope);
     // RI_LOG_DEBUG("function '%S' scope %d", id, scope->index);
 
     RiNode* type = ri_parse_spec_partial_func_type_(ri, pos);
@@ -1533,7 +2433,10 @@ ri_parse_spec_partial_func_(Ri* ri, RiPos pos, String id)
     switch (ri_lex_next_if_(ri, RiToken_LB))
     {
         case RiLexNextIf_Match: {
+            RiNodeRef func_type = ri->func_type;
+            ri->func_type = ri_node_ref_(ri, type);
             scope_body = ri_parse_scope_(ri, RiToken_RB, RiNode_Spec_Func);
+            ri->func_type = func_type;
             if (!scope_body) {
                 return NULL;
             }
@@ -1542,27 +2445,26 @@ ri_parse_spec_partial_func_(Ri* ri, RiPos pos, String id)
             // this won't be needed.
 
             RiNode* it;
-            array_each(&type->spec.type.func.inputs, &it) {
-                map_put(&scope->scope.map,
-                    (ValueScalar){ .ptr = it->decl.spec->spec.id.items },
-                    (ValueScalar){ .ptr = it }
-                );
+            ri_scope_table_reserve_(ri, &scope->scope.table, type->spec.type.func.inputs.count);
+            ri_nodes_each_(ri, &type->spec.type.func.inputs, &it) {
+                String it_id = ri_node_(ri, it->decl.spec)->spec.id;
+                if (!ri_scope_table_put_(ri, &scope->scope.table, it_id.items, it)) {
+                    ri_error_set_(ri, RiError_Declared, it->pos, "'%S' is already declared", it_id);
+                    return NULL;
+                }
             }
-            // TODO: Multiple return values.
             // TODO: Named return variables.
-            // array_each(&type->spec.type.func.outputs, &it) {
-            //     map_put(&scope->scope.map,
-            //         (ValueScalar){ .ptr = it->decl.spec->spec.id.items },
-            //         (ValueScalar){ .ptr = it }
-            //     );
+            // ri_nodes_each_(ri, &type->spec.type.func.outputs, &it) {
+            //     ri_scope_table_put_(ri, &scope->scope.table, it->decl.spec->spec.id.items, it);
             // }
-            array_push(&scope->scope.statements, scope_body);
+            ri_nodes_push_(ri, &scope->scope.statements, scope_body);
         } break;
         case RiLexNextIf_Error:
             return NULL;
+        default: break;
     }
 
-    RI_CHECK(ri->scope == scope);
+    RI_CHECK(ri_node_(ri, ri->scope) == scope);
     ri->scope = scope->owner;
 
     RiNode* spec = ri_make_spec_func_(ri, pos, id, type, scope_body ? scope : NULL);
@@ -1570,12 +2472,41 @@ ri_parse_spec_partial_func_(Ri* ri, RiPos pos, String id)
     return decl;
 }
 
+// True if the line before the one `start` is on is `directive`, like `//ri:noinline`.
+static bool
+ri_is_after_directive_(Ri* ri, char* start, String directive)
+{
+    char* source = ri->tokens ? ri->tokens->source.items : ri->stream.start;
+    char* it = start;
+    while (it > source && it[-1] != '\n') {
+        --it;
+    }
+    if (it == source) {
+        return false;
+    }
+    char* line_end = --it;
+    if (line_end > source && line_end[-1] == '\r') {
+        --line_end;
+    }
+    while (it > source && it[-1] != '\n') {
+        --it;
+    }
+    while (it < line_end && (*it == ' ' || *it == '\t')) {
+        ++it;
+    }
+    while (line_end > it && (line_end[-1] == ' ' || line_end[-1] == '\t')) {
+        --line_end;
+    }
+    return line_end - it == directive.count && memcmp(it, directive.items, directive.count) == 0;
+}
+
 static RiNode*
 ri_parse_spec_func_or_func_type_(Ri* ri)
 {
     ri_error_check_(ri);
     RI_CHECK(ri->token.kind == RiToken_Keyword_Func);
     RiPos pos = ri->token.pos;
+    char* start = ri->token.start;
     if (!ri_lex_next_(ri)) {
         return NULL;
     }
@@ -1586,6 +2517,9 @@ ri_parse_spec_func_or_func_type_(Ri* ri)
     {
         case RiLexNextIf_Match:
             node = ri_parse_spec_partial_func_(ri, pos, id);
+            if (node) {
+                ri_node_(ri, node->decl.spec)->spec.func.noinline = ri_is_after_directive_(ri, start, S("//ri:noinline"));
+            }
             break;
         case RiLexNextIf_NoMatch:
             node = ri_parse_spec_partial_func_type_(ri, pos);
@@ -1598,6 +2532,75 @@ ri_parse_spec_func_or_func_type_(Ri* ri)
     return node;
 }
 
+// `struct { a T; ... }` after `type <id>`.
+static RiNode*
+ri_parse_spec_partial_struct_(Ri* ri, RiPos pos, String id)
+{
+    ri_error_check_(ri);
+    RI_CHECK(ri->token.kind == RiToken_Keyword_Struct);
+    if (!ri_lex_next_(ri) || !ri_lex_expect_token_(ri, RiToken_LB)) {
+        return NULL;
+    }
+
+    RiNodeArray fields = {0};
+    while (ri_lex_next_if_(ri, RiToken_RB) == RiLexNextIf_NoMatch) {
+        RiToken token = ri->token;
+        if (!ri_lex_expect_token_(ri, RiToken_Identifier)) {
+            return NULL;
+        }
+        RiNode* type = ri_parse_type_(ri);
+        if (!type || !ri_lex_expect_token_(ri, RiToken_Semicolon)) {
+            return NULL;
+        }
+
+        RiNode* it;
+        ri_nodes_each_(ri, &fields, &it) {
+            if (ri_node_(ri, it->decl.spec)->spec.id.items == token.id.items) {
+                ri_error_set_(ri, RiError_Declared, token.pos, "'%S' is already declared", token.id);
+                return NULL;
+            }
+        }
+        RiNode* spec = ri_make_spec_var_(ri, token.pos, token.id, type, RiVar_Field);
+        ri_nodes_push_(ri, &fields, ri_make_decl_(ri, token.pos, spec));
+    }
+    if (ri->error.kind) {
+        return NULL;
+    }
+
+    return ri_make_spec_type_struct_(ri, pos, id, fields);
+}
+
+// `type <id> struct {...}`
+static RiNode*
+ri_parse_decl_type_(Ri* ri)
+{
+    ri_error_check_(ri);
+    RI_CHECK(ri->token.kind == RiToken_Keyword_Type);
+    if (!ri_lex_next_(ri)) {
+        return NULL;
+    }
+
+    RiToken token = ri->token;
+    if (!ri_lex_expect_token_(ri, RiToken_Identifier)) {
+        return NULL;
+    }
+
+    RiNode* spec = NULL;
+    switch (ri->token.kind)
+    {
+        case RiToken_Keyword_Struct:
+            spec = ri_parse_spec_partial_struct_(ri, token.pos, token.id);
+            break;
+        default:
+            ri_error_set_unexpected_token_(ri, &ri->token);
+            break;
+    }
+    if (!spec) {
+        return NULL;
+    }
+    return ri_make_decl_(ri, token.pos, spec);
+}
+
 static RiNode*
 ri_parse_decl_(Ri* ri)
 {
@@ -1609,6 +2612,7 @@ ri_parse_decl_(Ri* ri)
         // TODO: Type is not expected here, only function declaration.
         case RiToken_Keyword_Func: node = ri_parse_spec_func_or_func_type_(ri); break;
         case RiToken_Keyword_Variable: node = ri_parse_decl_variable_(ri); break;
+        case RiToken_Keyword_Type: node = ri_parse_decl_type_(ri); break;
         default:
             ri_error_set_unexpected_token_(ri, &ri->token);
             break;
@@ -1649,6 +2653,25 @@ ri_parse_st_expr_(Ri* ri)
             return NULL;
         }
         return ri_make_st_assign_(ri, expr->pos, RI_TOKEN_TO_OP_[token_kind].assign, expr, right);
+    } else if (token_kind == RiToken_Comma) {
+        // `a, b = f()`
+        RiNodeArray targets = {0};
+        ri_nodes_push_(ri, &targets, expr);
+        while (ri_lex_next_if_(ri, RiToken_Comma) == RiLexNextIf_Match) {
+            RiNode* target = ri_parse_expr_(ri);
+            if (!target) {
+                return NULL;
+            }
+            ri_nodes_push_(ri, &targets, target);
+        }
+        if (!ri_lex_expect_token_(ri, RiToken_Eq)) {
+            return NULL;
+        }
+        RiNode* call = ri_parse_expr_(ri);
+        if (!call) {
+            return NULL;
+        }
+        return ri_make_st_assign_outputs_(ri, expr->pos, targets, call);
     } else {
         return ri_make_st_expr_(ri, expr->pos, expr);
     }
@@ -1665,19 +2688,22 @@ ri_parse_st_return_(Ri* ri)
         return NULL;
     }
 
-    RiNode* argument = NULL;
+    RiNodeArray arguments = {0};
     if (ri->token.kind != RiToken_Semicolon) {
-        argument = ri_parse_expr_(ri);
-        if (!argument) {
-            return NULL;
-        }
+        do {
+            RiNode* argument = ri_parse_expr_(ri);
+            if (!argument) {
+                return NULL;
+            }
+            ri_nodes_push_(ri, &arguments, argument);
+        } while (ri_lex_next_if_(ri, RiToken_Comma) == RiLexNextIf_Match);
     }
 
     if (!ri_lex_expect_token_(ri, RiToken_Semicolon)) {
         return NULL;
     }
 
-    RiNode* statement = ri_make_st_return_(ri, pos, argument);
+    RiNode* statement = ri_make_st_return_(ri, pos, arguments);
     return statement;
 }
 
@@ -1693,7 +2719,7 @@ ri_parse_st_if_(Ri* ri)
     }
 
     RiNode* scope = ri_make_scope_(ri, pos);
-    ri->scope = scope;
+    ri->scope = ri_node_ref_(ri, scope);
 
     RiNode* condition = NULL;
     RiNode* pre = ri_parse_st_simple_(ri);
@@ -1716,7 +2742,7 @@ ri_parse_st_if_(Ri* ri)
                 ri_error_set_(ri, RiError_UnexpectedStatement, condition->pos, "conditional expression expected");
                 return NULL;
             }
-            condition = condition->st_expr;
+            condition = ri_node_(ri, condition->st_expr);
             RI_CHECK(ri_is_expr_like(condition->kind));
             pre = NULL;
         } break;
@@ -1735,7 +2761,7 @@ ri_parse_st_if_(Ri* ri)
     if (!scope_then) {
         return NULL;
     }
-    array_push(&scope->scope.statements, scope_then);
+    ri_nodes_push_(ri, &scope->scope.statements, scope_then);
 
     switch (ri_lex_next_if_(ri, RiToken_Keyword_Else))
     {
@@ -1745,7 +2771,7 @@ ri_parse_st_if_(Ri* ri)
                 if (!else_if) {
                     return NULL;
                 }
-                array_push(&scope->scope.statements, else_if);
+                ri_nodes_push_(ri, &scope->scope.statements, else_if);
             } else {
                 if (!ri_lex_expect_token_(ri, RiToken_LB)) {
                     return NULL;
@@ -1754,14 +2780,15 @@ ri_parse_st_if_(Ri* ri)
                 if (!scope_else) {
                     return NULL;
                 }
-                array_push(&scope->scope.statements, scope_else);
+                ri_nodes_push_(ri, &scope->scope.statements, scope_else);
             }
             break;
         case RiLexNextIf_Error:
             return NULL;
+        default: break;
     }
 
-    RI_CHECK(ri->scope == scope);
+    RI_CHECK(ri_node_(ri, ri->scope) == scope);
     ri->scope = scope->owner;
 
     RiNode* node = ri_make_st_if_(ri, pos, pre, condition, scope);
@@ -1779,7 +2806,7 @@ ri_parse_st_for_(Ri* ri)
     }
 
     RiNode* scope = ri_make_scope_(ri, pos);
-    ri->scope = scope;
+    ri->scope = ri_node_ref_(ri, scope);
 
     RiNode* pre = NULL;
     RiNode* condition = NULL;
@@ -1800,7 +2827,7 @@ ri_parse_st_for_(Ri* ri)
                     ri_error_set_(ri, RiError_UnexpectedStatement, condition->pos, "conditional expression expected");
                     return NULL;
                 }
-                condition = condition->st_expr;
+                condition = ri_node_(ri, condition->st_expr);
                 RI_CHECK(ri_is_expr_like(condition->kind));
                 pre = NULL;
                 goto skip;
@@ -1850,9 +2877,9 @@ skip:;
     if (!scope_block) {
         return NULL;
     }
-    array_push(&scope->scope.statements, scope_block);
+    ri_nodes_push_(ri, &scope->scope.statements, scope_block);
 
-    RI_CHECK(ri->scope == scope);
+    RI_CHECK(ri_node_(ri, ri->scope) == scope);
     ri->scope = scope->owner;
 
     RiNode* node = ri_make_st_for_(ri, pos, pre, condition, post, scope);
@@ -1871,7 +2898,7 @@ ri_parse_st_switch_(Ri* ri)
     }
 
     RiNode* scope = ri_make_scope_(ri, pos);
-    ri->scope = scope;
+    ri->scope = ri_node_ref_(ri, scope);
 
     RiNode* pre = NULL;
     RiNode* condition = NULL;
@@ -1893,7 +2920,7 @@ ri_parse_st_switch_(Ri* ri)
                 ri_error_set_(ri, RiError_UnexpectedStatement, condition->pos, "conditional expression expected");
                 return NULL;
             }
-            condition = condition->st_expr;
+            condition = ri_node_(ri, condition->st_expr);
             RI_CHECK(ri_is_expr_like(condition->kind));
             pre = NULL;
             goto skip;
@@ -1920,9 +2947,26 @@ skip:;
         return NULL;
     }
 
-    array_push(&scope->scope.statements, scope_block);
+    // Statements go after a case, `fallthrough` only right before the next one.
+    RiNodeArray* statements = &scope_block->scope.statements;
+    RiNode* it;
+    ri_nodes_eachi_(ri, statements, i, &it) {
+        if (i == 0 && it->kind != RiNode_St_Switch_Case && it->kind != RiNode_St_Switch_Default) {
+            ri_error_set_(ri, RiError_UnexpectedStatement, it->pos, "'case' or 'default' expected");
+            return NULL;
+        }
+        if (it->kind == RiNode_St_Switch_Fallthrough) {
+            RiNode* next = i + 1 < statements->count ? ri_nodes_at_(ri, statements, i + 1) : NULL;
+            if (!next || (next->kind != RiNode_St_Switch_Case && next->kind != RiNode_St_Switch_Default)) {
+                ri_error_set_(ri, RiError_UnexpectedStatement, it->pos, "'fallthrough' must be the last statement of a case");
+                return NULL;
+            }
+        }
+    }
+
+    ri_nodes_push_(ri, &scope->scope.statements, scope_block);
 
-    RI_CHECK(ri->scope == scope);
+    RI_CHECK(ri_node_(ri, ri->scope) == scope);
     ri->scope = scope->owner;
 
     RiNode* node = ri_make_st_switch_(ri, pos, pre, condition, scope);
@@ -2000,6 +3044,7 @@ ri_parse_st_simple_(Ri* ri)
                 case RiLexNextIf_Error:
                     // Assumes node == NULL.
                     break;
+                default: break;
             }
             break;
 
@@ -2025,7 +3070,7 @@ ri_parse_st_(Ri* ri, RiNodeKind scope_kind)
                 return NULL;
             }
             RI_CHECK(node->kind == RiNode_Decl);
-            if (node->decl.spec->kind == RiNode_Spec_Func) {
+            if (ri_node_(ri, node->decl.spec)->kind == RiNode_Spec_Func) {
                 if (ri_lex_next_if_(ri, RiToken_Semicolon) == RiLexNextIf_Error) {
                     return NULL;
                 }
@@ -2034,6 +3079,18 @@ ri_parse_st_(Ri* ri, RiNodeKind scope_kind)
             }
             break;
 
+        // Types are declared only at the top level.
+        case RiToken_Keyword_Type:
+            if (scope_kind != RiNode_Unknown) {
+                ri_error_set_unexpected_token_(ri, &ri->token);
+                return NULL;
+            }
+            node = ri_parse_decl_(ri);
+            if (!node || ri_lex_next_if_(ri, RiToken_Semicolon) == RiLexNextIf_Error) {
+                return NULL;
+            }
+            break;
+
         case RiToken_Keyword_Return:
             node = ri_parse_st_return_(ri);
             break;
@@ -2066,8 +3123,22 @@ ri_parse_st_(Ri* ri, RiNodeKind scope_kind)
             node = ri_parse_st_switch_default_(ri);
             break;
 
+        case RiToken_Keyword_Fallthrough: {
+            if (scope_kind != RiNode_St_Switch) {
+                ri_error_set_unexpected_token_(ri, &ri->token);
+                return NULL;
+            }
+            RiPos pos = ri->token.pos;
+            if (ri_lex_next_(ri)) {
+                node = ri_make_st_switch_fallthrough_(ri, pos);
+                if (ri_lex_expect_token_(ri, RiToken_Semicolon)) {
+                    break;
+                }
+            }
+        } return NULL;
+
         case RiToken_Keyword_Break:
-            if (scope_kind != RiNode_St_Switch && scope_kind != RiNode_St_For) {
+            if (ri->breakable == 0) {
                 ri_error_set_unexpected_token_(ri, &ri->token);
                 return NULL;
             }
@@ -2081,11 +3152,8 @@ ri_parse_st_(Ri* ri, RiNodeKind scope_kind)
             return NULL;
 
         // TODO: Merge with `break`?
-        // TODO: Continue/break is allowed if one of the parents is switch or for.
-        // - We can do this with counted allow_break++, allow_continue++.
-        // - We will also need to assign break and continue with the correct parent.
         case RiToken_Keyword_Continue: {
-            if (scope_kind != RiNode_St_For) {
+            if (ri->continuable == 0) {
                 ri_error_set_unexpected_token_(ri, &ri->token);
                 return NULL;
             }
@@ -2110,23 +3178,90 @@ ri_parse_st_(Ri* ri, RiNodeKind scope_kind)
     return node;
 }
 
+// Top-level statement given by `ri->parse_reuse`, or NULL if it has to be parsed (or on error).
+// The reused declaration keeps positions from the source it was parsed from.
+static RiNode*
+ri_parse_st_reuse_(Ri* ri)
+{
+    iptr length = 0;
+    iptr lines = 0;
+    RiNode* decl = ri->parse_reuse(ri->parse_reuse_user, ri, &length, &lines);
+    if (!decl) {
+        return NULL;
+    }
+    RI_CHECK(decl->kind == RiNode_Decl);
+    RI_CHECK(length > 0 && ri->token.start + length <= ri->stream.end);
+
+    decl->owner = ri->scope;
+    ri_scope_own_(ri, decl);
+    if (!ri_scope_set_(ri, decl)) {
+        return NULL;
+    }
+    // Comes resolved, so `ri_resolve_node_` won't add it.
+    ri_nodes_push_(ri, &ri_node_(ri, ri->scope)->scope.decl, decl);
+
+    // Continue after the statement's source.
+    char* it = ri->token.start + length;
+    char* line = it;
+    while (line > ri->stream.start && line[-1] != '\n') {
+        --line;
+    }
+    ri->stream.line_index = ri->token.pos.row + lines;
+    ri->stream.line = line;
+    ri->stream.it = it;
+    if (!ri_lex_next_(ri)) {
+        return NULL;
+    }
+    return decl;
+}
+
 static RiNode*
 ri_parse_scope_(Ri* ri, RiTokenKind end, RiNodeKind scope_kind)
 {
+    // Statements `break` and `continue` can leave, a function starts over.
+    int breakable = ri->breakable;
+    int continuable = ri->continuable;
+    if (scope_kind == RiNode_Spec_Func) {
+        ri->breakable = 0;
+        ri->continuable = 0;
+    } else if (scope_kind == RiNode_St_For) {
+        ri->breakable++;
+        ri->continuable++;
+    } else if (scope_kind == RiNode_St_Switch) {
+        ri->breakable++;
+    }
+
     RiNode* scope = ri_make_scope_(ri, ri->token.pos);
-    ri->scope = scope;
-    while (ri->token.kind != end) {
-        RiNode* statement = ri_parse_st_(ri, scope_kind);
+    ri->scope = ri_node_ref_(ri, scope);
+    bool ok = true;
+    while (ok && ri->token.kind != end) {
+        RiNode* statement = NULL;
+        if (end == RiToken_End && ri->parse_reuse && !ri->tokens) {
+            statement = ri_parse_st_reuse_(ri);
+            if (ri->error.kind != RiError_None) {
+                ok = false;
+                break;
+            }
+        }
         if (statement == NULL) {
-            return NULL;
+            statement = ri_parse_st_(ri, scope_kind);
+        }
+        if (statement == NULL) {
+            ok = false;
+            break;
         }
-        array_push(&ri->scope->scope.statements, statement);
+        ri_nodes_push_(ri, &ri_node_(ri, ri->scope)->scope.statements, statement);
     }
 
+    ri->breakable = breakable;
+    ri->continuable = continuable;
+    if (!ok) {
+        return NULL;
+    }
     if (end == RiToken_RB && !ri_lex_next_(ri)) {
         return NULL;
     }
-    RI_ASSERT(ri->scope == scope);
+    RI_ASSERT(ri_node_(ri, ri->scope) == scope);
     ri->scope = scope->owner;
 
     return scope;
@@ -2140,6 +3275,16 @@ ri_parse(Ri* ri, String stream, String path)
     array_clear(&ri->path);
     chararray_push(&ri->path, path);
 
+    if (ri->lex_buffered) {
+        RiTokens tokens = {0};
+        RiNode* block = NULL;
+        if (ri_lex(ri, stream, &tokens)) {
+            block = ri_parse_tokens(ri, &tokens, path);
+        }
+        ri_tokens_purge(&tokens);
+        return block;
+    }
+
     if (!ri_stream_set_(ri, stream)) {
         return NULL;
     }
@@ -2150,33 +3295,56 @@ ri_parse(Ri* ri, String stream, String path)
     return block;
 }
 
+// Token buffer can be produced by another `Ri` only if it shares the `intern`.
+RiNode*
+ri_parse_tokens(Ri* ri, RiTokens* tokens, String path)
+{
+    ri_error_check_(ri);
+    RI_CHECK(tokens->kind.count > 0);
+
+    array_clear(&ri->path);
+    chararray_push(&ri->path, path);
+
+    ri->tokens = tokens;
+    ri->tokens_index = 0;
+    ri->tokens_it = NULL;
+
+    RiNode* block = NULL;
+    if (ri_lex_next_(ri)) {
+        // TODO: Block scope kind.
+        block = ri_parse_scope_(ri, RiToken_End, RiNode_Unknown);
+    }
+
+    ri->tokens = NULL;
+    return block;
+}
+
 //
 //
 //
 
 // NOTE: `expected_type` is used to cast constants if possible.
-#define RI_RESOLVE_F_(Name) bool Name(Ri* ri, RiNode** node)
+#define RI_RESOLVE_F_(Name) bool Name(Ri* ri, RiNodeRef* node)
 typedef RI_RESOLVE_F_(RiResolveF_);
 
 static RI_RESOLVE_F_(ri_resolve_identifier_);
 static RI_RESOLVE_F_(ri_resolve_node_);
 
 static bool
-ri_resolve_slice_with_(Ri* ri, RiNodeSlice nodes, RiResolveF_* f)
+ri_resolve_nodes_with_(Ri* ri, RiNodeArray* nodes, RiResolveF_* f)
 {
-    RiNode* it;
-    slice_eachi(&nodes, i, &it) {
-        if (!f(ri, &it)) {
+    RiNodeRef* items = ri_nodes_items_(ri, nodes);
+    for (iptr i = 0; i < nodes->count; ++i) {
+        if (!f(ri, &items[i])) {
             return false;
         }
-        slice_at(&nodes, i) = it;
     }
     return true;
 }
 
 static RI_RESOLVE_F_(ri_resolve_unary_)
 {
-    RiNode* n = *node;
+    RiNode* n = ri_node_(ri, *node);
 
     if (!ri_resolve_node_(ri, &n->unary.argument)) {
         return false;
@@ -2184,7 +3352,7 @@ static RI_RESOLVE_F_(ri_resolve_unary_)
 
 #if 0
     // RiNode* ret_type = 0;
-    RiNode* arg_type = ri_retof_(ri, n->unary.argument);
+    RiNode* arg_type = ri_retof_(ri, ri_node_(ri, n->unary.argument));
 
     switch (n->kind)
     {
@@ -2237,7 +3405,7 @@ static RI_RESOLVE_F_(ri_resolve_unary_)
 
 static RI_RESOLVE_F_(ri_resolve_binary_)
 {
-    RiNode* n = *node;
+    RiNode* n = ri_node_(ri, *node);
 
     return (
         ri_resolve_node_(ri, &n->binary.argument0) &&
@@ -2247,7 +3415,7 @@ static RI_RESOLVE_F_(ri_resolve_binary_)
 
 static RI_RESOLVE_F_(ri_resolve_assign_)
 {
-    RiNode* n = *node;
+    RiNode* n = ri_node_(ri, *node);
 
     return (
         ri_resolve_node_(ri, &n->binary.argument0) &&
@@ -2257,11 +3425,10 @@ static RI_RESOLVE_F_(ri_resolve_assign_)
 
 static RI_RESOLVE_F_(ri_resolve_expr_call_func_)
 {
-    RiNode* n = *node;
-    RiNode* func = n->call.func;
+    RiNode* n = ri_node_(ri, *node);
     // TODO: Check number of arguments.
     // TOOD: Check if the argument types match.
-    if (!ri_resolve_slice_with_(ri, n->call.arguments.slice, &ri_resolve_node_)) {
+    if (!ri_resolve_nodes_with_(ri, &n->call.arguments, &ri_resolve_node_)) {
         return false;
     }
     return true;
@@ -2271,7 +3438,7 @@ static RI_RESOLVE_F_(ri_resolve_expr_call_func_)
 // we cannot continue processing after error.
 static RI_RESOLVE_F_(ri_resolve_expr_call_type_)
 {
-    RiNode* n = *node;
+    RiNode* n = ri_node_(ri, *node);
     RI_CHECK(n->kind == RiNode_Expr_Call);
     RiNode* type_to = ri_get_spec_(ri, n->call.func);
     RI_CHECK(ri_is_in(type_to->kind, RiNode_Spec_Type));
@@ -2282,13 +3449,15 @@ static RI_RESOLVE_F_(ri_resolve_expr_call_type_)
     }
 
     // Turn from type(expr) to cast(type_to, expr).
+    // Arrays have room for 4 nodes at least, so this doesn't allocate in the parallel phase.
+    RI_CHECK(n->call.arguments.count < n->call.arguments.capacity);
     n->kind = RiNode_Expr_Cast;
-    array_insert(&n->call.arguments, 0, type_to);
-    if (!ri_resolve_slice_with_(ri, n->call.arguments.slice, &ri_resolve_node_)) {
+    ri_nodes_insert_(ri, &n->call.arguments, 0, type_to);
+    if (!ri_resolve_nodes_with_(ri, &n->call.arguments, &ri_resolve_node_)) {
         return false;
     }
 
-    RiNode* expr = array_at(&n->call.arguments, 1);
+    RiNode* expr = ri_nodes_at_(ri, &n->call.arguments, 1);
     RiNode* type_expr = ri_retof_(ri, expr);
     if (!type_expr) {
         return false;
@@ -2298,8 +3467,9 @@ static RI_RESOLVE_F_(ri_resolve_expr_call_type_)
     RiNodeKind type_to_kind = type_to->kind;
 
     bool from_bool = type_from_kind == RiNode_Spec_Type_Number_Bool;
-    bool from_int = ri_is_in(type_from_kind, RiNode_Spec_Type_Number_Int);
-    bool from_float = ri_is_in(type_from_kind, RiNode_Spec_Type_Number_Float);
+    // Untyped constants are given a type in typecheck.
+    bool from_int = ri_is_in(type_from_kind, RiNode_Spec_Type_Number_Int) || type_from_kind == RiNode_Spec_Type_Number_None_Int;
+    bool from_float = ri_is_in(type_from_kind, RiNode_Spec_Type_Number_Float) || type_from_kind == RiNode_Spec_Type_Number_None_Real;
 
     bool to_bool = type_to_kind == RiNode_Spec_Type_Number_Bool;
     bool to_int = ri_is_in(type_to_kind, RiNode_Spec_Type_Number_Int);
@@ -2322,9 +3492,9 @@ static RI_RESOLVE_F_(ri_resolve_expr_call_type_)
     } else if (from_bool && to_float) {
         // Allow bool to any float.
     } else {
-        ri_error_set_(ri, RiError_Type, n->pos, "cannot cast from %S to %S",
-            ri->node_meta[type_from_kind].node->spec.id,
-            ri->node_meta[type_to_kind].node->spec.id
+        ri_error_set_(ri, RiError_Type, n->pos, "cannot cast from %s%S to %s%S",
+            ri_type_prefix_(type_expr), ri_type_name_(ri, type_expr),
+            ri_type_prefix_(type_to), ri_type_name_(ri, type_to)
         );
         return false;
     }
@@ -2334,7 +3504,7 @@ static RI_RESOLVE_F_(ri_resolve_expr_call_type_)
 
 static RI_RESOLVE_F_(ri_resolve_st_if_)
 {
-    RiNode* n = *node;
+    RiNode* n = ri_node_(ri, *node);
 
     if (n->st_if.pre && !ri_resolve_node_(ri, &n->st_if.pre)) {
         return false;
@@ -2345,12 +3515,12 @@ static RI_RESOLVE_F_(ri_resolve_st_if_)
     if (!ri_resolve_node_(ri, &n->st_if.condition)) {
         return false;
     }
-    RiNode* condition_type = ri_retof_(ri, n->st_if.condition);
+    RiNode* condition_type = ri_retof_(ri, ri_node_(ri, n->st_if.condition));
     if (condition_type == NULL) {
         return false;
     }
     if (condition_type->kind != RiNode_Spec_Type_Number_Bool) {
-        ri_error_set_(ri, RiError_Type, n->st_if.condition->pos, "'bool' expected");
+        ri_error_set_(ri, RiError_Type, ri_node_(ri, n->st_if.condition)->pos, "'bool' expected");
         return false;
     }
 
@@ -2363,7 +3533,7 @@ static RI_RESOLVE_F_(ri_resolve_st_if_)
 
 static RI_RESOLVE_F_(ri_resolve_st_for_)
 {
-    RiNode* n = *node;
+    RiNode* n = ri_node_(ri, *node);
 
     if (n->st_for.pre && !ri_resolve_node_(ri, &n->st_for.pre)) {
         return false;
@@ -2372,19 +3542,37 @@ static RI_RESOLVE_F_(ri_resolve_st_for_)
         if (!ri_resolve_node_(ri, &n->st_for.condition)) {
             return false;
         }
-        RiNode* condition_type = ri_retof_(ri, n->st_for.condition);
+        RiNode* condition_type = ri_retof_(ri, ri_node_(ri, n->st_for.condition));
         if (condition_type == NULL) {
             return false;
         }
         if (condition_type->kind != RiNode_Spec_Type_Number_Bool) {
-            ri_error_set_(ri, RiError_Type, n->st_for.condition->pos, "'bool' expected");
+            ri_error_set_(ri, RiError_Type, ri_node_(ri, n->st_for.condition)->pos, "'bool' expected");
             return false;
         }
     }
-    if (n->st_for.post && !ri_resolve_node_(ri, &n->st_for.post)) {
+    if (n->st_for.post && !ri_resolve_node_(ri, &n->st_for.post)) {
+        return false;
+    }
+    if (!ri_resolve_node_(ri, &n->st_for.scope)) {
+        return false;
+    }
+
+    return true;
+}
+
+static RI_RESOLVE_F_(ri_resolve_st_switch_)
+{
+    RiNode* n = ri_node_(ri, *node);
+
+    if (n->st_switch.pre && !ri_resolve_node_(ri, &n->st_switch.pre)) {
+        return false;
+    }
+    if (!ri_resolve_node_(ri, &n->st_switch.expr)) {
         return false;
     }
-    if (!ri_resolve_node_(ri, &n->st_for.scope)) {
+    // Cases are resolved with the statements of the scope.
+    if (!ri_resolve_node_(ri, &n->st_switch.scope)) {
         return false;
     }
 
@@ -2393,28 +3581,17 @@ static RI_RESOLVE_F_(ri_resolve_st_for_)
 
 static RI_RESOLVE_F_(ri_resolve_identifier_)
 {
-    RiNode* id = *node;
+    RiNode* id = ri_node_(ri, *node);
 
     RI_CHECK(id->kind == RiNode_Id);
     RI_CHECK(id->id.name.items != NULL);
 
-    RiNode* decl = NULL;
-    RiNode* scope = id->owner;
-    while (scope) {
-        decl = map_get(&scope->scope.map, (ValueScalar){ .ptr = id->id.name.items }).ptr;
-        if (decl) {
-            break;
-        }
-        scope = scope->owner;
-    }
-
+    RiNode* decl = ri_lookup_(ri, id->owner, id->id.name.items);
     if (decl == NULL) {
         ri_error_set_(ri, RiError_NotDeclared, id->pos, "%S was not declared", id->id.name);
         return false;
     }
 
-    RI_CHECK(decl->owner == scope);
-
     RI_CHECK(decl->kind == RiNode_Decl);
 
     if (decl->decl.state == RiDecl_Resolving)
@@ -2424,7 +3601,8 @@ static RI_RESOLVE_F_(ri_resolve_identifier_)
     }
     else if (decl->decl.state != RiDecl_Resolved)
     {
-        if (!ri_resolve_node_(ri, &decl)) {
+        RiNodeRef decl_ref = ri_node_ref_(ri, decl);
+        if (!ri_resolve_node_(ri, &decl_ref)) {
             return false;
         }
     } else {
@@ -2432,12 +3610,13 @@ static RI_RESOLVE_F_(ri_resolve_identifier_)
     }
 
 
-    switch (decl->decl.spec->kind)
+    RiNode* spec = ri_node_(ri, decl->decl.spec);
+    switch (spec->kind)
     {
         case RiNode_Spec_Var:
             id->kind = RiNode_Value_Var;
             id->value.spec = decl->decl.spec;
-            id->value.type = ri_get_spec_(ri, decl->decl.spec->spec.var.type);
+            id->value.type = ri_node_ref_(ri, ri_get_spec_(ri, spec->spec.var.type));
             break;
         case RiNode_Spec_Func:
             id->kind = RiNode_Value_Func;
@@ -2445,59 +3624,168 @@ static RI_RESOLVE_F_(ri_resolve_identifier_)
             // id->value.type = ri_get_spec_(ri, decl->decl.spec);
             break;
         default:
-            RI_CHECK(ri_is_in(decl->decl.spec->kind, RiNode_Spec_Type));
+            RI_CHECK(ri_is_in(spec->kind, RiNode_Spec_Type));
             id->kind = RiNode_Value_Type;
             id->value.spec = decl->decl.spec;
     }
-    RI_CHECK(ri_is_in(id->value.spec->kind, RiNode_Spec));
+    RI_CHECK(ri_is_in(ri_node_(ri, id->value.spec)->kind, RiNode_Spec));
 
     return true;
 }
 
 static bool
-ri_resolve_func_args_(Ri* ri, RiNode* func_type, RiNodeSlice* args)
+ri_resolve_func_args_(Ri* ri, RiNode* func_type, RiNodeArray* args)
 {
     RiNode* it;
-    slice_each(args, &it) {
+    ri_nodes_each_(ri, args, &it) {
         RI_CHECK(it->kind == RiNode_Decl);
-        RI_CHECK(it->decl.spec->kind == RiNode_Spec_Var);
-        if (!ri_resolve_node_(ri, &it->decl.spec->spec.var.type)) {
+        RiNode* spec = ri_node_(ri, it->decl.spec);
+        RI_CHECK(spec->kind == RiNode_Spec_Var);
+        if (!ri_resolve_node_(ri, &spec->spec.var.type)) {
             return false;
         }
+        // Arguments are values in slots, structs are shared through pointers.
+        if (ri_get_spec_(ri, spec->spec.var.type)->kind == RiNode_Spec_Type_Struct) {
+            ri_error_set_(ri, RiError_UnexpectedType, it->pos, "structs are passed by pointer");
+            return false;
+        }
+    }
+    return true;
+}
+
+static RI_RESOLVE_F_(ri_resolve_type_pointer_)
+{
+    RiNode* n = ri_node_(ri, *node);
+    RiNode* base = ri_node_(ri, n->spec.type.pointer.base);
+    if (!ri_is_in(base->kind, RiNode_Spec) && !ri_resolve_node_(ri, &n->spec.type.pointer.base)) {
+        return false;
+    }
+    // Only structs are pointed to, there's no dereference operator for the rest.
+    if (ri_get_spec_(ri, n->spec.type.pointer.base)->kind != RiNode_Spec_Type_Struct) {
+        ri_error_set_(ri, RiError_UnexpectedType, n->pos, "pointer to struct expected");
+        return false;
     }
     return true;
 }
 
+// Turns `a.b` to the field `b` of the struct `a` is or points to.
+static RI_RESOLVE_F_(ri_resolve_select_)
+{
+    RiNode* n = ri_node_(ri, *node);
+    RI_CHECK(n->kind == RiNode_Expr_Binary_Select);
+
+    if (!ri_resolve_node_(ri, &n->binary.argument0)) {
+        return false;
+    }
+    RiNode* base = ri_node_(ri, n->binary.argument0);
+    RiNode* id = ri_node_(ri, n->binary.argument1);
+    if (id->kind != RiNode_Id) {
+        ri_error_set_(ri, RiError_UnexpectedExpression, id->pos, "field name expected");
+        return false;
+    }
+
+    RiNode* type = NULL;
+    if (base->kind != RiNode_Value_Type && base->kind != RiNode_Value_Func) {
+        type = ri_retof_(ri, base);
+        if (!type) {
+            return false;
+        }
+        if (type->kind == RiNode_Spec_Type_Pointer) {
+            type = ri_get_spec_(ri, type->spec.type.pointer.base);
+        }
+    }
+    if (!type || type->kind != RiNode_Spec_Type_Struct) {
+        ri_error_set_(ri, RiError_Type, base->pos, "struct expected");
+        return false;
+    }
+
+    RiNode* it;
+    ri_nodes_each_(ri, &type->spec.type.compound.fields, &it) {
+        if (ri_node_(ri, it->decl.spec)->spec.id.items == id->id.name.items) {
+            n->kind = RiNode_Expr_Field;
+            n->field.base = ri_node_ref_(ri, base);
+            n->field.spec = it->decl.spec;
+            return true;
+        }
+    }
+    ri_error_set_(ri, RiError_NotDeclared, id->pos, "'%S' is not a field of '%S'", id->id.name, type->spec.id);
+    return false;
+}
+
+// Only structs have their address taken, they're the only values that live in memory.
+static RI_RESOLVE_F_(ri_resolve_addr_of_)
+{
+    RiNode* n = ri_node_(ri, *node);
+    if (!ri_resolve_node_(ri, &n->addr_of.argument)) {
+        return false;
+    }
+    RiNode* argument = ri_node_(ri, n->addr_of.argument);
+    if (argument->kind == RiNode_Value_Var || argument->kind == RiNode_Expr_Field) {
+        RiNode* type = ri_retof_(ri, argument);
+        if (!type) {
+            return false;
+        }
+        if (type->kind == RiNode_Spec_Type_Struct) {
+            n->addr_of.type = type->spec.type.compound.pointer;
+            return true;
+        }
+    }
+    ri_error_set_(ri, RiError_UnexpectedExpression, argument->pos, "struct variable or field expected");
+    return false;
+}
+
 static
 RI_RESOLVE_F_(ri_resolve_node_)
 {
-    RiNode* n = *node;
+    RiNode* n = ri_node_(ri, *node);
 
     if (n->kind == RiNode_Decl)
     {
         // TODO: 1. Move out to ri_resolve_decl_().
         // TODO: 2. Here only resolve variables and functions if we're in root scope.
 
+        if (n->decl.state == RiDecl_Resolved) {
+            // Resolved through an identifier before its own statement, or reused by an incremental build.
+            return true;
+        }
         RI_CHECK(n->decl.state == RiDecl_Unresolved);
         n->decl.state = RiDecl_Resolving;
 
-        switch (n->decl.spec->kind) {
+        RiNode* spec = ri_node_(ri, n->decl.spec);
+        switch (spec->kind) {
+            case RiNode_Spec_Type_Struct: {
+                // Fields can point to the struct itself, fields containing it are
+                // found when it's completed.
+                n->decl.state = RiDecl_Resolved;
+                RiNode* it;
+                ri_nodes_each_(ri, &spec->spec.type.compound.fields, &it) {
+                    if (!ri_resolve_node_(ri, &ri_node_(ri, it->decl.spec)->spec.var.type)) {
+                        return false;
+                    }
+                }
+            } break;
             case RiNode_Spec_Func:
                 if (!ri_resolve_node_(ri, &n->decl.spec)) {
                     return false;
                 }
                 break;
             case RiNode_Spec_Var:
-                if (!ri_resolve_node_(ri, &n->decl.spec->spec.var.type)) {
+                if (!ri_resolve_node_(ri, &spec->spec.var.type)) {
                     return false;
                 }
                 break;
+            default: break;
         }
         n->decl.state = RiDecl_Resolved;
-        array_push(&n->owner->scope.decl, n);
+        // Room was made by `ri_scope_own_`, so this doesn't allocate in the parallel phase.
+        RiNodeArray* decls = &ri_node_(ri, n->owner)->scope.decl;
+        RI_CHECK(decls->count < decls->capacity);
+        ri_nodes_push_(ri, decls, n);
         return true;
     } else if (ri_is_in(n->kind, RiNode_St_Assign)) {
         return ri_resolve_assign_(ri, node);
+    } else if (n->kind == RiNode_Expr_Binary_Select) {
+        return ri_resolve_select_(ri, node);
     } else if (ri_is_in(n->kind, RiNode_Expr_Binary)) {
         return ri_resolve_binary_(ri, node);
     } else if (ri_is_in(n->kind, RiNode_Expr_Unary)) {
@@ -2511,17 +3799,23 @@ RI_RESOLVE_F_(ri_resolve_node_)
         switch (n->kind)
         {
             case RiNode_Scope:
-                return ri_resolve_slice_with_(ri, n->scope.statements.slice, &ri_resolve_node_);
+                return ri_resolve_nodes_with_(ri, &n->scope.statements, &ri_resolve_node_);
 
             case RiNode_Id:
                 return ri_resolve_identifier_(ri, node);
 
             case RiNode_Spec_Type_Func:
                 return (
-                    ri_resolve_func_args_(ri, n, &n->spec.type.func.inputs.slice) &&
-                    ri_resolve_func_args_(ri, n, &n->spec.type.func.outputs.slice)
+                    ri_resolve_func_args_(ri, n, &n->spec.type.func.inputs) &&
+                    ri_resolve_func_args_(ri, n, &n->spec.type.func.outputs)
                 );
 
+            case RiNode_Spec_Type_Pointer:
+                return ri_resolve_type_pointer_(ri, node);
+
+            case RiNode_Expr_AddrOf:
+                return ri_resolve_addr_of_(ri, node);
+
             case RiNode_Spec_Func:
                 if (!ri_resolve_node_(ri, &n->spec.func.type)) {
                     return false;
@@ -2541,13 +3835,13 @@ RI_RESOLVE_F_(ri_resolve_node_)
                 if (!ri_resolve_node_(ri, &n->call.func)) {
                     return false;
                 }
-                RiNode* callable = n->call.func->value.spec;
+                RiNode* callable = ri_node_(ri, ri_node_(ri, n->call.func)->value.spec);
                 if (callable->kind == RiNode_Spec_Func) {
-                    if (!ri_resolve_expr_call_func_(ri, &n)) {
+                    if (!ri_resolve_expr_call_func_(ri, node)) {
                         return false;
                     }
                 } else if (ri_is_in(callable->kind, RiNode_Spec_Type)) {
-                    if (!ri_resolve_expr_call_type_(ri, &n)) {
+                    if (!ri_resolve_expr_call_type_(ri, node)) {
                         return false;
                     }
                 }
@@ -2560,16 +3854,31 @@ RI_RESOLVE_F_(ri_resolve_node_)
             case RiNode_St_Return:
                 // TODO: Use func's return value type to infer return's argument.
                 // TODO: Use the return type as `expected_type` too.
-                if (n->st_return.argument) {
-                    return ri_resolve_node_(ri, &n->st_return.argument);
+                return ri_resolve_nodes_with_(ri, &n->st_return.arguments, &ri_resolve_node_);
+
+            case RiNode_St_Assign_Outputs:
+                if (!ri_resolve_nodes_with_(ri, &n->st_assign_outputs.targets, &ri_resolve_node_)) {
+                    return false;
                 }
-                return true;
+                return ri_resolve_node_(ri, &n->st_assign_outputs.call);
 
             case RiNode_St_If:
-                return ri_resolve_st_if_(ri, &n);
+                return ri_resolve_st_if_(ri, node);
 
             case RiNode_St_For:
-                return ri_resolve_st_for_(ri, &n);
+                return ri_resolve_st_for_(ri, node);
+
+            case RiNode_St_Switch:
+                return ri_resolve_st_switch_(ri, node);
+
+            case RiNode_St_Switch_Case:
+                return ri_resolve_node_(ri, &n->st_switch_case.expr);
+
+            case RiNode_St_Switch_Default:
+            case RiNode_St_Switch_Fallthrough:
+            case RiNode_St_Break:
+            case RiNode_St_Continue:
+                return true;
 
             default: {
                 RI_ABORT("unexpected node");
@@ -2577,7 +3886,7 @@ RI_RESOLVE_F_(ri_resolve_node_)
             }
         }
 
-        *node = n;
+        *node = ri_node_ref_(ri, n);
         return true;
     }
 }
@@ -2585,14 +3894,18 @@ RI_RESOLVE_F_(ri_resolve_node_)
 RiNode*
 ri_resolve(Ri* ri, RiNode* node)
 {
-    array_push(&ri->pending, node);
+    // Function bodies found on the way are queued after `node`.
+    iptr start = ri->pending.count;
+    array_push(&ri->pending, ri_node_ref_(ri, node));
 
-    RiNode* it;
-    array_each(&ri->pending, &it) {
+    for (iptr i = start; i < ri->pending.count; ++i) {
+        RiNodeRef it = array_at(&ri->pending, i);
         if (!ri_resolve_node_(ri, &it)) {
+            ri->pending.count = start;
             return NULL;
         }
     }
+    ri->pending.count = start;
     return node;
 }
 
@@ -2605,15 +3918,58 @@ ri_typecheck_cast_const_(Ri* ri, RiNode* expr, RiNode* type)
 {
     RI_CHECK(ri_is_in(type->kind, RiNode_Spec_Type));
     if (ri_is_in(expr->kind, RiNode_Expr_Binary)) {
-        ri_typecheck_cast_const_(ri, expr->binary.argument0, type);
-        ri_typecheck_cast_const_(ri, expr->binary.argument1, type);
+        ri_typecheck_cast_const_(ri, ri_node_(ri, expr->binary.argument0), type);
+        ri_typecheck_cast_const_(ri, ri_node_(ri, expr->binary.argument1), type);
     } else if (ri_is_in(expr->kind, RiNode_Expr_Unary)) {
-        ri_typecheck_cast_const_(ri, expr->unary.argument, type);
+        ri_typecheck_cast_const_(ri, ri_node_(ri, expr->unary.argument), type);
     } else if (expr->kind == RiNode_Value_Const) {
         // TODO: We need to be sure that the const type can actually be implicitly cast to `type`.
-        RI_ASSERT(ri_is_in(expr->value.type->kind, RiNode_Spec_Type_Number_None));
-        expr->value.type = type;
+        RiNode* expr_type = ri_node_(ri, expr->value.type);
+        RI_ASSERT(ri_is_in(expr_type->kind, RiNode_Spec_Type_Number_None));
+        if (expr_type->kind == RiNode_Spec_Type_Number_None_Int && ri_is_in(type->kind, RiNode_Spec_Type_Number_Float)) {
+            // The literal is kept as it was written, so it's converted along with its type.
+            expr->value.constant.real = (double)expr->value.constant.integer;
+        }
+        expr->value.type = ri_node_ref_(ri, type);
+    }
+}
+
+// Operators are defined only for numbers, structs and pointers are used through fields.
+static bool
+ri_typecheck_operand_(Ri* ri, RiNode* node, RiNode* type)
+{
+    if (ri_is_in(type->kind, RiNode_Spec_Type_Number)) {
+        return true;
+    }
+    ri_error_set_(ri, RiError_Type, node->pos, "%s is not defined for %s%S",
+        RI_OP_NAMES_[node->kind] ? RI_OP_NAMES_[node->kind] : "operator",
+        ri_type_prefix_(type), ri_type_name_(ri, type)
+    );
+    return false;
+}
+
+// Pointers to the same struct are the same type. Structs are compared by name, declarations
+// reused by incremental builds point to structs from an earlier parse.
+static bool
+ri_typecheck_equal_(Ri* ri, RiNode* type0, RiNode* type1)
+{
+    if (type0 == type1) {
+        return true;
+    } else if (type0->kind != type1->kind) {
+        return false;
+    }
+    switch (type0->kind)
+    {
+        case RiNode_Spec_Type_Pointer:
+            return ri_typecheck_equal_(ri,
+                ri_get_spec_(ri, type0->spec.type.pointer.base),
+                ri_get_spec_(ri, type1->spec.type.pointer.base)
+            );
+        case RiNode_Spec_Type_Struct:
+            return type0->spec.id.items == type1->spec.id.items;
+        default: break;
     }
+    return false;
 }
 
 static RiNode*
@@ -2622,11 +3978,12 @@ ri_typecheck_get_untyped_default_type_(Ri* ri, RiNodeKind untyped)
     switch (untyped)
     {
         case RiNode_Spec_Type_Number_None_Int:
-            return ri->node_meta[RiNode_Spec_Type_Number_Int64].node;
+            return ri_node_(ri, ri->node_meta[RiNode_Spec_Type_Number_Int64].node);
             break;
         case RiNode_Spec_Type_Number_None_Real:
-            return ri->node_meta[RiNode_Spec_Type_Number_Float32].node;
+            return ri_node_(ri, ri->node_meta[RiNode_Spec_Type_Number_Float32].node);
             break;
+        default: break;
     }
     RI_UNREACHABLE;
     return NULL;
@@ -2635,21 +3992,25 @@ ri_typecheck_get_untyped_default_type_(Ri* ri, RiNodeKind untyped)
 RiNode*
 ri_typecheck_node_(Ri* ri, RiNode* node)
 {
-    RiNode* type_none = ri->node_meta[RiNode_Spec_Type_None].node;
+    RiNode* type_none = ri_node_(ri, ri->node_meta[RiNode_Spec_Type_None].node);
 
     if (ri_is_in(node->kind, RiNode_Expr_Binary_Comparison))
     {
         // Here we have to check for dominance, but
         // we'd always return bool. Here we'd need to call `set`
         // because we want the types to be concrete.
-        RiNode* t0 = ri_typecheck_node_(ri, node->binary.argument0);
-        RiNode* t1 = ri_typecheck_node_(ri, node->binary.argument1);
-        bool d0 = !ri_is_in(t0->kind, RiNode_Spec_Type_Number_None);
-        bool d1 = !ri_is_in(t1->kind, RiNode_Spec_Type_Number_None);
+        RiNode* t0 = ri_typecheck_node_(ri, ri_node_(ri, node->binary.argument0));
+        RiNode* t1 = ri_typecheck_node_(ri, ri_node_(ri, node->binary.argument1));
         if (t0 == NULL || t1 == NULL) {
             // Error.
             return NULL;
-        } else if (t0 == t1) {
+        }
+        if (!ri_typecheck_operand_(ri, node, t0) || !ri_typecheck_operand_(ri, node, t1)) {
+            return NULL;
+        }
+        bool d0 = !ri_is_in(t0->kind, RiNode_Spec_Type_Number_None);
+        bool d1 = !ri_is_in(t1->kind, RiNode_Spec_Type_Number_None);
+        if (t0 == t1) {
             // Types are the same, so return one.
             if (d0 == false) {
                 RI_CHECK(d1 == false);
@@ -2670,25 +4031,27 @@ ri_typecheck_node_(Ri* ri, RiNode* node)
                 // Left it dominant.
                 // Set right to t0?
                 t1 = t0;
-                ri_typecheck_cast_const_(ri, node->binary.argument1, t0);
+                ri_typecheck_cast_const_(ri, ri_node_(ri, node->binary.argument1), t0);
             } else {
                 RI_CHECK(d0 == false && d1 == true);
                 // Right is dominant.
                 t0 = t1;
-                ri_typecheck_cast_const_(ri, node->binary.argument0, t1);
+                ri_typecheck_cast_const_(ri, ri_node_(ri, node->binary.argument0), t1);
             }
         }
 
         // We always return bool.
-        return ri->node_meta[RiNode_Spec_Type_Number_Bool].node;
+        return ri_node_(ri, ri->node_meta[RiNode_Spec_Type_Number_Bool].node);
     }
     else if (ri_is_in(node->kind, RiNode_Expr_Binary))
     {
-        RiNode* t0 = ri_typecheck_node_(ri, node->binary.argument0);
-        RiNode* t1 = ri_typecheck_node_(ri, node->binary.argument1);
+        RiNode* t0 = ri_typecheck_node_(ri, ri_node_(ri, node->binary.argument0));
+        RiNode* t1 = ri_typecheck_node_(ri, ri_node_(ri, node->binary.argument1));
         if (t0 == NULL || t1 == NULL) {
             // Error.
             return NULL;
+        } else if (!ri_typecheck_operand_(ri, node, t0) || !ri_typecheck_operand_(ri, node, t1)) {
+            return NULL;
         } else if (t0 == t1) {
             // Types are the same, so return one.
         } else {
@@ -2706,29 +4069,33 @@ ri_typecheck_node_(Ri* ri, RiNode* node)
                 // Left it dominant.
                 // Set right to t0.
                 t1 = t0;
-                ri_typecheck_cast_const_(ri, node->binary.argument1, t0);
+                ri_typecheck_cast_const_(ri, ri_node_(ri, node->binary.argument1), t0);
             } else {
                 RI_CHECK(d0 == false && d1 == true);
                 // Right is dominant.
                 // Set left to t1.
                 t0 = t1;
-                ri_typecheck_cast_const_(ri, node->binary.argument0, t1);
+                ri_typecheck_cast_const_(ri, ri_node_(ri, node->binary.argument0), t1);
             }
         }
 
         return t0;
     } else if (ri_is_in(node->kind, RiNode_Expr_Unary)) {
-        return ri_typecheck_node_(ri, node->unary.argument);
+        RiNode* t = ri_typecheck_node_(ri, ri_node_(ri, node->unary.argument));
+        if (!t || !ri_typecheck_operand_(ri, node, t)) {
+            return NULL;
+        }
+        return t;
     } else {
         switch (node->kind)
         {
             case RiNode_Module: {
-                return ri_typecheck_node_(ri, node->module.scope);
+                return ri_typecheck_node_(ri, ri_node_(ri, node->module.scope));
             }
 
             case RiNode_Scope: {
                 RiNode* it;
-                array_each(&node->scope.statements, &it) {
+                ri_nodes_each_(ri, &node->scope.statements, &it) {
                     if (!ri_typecheck_node_(ri, it)) {
                         return NULL;
                     }
@@ -2737,14 +4104,30 @@ ri_typecheck_node_(Ri* ri, RiNode* node)
             } break;
 
             case RiNode_Decl: {
-                switch (node->decl.spec->kind) {
-                    case RiNode_Spec_Func:
-                        if (!ri_typecheck_node_(ri, node->decl.spec->spec.func.scope)) {
+                RiNode* spec = ri_node_(ri, node->decl.spec);
+                switch (spec->kind) {
+                    case RiNode_Spec_Func: {
+                        RiNode* func_type = ri_get_spec_(ri, spec->spec.func.type);
+                        if (func_type->spec.type.func.outputs.count > RI_OUTPUTS_MAX) {
+                            ri_error_set_(ri, RiError_Type, node->pos, "at most %d outputs expected", RI_OUTPUTS_MAX);
                             return NULL;
                         }
-                        break;
+                        if (ri->defer_bodies) {
+                            break;
+                        }
+                        if (!ri_typecheck_node_(ri, ri_node_(ri, spec->spec.func.scope))) {
+                            return NULL;
+                        }
+                    } break;
                     case RiNode_Spec_Var:
-                        return ri_get_spec_(ri, node->decl.spec->spec.var.type);
+                        return ri_get_spec_(ri, spec->spec.var.type);
+                    case RiNode_Spec_Type_Struct:
+                        // Laid out before function bodies, which are typechecked in parallel.
+                        if (!ri_complete_type_(ri, node->pos, spec)) {
+                            return NULL;
+                        }
+                        break;
+                    default: break;
                 }
                 return type_none;
             } break;
@@ -2754,7 +4137,7 @@ ri_typecheck_node_(Ri* ri, RiNode* node)
                 RiNode* func_type = ri_get_spec_(ri, func_spec->spec.func.type);
                 RiNodeArray* inputs = &func_type->spec.type.func.inputs;
                 RiNode* it;
-                array_eachi(&node->call.arguments, i, &it)
+                ri_nodes_eachi_(ri, &node->call.arguments, i, &it)
                 {
                     RiNode* t = ri_typecheck_node_(ri, it);
                     if (!t) {
@@ -2762,44 +4145,152 @@ ri_typecheck_node_(Ri* ri, RiNode* node)
                     }
                     if (ri_is_in(t->kind, RiNode_Spec_Type_Number_None)) {
                         // TODO: Cast constant to type required by input argument at `i`.
-                        RiNode* arg = array_at(inputs, i);
+                        RiNode* arg = ri_nodes_at_(ri, inputs, i);
                         RI_CHECK(arg->kind == RiNode_Decl);
-                        RI_CHECK(arg->decl.spec->kind == RiNode_Spec_Var);
-                        ri_typecheck_cast_const_(ri, it, ri_get_spec_(ri, arg->decl.spec->spec.var.type));
+                        RiNode* arg_spec = ri_node_(ri, arg->decl.spec);
+                        RI_CHECK(arg_spec->kind == RiNode_Spec_Var);
+                        ri_typecheck_cast_const_(ri, it, ri_get_spec_(ri, arg_spec->spec.var.type));
+                    } else if (i < inputs->count) {
+                        // Pointers are passed as they are, they have to point to the same struct.
+                        RiNode* arg_type = ri_get_spec_(ri, ri_node_(ri, ri_nodes_at_(ri, inputs, i)->decl.spec)->spec.var.type);
+                        bool pointers = t->kind == RiNode_Spec_Type_Pointer || arg_type->kind == RiNode_Spec_Type_Pointer;
+                        if (pointers && !ri_typecheck_equal_(ri, t, arg_type)) {
+                            ri_error_set_mismatched_types_(ri, it->pos, t, arg_type, "for");
+                            return NULL;
+                        }
                     }
                 }
                 return ri_retof_(ri, node);
             } break;
 
+            case RiNode_Expr_Cast: {
+                RiNode* type_to = ri_nodes_at_(ri, &node->call.arguments, 0);
+                RiNode* expr = ri_nodes_at_(ri, &node->call.arguments, 1);
+                RiNode* t = ri_typecheck_node_(ri, expr);
+                if (!t) {
+                    return NULL;
+                }
+                if (ri_is_in(t->kind, RiNode_Spec_Type_Number_None)) {
+                    // Constants take the type cast to, unless a real would become an integer.
+                    bool to_float = ri_is_in(type_to->kind, RiNode_Spec_Type_Number_Float);
+                    bool to_int = ri_is_in(type_to->kind, RiNode_Spec_Type_Number_Int);
+                    if (to_float || (to_int && t->kind == RiNode_Spec_Type_Number_None_Int)) {
+                        ri_typecheck_cast_const_(ri, expr, type_to);
+                    } else {
+                        ri_typecheck_cast_const_(ri, expr, ri_typecheck_get_untyped_default_type_(ri, t->kind));
+                    }
+                }
+                return type_to;
+            } break;
+
             case RiNode_St_Return: {
-                if (node->st_return.argument) {
-                    if (!ri_typecheck_node_(ri, node->st_return.argument)) {
+                RiNodeArray* arguments = &node->st_return.arguments;
+                RiNodeArray* outputs = node->st_return.func_type
+                    ? &ri_node_(ri, node->st_return.func_type)->spec.type.func.outputs
+                    : NULL;
+                // A call returns all of its outputs, which are written to those of the caller.
+                iptr count = arguments->count;
+                if (count == 1 && ri_nodes_at_(ri, arguments, 0)->kind == RiNode_Expr_Call) {
+                    RiNode* callee = ri_get_spec_(ri, ri_nodes_at_(ri, arguments, 0)->call.func);
+                    count = MAXIMUM(ri_node_(ri, callee->spec.func.type)->spec.type.func.outputs.count, 1);
+                }
+                if (outputs && count > 1 && count != outputs->count) {
+                    ri_error_set_(ri, RiError_Type, node->pos, "%d values returned for %d outputs",
+                        (int)count, (int)outputs->count);
+                    return NULL;
+                }
+                RiNode* it;
+                ri_nodes_eachi_(ri, arguments, i, &it) {
+                    RiNode* type = ri_typecheck_node_(ri, it);
+                    if (!type) {
+                        return NULL;
+                    }
+                    // Untyped constants get the type of their output.
+                    if (outputs && i < outputs->count && ri_is_in(type->kind, RiNode_Spec_Type_Number_None)) {
+                        RiNode* output_type = ri_get_spec_(ri, ri_node_(ri, ri_nodes_at_(ri, outputs, i)->decl.spec)->spec.var.type);
+                        bool to_float = output_type->kind == RiNode_Spec_Type_Number_Float32 ||
+                            output_type->kind == RiNode_Spec_Type_Number_Float64;
+                        bool to_int = ri_is_in(output_type->kind, RiNode_Spec_Type_Number_Int);
+                        if (to_float || (to_int && type->kind == RiNode_Spec_Type_Number_None_Int)) {
+                            ri_typecheck_cast_const_(ri, it, output_type);
+                        }
+                    } else if (outputs && i < outputs->count && type != type_none) {
+                        RiNode* output_type = ri_get_spec_(ri, ri_node_(ri, ri_nodes_at_(ri, outputs, i)->decl.spec)->spec.var.type);
+                        bool pointers = type->kind == RiNode_Spec_Type_Pointer || output_type->kind == RiNode_Spec_Type_Pointer;
+                        if (pointers && !ri_typecheck_equal_(ri, type, output_type)) {
+                            ri_error_set_mismatched_types_(ri, it->pos, type, output_type, "for");
+                            return NULL;
+                        }
+                    }
+                }
+                return type_none;
+            } break;
+
+            case RiNode_St_Assign_Outputs: {
+                RiNode* call = ri_node_(ri, node->st_assign_outputs.call);
+                if (call->kind != RiNode_Expr_Call || !ri_typecheck_node_(ri, call)) {
+                    if (!ri->error.kind) {
+                        ri_error_set_(ri, RiError_UnexpectedValue, call->pos, "call expected");
+                    }
+                    return NULL;
+                }
+                RiNodeArray* targets = &node->st_assign_outputs.targets;
+                RiNode* callee = ri_get_spec_(ri, call->call.func);
+                RiNodeArray* outputs = &ri_node_(ri, callee->spec.func.type)->spec.type.func.outputs;
+                if (outputs->count != targets->count) {
+                    ri_error_set_(ri, RiError_Type, node->pos, "%d outputs assigned to %d variables",
+                        (int)outputs->count, (int)targets->count);
+                    return NULL;
+                }
+                RiNode* it;
+                ri_nodes_eachi_(ri, targets, i, &it) {
+                    RiNode* type = ri_typecheck_node_(ri, it);
+                    if (!type) {
+                        return NULL;
+                    }
+                    RiNode* output = ri_nodes_at_(ri, outputs, i);
+                    RiNode* output_type = ri_get_spec_(ri, ri_node_(ri, output->decl.spec)->spec.var.type);
+                    if (!ri_typecheck_equal_(ri, type, output_type)) {
+                        ri_error_set_mismatched_types_(ri, it->pos, type, output_type, "=");
                         return NULL;
                     }
                 }
                 return type_none;
             } break;
 
-            case RiNode_St_Assign: {
-                RiNode* type0 = ri_typecheck_node_(ri, node->binary.argument0);
-                RiNode* type1 = ri_typecheck_node_(ri, node->binary.argument1);
+            case RiNode_St_Assign:
+            case RiNode_St_Assign_Add:
+            case RiNode_St_Assign_Sub:
+            case RiNode_St_Assign_Mul:
+            case RiNode_St_Assign_Div:
+            case RiNode_St_Assign_Mod:
+            case RiNode_St_Assign_And:
+            case RiNode_St_Assign_Or:
+            case RiNode_St_Assign_Xor: {
+                RiNode* type0 = ri_typecheck_node_(ri, ri_node_(ri, node->binary.argument0));
+                RiNode* type1 = ri_typecheck_node_(ri, ri_node_(ri, node->binary.argument1));
                 if (!type0 || !type1) {
                     return NULL;
                 }
+                // Structs and pointers are only copied.
+                if (node->kind != RiNode_St_Assign && !ri_typecheck_operand_(ri, node, type0)) {
+                    return NULL;
+                }
                 if (type0->kind == RiNode_Spec_Type_Infer) {
                     RI_CHECK(type1->kind != RiNode_Spec_Type_Infer);
                     if (ri_is_in(type1->kind, RiNode_Spec_Type_Number_None)) {
                         // If right is untyped, set it to default.
                         type1 = ri_typecheck_get_untyped_default_type_(ri, type1->kind);
-                        ri_typecheck_cast_const_(ri, node->binary.argument1, type1);
+                        ri_typecheck_cast_const_(ri, ri_node_(ri, node->binary.argument1), type1);
                     }
 
                     // Set left type to same type as we now have for right.
-                    RiNode* var = node->binary.argument0;
+                    RiNode* var = ri_node_(ri, node->binary.argument0);
                     RI_CHECK(var->kind == RiNode_Decl);
-                    RI_CHECK(var->decl.spec->kind == RiNode_Spec_Var);
-                    var->decl.spec->spec.var.type = type1;
-                } else if (type0 != type1) {
+                    RiNode* var_spec = ri_node_(ri, var->decl.spec);
+                    RI_CHECK(var_spec->kind == RiNode_Spec_Var);
+                    var_spec->spec.var.type = ri_node_ref_(ri, type1);
+                } else if (!ri_typecheck_equal_(ri, type0, type1)) {
                     if (
                         (
                             type0->kind == RiNode_Spec_Type_Number_Float64 ||
@@ -2808,11 +4299,11 @@ ri_typecheck_node_(Ri* ri, RiNode* node)
                         &&
                         type1->kind == RiNode_Spec_Type_Number_None_Real
                     ) {
-                        ri_typecheck_cast_const_(ri, node->binary.argument1, type0);
+                        ri_typecheck_cast_const_(ri, ri_node_(ri, node->binary.argument1), type0);
                     } else if (ri_is_in(type0->kind, RiNode_Spec_Type_Number_Int) &&
                         type1->kind == RiNode_Spec_Type_Number_None_Int
                     ) {
-                        ri_typecheck_cast_const_(ri, node->binary.argument1, type0);
+                        ri_typecheck_cast_const_(ri, ri_node_(ri, node->binary.argument1), type0);
                     } else {
                         ri_error_set_mismatched_types_(ri, node->pos, type0, type1, "=");
                         return NULL;
@@ -2822,15 +4313,104 @@ ri_typecheck_node_(Ri* ri, RiNode* node)
             } break;
 
             case RiNode_St_If: {
-                if (node->st_if.pre && !ri_typecheck_node_(ri, node->st_if.pre)) {
+                if (node->st_if.pre && !ri_typecheck_node_(ri, ri_node_(ri, node->st_if.pre))) {
+                    return NULL;
+                }
+                if (!ri_typecheck_node_(ri, ri_node_(ri, node->st_if.condition))) {
+                    return NULL;
+                }
+                if (!ri_typecheck_node_(ri, ri_node_(ri, node->st_if.scope))) {
+                    return NULL;
+                }
+                return type_none;
+            } break;
+
+            case RiNode_St_For: {
+                if (node->st_for.pre && !ri_typecheck_node_(ri, ri_node_(ri, node->st_for.pre))) {
+                    return NULL;
+                }
+                if (node->st_for.condition && !ri_typecheck_node_(ri, ri_node_(ri, node->st_for.condition))) {
+                    return NULL;
+                }
+                if (node->st_for.post && !ri_typecheck_node_(ri, ri_node_(ri, node->st_for.post))) {
+                    return NULL;
+                }
+                if (!ri_typecheck_node_(ri, ri_node_(ri, node->st_for.scope))) {
                     return NULL;
                 }
-                if (!ri_typecheck_node_(ri, node->st_if.condition)) {
+                return type_none;
+            } break;
+
+            case RiNode_St_Switch: {
+                if (node->st_switch.pre && !ri_typecheck_node_(ri, ri_node_(ri, node->st_switch.pre))) {
+                    return NULL;
+                }
+                RiNode* type = ri_typecheck_node_(ri, ri_node_(ri, node->st_switch.expr));
+                if (!type) {
+                    return NULL;
+                }
+                if (ri_is_in(type->kind, RiNode_Spec_Type_Number_None)) {
+                    type = ri_typecheck_get_untyped_default_type_(ri, type->kind);
+                    ri_typecheck_cast_const_(ri, ri_node_(ri, node->st_switch.expr), type);
+                }
+
+                // Cases are compared to the expression, so they get its type.
+                RiNodeArray* statements = &ri_node_(ri, node->st_switch.scope)->scope.statements;
+                RI_CHECK(statements->count == 1);
+                RiNode* scope = ri_nodes_at_(ri, statements, 0);
+                RiNode* it;
+                ri_nodes_each_(ri, &scope->scope.statements, &it) {
+                    if (it->kind != RiNode_St_Switch_Case) {
+                        if (!ri_typecheck_node_(ri, it)) {
+                            return NULL;
+                        }
+                        continue;
+                    }
+                    RiNode* case_type = ri_typecheck_node_(ri, ri_node_(ri, it->st_switch_case.expr));
+                    if (!case_type) {
+                        return NULL;
+                    }
+                    if (case_type != type) {
+                        if (ri_is_in(type->kind, RiNode_Spec_Type_Number_Int) &&
+                            case_type->kind == RiNode_Spec_Type_Number_None_Int
+                        ) {
+                            ri_typecheck_cast_const_(ri, ri_node_(ri, it->st_switch_case.expr), type);
+                        } else {
+                            ri_error_set_mismatched_types_(ri, it->pos, type, case_type, "case");
+                            return NULL;
+                        }
+                    }
+                }
+                return type_none;
+            } break;
+
+            case RiNode_St_Expr: {
+                if (!ri_typecheck_node_(ri, ri_node_(ri, node->st_expr))) {
                     return NULL;
                 }
                 return type_none;
             } break;
 
+            case RiNode_Expr_Field: {
+                if (!ri_typecheck_node_(ri, ri_node_(ri, node->field.base))) {
+                    return NULL;
+                }
+                return ri_retof_(ri, node);
+            } break;
+
+            case RiNode_Expr_AddrOf: {
+                if (!ri_typecheck_node_(ri, ri_node_(ri, node->addr_of.argument))) {
+                    return NULL;
+                }
+                return ri_node_(ri, node->addr_of.type);
+            } break;
+
+            case RiNode_St_Switch_Default:
+            case RiNode_St_Switch_Fallthrough:
+            case RiNode_St_Break:
+            case RiNode_St_Continue:
+                return type_none;
+
             default:
                 return ri_retof_(ri, node);
         }
@@ -2849,16 +4429,112 @@ ri_typecheck(Ri* ri, RiNode* node)
 //
 //
 
+typedef struct RiBuildBodies_ {
+    Ri* ri;
+    iptr start;
+    // One `Ri` per thread, see `ri_build_parallel_`.
+    Ri* workers;
+    RiError* errors;
+} RiBuildBodies_;
+
+static THREAD_FOR_F(ri_build_body_)
+{
+    RiBuildBodies_* B = user;
+    Ri* worker = &B->workers[thread];
+    RiNode* body = ri_node_(worker, array_at(&B->ri->pending, B->start + index));
+
+    // Nested functions are queued to the worker's own `pending`.
+    worker->pending.count = 0;
+    if (!ri_resolve(worker, body) || !ri_typecheck(worker, body)) {
+        B->errors[index] = worker->error;
+        worker->error = (RiError){0};
+    }
+}
+
+// Resolves and typechecks module scope serially, then function bodies on `ri->threads` threads.
+// Module scope resolves every top-level declaration including function signatures, and the
+// bodies only read those, so no body depends on another. Resolving and typechecking a body
+// writes only to nodes of that body, and to `pending` and `error`, which are per-thread.
+// Declarations that are already resolved (reused by an incremental build) are skipped, bodies included.
+// NOTE: Every failing body logs its error, the one reported is the first in source order.
+static RiNode*
+ri_build_parallel_(Ri* ri, RiNode* scope)
+{
+    iptr start = ri->pending.count;
+    RiNodeRef module_scope = ri_node_ref_(ri, scope);
+    bool resolved = ri_resolve_node_(ri, &module_scope);
+    RI_CHECK(ri_node_(ri, module_scope) == scope);
+
+    bool typechecked = false;
+    if (resolved) {
+        ri->defer_bodies = true;
+        typechecked = ri_typecheck(ri, scope);
+        ri->defer_bodies = false;
+    }
+    if (!typechecked) {
+        ri->pending.count = start;
+        return NULL;
+    }
+
+    int threads = MAXIMUM(ri->threads, 1);
+    iptr count = ri->pending.count - start;
+    RiBuildBodies_ B = {
+        .ri = ri,
+        .start = start,
+        .workers = heap_alloc(threads * sizeof(Ri)),
+        .errors = heap_alloc_zeroed(MAXIMUM(count, 1) * sizeof(RiError)),
+    };
+    for (int i = 0; i < threads; ++i) {
+        Ri* worker = &B.workers[i];
+        *worker = *ri;
+        memset(&worker->pending, 0, sizeof(worker->pending));
+    }
+
+    thread_for(threads, count, &ri_build_body_, &B);
+
+    for (int i = 0; i < threads; ++i) {
+        Ri* worker = &B.workers[i];
+        // Bodies must not allocate from `ri`, as the workers' copies of the allocators are discarded.
+        RI_CHECK(worker->nodes.used == ri->nodes.used);
+        RI_CHECK(worker->index == ri->index);
+        RI_CHECK(worker->error.kind == RiError_None);
+        array_purge(&worker->pending);
+    }
+    for (iptr i = 0; i < count; ++i) {
+        if (B.errors[i].kind == RiError_None) {
+            continue;
+        }
+        if (ri->error.kind == RiError_None) {
+            ri->error = B.errors[i];
+        } else {
+            array_purge(&B.errors[i].message);
+        }
+    }
+    heap_free(B.errors);
+    heap_free(B.workers);
+    ri->pending.count = start;
+
+    return ri->error.kind == RiError_None ? scope : NULL;
+}
+
 RiNode*
 ri_build(Ri* ri, String stream, String path)
 {
     RiNode* module = ri_make_node_(ri, (RiPos){0}, RiNode_Module);
     RiNode* scope = ri_parse(ri, stream, path);
     if (scope) {
+        if (ri->threads > 1) {
+            scope = ri_build_parallel_(ri, scope);
+            if (scope) {
+                module->module.scope = ri_node_ref_(ri, scope);
+                return module;
+            }
+            return NULL;
+        }
         scope = ri_resolve(ri, scope);
         if (scope) {
             if (ri_typecheck(ri, scope)) {
-                module->module.scope = scope;
+                module->module.scope = ri_node_ref_(ri, scope);
                 return module;
             }
         }
@@ -2876,19 +4552,19 @@ typedef struct RiDump_ {
     Map logged;
 } RiDump_;
 
-static void ri_dump_(RiDump_* dump, RiNode* node);
+static void ri_dump_(RiDump_* dump, RiNodeRef ref);
 
 static void
-ri_dump_slice_(RiDump_* D, RiNodeSlice* nodes, const char* block)
+ri_dump_nodes_(RiDump_* D, RiNodeArray* nodes, const char* block)
 {
     if (nodes->count > 0) {
         if (block) {
             riprinter_print(&D->printer, "(%s", block);
         }
         riprinter_print(&D->printer, "\n\t");
-        RiNode* it;
-        array_each(nodes, &it) {
-            ri_dump_(D, it);
+        RiNodeRef* items = ri_nodes_items_(D->ri, nodes);
+        for (iptr i = 0; i < nodes->count; ++i) {
+            ri_dump_(D, items[i]);
         }
         riprinter_print(&D->printer, "\b");
         if (block) {
@@ -2900,7 +4576,7 @@ ri_dump_slice_(RiDump_* D, RiNodeSlice* nodes, const char* block)
 }
 
 static void
-ri_dump_block_(RiDump_* D, RiNode* node, const char* block)
+ri_dump_block_(RiDump_* D, RiNodeRef node, const char* block)
 {
     if (!node && block) {
         riprinter_print(&D->printer, "(%s)\n", block);
@@ -2960,8 +4636,9 @@ static const char* RI_NODEKIND_NAMES_[RiNode_COUNT__] = {
 };
 
 static void
-ri_dump_(RiDump_* D, RiNode* node)
+ri_dump_(RiDump_* D, RiNodeRef ref)
 {
+    RiNode* node = ri_node_(D->ri, ref);
     RI_CHECK(node);
 
     int is_logged = map_get(&D->logged, (ValueScalar){ .ptr = node }).i32;
@@ -2981,7 +4658,6 @@ ri_dump_(RiDump_* D, RiNode* node)
     } else if (ri_is_in(node->kind, RiNode_Spec_Type_Number)) {
         riprinter_print(&D->printer, "(spec-type-number '%S')\n", node->spec.id);
     } else {
-        RiNode* it;
         switch (node->kind)
         {
             case RiNode_Module: {
@@ -2993,16 +4669,15 @@ ri_dump_(RiDump_* D, RiNode* node)
             case RiNode_Scope: {
                 riprinter_print(&D->printer, "(scope %d\n\t", node->index);
 
-                if (node->scope.decl.count) {
-                    array_each(&node->scope.decl, &it) {
-                        ri_dump_(D, it);
-                    }
+                RiNodeRef* decl = ri_nodes_items_(D->ri, &node->scope.decl);
+                for (iptr i = 0; i < node->scope.decl.count; ++i) {
+                    ri_dump_(D, decl[i]);
                 }
                 riprinter_print(&D->printer, "(code");
                 if (is_logged) {
                     riprinter_print(&D->printer, " (recursive)");
                 } else {
-                    ri_dump_slice_(D, &node->scope.statements.slice, NULL);
+                    ri_dump_nodes_(D, &node->scope.statements, NULL);
                 }
                 riprinter_print(&D->printer, ")\n");
 
@@ -3031,13 +4706,13 @@ ri_dump_(RiDump_* D, RiNode* node)
             case RiNode_Expr_Call: {
                 riprinter_print(&D->printer, "(expr-call\n\t");
                 ri_dump_(D, node->call.func);
-                ri_dump_slice_(D, &node->call.arguments.slice, "arguments");
+                ri_dump_nodes_(D, &node->call.arguments, "arguments");
                 riprinter_print(&D->printer, "\b)\n");
             } break;
 
             case RiNode_Expr_Cast: {
                 riprinter_print(&D->printer, "(expr-cast\n\t");
-                ri_dump_slice_(D, &node->call.arguments.slice, "arguments");
+                ri_dump_nodes_(D, &node->call.arguments, "arguments");
                 riprinter_print(&D->printer, "\b)\n");
             } break;
 
@@ -3049,14 +4724,19 @@ ri_dump_(RiDump_* D, RiNode* node)
 
             case RiNode_St_Return: {
                 riprinter_print(&D->printer, "(st-return");
-                if (node->st_return.argument) {
-                    riprinter_print(&D->printer, "\n\t");
-                    ri_dump_(D, node->st_return.argument);
-                    riprinter_print(&D->printer, "\b");
+                if (node->st_return.arguments.count) {
+                    ri_dump_nodes_(D, &node->st_return.arguments, NULL);
                 }
                 riprinter_print(&D->printer, ")\n");
             } break;
 
+            case RiNode_St_Assign_Outputs: {
+                riprinter_print(&D->printer, "(st-assign-outputs\n\t");
+                ri_dump_nodes_(D, &node->st_assign_outputs.targets, "targets");
+                ri_dump_(D, node->st_assign_outputs.call);
+                riprinter_print(&D->printer, "\b)\n");
+            } break;
+
             case RiNode_St_If: {
                 riprinter_print(&D->printer, ("(st-if\n\t"));
                 ri_dump_block_(D, node->st_if.pre, "pre");
@@ -3092,6 +4772,10 @@ ri_dump_(RiDump_* D, RiNode* node)
                 riprinter_print(&D->printer, ("(st-switch-default)\n"));
             } break;
 
+            case RiNode_St_Switch_Fallthrough: {
+                riprinter_print(&D->printer, ("(st-switch-fallthrough)\n"));
+            } break;
+
             case RiNode_St_Break: {
                 riprinter_print(&D->printer, ("(st-break)\n"));
             } break;
@@ -3110,7 +4794,7 @@ ri_dump_(RiDump_* D, RiNode* node)
 
             case RiNode_Value_Const: {
                 riprinter_print(&D->printer, "(const ");
-                switch (node->value.type->kind) {
+                switch (ri_node_(D->ri, node->value.type)->kind) {
                     case RiNode_Spec_Type_Number_Int8:
                     case RiNode_Spec_Type_Number_Int16:
                     case RiNode_Spec_Type_Number_Int32:
@@ -3161,8 +4845,38 @@ ri_dump_(RiDump_* D, RiNode* node)
 
             case RiNode_Spec_Type_Func: {
                 riprinter_print(&D->printer, "(spec-type-func '%S'\n\t", node->spec.id);
-                ri_dump_slice_(D, &node->spec.type.func.inputs.slice, "in");
-                ri_dump_slice_(D, &node->spec.type.func.outputs.slice, "out");
+                ri_dump_nodes_(D, &node->spec.type.func.inputs, "in");
+                ri_dump_nodes_(D, &node->spec.type.func.outputs, "out");
+                riprinter_print(&D->printer, "\b)\n");
+            } break;
+
+            case RiNode_Spec_Type_Struct: {
+                // Fields can point back to the struct.
+                riprinter_print(&D->printer, "(spec-type-struct '%S'", node->spec.id);
+                if (is_logged) {
+                    riprinter_print(&D->printer, ")\n");
+                    break;
+                }
+                riprinter_print(&D->printer, "\n\t");
+                ri_dump_nodes_(D, &node->spec.type.compound.fields, "fields");
+                riprinter_print(&D->printer, "\b)\n");
+            } break;
+
+            case RiNode_Spec_Type_Pointer: {
+                riprinter_print(&D->printer, "(spec-type-pointer\n\t");
+                ri_dump_(D, node->spec.type.pointer.base);
+                riprinter_print(&D->printer, "\b)\n");
+            } break;
+
+            case RiNode_Expr_AddrOf: {
+                riprinter_print(&D->printer, "(expr-addr-of\n\t");
+                ri_dump_(D, node->addr_of.argument);
+                riprinter_print(&D->printer, "\b)\n");
+            } break;
+
+            case RiNode_Expr_Field: {
+                riprinter_print(&D->printer, "(expr-field '%S'\n\t", ri_node_(D->ri, node->field.spec)->spec.id);
+                ri_dump_(D, node->field.base);
                 riprinter_print(&D->printer, "\b)\n");
             } break;
 
@@ -3180,9 +4894,10 @@ ri_dump(Ri* ri, RiNode* node, CharArray* buffer)
     RI_CHECK(buffer);
 
     RiDump_ dump = {
+        .ri = ri,
         .printer.out = buffer
     };
-    ri_dump_(&dump, node);
+    ri_dump_(&dump, ri_node_ref_(ri, node));
     map_purge(&dump.logged);
 }
 
@@ -3206,6 +4921,7 @@ ri_init(Ri* ri)
 
     memset(ri, 0, sizeof(Ri));
     arena_init(&ri->arena, MEGABYTES(1));
+    ri_node_heap_init_(&ri->nodes);
     intern_init(&ri->intern);
 
     ri->id_func        = ri_make_id_(ri, S("func")).items;
@@ -3233,23 +4949,25 @@ ri_init(Ri* ri)
 
     ri->id_underscore  = ri_make_id_(ri, S("_")).items;
 
-    ri->scope = ri_make_scope_(ri, RI_POS_OUTSIDE);
+    ri->scope = ri_node_ref_(ri, ri_make_scope_(ri, RI_POS_OUTSIDE));
+
+    RiNode* node;
 
-    ri->node_meta[RiNode_Spec_Type_None].node =
-        ri_make_node_(ri, RI_POS_OUTSIDE, RiNode_Spec_Type_None);
-    ri->node_meta[RiNode_Spec_Type_None].node->spec.id = ri_make_id_(ri, S("none"));
+    node = ri_make_node_(ri, RI_POS_OUTSIDE, RiNode_Spec_Type_None);
+    node->spec.id = ri_make_id_(ri, S("none"));
+    ri->node_meta[RiNode_Spec_Type_None].node = ri_node_ref_(ri, node);
 
-    ri->node_meta[RiNode_Spec_Type_Number_None_Int].node =
-        ri_make_node_(ri, RI_POS_OUTSIDE, RiNode_Spec_Type_Number_None_Int);
-    ri->node_meta[RiNode_Spec_Type_Number_None_Int].node->spec.id = ri_make_id_(ri, S("untyped-int"));
+    node = ri_make_node_(ri, RI_POS_OUTSIDE, RiNode_Spec_Type_Number_None_Int);
+    node->spec.id = ri_make_id_(ri, S("untyped-int"));
+    ri->node_meta[RiNode_Spec_Type_Number_None_Int].node = ri_node_ref_(ri, node);
 
-    ri->node_meta[RiNode_Spec_Type_Number_None_Real].node =
-        ri_make_node_(ri, RI_POS_OUTSIDE, RiNode_Spec_Type_Number_None_Real);
-    ri->node_meta[RiNode_Spec_Type_Number_None_Real].node->spec.id = ri_make_id_(ri, S("untyped-real"));
+    node = ri_make_node_(ri, RI_POS_OUTSIDE, RiNode_Spec_Type_Number_None_Real);
+    node->spec.id = ri_make_id_(ri, S("untyped-real"));
+    ri->node_meta[RiNode_Spec_Type_Number_None_Real].node = ri_node_ref_(ri, node);
 
-    ri->node_meta[RiNode_Spec_Type_Infer].node =
-        ri_make_node_(ri, RI_POS_OUTSIDE, RiNode_Spec_Type_Infer);
-    ri->node_meta[RiNode_Spec_Type_Infer].node->spec.id = ri_make_id_(ri, S("infer"));
+    node = ri_make_node_(ri, RI_POS_OUTSIDE, RiNode_Spec_Type_Infer);
+    node->spec.id = ri_make_id_(ri, S("infer"));
+    ri->node_meta[RiNode_Spec_Type_Infer].node = ri_node_ref_(ri, node);
 
     #define DECL_TYPE(Name, Type) { \
         String name = ri_make_id_(ri, S(Name)); \
@@ -3259,7 +4977,7 @@ ri_init(Ri* ri)
             RiNode_Spec_Type_ ## Type \
         ); \
         ri->node_meta[RiNode_Spec_Type_ ## Type] = (RiNodeMeta){ \
-            .node = spec, \
+            .node = ri_node_ref_(ri, spec), \
         }; \
         ri_scope_set_(ri, ri_make_decl_(ri, spec->pos, spec)); \
     }
@@ -3285,5 +5003,25 @@ ri_purge(Ri* ri)
     // RI_LOG_DEBUG("memory %d bytes", ri->arena.head);
     // RI_LOG_DEBUG("nodes %d", ri->index);
     arena_purge(&ri->arena);
+    // Nodes own no other memory, arrays and tables are in the heap too.
+    ri_node_heap_purge_(&ri->nodes);
     intern_purge(&ri->intern);
+    array_purge(&ri->path);
+    array_purge(&ri->error.message);
+    array_purge(&ri->pending);
+}
+
+void
+ri_nodes_copy(RiNodeHeap* from, RiNodeHeap* to)
+{
+    ri_node_heap_init_(to);
+    // Including the first unit, so handles are the same.
+    to->used = 0;
+    memcpy(ri_node_heap_push_(to, from->used), from->base, from->used);
+}
+
+void
+ri_nodes_purge(RiNodeHeap* heap)
+{
+    ri_node_heap_purge_(heap);
 }
\ No newline at end of file
@@ -14,10 +14,15 @@ typedef struct RiPos RiPos;
 typedef struct RiError RiError;
 typedef struct RiStream RiStream;
 typedef struct RiToken RiToken;
+typedef union RiTokenValue RiTokenValue;
+typedef struct RiTokens RiTokens;
 typedef union RiLiteral RiLiteral;
 typedef struct RiNode RiNode;
+typedef struct RiNodeHeap RiNodeHeap;
 typedef struct RiNodeMeta RiNodeMeta;
 typedef struct RiScope RiScope;
+typedef struct RiScopeTable RiScopeTable;
+typedef struct RiNodeArray RiNodeArray;
 
 typedef enum RiErrorKind RiErrorKind;
 typedef enum RiTokenKind RiTokenKind;
@@ -27,13 +32,15 @@ typedef enum RiTypeCompleteness RiTypeCompleteness;
 typedef enum RiVarKind RiVarKind;
 
 #define RI_INVALID_SLOT (-1)
+// Most outputs of a function, the VM has a slot for each of them (see `RIVM_OUTPUTS_MAX`).
+#define RI_OUTPUTS_MAX 8
 
 //
 //
 //
 
 struct RiPos {
-    iptr row, col;
+    int32_t row, col;
 };
 
 //
@@ -183,12 +190,58 @@ struct RiToken {
     };
 };
 
+union RiTokenValue {
+    // Interned, for identifiers and keywords.
+    const char* id;
+    uint64_t integer;
+    double real;
+};
+
+// Whole source lexed up front by `ri_lex`, one array per token field.
+// Token `i` starts at `source.items + start[i]`, its end is derived from the kind
+// and its position is counted from the previous token when it's read.
+struct RiTokens {
+    String source;
+    Array(uint8_t) kind;
+    Array(uint32_t) start;
+    Array(RiTokenValue) value;
+};
+
 //
 //
 //
 
-typedef Slice(RiNode*) RiNodeSlice;
-typedef ArrayWithSlice(RiNodeSlice) RiNodeArray;
+// 32-bit handle of a node in `RiNodeHeap`, 0 is NULL.
+typedef uint32_t RiNodeRef;
+
+// Nodes are allocated from a single reserved range, so they can be referenced
+// with 32-bit `RiNodeRef` handles (in `RI_NODE_ALIGN` units).
+// Other allocations, like scope tables and node arrays, follow a `RiNode_Unknown` header.
+// Links between nodes are all handles, so the used range can be copied as a whole, and the
+// copy used in place of the original (see `ri_nodes_copy`).
+// NOTE: Ids and literals point to strings interned by `Ri`, which outlive the range.
+struct RiNodeHeap {
+    uint8_t* base;
+    iptr used;
+    iptr committed;
+    iptr reserved;
+};
+
+// Declarations of a scope, keyed by interned id.
+// Up to `RI_SCOPE_TABLE_LINEAR` entries are searched linearly, bigger tables are open-addressing
+// hash tables with power of two capacity. Keys and then values are in `block` of `RiNodeHeap`.
+struct RiScopeTable {
+    RiNodeRef block;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+// Nodes in order, their handles are in `items`, a block of `RiNodeHeap` (see `ri_nodes_push_`).
+struct RiNodeArray {
+    RiNodeRef items;
+    uint32_t count;
+    uint32_t capacity;
+};
 
 //
 //
@@ -282,6 +335,8 @@ enum RiNodeKind
         RiNode_Expr_Call,
         RiNode_Expr_Cast,
         RiNode_Expr_AddrOf,
+        // `a.b`, a field of a struct or of the struct a pointer points to.
+        RiNode_Expr_Field,
 
         RiNode_Expr_Unary_FIRST__,
             // Arithmetic
@@ -348,6 +403,8 @@ enum RiNodeKind
         RiNode_St_Assign_Xor,
     RiNode_St_Assign_LAST__,
 
+    // `a, b = f()`, sets variables to the outputs of a call.
+    RiNode_St_Assign_Outputs,
     RiNode_St_Expr,
     RiNode_St_Return,
     RiNode_St_If,
@@ -362,7 +419,8 @@ enum RiNodeKind
     RiNode_COUNT__
 };
 
-static inline ri_is_in_(RiNodeKind kind, RiNodeKind first, RiNodeKind last) {
+static inline bool
+ri_is_in_(RiNodeKind kind, RiNodeKind first, RiNodeKind last) {
     return (kind > first) && (kind < last);
 }
 
@@ -380,6 +438,8 @@ enum RiVarKind {
     RiVar_Local,
     RiVar_Input,
     RiVar_Output,
+    // Field of a struct.
+    RiVar_Field,
 };
 
 //
@@ -397,54 +457,66 @@ union RiLiteral {
 //
 //
 
+// NOTE: Nodes are allocated only as large as their kind requires (see `ri_node_size_`),
+// so only the union member matching `kind` can be accessed.
 struct RiNode
 {
     RiNodeKind kind;
-    RiNode* owner;
     // TODO: Only used for debug.
     int index;
+    RiNodeRef owner;
     RiPos pos;
+    // Bytes taken in `RiNodeHeap`, so it can be walked.
+    uint32_t size;
     union {
         struct {
             String name;
         } id;
 
         struct {
-            RiNode* scope;
+            RiNodeRef scope;
         } module;
 
         struct {
-            Map map;
+            RiScopeTable table;
+            // Nearest enclosing scope with declarations, 0 until first lookup (see `ri_lookup_`).
+            RiNodeRef lookup_owner;
+            // Declarations owned by the scope, `decl` has room for all of them.
+            uint32_t owned;
             RiNodeArray decl;
             RiNodeArray statements;
         } scope;
 
         struct {
             RiDeclState state;
-            RiNode* spec;
+            RiNodeRef spec;
         } decl;
 
         struct {
             String id;
             union {
                 struct {
-                    RiNode* type;
-                    RiNode* scope;
+                    RiNodeRef type;
+                    RiNodeRef scope;
                     // Used by compiler.
                     // RI_INVALID_SLOT by default.
                     uint32_t slot;
+                    // Declared right after a `//ri:noinline` line, calls to it are never inlined.
+                    bool noinline;
                 } func;
 
                 struct {
-                    RiNode* type;
+                    RiNodeRef type;
                     RiVarKind kind;
                     // Used by compiler.
                     // RI_INVALID_SLOT by default.
                     uint32_t slot;
+                    // Offset in the struct for RiVar_Field, set when the struct is completed.
+                    uint32_t offset;
                 } var;
 
                 struct {
-                    RiNode* type;
+                    RiNodeRef type;
                     RiLiteral value;
                 } constant;
 
@@ -455,11 +527,16 @@ struct RiNode
                         RiNodeArray outputs;
                     } func;
                     struct {
+                        // Declarations of the fields, in order.
                         RiNodeArray fields;
+                        // Laid out like C structs, set when the type is completed.
                         iptr size;
+                        iptr align;
+                        // Pointer to this type, the type of `&a`.
+                        RiNodeRef pointer;
                     } compound;
                     struct {
-                        RiNode* base;
+                        RiNodeRef base;
                     } pointer;
                 } type;
             };
@@ -470,25 +547,36 @@ struct RiNode
         struct {
             // NOTE: Data used by all RiNode_Expr_Binary_* types.
             // NOTE: Data used by all RiNode_St_Assign_* types.
-            RiNode* argument0;
-            RiNode* argument1;
+            RiNodeRef argument0;
+            RiNodeRef argument1;
         } binary;
         struct {
             // NOTE: Data used by all RiNode_Expr_Unary_* types.
-            RiNode* argument;
+            RiNodeRef argument;
         } unary;
+        struct {
+            RiNodeRef argument;
+            // Pointer type of the result, set in resolve.
+            RiNodeRef type;
+        } addr_of;
+        struct {
+            // Struct or pointer to struct.
+            RiNodeRef base;
+            // RiNode_Spec_Var of the field.
+            RiNodeRef spec;
+        } field;
 
         // Expressions
 
         struct {
-            RiNode* func;
+            RiNodeRef func;
             RiNodeArray arguments;
         } call;
 
         // A constant or reference to a spec used in expressions (var, func, type,...)
         struct {
-            RiNode* spec;
-            RiNode* type;
+            RiNodeRef spec;
+            RiNodeRef type;
             // Used for inline constants, otherwise spec is not NULL.
             // All literals are resolved to their final type in resolve phase.
             // For untyped constants, spec == NULL and type == NULL.
@@ -499,40 +587,47 @@ struct RiNode
         // Statements
 
         struct {
-            // TODO: Merge with expr_call member?
-            // NOTE: Can be NULL.
-            RiNode* argument;
+            // One for each output of the function, none for none. A call to a function with
+            // the same outputs returns all of them.
+            RiNodeArray arguments;
+            // Type of the function it returns from.
+            RiNodeRef func_type;
         } st_return;
 
+        struct {
+            RiNodeArray targets;
+            RiNodeRef call;
+        } st_assign_outputs;
+
         struct {
             // NOTE: Can be NULL.
-            RiNode* pre;
+            RiNodeRef pre;
             // NOTE: Can be NULL.
-            RiNode* condition;
+            RiNodeRef condition;
             // NOTE: Has one or two statements referencing scopes.
             // One for `if` block.
             // One for `else` scope or `if`.
-            RiNode* scope;
+            RiNodeRef scope;
         } st_if;
 
         struct {
-            RiNode* pre;
-            RiNode* condition;
-            RiNode* post;
-            RiNode* scope;
+            RiNodeRef pre;
+            RiNodeRef condition;
+            RiNodeRef post;
+            RiNodeRef scope;
         } st_for;
 
         struct {
-            RiNode* pre;
-            RiNode* expr;
-            RiNode* scope;
+            RiNodeRef pre;
+            RiNodeRef expr;
+            RiNodeRef scope;
         } st_switch;
 
         struct {
-            RiNode* expr;
+            RiNodeRef expr;
         } st_switch_case;
 
-        RiNode* st_expr;
+        RiNodeRef st_expr;
     };
 };
 
@@ -541,20 +636,39 @@ struct RiNode
 //
 
 struct RiNodeMeta {
-    RiNode* node;
+    RiNodeRef node;
 };
 
+// Called by `ri_parse` at the start of each top-level statement (`ri->token` is its first token).
+// Returns a declaration to use instead of parsing the statement, whose source has to span `*length`
+// bytes with `*lines` line breaks, or NULL to parse it.
+#define RI_PARSE_REUSE_F(Name) RiNode* Name(void* user, Ri* ri, iptr* length, iptr* lines)
+typedef RI_PARSE_REUSE_F(RiParseReuseF);
+
 struct Ri {
     Arena arena;
+    RiNodeHeap nodes;
     Intern intern;
 
     CharArray path;
     RiError error;
     RiStream stream;
     RiToken token;
-    RiNode* scope;
-    RiNode* module;
-    RiNodeArray pending;
+    // Set while parsing from a token buffer.
+    RiTokens* tokens;
+    iptr tokens_index;
+    // Start, line and row of the last token read from `tokens`.
+    char* tokens_it;
+    char* tokens_line;
+    iptr tokens_row;
+    RiNodeRef scope;
+    RiNodeRef module;
+    Array(RiNodeRef) pending;
+    // While parsing, number of enclosing statements `break` (`for`, `switch`) and `continue` (`for`) can leave.
+    int breakable;
+    int continuable;
+    // While parsing a function body, type of the function.
+    RiNodeRef func_type;
 
 
     int index;
@@ -587,6 +701,15 @@ struct Ri {
     RiNodeMeta node_meta[RiNode_COUNT__];
 
     bool debug_tokens;
+    // `ri_parse` lexes the whole source with `ri_lex` before parsing.
+    bool lex_buffered;
+    // `ri_build` resolves and typechecks function bodies on this many threads (0 and 1 are serial).
+    int threads;
+    // Set while `ri_typecheck` leaves function bodies to `ri_build`'s parallel phase.
+    bool defer_bodies;
+    // Lets incremental builds reuse unchanged declarations (see `RiVmBuild`), NULL otherwise.
+    RiParseReuseF* parse_reuse;
+    void* parse_reuse_user;
 };
 
 //
@@ -596,7 +719,14 @@ struct Ri {
 
 void ri_init(Ri* ri);
 void ri_purge(Ri* ri);
+// Copies the nodes of `from` to a new heap `to`, at another address. Handles stay valid in the
+// copy, so it can be used as `ri->nodes` in place of the original.
+void ri_nodes_copy(RiNodeHeap* from, RiNodeHeap* to);
+void ri_nodes_purge(RiNodeHeap* heap);
 void ri_log(Ri* ri, RiNode* node);
+bool ri_lex(Ri* ri, String stream, RiTokens* out_tokens);
+void ri_tokens_purge(RiTokens* tokens);
 RiNode* ri_parse(Ri* ri, String stream, String path);
+RiNode* ri_parse_tokens(Ri* ri, RiTokens* tokens, String path);
 RiNode* ri_resolve(Ri* ri, RiNode* node);
 RiNode* ri_build(Ri* ri, String stream, String path);
\ No newline at end of file
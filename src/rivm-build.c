@@ -0,0 +1,372 @@
+#include "rivm-build.h"
+
+//
+//
+//
+
+void
+rivm_build_init(RiVmBuild* build, RiVmModule* module, String path)
+{
+    memset(build, 0, sizeof(RiVmBuild));
+    ri_init(&build->ri);
+    rivm_init(&build->compiler, &build->ri);
+    build->module = module;
+    chararray_push(&build->path, path);
+}
+
+void
+rivm_build_purge(RiVmBuild* build)
+{
+    rivm_purge(&build->compiler);
+    ri_purge(&build->ri);
+    map_purge(&build->funcs_map);
+    for (iptr i = 0; i < build->funcs.count; ++i) {
+        array_purge(&array_at(&build->funcs, i).name);
+        array_purge(&array_at(&build->funcs, i).inlined);
+    }
+    array_purge(&build->funcs);
+    array_purge(&build->statements);
+    array_purge(&build->starts);
+    array_purge(&build->path);
+    memset(build, 0, sizeof(RiVmBuild));
+}
+
+//
+//
+//
+
+static RiVmBuildFunc*
+rivm_build_func_(RiVmBuild* build, const char* id)
+{
+    iptr index = map_get(&build->funcs_map, (ValueScalar){ .ptr = (void*)id }).i64;
+    return index ? &array_at(&build->funcs, index - 1) : NULL;
+}
+
+// Size the node heap can grow to before `rivm_build_update` resets `ri`, at least.
+#define RIVM_BUILD_NODES_MIN_ MEGABYTES(1)
+
+// Frees the nodes of all builds so far by starting over with a fresh `ri`, so everything is parsed again.
+// Functions keep their slots.
+static void
+rivm_build_reset_(RiVmBuild* build)
+{
+    Ri* ri = &build->ri;
+    bool debug_tokens = ri->debug_tokens;
+    bool lex_buffered = ri->lex_buffered;
+    int threads = ri->threads;
+    ri_purge(ri);
+    ri_init(ri);
+    ri->debug_tokens = debug_tokens;
+    ri->lex_buffered = lex_buffered;
+    ri->threads = threads;
+
+    // Names were interned by the old `ri`.
+    map_clear(&build->funcs_map);
+    for (iptr i = 0; i < build->funcs.count; ++i) {
+        RiVmBuildFunc* func = &array_at(&build->funcs, i);
+        const char* id = ri_make_id_(ri, func->name.slice).items;
+        map_put(&build->funcs_map, (ValueScalar){ .ptr = (void*)id }, (ValueScalar){ .i64 = i + 1 });
+        func->decl = NULL;
+    }
+    build->ast_module = NULL;
+    build->full = true;
+}
+
+// Top-level function with a body, or NULL.
+static RiNode*
+rivm_build_get_func_(Ri* ri, RiNode* ast_st)
+{
+    RiNode* ast_spec = ast_st->kind == RiNode_Decl ? ri_node_(ri, ast_st->decl.spec) : NULL;
+    if (ast_spec &&
+        ast_spec->kind == RiNode_Spec_Func &&
+        ast_spec->spec.func.scope
+    ) {
+        return ast_spec;
+    }
+    return NULL;
+}
+
+// Reuses the declaration of a function if its source is the same as in the last build.
+static RI_PARSE_REUSE_F(rivm_build_reuse_)
+{
+    RiVmBuild* build = user;
+    char* start = ri->token.start;
+    char* end = ri->stream.end;
+    array_push(&build->starts, start - build->source.items);
+    if (build->full || ri->token.kind != RiToken_Keyword_Func) {
+        return NULL;
+    }
+
+    // Name follows `func`, anything else (like a comment in between) is parsed.
+    iptr line_index = 0;
+    char* line = NULL;
+    char* name = ri_scan_space_(ri->token.end, end, &line_index, &line);
+    char* it = ri_scan_id_(name, end);
+    if (it == name) {
+        return NULL;
+    }
+
+    RiVmBuildFunc* func = rivm_build_func_(build, ri_make_id_r_(ri, name, it).items);
+    if (!func || !func->decl || func->reparse) {
+        return NULL;
+    }
+    // The last statement spans to the end of source, so it has to stay last.
+    if (func->last ? start + func->length != end : start + func->length > end) {
+        return NULL;
+    }
+    if (hash_blob(start, func->length) != func->hash) {
+        return NULL;
+    }
+    // The directive is at the end of the statement before.
+    if (ri_is_after_directive_(ri, start, S("//ri:noinline")) != ri_node_(ri, func->decl->decl.spec)->spec.func.noinline) {
+        return NULL;
+    }
+
+    func->reused = true;
+    *length = func->length;
+    *lines = func->lines;
+    return func->decl;
+}
+
+// Values in the map of changed functions passed to `rivm_build_calls_changed_`.
+#define RIVM_BUILD_CHANGED_SIGNATURE_ 1
+#define RIVM_BUILD_CHANGED_BODY_ 2
+
+// True if `func` calls a function whose signature changed or that was removed, or inlined one that
+// changed in any way.
+static bool
+rivm_build_calls_changed_(RiVmModule* module, RiVmBuildFunc* func, Map* changed)
+{
+    for (iptr i = 0; i < func->inlined.count; ++i) {
+        if (map_get(changed, (ValueScalar){ .u64 = func->inlined.items[i] + 1 }).i32) {
+            return true;
+        }
+    }
+    RiVmInstSlice code = rivm_module_func_code(module, array_at(&module->slot, func->slot));
+    for (iptr i = 0; i < code.count; ++i) {
+        RiVmInst* inst = &code.items[i];
+        if ((inst->op == RiVmOp_Call || inst->op == RiVmOp_TailCall) &&
+            map_get(changed, (ValueScalar){ .u64 = inst->param1.func_slot + 1 }).i32 == RIVM_BUILD_CHANGED_SIGNATURE_
+        ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Hash of the source of a function before its body.
+static uint64_t
+rivm_build_signature_hash_(Ri* ri, char* start, char* end, RiNode* ast_st, RiNode* ast_func)
+{
+    RiNode* ast_body = ri_nodes_at_(ri, &ri_node_(ri, ast_func->spec.func.scope)->scope.statements, 0);
+    char* body = start - ast_st->pos.col;
+    for (int32_t row = ast_st->pos.row; row < ast_body->pos.row; ++row) {
+        body = (char*)memchr(body, '\n', end - body) + 1;
+    }
+    body += ast_body->pos.col;
+    return hash_blob(start, body - start);
+}
+
+static iptr
+rivm_build_count_lines_(char* it, char* end)
+{
+    iptr lines = 0;
+    while ((it = memchr(it, '\n', end - it)) != NULL) {
+        ++lines;
+        ++it;
+    }
+    return lines;
+}
+
+// Parses `source` reusing what it can. Returns NULL on error.
+// Sets `build->full` if a top-level statement other than a function changed.
+static RiNode*
+rivm_build_parse_(RiVmBuild* build, String source)
+{
+    Ri* ri = &build->ri;
+    RiVmModule* module = build->module;
+    build->source = source;
+
+    // 1. Reuse functions with the same source.
+    // 2. Reparse the ones that call a function whose signature changed, or inlined a changed one.
+    // 3. Reparse everything if other statements changed.
+    for (int pass = 0; ; ++pass) {
+        RI_CHECK(pass < 3);
+
+        for (iptr i = 0; i < build->funcs.count; ++i) {
+            RiVmBuildFunc* func = &array_at(&build->funcs, i);
+            func->seen = false;
+            func->reused = false;
+        }
+        array_clear(&build->starts);
+
+        ri->parse_reuse = &rivm_build_reuse_;
+        ri->parse_reuse_user = build;
+        RiNode* ast_scope = ri_parse(ri, source, build->path.slice);
+        ri->parse_reuse = NULL;
+        if (!ast_scope || build->full) {
+            return ast_scope;
+        }
+
+        RiNodeArray* statements = &ast_scope->scope.statements;
+        RI_CHECK(build->starts.count == statements->count);
+        iptr other = 0;
+        for (iptr i = 0; i < statements->count; ++i) {
+            RiNode* ast_st = ri_nodes_at_(ri, statements, i);
+            RiNode* ast_func = rivm_build_get_func_(ri, ast_st);
+            if (!ast_func) {
+                char* start = source.items + array_at(&build->starts, i);
+                char* end = i + 1 < statements->count ? source.items + array_at(&build->starts, i + 1) : source.items + source.count;
+                if (other >= build->statements.count ||
+                    array_at(&build->statements, other) != hash_blob(start, end - start)
+                ) {
+                    build->full = true;
+                }
+                ++other;
+                continue;
+            }
+
+            RiVmBuildFunc* func = rivm_build_func_(build, ast_func->spec.id.items);
+            if (func) {
+                func->seen = true;
+            }
+        }
+        if (other != build->statements.count) {
+            build->full = true;
+        }
+        if (build->full) {
+            rivm_build_reset_(build);
+            continue;
+        }
+
+        // Signatures of reused functions are the same. Parsed ones are compared in `rivm_build_update`,
+        // but their callers have to be known now, to be parsed too. Functions reparsed only for their
+        // callees have the same source.
+        Map changed = {0};
+        for (iptr i = 0; i < statements->count; ++i) {
+            RiNode* ast_st = ri_nodes_at_(ri, statements, i);
+            RiNode* ast_func = rivm_build_get_func_(ri, ast_st);
+            RiVmBuildFunc* func = ast_func ? rivm_build_func_(build, ast_func->spec.id.items) : NULL;
+            if (func && func->decl && !func->reused && !func->reparse) {
+                char* start = source.items + array_at(&build->starts, i);
+                char* end = source.items + source.count;
+                int32_t change = rivm_build_signature_hash_(ri, start, end, ast_st, ast_func) != func->signature_hash
+                    ? RIVM_BUILD_CHANGED_SIGNATURE_
+                    : RIVM_BUILD_CHANGED_BODY_;
+                map_put(&changed, (ValueScalar){ .u64 = func->slot + 1 }, (ValueScalar){ .i32 = change });
+            }
+        }
+        for (iptr i = 0; i < build->funcs.count; ++i) {
+            RiVmBuildFunc* func = &array_at(&build->funcs, i);
+            if (func->decl && !func->seen) {
+                map_put(&changed, (ValueScalar){ .u64 = func->slot + 1 }, (ValueScalar){ .i32 = RIVM_BUILD_CHANGED_SIGNATURE_ });
+            }
+        }
+
+        bool reparse = false;
+        if (changed.count) {
+            for (iptr i = 0; i < build->funcs.count; ++i) {
+                RiVmBuildFunc* func = &array_at(&build->funcs, i);
+                if (func->reused && rivm_build_calls_changed_(module, func, &changed)) {
+                    func->reparse = true;
+                    reparse = true;
+                }
+            }
+        }
+        map_purge(&changed);
+        if (!reparse) {
+            return ast_scope;
+        }
+    }
+}
+
+bool
+rivm_build_update(RiVmBuild* build, String source)
+{
+    Ri* ri = &build->ri;
+    RiVmModule* module = build->module;
+
+    array_purge(&ri->error.message);
+    ri->error = (RiError){0};
+
+    build->full = !build->built;
+    if (build->built && ri->nodes.used > MAXIMUM(2 * build->nodes_used, RIVM_BUILD_NODES_MIN_)) {
+        rivm_build_reset_(build);
+    }
+    RiNode* ast_scope = rivm_build_parse_(build, source);
+    // Reused declarations come resolved, so `ri_build_parallel_` skips them.
+    bool ok = ast_scope && ri_build_parallel_(ri, ast_scope);
+
+    if (ok) {
+        RiNodeArray* statements = &ast_scope->scope.statements;
+        array_clear(&build->compiler.ast_funcs);
+        array_clear(&build->statements);
+        for (iptr i = 0; i < build->funcs.count; ++i) {
+            array_at(&build->funcs, i).seen = false;
+        }
+
+        for (iptr i = 0; i < statements->count; ++i) {
+            RiNode* ast_st = ri_nodes_at_(ri, statements, i);
+            char* start = source.items + array_at(&build->starts, i);
+            char* end = i + 1 < statements->count ? source.items + array_at(&build->starts, i + 1) : source.items + source.count;
+            uint64_t hash = hash_blob(start, end - start);
+
+            RiNode* ast_func = rivm_build_get_func_(ri, ast_st);
+            if (!ast_func) {
+                array_push(&build->statements, hash);
+                continue;
+            }
+
+            const char* id = ast_func->spec.id.items;
+            RiVmBuildFunc* func = rivm_build_func_(build, id);
+            if (!func) {
+                array_push(&build->funcs, (RiVmBuildFunc){
+                    .slot = rivm_module_push_slot(module),
+                });
+                map_put(&build->funcs_map, (ValueScalar){ .ptr = (void*)id }, (ValueScalar){ .i64 = build->funcs.count });
+                func = &array_at(&build->funcs, build->funcs.count - 1);
+                chararray_push(&func->name, ast_func->spec.id);
+            }
+
+            if (!func->reused) {
+                func->signature_hash = rivm_build_signature_hash_(ri, start, end, ast_st, ast_func);
+                ast_func->spec.func.slot = func->slot;
+                array_push(&build->compiler.ast_funcs, ast_func);
+            }
+            func->hash = hash;
+            func->length = end - start;
+            func->lines = rivm_build_count_lines_(start, end);
+            func->last = i + 1 == statements->count;
+            func->decl = ast_st;
+            func->seen = true;
+        }
+
+        rivm_compile_funcs_(&build->compiler, module);
+        build->compiled_count = build->compiler.ast_funcs.count;
+        for (iptr i = 0; i < build->compiler.ast_funcs.count; ++i) {
+            RiVmBuildFunc* func = rivm_build_func_(build, array_at(&build->compiler.ast_funcs, i)->spec.id.items);
+            RiVmSlotIndexArray* inlined = &array_at(&build->compiler.inlined, i);
+            array_clear(&func->inlined);
+            memcpy(array_push_n(&func->inlined, inlined->count), inlined->items, inlined->count * sizeof(uint32_t));
+        }
+        rivm_module_reclaim(module);
+
+        build->ast_module = ri_make_node_(ri, (RiPos){0}, RiNode_Module);
+        build->ast_module->module.scope = ri_node_ref_(ri, ast_scope);
+        build->built = true;
+        if (build->full) {
+            build->nodes_used = ri->nodes.used;
+        }
+    }
+
+    for (iptr i = 0; i < build->funcs.count; ++i) {
+        RiVmBuildFunc* func = &array_at(&build->funcs, i);
+        if (ok && !func->seen) {
+            func->decl = NULL;
+        }
+        func->reparse = false;
+    }
+    build->source = (String){0};
+
+    return ok;
+}
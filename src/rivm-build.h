@@ -0,0 +1,76 @@
+#pragma once
+
+#include "rivm-compiler.h"
+
+typedef struct RiVmBuild RiVmBuild;
+typedef struct RiVmBuildFunc RiVmBuildFunc;
+
+//
+//
+//
+
+// Top-level function of the last successful build.
+struct RiVmBuildFunc
+{
+    // Kept to find the function again once `ri` is reset.
+    CharArray name;
+    // Source of the declaration, up to the next top-level statement.
+    uint64_t hash;
+    iptr length;
+    iptr lines;
+    bool last;
+    // Hash of the source before the body.
+    uint64_t signature_hash;
+    // NULL if the function was removed, the slot is kept in case it comes back.
+    RiNode* decl;
+    uint32_t slot;
+    // Slots of the functions inlined into it.
+    RiVmSlotIndexArray inlined;
+
+    // Used by `rivm_build_update`.
+    bool seen;
+    bool reused;
+    bool reparse;
+};
+
+// Keeps `module` up to date with a changing source.
+// Functions whose source didn't change are neither parsed nor resolved, typechecked or compiled
+// again, unless they call a function whose signature changed or inlined one that changed at all.
+// A change in any other top-level
+// statement (types, globals) rebuilds everything.
+// Slots of functions in `module` never change, so calls from unchanged functions run the new code.
+// Changed functions are compiled aside and then replaced, so other threads can run the module
+// with `rivm_exec_module` during an update.
+// NOTE: Reused declarations keep positions from the source they were parsed from.
+struct RiVmBuild
+{
+    Ri ri;
+    RiVmCompiler compiler;
+    RiVmModule* module;
+    CharArray path;
+    RiNode* ast_module;
+
+    // Interned function name to index + 1 in `funcs`.
+    Map funcs_map;
+    Array(RiVmBuildFunc) funcs;
+    // Hashes of the other top-level statements, in order.
+    Array(uint64_t) statements;
+    bool built;
+
+    // Source being parsed, and offsets of its top-level statements.
+    String source;
+    IPtrArray starts;
+    // Set while nothing is reused.
+    bool full;
+    // Size of the node heap after the last full build, replaced declarations stay in it until `ri`
+    // is reset.
+    iptr nodes_used;
+
+    // Number of functions compiled by the last update.
+    iptr compiled_count;
+};
+
+void rivm_build_init(RiVmBuild* build, RiVmModule* module, String path);
+void rivm_build_purge(RiVmBuild* build);
+// On error returns false and leaves the module as it was, `build->ri.error` has the error.
+bool rivm_build_update(RiVmBuild* build, String source);
@@ -29,6 +29,14 @@ RiVmOp RIVM_TO_OP_[RiNode_COUNT__] = {
     [RiNode_Expr_Binary_Comparison_GtEq] = RiVmOp_Binary_Comparison_GtEq,
     [RiNode_Expr_Binary_Comparison_Eq] = RiVmOp_Binary_Comparison_Eq,
     [RiNode_Expr_Binary_Comparison_NotEq] = RiVmOp_Binary_Comparison_NotEq,
+    [RiNode_St_Assign_Add] = RiVmOp_Binary_Add,
+    [RiNode_St_Assign_Sub] = RiVmOp_Binary_Sub,
+    [RiNode_St_Assign_Mul] = RiVmOp_Binary_Mul,
+    [RiNode_St_Assign_Div] = RiVmOp_Binary_Div,
+    [RiNode_St_Assign_Mod] = RiVmOp_Binary_Mod,
+    [RiNode_St_Assign_And] = RiVmOp_Binary_BAnd,
+    [RiNode_St_Assign_Or] = RiVmOp_Binary_BOr,
+    [RiNode_St_Assign_Xor] = RiVmOp_Binary_BXor,
 };
 
 //
@@ -45,8 +53,22 @@ rivm_init(RiVmCompiler* compiler, Ri* ri)
 void
 rivm_purge(RiVmCompiler* compiler)
 {
-    array_purge(&compiler->slot_pool);
-    array_purge(&compiler->labels);
+    for (int i = 0; i < compiler->funcs_count; ++i) {
+        RiVmFuncCompiler* func_compiler = &compiler->funcs[i];
+        arena_purge(&func_compiler->arena);
+        arena_purge(&func_compiler->done);
+        map_purge(&func_compiler->vars);
+        for (int j = 0; j < RIVM_INLINE_DEPTH_MAX; ++j) {
+            map_purge(&func_compiler->inline_vars[j]);
+        }
+    }
+    heap_free(compiler->funcs);
+    array_purge(&compiler->ast_funcs);
+    array_purge(&compiler->code);
+    for (iptr i = 0; i < compiler->inlined.count; ++i) {
+        array_purge(&compiler->inlined.items[i]);
+    }
+    array_purge(&compiler->inlined);
     memset(compiler, 0, sizeof(RiVmCompiler));
 }
 
@@ -55,14 +77,21 @@ rivm_purge(RiVmCompiler* compiler)
 //
 
 uint32_t
-rivm_code_emit_(RiVmInstArray* code, const RiVmInst inst)
+rivm_code_emit_(RiVmFuncCompiler* compiler, const RiVmInst inst)
 {
+    RiVmInstArray* code = &compiler->code;
     RI_CHECK(inst.param0.type >= RiVmValue_None);
     RI_CHECK(inst.param0.type < RiVmValue_COUNT__);
     RI_CHECK(inst.param1.type >= RiVmValue_None);
     RI_CHECK(inst.param1.type < RiVmValue_COUNT__);
 
-    if (rivm_op_is_in(inst.op, Binary))
+    if (rivm_op_is_in(inst.op, Unary))
+    {
+        RI_CHECK(inst.param0.type);
+        RI_CHECK(inst.param1.type);
+        RI_CHECK(inst.param2.type == RiVmValue_None);
+    }
+    else if (rivm_op_is_in(inst.op, Binary))
     {
         RI_CHECK(inst.param1.type);
         RI_CHECK(inst.param2.type);
@@ -83,17 +112,54 @@ rivm_code_emit_(RiVmInstArray* code, const RiVmInst inst)
                 RI_CHECK(inst.param2.type == RiVmValue_None);
                 break;
 
+            case RiVmOp_Output:
+                RI_CHECK(inst.param0.kind == RiVmParam_Imm);
+                RI_CHECK(inst.param1.type);
+                break;
+
             case RiVmOp_Assign:
-            case RiVmOp_Store:
-            case RiVmOp_Load:
-                // TODO: Load/Store target to be 64-bit Unsigned.
                 RI_CHECK(inst.param0.type);
                 RI_CHECK(inst.param1.type);
                 break;
 
             case RiVmOp_AddrOf:
+                RI_CHECK(inst.param0.kind == RiVmParam_Slot);
+                RI_CHECK(inst.param0.type == RiVmValue_U64);
+                RI_CHECK(inst.param1.kind == RiVmParam_Slot);
+                break;
+
+            // Addresses are 64-bit unsigned values in slots, offsets and sizes are immediate.
+            case RiVmOp_Load_I8:
+            case RiVmOp_Load_U8:
+            case RiVmOp_Load_I16:
+            case RiVmOp_Load_U16:
+            case RiVmOp_Load_32:
+            case RiVmOp_Load_64:
+                RI_CHECK(inst.param0.kind == RiVmParam_Slot);
+                RI_CHECK(inst.param1.kind == RiVmParam_Slot);
+                RI_CHECK(inst.param1.type == RiVmValue_U64);
+                RI_CHECK(inst.param2.kind == RiVmParam_Imm);
+                break;
+
+            case RiVmOp_Store_8:
+            case RiVmOp_Store_16:
+            case RiVmOp_Store_32:
+            case RiVmOp_Store_64:
+                RI_CHECK(inst.param0.kind == RiVmParam_Slot);
+                RI_CHECK(inst.param0.type == RiVmValue_U64);
+                RI_CHECK(inst.param1.kind == RiVmParam_Imm);
+                RI_CHECK(inst.param2.type);
+                break;
+
+            case RiVmOp_MemCopy:
                 RI_CHECK(inst.param0.kind == RiVmParam_Slot);
                 RI_CHECK(inst.param1.kind == RiVmParam_Slot);
+                RI_CHECK(inst.param2.kind == RiVmParam_Imm);
+                break;
+
+            case RiVmOp_MemZero:
+                RI_CHECK(inst.param0.kind == RiVmParam_Slot);
+                RI_CHECK(inst.param1.kind == RiVmParam_Imm);
                 break;
 
             case RiVmOp_If:
@@ -102,6 +168,12 @@ rivm_code_emit_(RiVmInstArray* code, const RiVmInst inst)
                 RI_CHECK(inst.param2.kind == RiVmParam_Label);
                 break;
 
+            case RiVmOp_Switch:
+                RI_CHECK(inst.param0.type);
+                RI_CHECK(inst.param1.kind == RiVmParam_Imm);
+                RI_CHECK(inst.param2.kind == RiVmParam_Imm);
+                break;
+
             case RiVmOp_GoTo:
                 RI_CHECK(inst.param0.kind == RiVmParam_Label);
                 break;
@@ -115,6 +187,13 @@ rivm_code_emit_(RiVmInstArray* code, const RiVmInst inst)
                 RI_CHECK(inst.param0.kind == RiVmParam_Slot);
                 RI_CHECK(inst.param1.kind == RiVmParam_Func);
                 RI_CHECK(inst.param1.func != 0);
+                RI_CHECK(inst.param2.kind == RiVmParam_None || inst.param2.kind == RiVmParam_Slot);
+                break;
+
+            case RiVmOp_TailCall:
+                RI_CHECK(inst.param0.kind == RiVmParam_Imm);
+                RI_CHECK(inst.param1.kind == RiVmParam_Func);
+                RI_CHECK(inst.param1.func != 0);
                 break;
 
             case RiVmOp_ArgPush:
@@ -131,12 +210,12 @@ rivm_code_emit_(RiVmInstArray* code, const RiVmInst inst)
         }
     }
 
-    array_push(code, inst);
+    arena_array_push(&compiler->done, code, inst);
     return (uint32_t)(code->count - 1);
 }
 
-#define rivm_code_emit(RiVmInstArray, Op, ...) \
-    rivm_code_emit_(RiVmInstArray, (RiVmInst){ \
+#define rivm_code_emit(RiVmFuncCompiler, Op, ...) \
+    rivm_code_emit_(RiVmFuncCompiler, (RiVmInst){ \
         .op = RiVmOp_ ## Op, \
         __VA_ARGS__ \
     })
@@ -146,66 +225,9 @@ rivm_code_emit_(RiVmInstArray* code, const RiVmInst inst)
 //
 
 static RiVmParam
-rivm_acquire_slot_(RiVmCompiler* compiler, RiVmParamSlotKind kind, RiVmValueType type)
+rivm_create_label_(RiVmFuncCompiler* compiler)
 {
-    uint32_t index;
-    if (compiler->slot_pool.count) {
-        index = array_at(&compiler->slot_pool, 0);
-        array_remove(&compiler->slot_pool, 0, 1);
-    } else {
-        index = compiler->slot_next;
-        compiler->slot_next++;
-    }
-
-    RiVmParam param = (RiVmParam) {
-        .kind = RiVmParam_Slot,
-        .type = type,
-        .slot.kind = kind,
-        .slot.index = index,
-    };
-
-    if (compiler->slot.count <= index) {
-        array_resize(&compiler->slot, index + 1);
-    }
-    array_at(&compiler->slot, index) = param;
-
-    // RI_LOG_DEBUG("allocating %s slot %d of type %s",
-    //     RIVM_DEBUG_SOURCE_NAMES_[kind],
-    //     index,
-    //     RIVM_DEBUG_TYPE_NAMES_[type]
-    // );
-
-    return param;
-}
-
-static void
-rivm_release_slot_(RiVmCompiler* compiler, RiVmParam param)
-{
-    if (param.kind == RiVmParam_Slot) {
-        if (param.slot.kind == RiSlot_Temporary) {
-            RI_ASSERT(param.slot.index >= 0);
-            param.kind = RiVmParam_None;
-            array_push(&compiler->slot_pool, param.slot.index);
-        }
-    } else {
-        RI_ASSERT(param.kind == RiVmParam_Imm);
-    }
-}
-
-static RiVmParam
-rivm_get_slot_param_(RiVmCompiler* compiler, uint32_t index)
-{
-    return array_at(&compiler->slot, index);
-}
-
-//
-//
-//
-
-static RiVmParam
-rivm_create_label_(RiVmCompiler* compiler)
-{
-    array_push(&compiler->labels, -1);
+    arena_array_push(&compiler->arena, &compiler->labels, -1);
     return (RiVmParam) {
         .kind = RiVmParam_Label,
         .label = compiler->labels.count
@@ -213,7 +235,7 @@ rivm_create_label_(RiVmCompiler* compiler)
 }
 
 static void
-rivm_mark_label_(RiVmCompiler* compiler, RiVmParam param)
+rivm_mark_label_(RiVmFuncCompiler* compiler, RiVmParam param)
 {
     RI_ASSERT(param.kind == RiVmParam_Label);
     RI_ASSERT(param.label > 0);
@@ -225,7 +247,7 @@ rivm_mark_label_(RiVmCompiler* compiler, RiVmParam param)
 //
 
 static RiVmValueType
-rivm_get_type_(RiVmCompiler* compiler, RiNode* ast_spec_type)
+rivm_get_type_(RiVmFuncCompiler* compiler, RiNode* ast_spec_type)
 {
     RI_ASSERT(ast_spec_type);
     RI_ASSERT(ri_is_in(ast_spec_type->kind, RiNode_Spec_Type));
@@ -233,10 +255,27 @@ rivm_get_type_(RiVmCompiler* compiler, RiNode* ast_spec_type)
     {
         case RiNode_Spec_Type_Number_Bool:
             return RiVmValue_U32;
+        case RiNode_Spec_Type_Number_Int8:
+        case RiNode_Spec_Type_Number_Int16:
         case RiNode_Spec_Type_Number_Int32:
             return RiVmValue_I32;
         case RiNode_Spec_Type_Number_Int64:
             return RiVmValue_I64;
+        case RiNode_Spec_Type_Number_UInt8:
+        case RiNode_Spec_Type_Number_UInt16:
+        case RiNode_Spec_Type_Number_UInt32:
+            return RiVmValue_U32;
+        case RiNode_Spec_Type_Number_UInt64:
+            return RiVmValue_U64;
+        case RiNode_Spec_Type_Number_Float32:
+            return RiVmValue_F32;
+        case RiNode_Spec_Type_Number_Float64:
+            return RiVmValue_F64;
+        // A struct variable is the address of the struct.
+        case RiNode_Spec_Type_Struct:
+        case RiNode_Spec_Type_Pointer:
+            return RiVmValue_U64;
+        default: break;
     }
     RI_UNREACHABLE;
     return RiVmValue_None;
@@ -244,324 +283,2005 @@ rivm_get_type_(RiVmCompiler* compiler, RiNode* ast_spec_type)
 
 
 static RiVmValueType
-rivm_get_type_from_expr_(RiVmCompiler* compiler, RiNode* ast_expr)
+rivm_get_type_from_expr_(RiVmFuncCompiler* compiler, RiNode* ast_expr)
 {
     RiNode* ast_type = ri_retof_(compiler->ri, ast_expr);
     return rivm_get_type_(compiler, ast_type);
 }
 
-static RiVmParam
-rivm_get_param_(RiVmCompiler* compiler, RiNode* ast_var)
+// Type of output `index` of the function `ast_func`.
+static RiVmValueType
+rivm_get_output_type_(RiVmFuncCompiler* compiler, RiNode* ast_func, iptr index)
 {
-    RI_ASSERT(ast_var->kind == RiNode_Value_Var);
-    RiNode* ast_spec = ast_var->value.spec;
-    RiVmValueType type = rivm_get_type_from_expr_(compiler, ast_var);
-    if (ast_spec->spec.var.slot == RI_INVALID_SLOT) {
-        RiVmParam param = rivm_acquire_slot_(
-            compiler, RiSlot_Local, type);
-        ast_spec->spec.var.slot = param.slot.index;
-        return param;
-    }
+    Ri* ri = compiler->ri;
+    RiNode* ast_output = ri_nodes_at_(ri, &ri_node_(ri, ast_func->spec.func.type)->spec.type.func.outputs, index);
+    return rivm_get_type_(compiler, ri_get_spec_(ri, ri_node_(ri, ast_output->decl.spec)->spec.var.type));
+}
 
-    return rivm_get_slot_param_(compiler, ast_spec->spec.var.slot);
+static iptr
+rivm_outputs_count_(Ri* ri, RiNode* ast_func)
+{
+    return ri_node_(ri, ast_func->spec.func.type)->spec.type.func.outputs.count;
 }
 
-static RiVmParam
-rivm_get_param_for_output_(RiVmCompiler* compiler, int output_index)
+// IR variable of the AST variable `ast_spec`.
+static uint32_t
+rivm_get_var_(RiVmFuncCompiler* compiler, RiNode* ast_spec, RiVmValueType type)
 {
-    RiNode* ast_func_type = compiler->ast_func->spec.func.type;
-    RiNode* output = array_at(&ast_func_type->spec.type.func.outputs, output_index);
-    return rivm_get_slot_param_(compiler, output->decl.spec->spec.var.slot);
+    ValueScalar key = { .ptr = ast_spec };
+    uint64_t var = map_get(&compiler->vars, key).u64;
+    if (var == 0) {
+        var = rivm_ir_var(&compiler->ir, type) + 1;
+        map_put(&compiler->vars, key, (ValueScalar){ .u64 = var });
+    }
+    return (uint32_t)(var - 1);
 }
 
 //
 //
 //
 
-// static void
-// rivm_compile_st_(RiVmCompiler* compiler, RiNode* ast_st)
-// {
-//     switch (ast_st->kind)
-//     {
-//     }
-// }
+static void rivm_compile_condition_(RiVmFuncCompiler* compiler, RiNode* ast_expr, uint32_t block_true, uint32_t block_false);
+static uint32_t rivm_compile_call_(RiVmFuncCompiler* compiler, RiNode* ast_call, bool tail);
+static bool rivm_can_inline_(RiVmFuncCompiler* compiler, RiNode* ast_callee);
+static uint32_t rivm_compile_inline_(RiVmFuncCompiler* compiler, RiNode* ast_callee, uint32_t* args, RiVmValueType type, bool tail);
 
-static RiVmParam
-rivm_compile_expr_(RiVmCompiler* compiler, RiNode* ast_expr)
+static bool
+rivm_is_float_(RiVmValueType type)
+{
+    return type == RiVmValue_F32 || type == RiVmValue_F64;
+}
+
+// Integer `+`, `-` and `*` trap on overflow when the module is compiled `checked`.
+static RiVmOp
+rivm_arithmetic_op_(RiVmFuncCompiler* compiler, RiVmOp op, RiVmValueType type)
+{
+    if (compiler->checked && !rivm_is_float_(type)) {
+        switch (op)
+        {
+            case RiVmOp_Binary_Add: return RiVmOp_Binary_Checked_Add;
+            case RiVmOp_Binary_Sub: return RiVmOp_Binary_Checked_Sub;
+            case RiVmOp_Binary_Mul: return RiVmOp_Binary_Checked_Mul;
+            default: break;
+        }
+    }
+    return op;
+}
+
+// Op converting `from` to `to`, `RiVmOp_None` if they're the same.
+static RiVmOp
+rivm_convert_op_(RiVmValueType from, RiVmValueType to)
+{
+    if (from == to) {
+        return RiVmOp_None;
+    }
+    if (rivm_is_float_(from)) {
+        return rivm_is_float_(to) ? RiVmOp_Unary_Convert_Float : RiVmOp_Unary_Convert_FloatToInt;
+    }
+    return rivm_is_float_(to) ? RiVmOp_Unary_Convert_IntToFloat : RiVmOp_Unary_Convert_Int;
+}
+
+// Op wrapping values to the range of `ast_type`, `RiVmOp_None` if it isn't a narrow integer.
+static RiVmOp
+rivm_narrow_op_(RiNode* ast_type)
+{
+    switch (ast_type->kind)
+    {
+        case RiNode_Spec_Type_Number_Int8: return RiVmOp_Unary_Convert_Narrow_I8;
+        case RiNode_Spec_Type_Number_Int16: return RiVmOp_Unary_Convert_Narrow_I16;
+        case RiNode_Spec_Type_Number_UInt8: return RiVmOp_Unary_Convert_Narrow_U8;
+        case RiNode_Spec_Type_Number_UInt16: return RiVmOp_Unary_Convert_Narrow_U16;
+        default: break;
+    }
+    return RiVmOp_None;
+}
+
+// Op wrapping like `narrow`, which traps if the value was out of range.
+static RiVmOp
+rivm_narrow_checked_op_(RiVmOp narrow)
+{
+    switch (narrow)
+    {
+        case RiVmOp_Unary_Convert_Narrow_I8: return RiVmOp_Unary_Checked_Narrow_I8;
+        case RiVmOp_Unary_Convert_Narrow_I16: return RiVmOp_Unary_Checked_Narrow_I16;
+        case RiVmOp_Unary_Convert_Narrow_U8: return RiVmOp_Unary_Checked_Narrow_U8;
+        case RiVmOp_Unary_Convert_Narrow_U16: return RiVmOp_Unary_Checked_Narrow_U16;
+        default: break;
+    }
+    RI_UNREACHABLE;
+    return RiVmOp_None;
+}
+
+// Whether the result of `op` on values in range of a narrow integer can be out of its range.
+static bool
+rivm_narrow_wraps_(RiVmOp op, RiVmValueType type)
+{
+    switch (op)
+    {
+        case RiVmOp_Binary_Add:
+        case RiVmOp_Binary_Sub:
+        case RiVmOp_Binary_Mul:
+        case RiVmOp_Binary_BShL:
+            return true;
+        // The lowest signed integer divided by -1.
+        case RiVmOp_Binary_Div:
+            return type == RiVmValue_I32;
+        default: break;
+    }
+    return false;
+}
+
+static int
+rivm_int_bits_(RiNodeKind kind)
+{
+    switch (kind)
+    {
+        case RiNode_Spec_Type_Number_Int8:
+        case RiNode_Spec_Type_Number_UInt8:
+            return 8;
+        case RiNode_Spec_Type_Number_Int16:
+        case RiNode_Spec_Type_Number_UInt16:
+            return 16;
+        case RiNode_Spec_Type_Number_Int32:
+        case RiNode_Spec_Type_Number_UInt32:
+            return 32;
+        case RiNode_Spec_Type_Number_Int64:
+        case RiNode_Spec_Type_Number_UInt64:
+            return 64;
+        default: break;
+    }
+    RI_UNREACHABLE;
+    return 0;
+}
+
+// Whether every value of `ast_from` is a value of the integer `ast_to` too.
+static bool
+rivm_int_fits_(RiNode* ast_from, RiNode* ast_to)
+{
+    if (ast_from->kind == RiNode_Spec_Type_Number_Bool) {
+        return true;
+    }
+    if (!ri_is_in(ast_from->kind, RiNode_Spec_Type_Number_Int)) {
+        return false;
+    }
+    int from_bits = rivm_int_bits_(ast_from->kind);
+    int to_bits = rivm_int_bits_(ast_to->kind);
+    bool from_signed = ri_is_in(ast_from->kind, RiNode_Spec_Type_Number_Int_Signed);
+    bool to_signed = ri_is_in(ast_to->kind, RiNode_Spec_Type_Number_Int_Signed);
+    if (from_signed == to_signed) {
+        return from_bits <= to_bits;
+    }
+    return !from_signed && from_bits < to_bits;
+}
+
+// Wraps `value` to the range of `ast_type` if it's a narrow integer.
+static uint32_t
+rivm_compile_narrow_(RiVmFuncCompiler* compiler, RiNode* ast_type, uint32_t value)
+{
+    RiVmIrFunc* func = &compiler->ir;
+    RiVmOp op = rivm_narrow_op_(ast_type);
+    if (!op) {
+        return value;
+    }
+    RiVmValueType type = rivm_get_type_(compiler, ast_type);
+    RiVmIrInst* inst = rivm_ir_inst(func, value);
+    if (inst->op == RiVmIr_Const) {
+        return rivm_ir_const(func, type, rivm_narrow(op, inst->imm));
+    }
+    return rivm_ir_unary(func, compiler->block, op, type, value);
+}
+
+// Result of `op` on narrow integers of `ast_type`, computed in 32 bits, back in their range. Checked
+// `+`, `-` and `*` trap if it was out of it, and so does the lowest signed integer divided by -1.
+// Otherwise it wraps, unless it's `stored`, which keeps only its low bytes anyway.
+static uint32_t
+rivm_compile_narrow_result_(RiVmFuncCompiler* compiler, RiVmOp op, RiNode* ast_type, uint32_t result, bool stored)
+{
+    RiVmOp narrow = rivm_narrow_op_(ast_type);
+    RiVmValueType type = rivm_get_type_(compiler, ast_type);
+    if (!narrow || !rivm_narrow_wraps_(op, type)) {
+        return result;
+    }
+    if (op == RiVmOp_Binary_Div || (compiler->checked && op != RiVmOp_Binary_BShL)) {
+        return rivm_ir_unary(&compiler->ir, compiler->block, rivm_narrow_checked_op_(narrow), type, result);
+    }
+    return stored ? result : rivm_compile_narrow_(compiler, ast_type, result);
+}
+
+// Shift count of narrow integers of `ast_type`, taken modulo their width.
+static uint32_t
+rivm_compile_shift_count_(RiVmFuncCompiler* compiler, RiNode* ast_type, uint32_t count)
+{
+    if (!rivm_narrow_op_(ast_type)) {
+        return count;
+    }
+    RiVmIrFunc* func = &compiler->ir;
+    RiVmIrInst* inst = rivm_ir_inst(func, count);
+    RiVmValueType type = inst->type;
+    RiVmValue mask = { .u64 = rivm_int_bits_(ast_type->kind) - 1 };
+    if (inst->op == RiVmIr_Const) {
+        return rivm_ir_const(func, type, (RiVmValue){ .u64 = inst->imm.u64 & mask.u64 });
+    }
+    return rivm_ir_binary(func, compiler->block, RiVmOp_Binary_BAnd, type, count, rivm_ir_const(func, type, mask));
+}
+
+// Op loading a field of `ast_type`, 8 and 16-bit integers are extended by their sign.
+static RiVmOp
+rivm_load_op_(RiNode* ast_type)
+{
+    switch (ast_type->kind)
+    {
+        case RiNode_Spec_Type_Number_Int8: return RiVmOp_Load_I8;
+        case RiNode_Spec_Type_Number_Bool:
+        case RiNode_Spec_Type_Number_UInt8: return RiVmOp_Load_U8;
+        case RiNode_Spec_Type_Number_Int16: return RiVmOp_Load_I16;
+        case RiNode_Spec_Type_Number_UInt16: return RiVmOp_Load_U16;
+        case RiNode_Spec_Type_Number_Int32:
+        case RiNode_Spec_Type_Number_UInt32:
+        case RiNode_Spec_Type_Number_Float32: return RiVmOp_Load_32;
+        default: break;
+    }
+    return RiVmOp_Load_64;
+}
+
+// Op storing a field of `ast_type`. It keeps the low bits, which wraps 8 and 16-bit integers.
+static RiVmOp
+rivm_store_op_(RiNode* ast_type)
+{
+    switch (rivm_load_op_(ast_type))
+    {
+        case RiVmOp_Load_I8:
+        case RiVmOp_Load_U8: return RiVmOp_Store_8;
+        case RiVmOp_Load_I16:
+        case RiVmOp_Load_U16: return RiVmOp_Store_16;
+        case RiVmOp_Load_32: return RiVmOp_Store_32;
+        default: break;
+    }
+    return RiVmOp_Store_64;
+}
+
+static uint32_t
+rivm_compile_offset_(RiVmFuncCompiler* compiler, uint32_t address, uint32_t offset)
+{
+    if (offset == 0) {
+        return address;
+    }
+    uint32_t constant = rivm_ir_const(&compiler->ir, RiVmValue_U64, (RiVmValue){ .u64 = offset });
+    return rivm_ir_binary(&compiler->ir, compiler->block, RiVmOp_Binary_Add, RiVmValue_U64, address, constant);
+}
+
+static uint32_t rivm_compile_expr_(RiVmFuncCompiler* compiler, RiNode* ast_expr);
+
+// Address of the struct `ast_expr` is a field of, and its offset in `offset`. Fields of struct
+// fields add up to one offset from the outermost struct, only pointers are followed.
+static uint32_t
+rivm_compile_place_(RiVmFuncCompiler* compiler, RiNode* ast_expr, uint32_t* offset)
+{
+    RI_ASSERT(ast_expr->kind == RiNode_Expr_Field);
+    RiNode* ast_base = ri_node_(compiler->ri, ast_expr->field.base);
+    uint32_t address;
+    if (ast_base->kind == RiNode_Expr_Field && ri_retof_(compiler->ri, ast_base)->kind == RiNode_Spec_Type_Struct) {
+        address = rivm_compile_place_(compiler, ast_base, offset);
+    } else {
+        // A struct variable or a pointer.
+        address = rivm_compile_expr_(compiler, ast_base);
+        *offset = 0;
+    }
+    *offset += ri_node_(compiler->ri, ast_expr->field.spec)->spec.var.offset;
+    return address;
+}
+
+static bool
+rivm_is_logical_(RiNode* ast_expr)
+{
+    return (
+        ast_expr->kind == RiNode_Expr_Binary_Numeric_Boolean_And ||
+        ast_expr->kind == RiNode_Expr_Binary_Numeric_Boolean_Or ||
+        ast_expr->kind == RiNode_Expr_Unary_Not
+    );
+}
+
+static uint32_t
+rivm_compile_expr_(RiVmFuncCompiler* compiler, RiNode* ast_expr)
 {
     RI_ASSERT(
         ri_is_in(ast_expr->kind, RiNode_Expr) ||
         ast_expr->kind == RiNode_Value_Var ||
         ast_expr->kind == RiNode_Value_Const
     );
-
-    if (ri_is_in(ast_expr->kind, RiNode_Expr_Binary)) {
-        RiNode* a0 = ast_expr->binary.argument0;
-        RiNode* a1 = ast_expr->binary.argument1;
-        RiVmParam result = rivm_acquire_slot_(compiler,
-            RiSlot_Temporary,
-            ri_is_in(ast_expr->kind, RiNode_Expr_Binary_Comparison)
-                ? RiVmValue_I32
-                : rivm_get_type_from_expr_(compiler, a0)
-        );
-        RiVmParam p0 = rivm_compile_expr_(compiler, a0);
-        RiVmParam p1 = rivm_compile_expr_(compiler, a1);
+    RiVmIrFunc* func = &compiler->ir;
+
+    if (rivm_is_logical_(ast_expr)) {
+        // Used as a value, the branches of the condition set it to 1 or 0.
+        RiVmValueType type = rivm_get_type_from_expr_(compiler, ast_expr);
+        uint32_t block_true = rivm_ir_block(func);
+        uint32_t block_false = rivm_ir_block(func);
+        uint32_t block_end = rivm_ir_block(func);
+        rivm_compile_condition_(compiler, ast_expr, block_true, block_false);
+        rivm_ir_seal(func, block_true);
+        rivm_ir_seal(func, block_false);
+
+        uint32_t var = rivm_ir_var(func, type);
+        rivm_ir_write_var(func, var, block_true, rivm_ir_const(func, type, (RiVmValue){ .u64 = 1 }));
+        rivm_ir_jump(func, block_true, block_end);
+        rivm_ir_write_var(func, var, block_false, rivm_ir_const(func, type, (RiVmValue){ .u64 = 0 }));
+        rivm_ir_jump(func, block_false, block_end);
+        rivm_ir_seal(func, block_end);
+        compiler->block = block_end;
+        return rivm_ir_read_var(func, var, block_end);
+    } else if (ri_is_in(ast_expr->kind, RiNode_Expr_Binary)) {
+        RiNode* a0 = ri_node_(compiler->ri, ast_expr->binary.argument0);
+        RiNode* a1 = ri_node_(compiler->ri, ast_expr->binary.argument1);
+        // Comparisons result in a bool, the operands keep their own type.
+        RiVmValueType type = ri_is_in(ast_expr->kind, RiNode_Expr_Binary_Comparison)
+            ? rivm_get_type_from_expr_(compiler, ast_expr)
+            : rivm_get_type_from_expr_(compiler, a0);
+        uint32_t v0 = rivm_compile_expr_(compiler, a0);
+        uint32_t v1 = rivm_compile_expr_(compiler, a1);
 
         RiVmOp op = RIVM_TO_OP_[ast_expr->kind];
         RI_ASSERT(op);
-        rivm_code_emit_(&compiler->code, (RiVmInst) {
-            .op = op, result, p0, p1
-        });
-        return result;
+        RiNode* ast_type = ri_retof_(compiler->ri, a0);
+        if (op == RiVmOp_Binary_BShL || op == RiVmOp_Binary_BShR) {
+            v1 = rivm_compile_shift_count_(compiler, ast_type, v1);
+        }
+        uint32_t result = rivm_ir_binary(func, compiler->block, rivm_arithmetic_op_(compiler, op, type), type, v0, v1);
+        return rivm_compile_narrow_result_(compiler, op, ast_type, result, false);
     } else {
         switch (ast_expr->kind)
         {
-            case RiNode_Expr_Call: {
-                RiNodeArray* arguments = &ast_expr->call.arguments;
-                for (iptr i = 0; i < arguments->count; ++i)
-                {
-                    RiVmParam arg = rivm_compile_expr_(compiler, arguments->items[i]);
-                    rivm_code_emit(&compiler->code, ArgPush, arg);
-                    rivm_release_slot_(compiler, arg);
+            case RiNode_Expr_Unary_Positive:
+                return rivm_compile_expr_(compiler, ri_node_(compiler->ri, ast_expr->unary.argument));
+
+            case RiNode_Expr_Unary_Negative: {
+                RiNode* ast_type = ri_retof_(compiler->ri, ast_expr);
+                RiVmValueType type = rivm_get_type_(compiler, ast_type);
+                uint32_t a = rivm_compile_expr_(compiler, ri_node_(compiler->ri, ast_expr->unary.argument));
+                RiVmIrInst* inst = rivm_ir_inst(func, a);
+                if (inst->op == RiVmIr_Const) {
+                    // Negative literals are constants, so they can be immediates.
+                    RiVmValue imm = {0};
+                    switch (type)
+                    {
+                        case RiVmValue_I32:
+                        case RiVmValue_U32: imm.u32 = 0u - inst->imm.u32; break;
+                        case RiVmValue_I64:
+                        case RiVmValue_U64: imm.u64 = 0u - inst->imm.u64; break;
+                        case RiVmValue_F32: imm.f32 = -inst->imm.f32; break;
+                        case RiVmValue_F64: imm.f64 = -inst->imm.f64; break;
+                        default: RI_UNREACHABLE; break;
+                    }
+                    return rivm_compile_narrow_(compiler, ast_type, rivm_ir_const(func, type, imm));
+                }
+                if (compiler->checked && !rivm_is_float_(type)) {
+                    uint32_t zero = rivm_ir_const(func, type, (RiVmValue){ .u64 = 0 });
+                    a = rivm_ir_binary(func, compiler->block, RiVmOp_Binary_Checked_Sub, type, zero, a);
+                } else {
+                    a = rivm_ir_unary(func, compiler->block, RiVmOp_Unary_Neg, type, a);
                 }
+                return rivm_compile_narrow_(compiler, ast_type, a);
+            }
 
-                RiNode* spec = ast_expr->call.func->value.spec;
-                RiNode* type = spec->spec.func.type;
-                RI_ASSERT(type->spec.type.func.outputs.count < 2);
+            case RiNode_Expr_Cast: {
+                RiNode* ast_argument = ri_nodes_at_(compiler->ri, &ast_expr->call.arguments, 1);
+                RiNode* ast_from = ri_retof_(compiler->ri, ast_argument);
+                RiNode* ast_to = ri_retof_(compiler->ri, ast_expr);
+                RiVmValueType from = rivm_get_type_(compiler, ast_from);
+                RiVmValueType type = rivm_get_type_(compiler, ast_to);
+                uint32_t a = rivm_compile_expr_(compiler, ast_argument);
+                if (rivm_narrow_op_(ast_to) && !rivm_int_fits_(ast_from, ast_to)) {
+                    // Wrapping reads the low bits of any integer, floats are converted to 32 bits first.
+                    if (rivm_is_float_(from)) {
+                        a = rivm_ir_unary(func, compiler->block, RiVmOp_Unary_Convert_FloatToInt, type, a);
+                    }
+                    return rivm_compile_narrow_(compiler, ast_to, a);
+                }
+                RiVmOp op = rivm_convert_op_(from, type);
+                return op ? rivm_ir_unary(func, compiler->block, op, type, a) : a;
+            }
 
-                // RiVmParam result = {0};
-                // for (iptr i = 0; i < type->spec.type.func.outputs.count; ++i) {
-                //     result = rivm_acquire_slot_(compiler, RiSlot_Temporary, RiVmValue_I32);
-                //     RiVmParam result_addr = rivm_acquire_slot_(compiler, RiSlot_Temporary, RiVmValue_U64);
-                //     rivm_code_emit(&compiler->code, AddrOf, result_addr, result);
-                //     rivm_code_emit(&compiler->code, ArgPush, result_addr);
-                // }
+            case RiNode_Expr_Unary_BNeg: {
+                RiNode* ast_type = ri_retof_(compiler->ri, ast_expr);
+                RiVmValueType type = rivm_get_type_(compiler, ast_type);
+                uint32_t a = rivm_compile_expr_(compiler, ri_node_(compiler->ri, ast_expr->unary.argument));
+                a = rivm_ir_unary(func, compiler->block, RiVmOp_Unary_BNot, type, a);
+                return rivm_compile_narrow_(compiler, ast_type, a);
+            }
 
-                RiVmParam result = result = rivm_acquire_slot_(compiler, RiSlot_Temporary, RiVmValue_I32);
+            case RiNode_Expr_Call:
+                return rivm_compile_call_(compiler, ast_expr, false);
 
-                rivm_code_emit(&compiler->code,
-                    Call,
-                    result,
-                    rivm_make_param(Func,
-                        .func = spec
-                    )
-                );
+            case RiNode_Expr_Field: {
+                RiNode* ast_type = ri_retof_(compiler->ri, ast_expr);
+                uint32_t offset;
+                uint32_t address = rivm_compile_place_(compiler, ast_expr, &offset);
+                if (ast_type->kind == RiNode_Spec_Type_Struct) {
+                    return rivm_compile_offset_(compiler, address, offset);
+                }
+                return rivm_ir_load(func, compiler->block, rivm_load_op_(ast_type), rivm_get_type_(compiler, ast_type), address, offset);
+            }
 
-                rivm_code_emit(&compiler->code,
-                    ArgPopN,
-                    rivm_make_param(Imm,
-                        .type = RiVmValue_U64,
-                        .imm.i64 = arguments->count
-                    )
-                );
+            // Struct variables and fields are their address already.
+            case RiNode_Expr_AddrOf:
+                return rivm_compile_expr_(compiler, ri_node_(compiler->ri, ast_expr->addr_of.argument));
 
-                return result;
+            case RiNode_Value_Var: {
+                uint32_t var = rivm_get_var_(compiler, ri_node_(compiler->ri, ast_expr->value.spec), rivm_get_type_from_expr_(compiler, ast_expr));
+                return rivm_ir_read_var(func, var, compiler->block);
             }
 
-            case RiNode_Value_Var:
-                return rivm_get_param_(compiler, ast_expr);
-
             case RiNode_Value_Const: {
                 RiVmValueType type = rivm_get_type_from_expr_(compiler, ast_expr);
+                RiVmValue imm = {0};
                 switch (type)
                 {
                     case RiVmValue_I32:
-                        return rivm_make_param(Imm, .type = type, .imm.i32 = (int32_t)ast_expr->value.constant.integer);
+                        imm.i32 = (int32_t)ast_expr->value.constant.integer;
+                        break;
                     case RiVmValue_I64:
-                        return rivm_make_param(Imm, .type = type, .imm.i64 = (int64_t)ast_expr->value.constant.integer);
+                        imm.i64 = (int64_t)ast_expr->value.constant.integer;
+                        break;
+                    case RiVmValue_U32:
+                        imm.u32 = (uint32_t)ast_expr->value.constant.integer;
+                        break;
+                    case RiVmValue_U64:
+                        imm.u64 = (uint64_t)ast_expr->value.constant.integer;
+                        break;
+                    case RiVmValue_F32:
+                        imm.f32 = (float)ast_expr->value.constant.real;
+                        break;
+                    case RiVmValue_F64:
+                        imm.f64 = ast_expr->value.constant.real;
+                        break;
                     default:
                         RI_UNREACHABLE;
                         break;
                 }
-            } break;
+                RiVmOp narrow = rivm_narrow_op_(ri_retof_(compiler->ri, ast_expr));
+                if (narrow) {
+                    imm = rivm_narrow(narrow, imm);
+                }
+                return rivm_ir_const(func, type, imm);
+            }
+            default: break;
         }
     }
     RI_ABORT("invalid expr");
-    return (RiVmParam){0};
+    return RIVM_IR_NONE;
 }
 
-static void
-rivm_compile_st_(RiVmCompiler* compiler, RiNode* ast_st)
+// With `tail`, the call returns its result from the current function in its place, which
+// terminates the block. Inlined, the body returns from the current function instead.
+static uint32_t
+rivm_compile_call_(RiVmFuncCompiler* compiler, RiNode* ast_call, bool tail)
 {
-    RI_ASSERT(ast_st);
+    RiVmIrFunc* func = &compiler->ir;
 
-    switch (ast_st->kind)
-    {
-        case RiNode_Decl: {
-            // Skip.
-        } break;
+    RiNodeArray* arguments = &ast_call->call.arguments;
+    uint32_t* args = arena_push_nt(&compiler->arena, uint32_t, MAXIMUM(arguments->count, 1));
+    for (iptr i = 0; i < arguments->count; ++i) {
+        args[i] = rivm_compile_expr_(compiler, ri_nodes_at_(compiler->ri, arguments, i));
+    }
 
-        case RiNode_Scope: {
-            RiNode* it;
-            array_each(&ast_st->scope.statements, &it) {
-                rivm_compile_st_(compiler, it);
-            }
-        } break;
+    // The call's value is the first output, the others are `RiVmIr_Result`s of it.
+    RiNode* spec = ri_node_(compiler->ri, ri_node_(compiler->ri, ast_call->call.func)->value.spec);
+    RiVmValueType result_type = rivm_outputs_count_(compiler->ri, spec)
+        ? rivm_get_output_type_(compiler, spec, 0)
+        : RiVmValue_None;
 
-        case RiNode_St_Return: {
-            if (ast_st->st_return.argument) {
-                // TODO: Optimization: Allow for rivm_compile_expr_ to take target for expression result? This can also be done as an additional optimization step.
-                RiVmParam result = rivm_compile_expr_(compiler, ast_st->st_return.argument);
-                rivm_code_emit(&compiler->code, Ret, result);
-                // RiVmParam target = rivm_get_param_for_output_(compiler, 0);
-                // rivm_code_emit(&compiler->code, Assign, target, result);
+    if (rivm_can_inline_(compiler, spec)) {
+        return rivm_compile_inline_(compiler, spec, args, result_type, tail);
+    }
+    if (tail) {
+        rivm_ir_tail_call(func, compiler->block, spec, args, arguments->count);
+        return RIVM_IR_NONE;
+    }
+    return rivm_ir_call(func, compiler->block, result_type, spec, args, arguments->count);
+}
+
+// Goes to `block_true` if `ast_expr` is true, otherwise to `block_false`.
+// The right side of `&&` and `||` is only evaluated when the left one doesn't decide, and neither
+// gets a value of its own, they're just jumps.
+static void
+rivm_compile_condition_(RiVmFuncCompiler* compiler, RiNode* ast_expr, uint32_t block_true, uint32_t block_false)
+{
+    RiVmIrFunc* func = &compiler->ir;
+    Ri* ri = compiler->ri;
+    switch (ast_expr->kind)
+    {
+        case RiNode_Expr_Binary_Numeric_Boolean_And:
+        case RiNode_Expr_Binary_Numeric_Boolean_Or: {
+            uint32_t block_right = rivm_ir_block(func);
+            if (ast_expr->kind == RiNode_Expr_Binary_Numeric_Boolean_And) {
+                rivm_compile_condition_(compiler, ri_node_(ri, ast_expr->binary.argument0), block_right, block_false);
             } else {
-                rivm_code_emit(&compiler->code, Ret);
+                rivm_compile_condition_(compiler, ri_node_(ri, ast_expr->binary.argument0), block_true, block_right);
             }
+            rivm_ir_seal(func, block_right);
+            compiler->block = block_right;
+            rivm_compile_condition_(compiler, ri_node_(ri, ast_expr->binary.argument1), block_true, block_false);
         } break;
 
-        case RiNode_St_Assign: {
-            RiVmParam result = rivm_compile_expr_(compiler, ast_st->binary.argument1);
-            RiVmParam target = rivm_get_param_(compiler, ast_st->binary.argument0);
-            rivm_code_emit(&compiler->code, Assign, target, result);
-            rivm_release_slot_(compiler, result);
+        case RiNode_Expr_Unary_Not: {
+            rivm_compile_condition_(compiler, ri_node_(ri, ast_expr->unary.argument), block_false, block_true);
         } break;
 
-        case RiNode_St_If: {
-            if (ast_st->st_if.pre) {
-                rivm_compile_st_(compiler, ast_st->st_if.pre);
-            }
-            RiVmParam condition = rivm_compile_expr_(compiler, ast_st->st_if.condition);
-            RiVmParam label_then = rivm_create_label_(compiler);
-            RiVmParam label_else = rivm_create_label_(compiler);
-            rivm_code_emit(&compiler->code, If, condition, label_then, label_else);
-            rivm_release_slot_(compiler, condition);
-
-            RiNodeArray* statements = &ast_st->st_if.scope->scope.statements;
-            rivm_mark_label_(compiler, label_then);
-            rivm_compile_st_(compiler, array_at(statements, 0));
-            if (statements->count > 1) {
-                RiVmParam label_end  = rivm_create_label_(compiler);
-                rivm_code_emit(&compiler->code, GoTo, label_end);
-                rivm_mark_label_(compiler, label_else);
-                rivm_compile_st_(compiler, array_at(statements, 1));
-                rivm_mark_label_(compiler, label_end);
-            } else {
-                rivm_mark_label_(compiler, label_else);
-            }
+        default: {
+            uint32_t condition = rivm_compile_expr_(compiler, ast_expr);
+            rivm_ir_branch(func, compiler->block, condition, block_true, block_false);
         } break;
-
-        default:
-            RI_UNREACHABLE;
-            break;
     }
 }
 
+// Statements after a jump are compiled to a block that's never entered, and dropped.
 static void
-rivm_acquire_func_args_(RiVmCompiler* compiler, RiVmParamSlotKind source, RiNodeArray* args)
+rivm_compile_unreachable_(RiVmFuncCompiler* compiler)
 {
-    // TODO: Only named args.
-    for (iptr i = 0; i < args->count; ++i) {
-        RI_ASSERT(args->items[i]->kind == RiNode_Decl);
-        RI_ASSERT(args->items[i]->decl.spec->kind == RiNode_Spec_Var);
-        // TODO: Extracting a type of var decl is a bit too awkward to do. Is there a better way?
-        RiVmParam param = rivm_acquire_slot_(compiler,
-            source,
-            rivm_get_type_(compiler,
-                ri_get_spec_(compiler->ri,
-                    args->items[i]->decl.spec->spec.var.type
-                )
-            )
-        );
-        args->items[i]->decl.spec->spec.var.slot = param.slot.index;
-    }
+    compiler->block = rivm_ir_block(&compiler->ir);
+    rivm_ir_seal(&compiler->ir, compiler->block);
 }
 
-static RiVmFunc*
-rivm_compile_func_(RiVmCompiler* compiler, RiNode* ast_func)
+// Goes to `block_body` if `ast_condition` is true or missing, otherwise to `block_exit`.
+static void
+rivm_compile_loop_test_(RiVmFuncCompiler* compiler, RiNode* ast_condition, uint32_t block_body, uint32_t block_exit)
 {
-    compiler->ast_func = ast_func;
-
-    RiNode* ast_func_type = ast_func->spec.func.type;
-    // Allocate slots for input and output parameters.
-    rivm_acquire_func_args_(compiler, RiSlot_Input, &ast_func_type->spec.type.func.inputs);
-    // TODO: Multiple return values.
-    RI_ASSERT(ast_func_type->spec.type.func.outputs.count < 2);
-    // rivm_acquire_func_args_(compiler, RiSlot_Output, &ast_func_type->spec.type.func.outputs);
-
-    uint32_t slot_locals = compiler->slot_next;
-    uint32_t enter_index = rivm_code_emit(&compiler->code, Enter);
-    {
-        rivm_compile_st_(compiler, ast_func->spec.func.scope);
+    if (ast_condition) {
+        rivm_compile_condition_(compiler, ast_condition, block_body, block_exit);
+    } else {
+        rivm_ir_jump(&compiler->ir, compiler->block, block_body);
     }
-    RiVmInst* enter = &array_at(&compiler->code, enter_index);
-    enter->param0 = rivm_make_param(Imm,
-        .type = RiVmValue_U64,
-        .imm.u64 = compiler->slot_next - slot_locals
-    );
-    ast_func->spec.func.slot = compiler->module->func.count;
+}
 
-    RiVmFunc* func = rivm_module_push_func(compiler->module, compiler->code.slice);
-    func->debug_inputs_count = ast_func_type->spec.type.func.inputs.count;
-    func->debug_outputs_count = ast_func_type->spec.type.func.outputs.count;
-    compiler->code = (RiVmInstArray){0};
+static void rivm_compile_st_(RiVmFuncCompiler* compiler, RiNode* ast_st);
 
-    array_clear(&compiler->slot_pool);
-    compiler->slot_next = 0;
+// Case of a switch with a constant value, and the block of its clause. `value` holds the bits of
+// the constant extended to 64 bits, `key` orders it as unsigned, with the sign flipped for signed types.
+typedef struct RiVmCase_ {
+    uint64_t value;
+    uint64_t key;
+    uint32_t block;
+} RiVmCase_;
+
+// Switches with at least this many cases can use a jump table, if it's at most twice that long.
+#define RIVM_SWITCH_TABLE_MIN_ 4
+// Cases searched by halves end with a chain of comparisons of at most this many.
+#define RIVM_SWITCH_CHAIN_MAX_ 3
 
-    return func;
+static int
+rivm_case_compare_(const void* a, const void* b)
+{
+    const RiVmCase_* ca = a;
+    const RiVmCase_* cb = b;
+    if (ca->key != cb->key) {
+        return ca->key < cb->key ? -1 : 1;
+    }
+    // Blocks are in source order, the first case wins.
+    return ca->block < cb->block ? -1 : ca->block > cb->block;
 }
 
-static void
-rivm_patch_label_(RiVmCompiler* compiler, RiVmParam* param)
+static uint32_t
+rivm_case_const_(RiVmFuncCompiler* compiler, RiVmValueType type, uint64_t value)
 {
-    param->kind = RiVmParam_Imm;
-    param->type = RiVmValue_U64;
-    param->imm.u64 = array_at(&compiler->labels, param->label - 1);
+    RiVmValue imm = {0};
+    if (type == RiVmValue_I32 || type == RiVmValue_U32) {
+        imm.u32 = (uint32_t)value;
+    } else {
+        imm.u64 = value;
+    }
+    return rivm_ir_const(&compiler->ir, type, imm);
 }
 
-static void
-rivm_patch_(RiVmCompiler* compiler, RiVmModule* module)
+// Folds an integer constant, with any signs in front of it, to the case of a switch on `type`.
+static bool
+rivm_case_fold_(Ri* ri, RiNode* ast_case, RiVmValueType type, RiVmCase_* c)
 {
-    RiVmFunc* func;
-    RiVmInst* inst;
-    slice_each(&module->func, &func)
+    bool negative = false;
+    while (ast_case->kind == RiNode_Expr_Unary_Negative || ast_case->kind == RiNode_Expr_Unary_Positive) {
+        negative ^= ast_case->kind == RiNode_Expr_Unary_Negative;
+        ast_case = ri_node_(ri, ast_case->unary.argument);
+    }
+    if (ast_case->kind != RiNode_Value_Const) {
+        return false;
+    }
+    uint64_t integer = ast_case->value.constant.integer;
+    if (negative) {
+        integer = 0u - integer;
+    }
+    switch (type)
     {
-        for (int64_t i = 0; i < func->code.count; ++i) {
-            inst = &func->code.items[i];
-            switch (inst->op)
-            {
-                case RiVmOp_Call: {
-                    RI_CHECK(inst->param1.kind == RiVmParam_Func);
-                    RiNode* ast_func = inst->param1.func;
-                    RI_CHECK(ast_func);
-                    RI_CHECK(ast_func->spec.func.slot != RI_INVALID_SLOT);
-                    RiVmFunc* func = array_at(&module->func, ast_func->spec.func.slot);
-                    inst->param1.func = func;
-                } break;
-
-                case RiVmOp_If: {
-                    rivm_patch_label_(compiler, &inst->param1);
-                    rivm_patch_label_(compiler, &inst->param2);
-                } break;
+        case RiVmValue_I32: c->value = (uint64_t)(int64_t)(int32_t)integer; break;
+        case RiVmValue_U32: c->value = (uint32_t)integer; break;
+        default: c->value = integer; break;
+    }
+    c->key = type == RiVmValue_I32 || type == RiVmValue_I64 ? c->value ^ (UINT64_C(1) << 63) : c->value;
+    return true;
+}
 
-                case RiVmOp_GoTo: {
-                    rivm_patch_label_(compiler, &inst->param0);
-                } break;
+// Goes to the block of the case equal to `value`, to `otherwise` if there's none.
+// `cases` are sorted and distinct. Dense cases go through a jump table, others are searched by
+// halves, down to a few that are compared one by one.
+static void
+rivm_compile_switch_dispatch_(RiVmFuncCompiler* compiler, uint32_t value, RiVmValueType type, RiVmCase_* cases, iptr count, uint32_t otherwise)
+{
+    RiVmIrFunc* func = &compiler->ir;
+
+    uint64_t span = count ? cases[count - 1].key - cases[0].key : 0;
+    if (count >= RIVM_SWITCH_TABLE_MIN_ && span < 2 * (uint64_t)count) {
+        uint32_t* table = arena_push_nt(&compiler->arena, uint32_t, span + 1);
+        for (iptr i = 0, j = 0; i <= (iptr)span; ++i) {
+            if (cases[j].key - cases[0].key == (uint64_t)i) {
+                table[i] = cases[j++].block;
+            } else {
+                table[i] = otherwise;
             }
         }
+        rivm_ir_switch(func, compiler->block, value, (int64_t)cases[0].value, table, span + 1, otherwise);
+    } else if (count <= RIVM_SWITCH_CHAIN_MAX_) {
+        for (iptr i = 0; i < count; ++i) {
+            uint32_t constant = rivm_case_const_(compiler, type, cases[i].value);
+            uint32_t equal = rivm_ir_binary(func, compiler->block, RiVmOp_Binary_Comparison_Eq, type, value, constant);
+            uint32_t block_next = rivm_ir_block(func);
+            rivm_ir_branch(func, compiler->block, equal, cases[i].block, block_next);
+            rivm_ir_seal(func, block_next);
+            compiler->block = block_next;
+        }
+        rivm_ir_jump(func, compiler->block, otherwise);
+    } else {
+        iptr half = count / 2;
+        uint32_t constant = rivm_case_const_(compiler, type, cases[half].value);
+        uint32_t less = rivm_ir_binary(func, compiler->block, RiVmOp_Binary_Comparison_Lt, type, value, constant);
+        uint32_t block_low = rivm_ir_block(func);
+        uint32_t block_high = rivm_ir_block(func);
+        rivm_ir_branch(func, compiler->block, less, block_low, block_high);
+        rivm_ir_seal(func, block_low);
+        rivm_ir_seal(func, block_high);
+        compiler->block = block_low;
+        rivm_compile_switch_dispatch_(compiler, value, type, cases, half, otherwise);
+        compiler->block = block_high;
+        rivm_compile_switch_dispatch_(compiler, value, type, cases + half, count - half, otherwise);
     }
 }
 
-bool
-rivm_compile(RiVmCompiler* compiler, RiNode* ast_module, RiVmModule* module)
+// Clauses don't fall through unless they end with `fallthrough`. Cases that are all integer
+// constants are dispatched by `rivm_compile_switch_dispatch_`, others are compared in order.
+static void
+rivm_compile_switch_(RiVmFuncCompiler* compiler, RiNode* ast_st)
 {
-    compiler->module = module;
+    RiVmIrFunc* func = &compiler->ir;
+    Ri* ri = compiler->ri;
 
-    RI_ASSERT(ast_module->kind == RiNode_Module);
-    RiNode* ast_scope = ast_module->module.scope;
+    if (ast_st->st_switch.pre) {
+        rivm_compile_st_(compiler, ri_node_(ri, ast_st->st_switch.pre));
+    }
+    RiNode* ast_expr = ri_node_(ri, ast_st->st_switch.expr);
+    RiVmValueType type = rivm_get_type_from_expr_(compiler, ast_expr);
+    uint32_t value = rivm_compile_expr_(compiler, ast_expr);
+
+    // Each case and default starts a clause with a block of its own.
+    RiNodeArray* statements = &ri_nodes_at_(ri, &ri_node_(ri, ast_st->st_switch.scope)->scope.statements, 0)->scope.statements;
+    iptr capacity = MAXIMUM(statements->count, 1);
+    uint32_t* blocks = arena_push_nt(&compiler->arena, uint32_t, capacity);
+    RiVmCase_* cases = arena_push_nt(&compiler->arena, RiVmCase_, capacity);
+    iptr cases_count = 0;
+    bool constant = type == RiVmValue_I32 || type == RiVmValue_I64 || type == RiVmValue_U32 || type == RiVmValue_U64;
+    uint32_t block_exit = rivm_ir_block(func);
+    uint32_t block_default = block_exit;
+    for (iptr i = 0; i < statements->count; ++i) {
+        RiNode* it = ri_nodes_at_(ri, statements, i);
+        if (it->kind == RiNode_St_Switch_Default) {
+            blocks[i] = block_default = rivm_ir_block(func);
+        } else if (it->kind == RiNode_St_Switch_Case) {
+            blocks[i] = rivm_ir_block(func);
+            RiNode* ast_case = ri_node_(ri, it->st_switch_case.expr);
+            if (constant && rivm_case_fold_(ri, ast_case, type, &cases[cases_count])) {
+                cases[cases_count++].block = blocks[i];
+            } else {
+                constant = false;
+            }
+        }
+    }
+
+    if (constant) {
+        qsort(cases, cases_count, sizeof(RiVmCase_), &rivm_case_compare_);
+        iptr distinct = 0;
+        for (iptr i = 0; i < cases_count; ++i) {
+            if (distinct == 0 || cases[distinct - 1].key != cases[i].key) {
+                cases[distinct++] = cases[i];
+            }
+        }
+        rivm_compile_switch_dispatch_(compiler, value, type, cases, distinct, block_default);
+    } else {
+        for (iptr i = 0; i < statements->count; ++i) {
+            RiNode* it = ri_nodes_at_(ri, statements, i);
+            if (it->kind == RiNode_St_Switch_Case) {
+                uint32_t other = rivm_compile_expr_(compiler, ri_node_(ri, it->st_switch_case.expr));
+                uint32_t equal = rivm_ir_binary(func, compiler->block, RiVmOp_Binary_Comparison_Eq, type, value, other);
+                uint32_t block_next = rivm_ir_block(func);
+                rivm_ir_branch(func, compiler->block, equal, blocks[i], block_next);
+                rivm_ir_seal(func, block_next);
+                compiler->block = block_next;
+            }
+        }
+        rivm_ir_jump(func, compiler->block, block_default);
+    }
 
-    RiNode** ast_decl = ast_scope->scope.decl.items;
-    for (iptr i = 0; i < ast_scope->scope.decl.count; ++i, ++ast_decl)
+    uint32_t block_break = compiler->block_break;
+    uint32_t block_fallthrough = compiler->block_fallthrough;
+    compiler->block_break = block_exit;
+    for (iptr i = 0; i < statements->count; ++i) {
+        RiNode* it = ri_nodes_at_(ri, statements, i);
+        if (it->kind != RiNode_St_Switch_Case && it->kind != RiNode_St_Switch_Default) {
+            rivm_compile_st_(compiler, it);
+            continue;
+        }
+        if (i > 0) {
+            rivm_ir_jump(func, compiler->block, block_exit);
+        }
+        // All predecessors are known, the previous clause is done.
+        rivm_ir_seal(func, blocks[i]);
+        compiler->block = blocks[i];
+        compiler->block_fallthrough = RIVM_IR_UNREACHABLE;
+        for (iptr j = i + 1; j < statements->count; ++j) {
+            RiNodeKind kind = ri_nodes_at_(ri, statements, j)->kind;
+            if (kind == RiNode_St_Switch_Case || kind == RiNode_St_Switch_Default) {
+                compiler->block_fallthrough = blocks[j];
+                break;
+            }
+        }
+    }
+    if (statements->count) {
+        rivm_ir_jump(func, compiler->block, block_exit);
+    }
+    rivm_ir_seal(func, block_exit);
+
+    compiler->block_break = block_break;
+    compiler->block_fallthrough = block_fallthrough;
+    compiler->block = block_exit;
+}
+
+static void
+rivm_compile_st_(RiVmFuncCompiler* compiler, RiNode* ast_st)
+{
+    RI_ASSERT(ast_st);
+    RiVmIrFunc* func = &compiler->ir;
+    Ri* ri = compiler->ri;
+
+    switch (ast_st->kind)
     {
-        RI_ASSERT((*ast_decl)->kind == RiNode_Decl);
-        RiNode* ast_spec = (*ast_decl)->decl.spec;
-        if (ast_spec->kind == RiNode_Spec_Func) {
-            rivm_compile_func_(compiler, ast_spec);
+        case RiNode_Decl: {
+            // Structs have a region in the frame, cleared where they're declared. Other variables
+            // are defined by assignments.
+            RiNode* ast_spec = ri_node_(ri, ast_st->decl.spec);
+            if (ast_spec->kind != RiNode_Spec_Var) {
+                break;
+            }
+            RiNode* ast_type = ri_get_spec_(compiler->ri, ast_spec->spec.var.type);
+            if (ast_type->kind == RiNode_Spec_Type_Struct) {
+                uint32_t size = (uint32_t)ast_type->spec.type.compound.size;
+                uint32_t address = rivm_ir_local(func, compiler->block, size);
+                rivm_ir_mem_zero(func, compiler->block, address, size);
+                rivm_ir_write_var(func, rivm_get_var_(compiler, ast_spec, RiVmValue_U64), compiler->block, address);
+                compiler->locals = true;
+            }
+        } break;
+
+        case RiNode_Scope: {
+            RiNode* it;
+            ri_nodes_each_(ri, &ast_st->scope.statements, &it) {
+                rivm_compile_st_(compiler, it);
+            }
+        } break;
+
+        case RiNode_St_Return: {
+            RiNodeArray* ast_arguments = &ast_st->st_return.arguments;
+            RiNode* ast_argument = ast_arguments->count ? ri_nodes_at_(ri, ast_arguments, 0) : NULL;
+            // From the function, not from a body inlined into it.
+            bool ret = compiler->block_return == RIVM_IR_UNREACHABLE;
+            uint32_t result = RIVM_IR_NONE;
+            if (ast_arguments->count > 1) {
+                // Functions with more outputs aren't inlined.
+                RI_ASSERT(ret);
+                uint32_t* results = arena_push_nt(&compiler->arena, uint32_t, ast_arguments->count);
+                for (iptr i = 0; i < ast_arguments->count; ++i) {
+                    results[i] = rivm_compile_expr_(compiler, ri_nodes_at_(ri, ast_arguments, i));
+                }
+                rivm_ir_ret_values(func, compiler->block, results, ast_arguments->count);
+            } else if (ast_argument && ast_argument->kind == RiNode_Expr_Call) {
+                // With more outputs, the tail call sets them for the caller of this function.
+                // `return f(...)` reuses the frame, so tail recursion runs in constant stack.
+                result = rivm_compile_call_(compiler, ast_argument, ret);
+            } else if (ast_argument) {
+                result = rivm_compile_expr_(compiler, ast_argument);
+            }
+            if (!rivm_ir_is_terminated(func, compiler->block)) {
+                if (ret) {
+                    rivm_ir_ret(func, compiler->block, result);
+                } else {
+                    if (result != RIVM_IR_NONE) {
+                        rivm_ir_write_var(func, compiler->var_return, compiler->block, result);
+                    }
+                    rivm_ir_jump(func, compiler->block, compiler->block_return);
+                }
+            }
+            rivm_compile_unreachable_(compiler);
+        } break;
+
+        case RiNode_St_Expr: {
+            rivm_compile_expr_(compiler, ri_node_(ri, ast_st->st_expr));
+        } break;
+
+        case RiNode_St_Assign_Outputs: {
+            RiNodeArray* ast_targets = &ast_st->st_assign_outputs.targets;
+            uint32_t call = rivm_compile_call_(compiler, ri_node_(ri, ast_st->st_assign_outputs.call), false);
+            for (iptr i = 0; i < ast_targets->count; ++i) {
+                RiNode* ast_var = ri_nodes_at_(ri, ast_targets, i);
+                RiVmValueType type = rivm_get_type_from_expr_(compiler, ast_var);
+                uint32_t result = i ? rivm_ir_result(func, compiler->block, type, call, (uint32_t)i) : call;
+                uint32_t var = rivm_get_var_(compiler, ri_node_(ri, ast_var->value.spec), type);
+                rivm_ir_write_var(func, var, compiler->block, rivm_ir_copy(func, compiler->block, result));
+            }
+        } break;
+
+        case RiNode_St_Assign:
+        case RiNode_St_Assign_Add:
+        case RiNode_St_Assign_Sub:
+        case RiNode_St_Assign_Mul:
+        case RiNode_St_Assign_Div:
+        case RiNode_St_Assign_Mod:
+        case RiNode_St_Assign_And:
+        case RiNode_St_Assign_Or:
+        case RiNode_St_Assign_Xor: {
+            uint32_t result = rivm_compile_expr_(compiler, ri_node_(ri, ast_st->binary.argument1));
+            RiNode* ast_target = ri_node_(ri, ast_st->binary.argument0);
+            // `var x T = ...` declares `x` first.
+            if (ast_target->kind == RiNode_Decl) {
+                rivm_compile_st_(compiler, ast_target);
+            }
+            RiNode* ast_spec = ast_target->kind == RiNode_Decl ? ri_node_(ri, ast_target->decl.spec)
+                : ast_target->kind == RiNode_Value_Var ? ri_node_(ri, ast_target->value.spec)
+                : NULL;
+            RiNode* ast_type = ast_spec
+                ? ri_get_spec_(ri, ast_spec->spec.var.type)
+                : ri_retof_(ri, ast_target);
+            RiVmValueType type = rivm_get_type_(compiler, ast_type);
+
+            if (ast_type->kind == RiNode_Spec_Type_Struct) {
+                // Structs are copied, from one address to the other.
+                uint32_t address = ast_spec
+                    ? rivm_ir_read_var(func, rivm_get_var_(compiler, ast_spec, type), compiler->block)
+                    : rivm_compile_expr_(compiler, ast_target);
+                rivm_ir_mem_copy(func, compiler->block, address, result, (uint32_t)ast_type->spec.type.compound.size);
+                break;
+            }
+
+            RiVmOp op = RIVM_TO_OP_[ast_st->kind];
+            RI_ASSERT(op || ast_st->kind == RiNode_St_Assign);
+            if (!ast_spec) {
+                uint32_t offset;
+                uint32_t address = rivm_compile_place_(compiler, ast_target, &offset);
+                if (op) {
+                    uint32_t value = rivm_ir_load(func, compiler->block, rivm_load_op_(ast_type), type, address, offset);
+                    result = rivm_ir_binary(func, compiler->block, rivm_arithmetic_op_(compiler, op, type), type, value, result);
+                    result = rivm_compile_narrow_result_(compiler, op, ast_type, result, true);
+                }
+                rivm_ir_store(func, compiler->block, rivm_store_op_(ast_type), address, offset, result);
+                break;
+            }
+
+            uint32_t var = rivm_get_var_(compiler, ast_spec, type);
+            if (op) {
+                uint32_t value = rivm_ir_read_var(func, var, compiler->block);
+                result = rivm_ir_binary(func, compiler->block, rivm_arithmetic_op_(compiler, op, type), type, value, result);
+                result = rivm_compile_narrow_result_(compiler, op, ast_type, result, false);
+            }
+            // The variable gets a copy, as if it had a slot of its own, until copies are propagated.
+            rivm_ir_write_var(func, var, compiler->block, rivm_ir_copy(func, compiler->block, result));
+        } break;
+
+        case RiNode_St_If: {
+            if (ast_st->st_if.pre) {
+                rivm_compile_st_(compiler, ri_node_(ri, ast_st->st_if.pre));
+            }
+            uint32_t block_then = rivm_ir_block(func);
+            uint32_t block_else = rivm_ir_block(func);
+            rivm_compile_condition_(compiler, ri_node_(ri, ast_st->st_if.condition), block_then, block_else);
+            rivm_ir_seal(func, block_then);
+
+            RiNodeArray* statements = &ri_node_(ri, ast_st->st_if.scope)->scope.statements;
+            compiler->block = block_then;
+            if (statements->count > 1) {
+                rivm_ir_seal(func, block_else);
+                rivm_compile_st_(compiler, ri_nodes_at_(ri, statements, 0));
+                uint32_t block_end = rivm_ir_block(func);
+                rivm_ir_jump(func, compiler->block, block_end);
+                compiler->block = block_else;
+                rivm_compile_st_(compiler, ri_nodes_at_(ri, statements, 1));
+                rivm_ir_jump(func, compiler->block, block_end);
+                rivm_ir_seal(func, block_end);
+                compiler->block = block_end;
+            } else {
+                rivm_compile_st_(compiler, ri_nodes_at_(ri, statements, 0));
+                rivm_ir_jump(func, compiler->block, block_else);
+                rivm_ir_seal(func, block_else);
+                compiler->block = block_else;
+            }
+        } break;
+
+        case RiNode_St_For: {
+            // Rotated: the condition is checked once before the loop and then at the end of each
+            // iteration, so an iteration ends with a single conditional jump back.
+            RiNode* ast_condition = ri_node_(ri, ast_st->st_for.condition);
+            if (ast_st->st_for.pre) {
+                rivm_compile_st_(compiler, ri_node_(ri, ast_st->st_for.pre));
+            }
+            uint32_t block_body = rivm_ir_block(func);
+            uint32_t block_latch = rivm_ir_block(func);
+            uint32_t block_exit = rivm_ir_block(func);
+            rivm_compile_loop_test_(compiler, ast_condition, block_body, block_exit);
+
+            uint32_t block_break = compiler->block_break;
+            uint32_t block_continue = compiler->block_continue;
+            compiler->block_break = block_exit;
+            compiler->block_continue = block_latch;
+
+            compiler->block = block_body;
+            rivm_compile_st_(compiler, ri_node_(ri, ast_st->st_for.scope));
+            rivm_ir_jump(func, compiler->block, block_latch);
+            rivm_ir_seal(func, block_latch);
+
+            compiler->block = block_latch;
+            if (ast_st->st_for.post) {
+                rivm_compile_st_(compiler, ri_node_(ri, ast_st->st_for.post));
+            }
+            rivm_compile_loop_test_(compiler, ast_condition, block_body, block_exit);
+            rivm_ir_seal(func, block_body);
+            rivm_ir_seal(func, block_exit);
+
+            compiler->block_break = block_break;
+            compiler->block_continue = block_continue;
+            compiler->block = block_exit;
+        } break;
+
+        case RiNode_St_Break: {
+            RI_ASSERT(compiler->block_break != RIVM_IR_UNREACHABLE);
+            rivm_ir_jump(func, compiler->block, compiler->block_break);
+            rivm_compile_unreachable_(compiler);
+        } break;
+
+        case RiNode_St_Continue: {
+            RI_ASSERT(compiler->block_continue != RIVM_IR_UNREACHABLE);
+            rivm_ir_jump(func, compiler->block, compiler->block_continue);
+            rivm_compile_unreachable_(compiler);
+        } break;
+
+        case RiNode_St_Switch: {
+            rivm_compile_switch_(compiler, ast_st);
+        } break;
+
+        case RiNode_St_Switch_Fallthrough: {
+            RI_ASSERT(compiler->block_fallthrough != RIVM_IR_UNREACHABLE);
+            rivm_ir_jump(func, compiler->block, compiler->block_fallthrough);
+            rivm_compile_unreachable_(compiler);
+        } break;
+
+        default:
+            RI_UNREACHABLE;
+            break;
+    }
+}
+
+//
+// Inlining
+//
+
+// Calls to functions whose body is at most this big are inlined, see `rivm_inline_size_`.
+#define RIVM_INLINE_SIZE_MAX_ 12
+// A function inlines bodies of at most this size in total.
+#define RIVM_INLINE_BUDGET_ 64
+
+// Size of the node `ref` as the number of operations and statements in it, counted up to `limit`.
+// Anything the compiler can't inline is `limit`.
+static iptr
+rivm_inline_size_(Ri* ri, RiNodeRef ref, iptr limit)
+{
+    RiNode* ast = ri_node_(ri, ref);
+    if (!ast) {
+        return 0;
+    }
+    iptr size = 0;
+    if (ri_is_in(ast->kind, RiNode_Expr_Binary) || ri_is_in(ast->kind, RiNode_St_Assign)) {
+        size = 1 + rivm_inline_size_(ri, ast->binary.argument0, limit) + rivm_inline_size_(ri, ast->binary.argument1, limit);
+    } else if (ri_is_in(ast->kind, RiNode_Expr_Unary)) {
+        size = 1 + rivm_inline_size_(ri, ast->unary.argument, limit);
+    } else {
+        switch (ast->kind)
+        {
+            case RiNode_Value_Var:
+            case RiNode_Value_Const:
+                break;
+
+            case RiNode_Expr_Field:
+                size = 1 + rivm_inline_size_(ri, ast->field.base, limit);
+                break;
+
+            case RiNode_Expr_AddrOf:
+                size = rivm_inline_size_(ri, ast->addr_of.argument, limit);
+                break;
+
+            case RiNode_Scope:
+                for (iptr i = 0; i < ast->scope.statements.count && size < limit; ++i) {
+                    size += rivm_inline_size_(ri, ri_nodes_items_(ri, &ast->scope.statements)[i], limit);
+                }
+                break;
+
+            case RiNode_Decl:
+                size = ri_node_(ri, ast->decl.spec)->kind == RiNode_Spec_Var ? 0 : limit;
+                break;
+
+            case RiNode_Expr_Call:
+                size = 1;
+                for (iptr i = 0; i < ast->call.arguments.count && size < limit; ++i) {
+                    size += rivm_inline_size_(ri, ri_nodes_items_(ri, &ast->call.arguments)[i], limit);
+                }
+                break;
+
+            case RiNode_St_Expr:
+                size = rivm_inline_size_(ri, ast->st_expr, limit);
+                break;
+
+            case RiNode_St_Return:
+                size = 1;
+                for (iptr i = 0; i < ast->st_return.arguments.count && size < limit; ++i) {
+                    size += rivm_inline_size_(ri, ri_nodes_items_(ri, &ast->st_return.arguments)[i], limit);
+                }
+                break;
+
+            case RiNode_St_If:
+                size = 1 +
+                    rivm_inline_size_(ri, ast->st_if.pre, limit) +
+                    rivm_inline_size_(ri, ast->st_if.condition, limit) +
+                    rivm_inline_size_(ri, ast->st_if.scope, limit);
+                break;
+
+            case RiNode_St_For:
+                size = 1 +
+                    rivm_inline_size_(ri, ast->st_for.pre, limit) +
+                    // Checked before the loop and after each iteration.
+                    2 * rivm_inline_size_(ri, ast->st_for.condition, limit) +
+                    rivm_inline_size_(ri, ast->st_for.post, limit) +
+                    rivm_inline_size_(ri, ast->st_for.scope, limit);
+                break;
+
+            case RiNode_St_Switch:
+                size = 1 +
+                    rivm_inline_size_(ri, ast->st_switch.pre, limit) +
+                    rivm_inline_size_(ri, ast->st_switch.expr, limit) +
+                    rivm_inline_size_(ri, ast->st_switch.scope, limit);
+                break;
+
+            case RiNode_St_Switch_Case:
+                size = 1 + rivm_inline_size_(ri, ast->st_switch_case.expr, limit);
+                break;
+
+            case RiNode_St_Switch_Default:
+            case RiNode_St_Switch_Fallthrough:
+            case RiNode_St_Break:
+            case RiNode_St_Continue:
+                size = 1;
+                break;
+
+            default:
+                size = limit;
+                break;
+        }
+    }
+    return MINIMUM(size, limit);
+}
+
+// Small functions are inlined at O2, unless they're declared `//ri:noinline`, have more than one
+// output, are already being inlined (recursion), too deep, or the caller's budget is spent.
+static bool
+rivm_can_inline_(RiVmFuncCompiler* compiler, RiNode* ast_callee)
+{
+    if (compiler->opt_level < RiVmOpt_O2 ||
+        !ast_callee->spec.func.scope ||
+        ast_callee->spec.func.noinline ||
+        rivm_outputs_count_(compiler->ri, ast_callee) > 1 ||
+        ast_callee == compiler->ast_func ||
+        compiler->inline_depth == RIVM_INLINE_DEPTH_MAX
+    ) {
+        return false;
+    }
+    for (int i = 0; i < compiler->inline_depth; ++i) {
+        if (compiler->inline_funcs[i] == ast_callee) {
+            return false;
+        }
+    }
+    iptr limit = MINIMUM(RIVM_INLINE_SIZE_MAX_, RIVM_INLINE_BUDGET_ - compiler->inline_size) + 1;
+    iptr size = rivm_inline_size_(compiler->ri, ast_callee->spec.func.scope, limit);
+    if (size == limit) {
+        return false;
+    }
+    compiler->inline_size += size;
+    return true;
+}
+
+// Compiles the body of `ast_callee` in place of a call with `args`, returns its result.
+// The callee has variables of its own, its inputs start as the arguments, and `return` sets the
+// result and goes to the block after the body. With `tail`, `return` returns from the function.
+static uint32_t
+rivm_compile_inline_(RiVmFuncCompiler* compiler, RiNode* ast_callee, uint32_t* args, RiVmValueType type, bool tail)
+{
+    RiVmIrFunc* func = &compiler->ir;
+
+    uint32_t slot = ast_callee->spec.func.slot;
+    RiVmSlotIndexArray* inlined = compiler->inlined;
+    iptr found = 0;
+    while (found < inlined->count && inlined->items[found] != slot) {
+        ++found;
+    }
+    if (found == inlined->count) {
+        array_push(inlined, slot);
+    }
+
+    int depth = compiler->inline_depth++;
+    compiler->inline_funcs[depth] = ast_callee;
+    Map vars = compiler->inline_vars[depth];
+    compiler->inline_vars[depth] = compiler->vars;
+    compiler->vars = vars;
+    map_clear(&compiler->vars);
+
+    uint32_t block_return = compiler->block_return;
+    uint32_t var_return = compiler->var_return;
+    uint32_t block_break = compiler->block_break;
+    uint32_t block_continue = compiler->block_continue;
+    uint32_t block_fallthrough = compiler->block_fallthrough;
+    compiler->block_return = tail ? RIVM_IR_UNREACHABLE : rivm_ir_block(func);
+    compiler->var_return = !tail && type != RiVmValue_None ? rivm_ir_var(func, type) : RIVM_IR_UNREACHABLE;
+    compiler->block_break = RIVM_IR_UNREACHABLE;
+    compiler->block_continue = RIVM_IR_UNREACHABLE;
+    compiler->block_fallthrough = RIVM_IR_UNREACHABLE;
+
+    Ri* ri = compiler->ri;
+    RiNodeArray* inputs = &ri_node_(ri, ast_callee->spec.func.type)->spec.type.func.inputs;
+    for (iptr i = 0; i < inputs->count; ++i) {
+        RiNode* ast_spec = ri_node_(ri, ri_nodes_at_(ri, inputs, i)->decl.spec);
+        RiVmValueType input_type = rivm_get_type_(compiler, ri_get_spec_(ri, ast_spec->spec.var.type));
+        uint32_t var = rivm_get_var_(compiler, ast_spec, input_type);
+        rivm_ir_write_var(func, var, compiler->block, args[i]);
+    }
+
+    rivm_compile_st_(compiler, ri_node_(ri, ast_callee->spec.func.scope));
+    uint32_t result = RIVM_IR_NONE;
+    if (tail) {
+        if (!rivm_ir_is_terminated(func, compiler->block)) {
+            rivm_ir_ret(func, compiler->block, RIVM_IR_NONE);
+        }
+    } else {
+        rivm_ir_jump(func, compiler->block, compiler->block_return);
+        rivm_ir_seal(func, compiler->block_return);
+        compiler->block = compiler->block_return;
+        if (type != RiVmValue_None) {
+            result = rivm_ir_read_var(func, compiler->var_return, compiler->block);
+        }
+    }
+
+    compiler->block_return = block_return;
+    compiler->var_return = var_return;
+    compiler->block_break = block_break;
+    compiler->block_continue = block_continue;
+    compiler->block_fallthrough = block_fallthrough;
+
+    vars = compiler->vars;
+    compiler->vars = compiler->inline_vars[depth];
+    compiler->inline_vars[depth] = vars;
+    compiler->inline_depth--;
+    return result;
+}
+
+//
+//
+//
+
+static RiVmParam
+rivm_value_param_(RiVmFuncCompiler* compiler, uint32_t value)
+{
+    RiVmIrInst* inst = rivm_ir_inst(&compiler->ir, value);
+    if (inst->op == RiVmIr_Const) {
+        return rivm_make_param(Imm, .type = inst->type, .imm = inst->imm);
+    }
+    return rivm_make_param(Slot,
+        .type = inst->type,
+        .slot.kind = inst->op == RiVmIr_Param ? RiSlot_Input : RiSlot_Temporary,
+        .slot.index = array_at(&compiler->slot, value)
+    );
+}
+
+static RiVmParam
+rivm_block_label_(uint32_t block)
+{
+    return (RiVmParam) {
+        .kind = RiVmParam_Label,
+        .label = block + 1
+    };
+}
+
+static bool
+rivm_has_phis_(RiVmIrFunc* func, uint32_t block)
+{
+    RiVmIrBlock* b = rivm_ir_block_at(func, block);
+    return b->inst.count && rivm_ir_inst(func, b->inst.items[0])->op == RiVmIr_Phi;
+}
+
+static bool
+rivm_is_copy_source_(RiVmInst* copies, iptr count, RiVmParam slot)
+{
+    for (iptr i = 0; i < count; ++i) {
+        if (copies[i].param1.kind == RiVmParam_Slot && copies[i].param1.slot.index == slot.slot.index) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Sets the phis of `target` to their arguments from `block`. Phis are set all at once, so a phi
+// that's an argument of another is set after it's read, and a cycle of them is broken by copying
+// one aside.
+static void
+rivm_emit_phi_copies_(RiVmFuncCompiler* compiler, uint32_t block, uint32_t target)
+{
+    RiVmIrFunc* func = &compiler->ir;
+    RiVmIrBlock* t = rivm_ir_block_at(func, target);
+    iptr pred = rivm_ir_pred_index(func, target, block);
+    RI_CHECK(pred >= 0);
+
+    RiVmInst* copies = arena_push_nt(&compiler->arena, RiVmInst, MAXIMUM(t->inst.count, 1));
+    iptr count = 0;
+    for (iptr i = 0; i < t->inst.count; ++i) {
+        uint32_t phi = t->inst.items[i];
+        RiVmIrInst* inst = rivm_ir_inst(func, phi);
+        if (inst->op != RiVmIr_Phi) {
+            break;
+        }
+        uint32_t arg = inst->args.items[pred];
+        if (arg != phi) {
+            copies[count++] = (RiVmInst) {
+                .op = RiVmOp_Assign,
+                rivm_value_param_(compiler, phi),
+                rivm_value_param_(compiler, arg)
+            };
         }
     }
 
-    rivm_patch_(compiler, module);
+    while (count) {
+        bool progress = false;
+        for (iptr i = 0; i < count;) {
+            if (rivm_is_copy_source_(copies, count, copies[i].param0)) {
+                ++i;
+            } else {
+                rivm_code_emit_(compiler, copies[i]);
+                copies[i] = copies[--count];
+                progress = true;
+            }
+        }
+        if (!progress) {
+            RiVmParam from = copies[0].param0;
+            RiVmParam aside = from;
+            if (compiler->slot_aside == RIVM_IR_UNREACHABLE) {
+                compiler->slot_aside = compiler->slot_next++;
+            }
+            aside.slot.index = compiler->slot_aside;
+            rivm_code_emit(compiler, Assign, aside, from);
+            for (iptr i = 0; i < count; ++i) {
+                if (copies[i].param1.kind == RiVmParam_Slot && copies[i].param1.slot.index == from.slot.index) {
+                    copies[i].param1.slot.index = aside.slot.index;
+                }
+            }
+        }
+    }
+}
+
+// Whether the phi copies for the edge from `block` to `target[j]` of its `branch` can go before
+// the branch, so it goes to the target directly. They then also run when it goes to the other
+// target, which is fine as long as the phis they set aren't read there before being set again:
+// the other target isn't dominated by `target[j]`, and neither the condition nor its own phis
+// read them.
+static bool
+rivm_can_hoist_phi_copies_(RiVmFuncCompiler* compiler, uint32_t block, RiVmIrInst* branch, int j)
+{
+    RiVmIrFunc* func = &compiler->ir;
+    uint32_t target = branch->target.items[j];
+    uint32_t other = branch->target.items[1 - j];
+    if (!rivm_has_phis_(func, target) || rivm_ir_dominates(func, target, other)) {
+        return false;
+    }
+    RiVmIrInst* condition = rivm_ir_inst(func, branch->args.items[0]);
+    if (condition->op == RiVmIr_Phi && condition->block == target) {
+        return false;
+    }
+    RiVmIrBlock* b = rivm_ir_block_at(func, other);
+    iptr pred = rivm_ir_pred_index(func, other, block);
+    for (iptr i = 0; i < b->inst.count; ++i) {
+        RiVmIrInst* phi = rivm_ir_inst(func, b->inst.items[i]);
+        if (phi->op != RiVmIr_Phi) {
+            break;
+        }
+        RiVmIrInst* arg = rivm_ir_inst(func, phi->args.items[pred]);
+        if (arg->op == RiVmIr_Phi && arg->block == target) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Live ranges of values, by positions of instructions in block order, see `rivm_assign_slots_`.
+typedef struct RiVmLiveness_ {
+    RiVmIrFunc* func;
+    // Position of each instruction, and of the first and the last instruction of each block.
+    uint32_t* pos;
+    uint32_t* first;
+    uint32_t* last;
+    // Range of each value, `RIVM_IR_UNREACHABLE` for values with a fixed slot or none.
+    uint32_t* start;
+    uint32_t* end;
+    // Blocks the value being walked is live into are marked with it.
+    uint32_t* mark;
+} RiVmLiveness_;
+
+static inline void
+rivm_live_extend_(RiVmLiveness_* L, uint32_t value, uint32_t pos)
+{
+    L->start[value] = MINIMUM(L->start[value], pos);
+    L->end[value] = MAXIMUM(L->end[value], pos);
+}
+
+// Extends the range of `value` to its use at `pos` in `block`, and through the blocks on the way
+// there from its definition. The range is a single interval, so it also covers the blocks in
+// between, like the whole body of a loop the value is live around.
+static void
+rivm_live_use_(RiVmLiveness_* L, uint32_t value, uint32_t block, uint32_t pos, RiVmIrIndexArray* stack)
+{
+    RiVmIrFunc* func = L->func;
+    uint32_t def = rivm_ir_inst(func, value)->block;
+    rivm_live_extend_(L, value, pos);
+    if (block == def || L->mark[block] == value) {
+        return;
+    }
+    L->mark[block] = value;
+    stack->count = 0;
+    arena_array_push(func->arena, stack, block);
+    while (stack->count) {
+        uint32_t b = stack->items[--stack->count];
+        rivm_live_extend_(L, value, L->first[b]);
+        RiVmIrBlock* B = rivm_ir_block_at(func, b);
+        for (iptr i = 0; i < B->pred.count; ++i) {
+            uint32_t pred = B->pred.items[i];
+            rivm_live_extend_(L, value, L->last[pred]);
+            if (pred != def && L->mark[pred] != value) {
+                L->mark[pred] = value;
+                arena_array_push(func->arena, stack, pred);
+            }
+        }
+    }
+}
+
+// Values that don't need a slot by liveness: inputs, constants, and the slot ranges of structs and
+// of calls with more outputs, which are kept for the whole function.
+static bool
+rivm_has_live_range_(Ri* ri, RiVmIrInst* inst)
+{
+    switch (inst->op)
+    {
+        case RiVmIr_Const:
+        case RiVmIr_Param:
+        case RiVmIr_Result:
+        case RiVmIr_Local:
+            return false;
+        case RiVmIr_Call:
+            return rivm_outputs_count_(ri, inst->func) <= 1;
+        default:
+            return !rivm_ir_is_terminator(inst->op) && !rivm_ir_is_store(inst->op);
+    }
+}
+
+// Inputs are in the first slots, structs and calls with more outputs get slots of their own, other
+// values share slots when their live ranges don't overlap (linear scan, Poletto and Sarkar).
+// A phi is live from the end of each predecessor, where it's set, so it never shares a slot with
+// a value that's live out of one, and copies hoisted above a branch can't overwrite those.
+static void
+rivm_assign_slots_(RiVmFuncCompiler* compiler)
+{
+    RiVmIrFunc* func = &compiler->ir;
+    Arena* arena = &compiler->arena;
+    iptr count = func->inst.count;
+
+    arena_array_resize(arena, &compiler->slot, count);
+    compiler->slot_next = func->inputs_count;
+    compiler->slot_aside = RIVM_IR_UNREACHABLE;
+
+    RiVmLiveness_ L = {
+        .func = func,
+        .pos = arena_push_nt(arena, uint32_t, count),
+        .first = arena_push_nt(arena, uint32_t, func->block.count),
+        .last = arena_push_nt(arena, uint32_t, func->block.count),
+        .start = arena_push_nt(arena, uint32_t, count),
+        .end = arena_push_nt(arena, uint32_t, count),
+        .mark = arena_push_nt(arena, uint32_t, func->block.count),
+    };
+    memset(L.start, 0xFF, count * sizeof(uint32_t));
+    memset(L.end, 0, count * sizeof(uint32_t));
+    memset(L.mark, 0xFF, func->block.count * sizeof(uint32_t));
+
+    // Positions, and fixed slots.
+    uint32_t positions = 0;
+    for (iptr k = 0; k < func->order.count; ++k) {
+        uint32_t block = func->order.items[k];
+        RiVmIrBlock* b = rivm_ir_block_at(func, block);
+        L.first[block] = positions;
+        for (iptr i = 0; i < b->inst.count; ++i) {
+            uint32_t value = b->inst.items[i];
+            RiVmIrInst* inst = rivm_ir_inst(func, value);
+            L.pos[value] = positions++;
+            if (rivm_has_live_range_(compiler->ri, inst)) {
+                rivm_live_extend_(&L, value, L.pos[value]);
+            } else if (inst->op == RiVmIr_Param) {
+                compiler->slot.items[value] = inst->param;
+            } else if (inst->op == RiVmIr_Local) {
+                // The address, then the struct in the slots after it.
+                compiler->slot.items[value] = compiler->slot_next++;
+                compiler->slot_next += (inst->size + sizeof(RiVmValue) - 1) / sizeof(RiVmValue);
+            } else if (inst->op == RiVmIr_Call) {
+                compiler->slot.items[value] = compiler->slot_next;
+                compiler->slot_next += (uint32_t)rivm_outputs_count_(compiler->ri, inst->func);
+            }
+        }
+        L.last[block] = positions - 1;
+    }
+
+    // Ranges.
+    RiVmIrIndexArray stack = {0};
+    for (iptr k = 0; k < func->order.count; ++k) {
+        uint32_t block = func->order.items[k];
+        RiVmIrBlock* b = rivm_ir_block_at(func, block);
+        for (iptr i = 0; i < b->inst.count; ++i) {
+            uint32_t value = b->inst.items[i];
+            RiVmIrInst* inst = rivm_ir_inst(func, value);
+            if (inst->op == RiVmIr_Result) {
+                // Set by the callee in the slots after the call's.
+                compiler->slot.items[value] = compiler->slot.items[inst->args.items[0]] + inst->output;
+            }
+            for (iptr j = 0; j < inst->args.count; ++j) {
+                uint32_t arg = inst->args.items[j];
+                if (!rivm_has_live_range_(compiler->ri, rivm_ir_inst(func, arg))) {
+                    continue;
+                }
+                if (inst->op == RiVmIr_Phi) {
+                    // Read at the end of the predecessor.
+                    uint32_t pred = b->pred.items[j];
+                    rivm_live_use_(&L, arg, pred, L.last[pred], &stack);
+                } else {
+                    rivm_live_use_(&L, arg, block, L.pos[value], &stack);
+                }
+            }
+            if (inst->op == RiVmIr_Phi) {
+                for (iptr j = 0; j < b->pred.count; ++j) {
+                    rivm_live_extend_(&L, value, L.last[b->pred.items[j]]);
+                }
+            }
+        }
+    }
+
+    // Values by the position their range starts at, and by the one it ends at.
+    uint32_t* starting = arena_push_nt(arena, uint32_t, MAXIMUM(positions, 1));
+    uint32_t* ending = arena_push_nt(arena, uint32_t, MAXIMUM(positions, 1));
+    uint32_t* next_starting = arena_push_nt(arena, uint32_t, count);
+    uint32_t* next_ending = arena_push_nt(arena, uint32_t, count);
+    memset(starting, 0xFF, MAXIMUM(positions, 1) * sizeof(uint32_t));
+    memset(ending, 0xFF, MAXIMUM(positions, 1) * sizeof(uint32_t));
+    for (uint32_t value = 0; value < count; ++value) {
+        if (L.start[value] != RIVM_IR_UNREACHABLE) {
+            next_starting[value] = starting[L.start[value]];
+            starting[L.start[value]] = value;
+        }
+    }
+
+    // Slots of ranges that ended before the position are free.
+    RiVmIrIndexArray free = {0};
+    for (uint32_t p = 0; p < positions; ++p) {
+        if (p > 0) {
+            for (uint32_t value = ending[p - 1]; value != RIVM_IR_UNREACHABLE; value = next_ending[value]) {
+                arena_array_push(arena, &free, compiler->slot.items[value]);
+            }
+        }
+        for (uint32_t value = starting[p]; value != RIVM_IR_UNREACHABLE; value = next_starting[value]) {
+            compiler->slot.items[value] = free.count ? free.items[--free.count] : compiler->slot_next++;
+            next_ending[value] = ending[L.end[value]];
+            ending[L.end[value]] = value;
+        }
+    }
+}
+
+// Generates VM code for `compiler->ir`, with blocks in reverse postorder, in slots given by
+// `rivm_assign_slots_`.
+// Phis are set right before jumping to their block, for branches before the branch when possible
+// (like the back edge of a loop), otherwise on a separate path.
+static void
+rivm_emit_func_(RiVmFuncCompiler* compiler)
+{
+    RiVmIrFunc* func = &compiler->ir;
+
+    rivm_assign_slots_(compiler);
+
+    // Labels of blocks first, by block index.
+    for (iptr i = 0; i < func->block.count; ++i) {
+        rivm_create_label_(compiler);
+    }
+
+    uint32_t enter_index = rivm_code_emit(compiler, Enter);
+    for (iptr k = 0; k < func->order.count; ++k) {
+        uint32_t block = func->order.items[k];
+        uint32_t next = k + 1 < func->order.count ? func->order.items[k + 1] : RIVM_IR_UNREACHABLE;
+        rivm_mark_label_(compiler, rivm_block_label_(block));
+
+        RiVmIrBlock* b = rivm_ir_block_at(func, block);
+        for (iptr i = 0; i < b->inst.count; ++i) {
+            uint32_t value = b->inst.items[i];
+            RiVmIrInst* inst = rivm_ir_inst(func, value);
+            switch (inst->op)
+            {
+                case RiVmIr_Param:
+                case RiVmIr_Phi:
+                case RiVmIr_Result:
+                    break;
+
+                case RiVmIr_Copy:
+                    rivm_code_emit(compiler, Assign,
+                        rivm_value_param_(compiler, value),
+                        rivm_value_param_(compiler, inst->args.items[0]));
+                    break;
+
+                case RiVmIr_Unary:
+                    rivm_code_emit_(compiler, (RiVmInst) {
+                        .op = inst->unary,
+                        rivm_value_param_(compiler, value),
+                        rivm_value_param_(compiler, inst->args.items[0])
+                    });
+                    break;
+
+                case RiVmIr_Binary:
+                    rivm_code_emit_(compiler, (RiVmInst) {
+                        .op = inst->binary,
+                        rivm_value_param_(compiler, value),
+                        rivm_value_param_(compiler, inst->args.items[0]),
+                        rivm_value_param_(compiler, inst->args.items[1])
+                    });
+                    break;
+
+                case RiVmIr_Call:
+                    for (iptr j = 0; j < inst->args.count; ++j) {
+                        rivm_code_emit(compiler, ArgPush, rivm_value_param_(compiler, inst->args.items[j]));
+                    }
+                    rivm_code_emit(compiler,
+                        Call,
+                        rivm_value_param_(compiler, value),
+                        rivm_make_param(Func,
+                            .func = inst->func
+                        ),
+                        rivm_outputs_count_(compiler->ri, inst->func) > 1
+                            ? rivm_make_param(Slot,
+                                .type = RiVmValue_U64,
+                                .slot.kind = RiSlot_Temporary,
+                                .slot.index = array_at(&compiler->slot, value) + 1
+                            )
+                            : (RiVmParam){0}
+                    );
+                    rivm_code_emit(compiler,
+                        ArgPopN,
+                        rivm_make_param(Imm,
+                            .type = RiVmValue_U64,
+                            .imm.i64 = inst->args.count
+                        )
+                    );
+                    break;
+
+                case RiVmIr_Local:
+                    rivm_code_emit(compiler, AddrOf,
+                        rivm_value_param_(compiler, value),
+                        rivm_make_param(Slot,
+                            .type = RiVmValue_U64,
+                            .slot.kind = RiSlot_Temporary,
+                            .slot.index = array_at(&compiler->slot, value) + 1
+                        )
+                    );
+                    break;
+
+                case RiVmIr_Load:
+                    rivm_code_emit_(compiler, (RiVmInst) {
+                        .op = inst->memory.op,
+                        rivm_value_param_(compiler, value),
+                        rivm_value_param_(compiler, inst->args.items[0]),
+                        rivm_make_param(Imm,
+                            .type = RiVmValue_U64,
+                            .imm.u64 = inst->memory.offset
+                        )
+                    });
+                    break;
+
+                case RiVmIr_Store:
+                    rivm_code_emit_(compiler, (RiVmInst) {
+                        .op = inst->memory.op,
+                        rivm_value_param_(compiler, inst->args.items[0]),
+                        rivm_make_param(Imm,
+                            .type = RiVmValue_U64,
+                            .imm.u64 = inst->memory.offset
+                        ),
+                        rivm_value_param_(compiler, inst->args.items[1])
+                    });
+                    break;
+
+                case RiVmIr_MemCopy:
+                    rivm_code_emit(compiler, MemCopy,
+                        rivm_value_param_(compiler, inst->args.items[0]),
+                        rivm_value_param_(compiler, inst->args.items[1]),
+                        rivm_make_param(Imm,
+                            .type = RiVmValue_U64,
+                            .imm.u64 = inst->size
+                        )
+                    );
+                    break;
+
+                case RiVmIr_MemZero:
+                    rivm_code_emit(compiler, MemZero,
+                        rivm_value_param_(compiler, inst->args.items[0]),
+                        rivm_make_param(Imm,
+                            .type = RiVmValue_U64,
+                            .imm.u64 = inst->size
+                        )
+                    );
+                    break;
+
+                case RiVmIr_Jump:
+                    rivm_emit_phi_copies_(compiler, block, inst->target.items[0]);
+                    if (inst->target.items[0] != next) {
+                        rivm_code_emit(compiler, GoTo, rivm_block_label_(inst->target.items[0]));
+                    }
+                    break;
+
+                case RiVmIr_Branch: {
+                    int hoisted = -1;
+                    for (int j = 0; j < 2 && hoisted < 0; ++j) {
+                        if (rivm_can_hoist_phi_copies_(compiler, block, inst, j)) {
+                            hoisted = j;
+                            rivm_emit_phi_copies_(compiler, block, inst->target.items[j]);
+                        }
+                    }
+                    bool stub[2];
+                    RiVmParam labels[2];
+                    for (int j = 0; j < 2; ++j) {
+                        stub[j] = j != hoisted && rivm_has_phis_(func, inst->target.items[j]);
+                        labels[j] = stub[j] ? rivm_create_label_(compiler) : rivm_block_label_(inst->target.items[j]);
+                    }
+                    rivm_code_emit(compiler, If, rivm_value_param_(compiler, inst->args.items[0]), labels[0], labels[1]);
+                    for (int j = 0; j < 2; ++j) {
+                        if (stub[j]) {
+                            rivm_mark_label_(compiler, labels[j]);
+                            rivm_emit_phi_copies_(compiler, block, inst->target.items[j]);
+                            // The last one can fall through.
+                            if (inst->target.items[j] != next || (j == 0 && stub[1])) {
+                                rivm_code_emit(compiler, GoTo, rivm_block_label_(inst->target.items[j]));
+                            }
+                        }
+                    }
+                } break;
+
+                case RiVmIr_Switch: {
+                    // Targets with phis go through a stub setting them.
+                    RiVmParam* labels = arena_push_nt(&compiler->arena, RiVmParam, inst->target.count);
+                    for (iptr j = 0; j < inst->target.count; ++j) {
+                        uint32_t target = inst->target.items[j];
+                        labels[j] = rivm_has_phis_(func, target) ? rivm_create_label_(compiler) : rivm_block_label_(target);
+                    }
+                    rivm_code_emit(compiler, Switch,
+                        rivm_value_param_(compiler, inst->args.items[0]),
+                        rivm_make_param(Imm,
+                            .type = RiVmValue_I64,
+                            .imm.i64 = inst->cases.min
+                        ),
+                        rivm_make_param(Imm,
+                            .type = RiVmValue_U64,
+                            .imm.u64 = inst->cases.table.count
+                        )
+                    );
+                    for (iptr j = 0; j < inst->cases.table.count; ++j) {
+                        rivm_code_emit(compiler, GoTo, labels[inst->cases.table.items[j]]);
+                    }
+                    rivm_code_emit(compiler, GoTo, labels[0]);
+                    for (iptr j = 0; j < inst->target.count; ++j) {
+                        uint32_t target = inst->target.items[j];
+                        if (labels[j].label != rivm_block_label_(target).label) {
+                            rivm_mark_label_(compiler, labels[j]);
+                            rivm_emit_phi_copies_(compiler, block, target);
+                            rivm_code_emit(compiler, GoTo, rivm_block_label_(target));
+                        }
+                    }
+                } break;
+
+                case RiVmIr_Ret:
+                    for (iptr j = 1; j < inst->args.count; ++j) {
+                        rivm_code_emit(compiler, Output,
+                            rivm_make_param(Imm,
+                                .type = RiVmValue_U64,
+                                .imm.u64 = j - 1
+                            ),
+                            rivm_value_param_(compiler, inst->args.items[j]));
+                    }
+                    if (inst->args.count) {
+                        rivm_code_emit(compiler, Ret, rivm_value_param_(compiler, inst->args.items[0]));
+                    } else {
+                        rivm_code_emit(compiler, Ret);
+                    }
+                    break;
+
+                case RiVmIr_TailCall:
+                    for (iptr j = 0; j < inst->args.count; ++j) {
+                        rivm_code_emit(compiler, ArgPush, rivm_value_param_(compiler, inst->args.items[j]));
+                    }
+                    rivm_code_emit(compiler,
+                        TailCall,
+                        rivm_make_param(Imm,
+                            .type = RiVmValue_U64,
+                            .imm.i64 = inst->args.count
+                        ),
+                        rivm_make_param(Func,
+                            .func = inst->func
+                        )
+                    );
+                    break;
+
+                default:
+                    RI_UNREACHABLE;
+                    break;
+            }
+        }
+    }
+
+    RiVmInst* enter = &array_at(&compiler->code, enter_index);
+    enter->param0 = rivm_make_param(Imm,
+        .type = RiVmValue_U64,
+        .imm.u64 = compiler->slot_next - func->inputs_count
+    );
+}
+
+// Tail calls reuse the frame from its start, where structs of the function can be, and arguments
+// can point to them. Functions with structs call and return instead.
+static void
+rivm_untail_calls_(RiVmFuncCompiler* compiler)
+{
+    RiVmIrFunc* func = &compiler->ir;
+    for (uint32_t block = 0; block < func->block.count; ++block) {
+        RiVmIrBlock* b = rivm_ir_block_at(func, block);
+        if (!b->inst.count) {
+            continue;
+        }
+        uint32_t call = b->inst.items[b->inst.count - 1];
+        RiVmIrInst* inst = rivm_ir_inst(func, call);
+        if (inst->op != RiVmIr_TailCall) {
+            continue;
+        }
+        RiNode* ast_callee = inst->func;
+        iptr count = rivm_outputs_count_(compiler->ri, ast_callee);
+        inst->op = RiVmIr_Call;
+        inst->type = count ? rivm_get_output_type_(compiler, ast_callee, 0) : RiVmValue_None;
+        uint32_t* results = arena_push_nt(&compiler->arena, uint32_t, MAXIMUM(count, 1));
+        results[0] = call;
+        for (iptr i = 1; i < count; ++i) {
+            results[i] = rivm_ir_result(func, block, rivm_get_output_type_(compiler, ast_callee, i), call, (uint32_t)i);
+        }
+        rivm_ir_ret_values(func, block, results, count);
+    }
+}
+
+static void
+rivm_patch_label_(RiVmFuncCompiler* compiler, RiVmParam* param)
+{
+    param->kind = RiVmParam_Imm;
+    param->type = RiVmValue_U64;
+    param->imm.u64 = array_at(&compiler->labels, param->label - 1);
+}
+
+// Labels are local to the function, so they're resolved right after its code is generated.
+static void
+rivm_patch_labels_(RiVmFuncCompiler* compiler)
+{
+    for (iptr i = 0; i < compiler->code.count; ++i) {
+        RiVmInst* inst = &compiler->code.items[i];
+        switch (inst->op)
+        {
+            case RiVmOp_If: {
+                rivm_patch_label_(compiler, &inst->param1);
+                rivm_patch_label_(compiler, &inst->param2);
+            } break;
+
+            case RiVmOp_GoTo: {
+                rivm_patch_label_(compiler, &inst->param0);
+            } break;
+            default: break;
+        }
+    }
+}
+
+static RiVmInstSlice
+rivm_compile_func_(RiVmFuncCompiler* compiler, RiNode* ast_func)
+{
+    compiler->ast_func = ast_func;
+    iptr scratch = compiler->arena.head;
+    RiVmIrFunc* func = &compiler->ir;
+    Ri* ri = compiler->ri;
+
+    RiNode* ast_func_type = ri_node_(ri, ast_func->spec.func.type);
+    RiNodeArray* inputs = &ast_func_type->spec.type.func.inputs;
+    RI_ASSERT(ast_func_type->spec.type.func.outputs.count <= RIVM_OUTPUTS_MAX);
+
+    map_clear(&compiler->vars);
+    rivm_ir_init(func, &compiler->arena, (uint32_t)inputs->count);
+    compiler->block = 0;
+    compiler->block_break = RIVM_IR_UNREACHABLE;
+    compiler->block_continue = RIVM_IR_UNREACHABLE;
+    compiler->block_fallthrough = RIVM_IR_UNREACHABLE;
+    compiler->block_return = RIVM_IR_UNREACHABLE;
+    compiler->var_return = RIVM_IR_UNREACHABLE;
+    compiler->inline_size = 0;
+    compiler->locals = false;
+    // Inputs are variables set to the arguments.
+    // TODO: Only named args.
+    for (iptr i = 0; i < inputs->count; ++i) {
+        RiNode* ast_input = ri_nodes_at_(ri, inputs, i);
+        RI_ASSERT(ast_input->kind == RiNode_Decl);
+        RiNode* ast_spec = ri_node_(ri, ast_input->decl.spec);
+        RI_ASSERT(ast_spec->kind == RiNode_Spec_Var);
+        RiVmValueType type = rivm_get_type_(compiler, ri_get_spec_(ri, ast_spec->spec.var.type));
+        uint32_t var = rivm_get_var_(compiler, ast_spec, type);
+        rivm_ir_write_var(func, var, 0, rivm_ir_param(func, (uint32_t)i, type));
+    }
+
+    rivm_compile_st_(compiler, ri_node_(ri, ast_func->spec.func.scope));
+    if (!rivm_ir_is_terminated(func, compiler->block)) {
+        rivm_ir_ret(func, compiler->block, RIVM_IR_NONE);
+    }
+    if (compiler->locals) {
+        rivm_untail_calls_(compiler);
+    }
+    rivm_ir_finish(func);
+    rivm_ir_optimize(func, compiler->opt_level);
+
+    rivm_emit_func_(compiler);
+    rivm_patch_labels_(compiler);
+
+    // Code is the last thing in `done`, unless it outgrew a block, so the capacity it didn't use is
+    // returned. The rest is dropped.
+    if ((void*)(compiler->code.items + compiler->code.capacity) == compiler->done.it) {
+        arena_rewind(&compiler->done, compiler->done.head - (compiler->code.capacity - compiler->code.count) * sizeof(RiVmInst));
+    }
+    RiVmInstSlice code = compiler->code.slice;
+
+    compiler->code = (RiVmInstArray){0};
+    compiler->slot = (RiVmSlotIndexArray){0};
+    compiler->labels = (RiVmSlotIndexArray){0};
+    compiler->slot_next = 0;
+    arena_rewind(&compiler->arena, scratch);
+    return code;
+}
+
+static THREAD_FOR_F(rivm_compile_func_job_)
+{
+    RiVmCompiler* compiler = user;
+    RiNode* ast_func = array_at(&compiler->ast_funcs, index);
+    RiVmFuncCompiler* func_compiler = &compiler->funcs[thread];
+    func_compiler->inlined = &array_at(&compiler->inlined, index);
+    array_clear(func_compiler->inlined);
+    array_at(&compiler->code, index) = rivm_compile_func_(func_compiler, ast_func);
+}
+
+// Adds functions in `compiler->ast_funcs` to the module and links their calls:
+// `RiVmParam_Func` refers to the AST function until all functions have slots, then to the slot.
+static void
+rivm_link_(RiVmCompiler* compiler, RiVmModule* module, uint32_t* funcs)
+{
+    for (iptr i = 0; i < compiler->ast_funcs.count; ++i) {
+        RiNode* ast_func_type = ri_node_(compiler->ri, array_at(&compiler->ast_funcs, i)->spec.func.type);
+        funcs[i] = rivm_module_add_func(module, array_at(&compiler->code, i),
+            ast_func_type->spec.type.func.inputs.count,
+            ast_func_type->spec.type.func.outputs.count);
+
+        RiVmInstSlice code = rivm_module_func_code(module, funcs[i]);
+        for (iptr j = 0; j < code.count; ++j) {
+            RiVmInst* inst = &code.items[j];
+            if (inst->op == RiVmOp_Call || inst->op == RiVmOp_TailCall) {
+                RI_CHECK(inst->param1.kind == RiVmParam_Func);
+                RiNode* ast_callee = inst->param1.func;
+                RI_CHECK(ast_callee);
+                RI_CHECK(ast_callee->spec.func.slot != RI_INVALID_SLOT);
+                inst->param1.func = NULL;
+                inst->param1.func_slot = ast_callee->spec.func.slot;
+            }
+        }
+    }
+}
+
+// Compiles functions in `compiler->ast_funcs` and makes them the functions in their slots.
+// Functions in new slots are published first, as only the others can be called already.
+// NOTE: A call racing with the update can still see some functions replaced and others not.
+static void
+rivm_compile_funcs_(RiVmCompiler* compiler, RiVmModule* module)
+{
+    compiler->module = module;
+
+    int threads = MAXIMUM(compiler->threads, 1);
+    if (compiler->funcs_count < threads) {
+        compiler->funcs = heap_realloc(compiler->funcs, threads * sizeof(RiVmFuncCompiler));
+        memset(compiler->funcs + compiler->funcs_count, 0, (threads - compiler->funcs_count) * sizeof(RiVmFuncCompiler));
+        compiler->funcs_count = threads;
+    }
+    for (int i = 0; i < compiler->funcs_count; ++i) {
+        RiVmFuncCompiler* func_compiler = &compiler->funcs[i];
+        func_compiler->ri = compiler->ri;
+        func_compiler->opt_level = compiler->opt_level;
+        func_compiler->checked = compiler->checked;
+        if (func_compiler->arena.block_size == 0) {
+            arena_init(&func_compiler->arena, MEGABYTES(1));
+        }
+        if (func_compiler->done.block_size == 0) {
+            arena_init(&func_compiler->done, MEGABYTES(1));
+        }
+    }
+
+    array_resize(&compiler->code, compiler->ast_funcs.count);
+    if (compiler->inlined.count < compiler->ast_funcs.count) {
+        iptr count = compiler->inlined.count;
+        array_resize(&compiler->inlined, compiler->ast_funcs.count);
+        memset(compiler->inlined.items + count, 0, (compiler->inlined.count - count) * sizeof(RiVmSlotIndexArray));
+    }
+    thread_for(threads, compiler->ast_funcs.count, &rivm_compile_func_job_, compiler);
+
+    uint32_t* funcs = heap_alloc(MAXIMUM(compiler->ast_funcs.count, 1) * sizeof(uint32_t));
+    rivm_link_(compiler, module, funcs);
+    for (int i = 0; i < compiler->funcs_count; ++i) {
+        arena_rewind(&compiler->funcs[i].done, 0);
+    }
+
+    for (int pass = 0; pass < 2; ++pass) {
+        for (iptr i = 0; i < compiler->ast_funcs.count; ++i) {
+            uint32_t slot = array_at(&compiler->ast_funcs, i)->spec.func.slot;
+            if ((array_at(&module->slot, slot) == RIVM_INVALID_FUNC) == (pass == 0)) {
+                rivm_module_replace_func(module, slot, funcs[i]);
+            }
+        }
+    }
+    heap_free(funcs);
+}
+
+bool
+rivm_compile(RiVmCompiler* compiler, RiNode* ast_module, RiVmModule* module)
+{
+    compiler->module = module;
+
+    RI_ASSERT(ast_module->kind == RiNode_Module);
+    Ri* ri = compiler->ri;
+    RiNode* ast_scope = ri_node_(ri, ast_module->module.scope);
+
+    // Functions get their slots up front, so calls can refer to them before they're compiled.
+    array_clear(&compiler->ast_funcs);
+    RiNode* ast_decl;
+    ri_nodes_each_(ri, &ast_scope->scope.decl, &ast_decl)
+    {
+        RI_ASSERT(ast_decl->kind == RiNode_Decl);
+        RiNode* ast_spec = ri_node_(ri, ast_decl->decl.spec);
+        if (ast_spec->kind == RiNode_Spec_Func) {
+            ast_spec->spec.func.slot = rivm_module_push_slot(module);
+            array_push(&compiler->ast_funcs, ast_spec);
+        }
+    }
+    rivm_compile_funcs_(compiler, module);
 
     return true;
 }
@@ -592,7 +2312,7 @@ rivm_compile_file(String path, RiVmModule* module)
     }
 
     ri_dump(&ri, ast_module, &out);
-    LOG("%S", out);
+    LOG("%S", out.slice);
 
     RiVmCompiler compiler;
     rivm_init(&compiler, &ri);
@@ -603,7 +2323,7 @@ rivm_compile_file(String path, RiVmModule* module)
 
     array_clear(&out);
     rivm_dump_module(module, &out);
-    LOG("%S", out);
+    LOG("%S", out.slice);
 
     array_purge(&out);
     rivm_purge(&compiler);
@@ -2,29 +2,95 @@
 
 #include "ri.h"
 #include "rivm.h"
+#include "rivm-ir.h"
 
 typedef struct RiVmCompiler RiVmCompiler;
+typedef struct RiVmFuncCompiler RiVmFuncCompiler;
 
 //
 //
 //
 
-struct RiVmCompiler
+typedef Slice(uint32_t) RiVmSlotIndexSlice;
+typedef ArrayWithSlice(RiVmSlotIndexSlice) RiVmSlotIndexArray;
+
+// Calls are inlined this many levels deep at most.
+#define RIVM_INLINE_DEPTH_MAX 2
+
+// State of generating code for one function.
+// Functions don't share any, so they can be compiled in parallel.
+// The function is built in SSA form (see `RiVmIrFunc`), optimized, then VM code is generated
+// from it. Arrays below are in `arena`, which is rewound after every function, except `code`.
+struct RiVmFuncCompiler
 {
     Ri* ri;
-    RiVmModule* module;
-    
-    RiVmInstArray code;
+    Arena arena;
+    // Code of the functions compiled on this thread, until it's added to the module.
+    Arena done;
+    RiVmOptLevel opt_level;
+    bool checked;
 
-    uint32_t slot_next;
-    Array(uint32_t) slot_pool;
-    Array(RiVmParam) slot;
+    RiVmIrFunc ir;
+    // Block the code of statements goes to.
+    uint32_t block;
+    // Targets of `break`, `continue` and `fallthrough`, `RIVM_IR_UNREACHABLE` outside of loops
+    // and switches.
+    uint32_t block_break;
+    uint32_t block_continue;
+    uint32_t block_fallthrough;
+    // AST variable to its IR variable + 1.
+    Map vars;
 
-    Array(uint32_t) labels;
+    // Functions whose body is being compiled in place of a call, and `vars` of their callers
+    // (spare maps when not inlining).
+    RiNode* inline_funcs[RIVM_INLINE_DEPTH_MAX];
+    Map inline_vars[RIVM_INLINE_DEPTH_MAX];
+    int inline_depth;
+    // Size of the bodies inlined so far, see `rivm_inline_size_`.
+    iptr inline_size;
+    // Where `return` goes while inlining, and the variable it sets.
+    uint32_t block_return;
+    uint32_t var_return;
+    // Slots of the functions inlined, in `RiVmCompiler.inlined`.
+    RiVmSlotIndexArray* inlined;
+    // Whether a struct has a region in the frame, which rules out tail calls.
+    bool locals;
+
+    RiVmInstArray code;
+    uint32_t slot_next;
+    // Slot a cycle of phi copies is broken with, `RIVM_IR_UNREACHABLE` until needed.
+    uint32_t slot_aside;
+    // Slot of each IR value.
+    RiVmSlotIndexArray slot;
+    // Code index of each IR block, then of other labels.
+    RiVmSlotIndexArray labels;
 
     RiNode* ast_func;
 };
 
+struct RiVmCompiler
+{
+    Ri* ri;
+    RiVmModule* module;
+
+    // Functions are compiled on this many threads (0 and 1 are serial).
+    int threads;
+    // Optimization level of the module's functions.
+    RiVmOptLevel opt_level;
+    // Integer `+`, `-` and `*` check for overflow, the call traps with `RiVmTrap_Overflow` before
+    // its function stores, outputs, calls, jumps or returns after it.
+    bool checked;
+    // One per thread.
+    RiVmFuncCompiler* funcs;
+    int funcs_count;
+    Array(RiNode*) ast_funcs;
+    // Code of each function in `ast_funcs`, in `done` of the thread that compiled it.
+    Array(RiVmInstSlice) code;
+    // Slots of the functions inlined into each function in `ast_funcs`, at any depth.
+    // Their changes have to be compiled into it too.
+    Array(RiVmSlotIndexArray) inlined;
+};
+
 void rivm_init(RiVmCompiler* rix, Ri* ri);
 void rivm_purge(RiVmCompiler* rix);
 bool rivm_compile(RiVmCompiler* rix, RiNode* ast_module, RiVmModule* module);
@@ -50,6 +50,8 @@ rivm_dump_param_(RiVmParam* param, CharArray* out)
                 case RiVmValue_I64: chararray_push_f(out, "%"PRIi64 RIVM_DUMP_PARAM_TYPE_ "", param->imm.i64, RIVM_DEBUG_TYPE_NAMES_SHORT_[param->type]); break;
                 case RiVmValue_U32: chararray_push_f(out, "%"PRIu32 RIVM_DUMP_PARAM_TYPE_ "", param->imm.u32, RIVM_DEBUG_TYPE_NAMES_SHORT_[param->type]); break;
                 case RiVmValue_U64: chararray_push_f(out, "%"PRIu64 RIVM_DUMP_PARAM_TYPE_ "", param->imm.u64, RIVM_DEBUG_TYPE_NAMES_SHORT_[param->type]); break;
+                case RiVmValue_F32: chararray_push_f(out, "%g" RIVM_DUMP_PARAM_TYPE_ "", (double)param->imm.f32, RIVM_DEBUG_TYPE_NAMES_SHORT_[param->type]); break;
+                case RiVmValue_F64: chararray_push_f(out, "%g" RIVM_DUMP_PARAM_TYPE_ "", param->imm.f64, RIVM_DEBUG_TYPE_NAMES_SHORT_[param->type]); break;
                 default: RI_UNREACHABLE; break;
             }
             break;
@@ -60,7 +62,7 @@ rivm_dump_param_(RiVmParam* param, CharArray* out)
             chararray_push_f(out, "t%d" RIVM_DUMP_PARAM_TYPE_, param->slot.index, RIVM_DEBUG_TYPE_NAMES_SHORT_[param->type]);
             break;
         case RiVmParam_Func:
-            chararray_push_f(out, "func%d", param->func);
+            chararray_push_f(out, "func%d", param->func_slot);
             break;
         default:
             RI_UNREACHABLE;
@@ -81,14 +83,15 @@ rivm_dump_param_(RiVmParam* param, CharArray* out)
 // }
 
 void
-rivm_dump_func(RiVmFunc* func, CharArray* out)
+rivm_dump_func(RiVmModule* module, uint32_t func, CharArray* out)
 {
-    RiVmInst* it = func->code.items;
+    RiVmInstSlice code = rivm_module_func_code(module, func);
+    RiVmInst* it = code.items;
     CharArray s0 = {0};
     CharArray s1 = {0};
     CharArray s2 = {0};
 
-    for (iptr i = 0; i < func->code.count; ++i, ++it)
+    for (iptr i = 0; i < code.count; ++i, ++it)
     {
         // rivm_dump_labels(compiler, out, i);
 
@@ -103,36 +106,45 @@ rivm_dump_func(RiVmFunc* func, CharArray* out)
 
         chararray_push_f(out, "    %4d (", i);
         if (rivm_op_is_in(it->op, Binary)) {
-            chararray_push_f(out, "%S = %S %s %S", s0, s1, sop, s2);
+            chararray_push_f(out, "%S = %S %s %S", s0.slice, s1.slice, sop, s2.slice);
+        } else if (rivm_op_is_in(it->op, Unary)) {
+            chararray_push_f(out, "%S = %s %S", s0.slice, sop, s1.slice);
+        } else if (rivm_op_is_in(it->op, Load)) {
+            chararray_push_f(out, "%S = %s %S + %S", s0.slice, sop, s1.slice, s2.slice);
+        } else if (rivm_op_is_in(it->op, Store)) {
+            chararray_push_f(out, "%s %S + %S = %S", sop, s0.slice, s1.slice, s2.slice);
         } else {
             switch (it->op)
             {
                 case RiVmOp_Assign:
-                    chararray_push_f(out, "%S = %S", s0, s1);
+                    chararray_push_f(out, "%S = %S", s0.slice, s1.slice);
                     break;
 
                 case RiVmOp_AddrOf:
-                    chararray_push_f(out, "%S = (%s %S)", s0, sop, s1);
+                    chararray_push_f(out, "%S = (%s %S)", s0.slice, sop, s1.slice);
                     break;
 
                case RiVmOp_Call:
-                    chararray_push_f(out, "%S = (%s %S)", s0, sop, s1);
+                    chararray_push_f(out, "%S = (%s %S)", s0.slice, sop, s1.slice);
+                    if (it->param2.kind) {
+                        chararray_push_f(out, " outputs %S", s2.slice);
+                    }
                     break;
 
                 case RiVmOp_If:
-                    chararray_push_f(out, "%s %S != 0 then (goto %S) else (goto %S)", sop, s0, s1, s2);
+                    chararray_push_f(out, "%s %S != 0 then (goto %S) else (goto %S)", sop, s0.slice, s1.slice, s2.slice);
                     break;
 
                 default:
                     chararray_push_f(out, "%s", sop);
                     if (it->param0.kind) {
-                        chararray_push_f(out, " %S", s0);
+                        chararray_push_f(out, " %S", s0.slice);
                     }
                     if (it->param1.kind) {
-                        chararray_push_f(out, " %S", s1);
+                        chararray_push_f(out, " %S", s1.slice);
                     }
                     if (it->param2.kind) {
-                        chararray_push_f(out, " %S", s2);
+                        chararray_push_f(out, " %S", s2.slice);
                     }
                     break;
             }
@@ -145,12 +157,131 @@ rivm_dump_func(RiVmFunc* func, CharArray* out)
     array_purge(&s2);
 }
 
+static void
+rivm_dump_ir_value_(RiVmIrFunc* func, uint32_t value, CharArray* out)
+{
+    RiVmIrInst* inst = rivm_ir_inst(func, value);
+    if (inst->op == RiVmIr_Const) {
+        RiVmParam param = rivm_make_param(Imm, .type = inst->type, .imm = inst->imm);
+        rivm_dump_param_(&param, out);
+    } else {
+        chararray_push_f(out, "v%d", value);
+    }
+}
+
+// Blocks in order with their predecessors, constants inline:
+//
+//     b1 <- b0 b2
+//         v5 = phi v1 v7
+//         v6 = v5 < 10
+//         branch v6 b2 b3
+//
+void
+rivm_dump_ir(RiVmIrFunc* func, CharArray* out)
+{
+    for (iptr k = 0; k < func->order.count; ++k) {
+        uint32_t block = func->order.items[k];
+        RiVmIrBlock* b = rivm_ir_block_at(func, block);
+        chararray_push_f(out, "b%d", block);
+        if (b->pred.count) {
+            chararray_push_f(out, " <-");
+            for (iptr i = 0; i < b->pred.count; ++i) {
+                chararray_push_f(out, " b%d", b->pred.items[i]);
+            }
+        }
+        chararray_push_f(out, "\n");
+
+        for (iptr i = 0; i < b->inst.count; ++i) {
+            uint32_t value = b->inst.items[i];
+            RiVmIrInst* inst = rivm_ir_inst(func, value);
+            chararray_push_f(out, "    ");
+            if (inst->type != RiVmValue_None && !rivm_ir_is_terminator(inst->op)) {
+                chararray_push_f(out, "v%d = ", value);
+            }
+            switch (inst->op)
+            {
+                case RiVmIr_Param:
+                    chararray_push_f(out, "param %d", inst->param);
+                    break;
+                case RiVmIr_Unary:
+                    chararray_push_f(out, "%s", RIVM_DEBUG_OP_NAMES_[inst->unary]);
+                    break;
+                case RiVmIr_Binary:
+                    rivm_dump_ir_value_(func, inst->args.items[0], out);
+                    chararray_push_f(out, " %s ", RIVM_DEBUG_OP_NAMES_[inst->binary]);
+                    rivm_dump_ir_value_(func, inst->args.items[1], out);
+                    break;
+                case RiVmIr_Call:
+                    chararray_push_f(out, "call %S", ((RiNode*)inst->func)->spec.id);
+                    break;
+                case RiVmIr_Result:
+                    chararray_push_f(out, "result %d of", inst->output);
+                    break;
+                case RiVmIr_Local:
+                    chararray_push_f(out, "local %d", inst->size);
+                    break;
+                case RiVmIr_Load:
+                case RiVmIr_Store:
+                    chararray_push_f(out, "%s +%d", RIVM_DEBUG_OP_NAMES_[inst->memory.op], inst->memory.offset);
+                    break;
+                case RiVmIr_MemCopy:
+                    chararray_push_f(out, "mem-copy %d", inst->size);
+                    break;
+                case RiVmIr_MemZero:
+                    chararray_push_f(out, "mem-zero %d", inst->size);
+                    break;
+                case RiVmIr_Copy:
+                    break;
+                case RiVmIr_Phi:
+                    chararray_push_f(out, "phi");
+                    break;
+                case RiVmIr_Jump:
+                    chararray_push_f(out, "jump b%d", inst->target.items[0]);
+                    break;
+                case RiVmIr_Branch:
+                    chararray_push_f(out, "branch");
+                    break;
+                case RiVmIr_Switch:
+                    chararray_push_f(out, "switch");
+                    break;
+                case RiVmIr_Ret:
+                    chararray_push_f(out, "ret");
+                    break;
+                case RiVmIr_TailCall:
+                    chararray_push_f(out, "tail-call %S", ((RiNode*)inst->func)->spec.id);
+                    break;
+                default:
+                    RI_UNREACHABLE;
+                    break;
+            }
+            if (inst->op != RiVmIr_Binary) {
+                for (iptr j = 0; j < inst->args.count; ++j) {
+                    if (j || inst->op != RiVmIr_Copy) {
+                        chararray_push_f(out, " ");
+                    }
+                    rivm_dump_ir_value_(func, inst->args.items[j], out);
+                }
+            }
+            if (inst->op == RiVmIr_Branch) {
+                chararray_push_f(out, " b%d b%d", inst->target.items[0], inst->target.items[1]);
+            } else if (inst->op == RiVmIr_Switch) {
+                chararray_push_f(out, " from %lld", (long long)inst->cases.min);
+                for (iptr j = 0; j < inst->cases.table.count; ++j) {
+                    chararray_push_f(out, " b%d", inst->target.items[inst->cases.table.items[j]]);
+                }
+                chararray_push_f(out, " else b%d", inst->target.items[0]);
+            }
+            chararray_push_f(out, "\n");
+        }
+    }
+}
+
 void
 rivm_dump_module(RiVmModule* module, CharArray* out)
 {
-    RiVmFunc* it;
-    slice_eachi(&module->func, i, &it) {
+    uint32_t it;
+    slice_eachi(&module->slot, i, &it) {
         chararray_push_f(out, "func%d:\n", i);
-        rivm_dump_func(it, out);
+        rivm_dump_func(module, it, out);
     }
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "rivm.h"
+#include "rivm-ir.h"
 
 void rivm_dump_module(RiVmModule* module, CharArray* out);
-void rivm_dump_func(RiVmFunc* func, CharArray* out);
\ No newline at end of file
+void rivm_dump_func(RiVmModule* module, uint32_t func, CharArray* out);
+void rivm_dump_ir(RiVmIrFunc* func, CharArray* out);
\ No newline at end of file
@@ -4,10 +4,19 @@
 // - Caller pushes input arguments.
 // - Caller calls callee with a stack pointer pointing to first input argument.
 // - Callee reserves a value on C side for return value that is set when `ret <expr>` is called.
+// - Outputs after the first one are written by the callee directly to consecutive slots in the
+//   frame of the caller, given by `call` (`output N <expr>` sets the Nth one before `ret`), so
+//   they never go through memory or the stack. A host call gets them in `RiVmExec.outputs`.
+//   Native (JIT) code has to follow the same rules: it takes the pointer to those slots as an
+//   argument after the stack pointer, writes each output as a 64-bit value (32-bit ones in the
+//   low half) and returns the first one like `rivm_exec_`.
 // - Callee pushes space needed for it's local and temporary variables. (`enter N`)
 // - Callee uses slot indices in instruction params to operate over inputs, outputs, locals and temporaries.
 // - Callee pops space needed for it's local and temporary variables. (`leave N`)
 // - Caller pops space needed for input and output arguments.
+// - Tail call moves arguments of the callee over the inputs and runs it in the same frame, so
+//   the stack is set back to where the inputs end when it returns. The callee writes its outputs
+//   to those of the current function.
 
 void
 rivm_exec_init(RiVmExec* context)
@@ -22,7 +31,7 @@ rivm_exec_init(RiVmExec* context)
 void
 rivm_exec_purge(RiVmExec* context)
 {
-    virtual_free(context->stack.it, context->stack.end - context->stack.end);
+    virtual_free(context->stack.start, (context->stack.end - context->stack.start) * sizeof(RiVmValue));
 }
 
 //
@@ -59,19 +68,20 @@ rivm_stack_pop(RiVmStack* stack, iptr count)
 
 #define binary_op_tt(Member, TT, Op) \
     switch (TT) { \
-        case RiVmParam_SlotSlot: get_local(inst->param0). ## Member = get_local(inst->param1). ## Member Op get_local(inst->param2). ## Member; break; \
-        case RiVmParam_SlotImm:  get_local(inst->param0). ## Member = get_local(inst->param1). ## Member Op inst->param2.imm. ## Member; break; \
-        case RiVmParam_ImmSlot:  get_local(inst->param0). ## Member = inst->param1.imm. ## Member        Op get_local(inst->param2). ## Member; break; \
-        case RiVmParam_ImmImm:   get_local(inst->param0). ## Member = inst->param1.imm. ## Member        Op inst->param2.imm. ## Member; break; \
+        case RiVmParam_SlotSlot: get_local(inst->param0).Member = get_local(inst->param1).Member Op get_local(inst->param2).Member; break; \
+        case RiVmParam_SlotImm:  get_local(inst->param0).Member = get_local(inst->param1).Member Op inst->param2.imm.Member; break; \
+        case RiVmParam_ImmSlot:  get_local(inst->param0).Member = inst->param1.imm.Member        Op get_local(inst->param2).Member; break; \
+        case RiVmParam_ImmImm:   get_local(inst->param0).Member = inst->param1.imm.Member        Op inst->param2.imm.Member; break; \
         default: RI_UNREACHABLE; break; \
     }
 
+// Signed integers are computed as unsigned, which wraps around instead of being undefined.
 #define binary_op(Op) { \
         int tt = RIVMPARAMKIND_PAIR(inst->param1.kind, inst->param2.kind); \
         switch (inst->param0.type) { \
-            case RiVmValue_I32: binary_op_tt(i32, tt, Op); break; \
-            case RiVmValue_I64: binary_op_tt(i64, tt, Op); break; \
+            case RiVmValue_I32: \
             case RiVmValue_U32: binary_op_tt(u32, tt, Op); break; \
+            case RiVmValue_I64: \
             case RiVmValue_U64: binary_op_tt(u64, tt, Op); break; \
             case RiVmValue_F32: binary_op_tt(f32, tt, Op); break; \
             case RiVmValue_F64: binary_op_tt(f64, tt, Op); break; \
@@ -79,32 +89,218 @@ rivm_stack_pop(RiVmStack* stack, iptr count)
         } \
     }
 
+#define bitwise_op(Op) { \
+        int tt = RIVMPARAMKIND_PAIR(inst->param1.kind, inst->param2.kind); \
+        switch (inst->param0.type) { \
+            case RiVmValue_I32: \
+            case RiVmValue_U32: binary_op_tt(u32, tt, Op); break; \
+            case RiVmValue_I64: \
+            case RiVmValue_U64: binary_op_tt(u64, tt, Op); break; \
+            default: RI_UNREACHABLE; break; \
+        } \
+    }
+
+// The whole slot is set, as the result can be of a different type than the arguments.
+#define compare_op_tt(Member, TT, Op) \
+    switch (TT) { \
+        case RiVmParam_SlotSlot: get_local(inst->param0).u64 = get_local(inst->param1).Member Op get_local(inst->param2).Member; break; \
+        case RiVmParam_SlotImm:  get_local(inst->param0).u64 = get_local(inst->param1).Member Op inst->param2.imm.Member; break; \
+        case RiVmParam_ImmSlot:  get_local(inst->param0).u64 = inst->param1.imm.Member        Op get_local(inst->param2).Member; break; \
+        case RiVmParam_ImmImm:   get_local(inst->param0).u64 = inst->param1.imm.Member        Op inst->param2.imm.Member; break; \
+        default: RI_UNREACHABLE; break; \
+    }
+
+#define compare_op(Op) { \
+        int tt = RIVMPARAMKIND_PAIR(inst->param1.kind, inst->param2.kind); \
+        switch (inst->param1.type) { \
+            case RiVmValue_I32: compare_op_tt(i32, tt, Op); break; \
+            case RiVmValue_I64: compare_op_tt(i64, tt, Op); break; \
+            case RiVmValue_U32: compare_op_tt(u32, tt, Op); break; \
+            case RiVmValue_U64: compare_op_tt(u64, tt, Op); break; \
+            case RiVmValue_F32: compare_op_tt(f32, tt, Op); break; \
+            case RiVmValue_F64: compare_op_tt(f64, tt, Op); break; \
+            default: RI_UNREACHABLE; break; \
+        } \
+    }
+
+#define get_value(Param) \
+    ((Param).kind == RiVmParam_Imm ? (Param).imm : get_local(Param))
+
+// Fields can be at any address the host gives, so they're copied rather than dereferenced.
+#define load_op(Type, Member) { \
+        Type v; \
+        memcpy(&v, (uint8_t*)get_local(inst->param1).ptr + inst->param2.imm.u64, sizeof(v)); \
+        get_local(inst->param0).Member = v; \
+    }
+
+#define store_op(Type, Member) { \
+        check_overflow(); \
+        Type v = (Type)get_value(inst->param2).Member; \
+        memcpy((uint8_t*)get_local(inst->param0).ptr + inst->param1.imm.u64, &v, sizeof(v)); \
+    }
+
+// Overflow is accumulated without branching, and checked before anything is seen outside the
+// frame: stores, outputs, calls and returns. Jumps check it too, so loops don't run on after it.
+#define check_overflow() \
+    if (overflow) goto trap_overflow
+
+#define checked_op(Op) { \
+        RiVmValue a = get_value(inst->param1); \
+        RiVmValue b = get_value(inst->param2); \
+        RiVmValue* r = &get_local(inst->param0); \
+        switch (inst->param0.type) { \
+            case RiVmValue_I32: overflow |= RIVM_OVERFLOW_(Op, i32, a.i32, b.i32, &r->i32); break; \
+            case RiVmValue_I64: overflow |= RIVM_OVERFLOW_(Op, i64, a.i64, b.i64, &r->i64); break; \
+            case RiVmValue_U32: overflow |= RIVM_OVERFLOW_(Op, u32, a.u32, b.u32, &r->u32); break; \
+            case RiVmValue_U64: overflow |= RIVM_OVERFLOW_(Op, u64, a.u64, b.u64, &r->u64); break; \
+            default: RI_UNREACHABLE; break; \
+        } \
+    }
+
+#if defined(COMPILER_MSVC)
+
+#include <intrin.h>
+
+// Same as the builtins: sets the wrapped result, returns true if it overflowed.
+#define RIVM_OVERFLOW_(Op, Type, A, B, R) rivm_ ## Op ## _overflow_ ## Type ## _(A, B, R)
+
+#define RIVM_OVERFLOW_32_(Op, Type, Wide, Operator) \
+    static inline bool \
+    rivm_ ## Op ## _overflow_ ## Type ## _(Type ## _t a, Type ## _t b, Type ## _t* r) \
+    { \
+        Wide w = (Wide)a Operator (Wide)b; \
+        *r = (Type ## _t)w; \
+        return w != (Wide)*r; \
+    }
+
+RIVM_OVERFLOW_32_(add, int32, int64_t, +)
+RIVM_OVERFLOW_32_(sub, int32, int64_t, -)
+RIVM_OVERFLOW_32_(mul, int32, int64_t, *)
+RIVM_OVERFLOW_32_(add, uint32, uint64_t, +)
+RIVM_OVERFLOW_32_(sub, uint32, uint64_t, -)
+RIVM_OVERFLOW_32_(mul, uint32, uint64_t, *)
+
+static inline bool
+rivm_add_overflow_i64_(int64_t a, int64_t b, int64_t* r)
+{
+    *r = (int64_t)((uint64_t)a + (uint64_t)b);
+    return ((a ^ *r) & (b ^ *r)) < 0;
+}
+
+static inline bool
+rivm_sub_overflow_i64_(int64_t a, int64_t b, int64_t* r)
+{
+    *r = (int64_t)((uint64_t)a - (uint64_t)b);
+    return ((a ^ b) & (a ^ *r)) < 0;
+}
+
+static inline bool
+rivm_mul_overflow_i64_(int64_t a, int64_t b, int64_t* r)
+{
+    int64_t high;
+    *r = _mul128(a, b, &high);
+    return high != (*r >> 63);
+}
+
+static inline bool
+rivm_add_overflow_u64_(uint64_t a, uint64_t b, uint64_t* r)
+{
+    *r = a + b;
+    return *r < a;
+}
+
+static inline bool
+rivm_sub_overflow_u64_(uint64_t a, uint64_t b, uint64_t* r)
+{
+    *r = a - b;
+    return a < b;
+}
+
+static inline bool
+rivm_mul_overflow_u64_(uint64_t a, uint64_t b, uint64_t* r)
+{
+    uint64_t high;
+    *r = _umul128(a, b, &high);
+    return high != 0;
+}
+
+#define rivm_add_overflow_i32_ rivm_add_overflow_int32_
+#define rivm_sub_overflow_i32_ rivm_sub_overflow_int32_
+#define rivm_mul_overflow_i32_ rivm_mul_overflow_int32_
+#define rivm_add_overflow_u32_ rivm_add_overflow_uint32_
+#define rivm_sub_overflow_u32_ rivm_sub_overflow_uint32_
+#define rivm_mul_overflow_u32_ rivm_mul_overflow_uint32_
+
+#else
+
+#define RIVM_OVERFLOW_(Op, Type, A, B, R) __builtin_ ## Op ## _overflow(A, B, R)
+
+#endif
+
+static inline bool
+rivm_type_is_32bit_(RiVmValueType type)
+{
+    return type == RiVmValue_I32 || type == RiVmValue_U32 || type == RiVmValue_F32;
+}
+
+// Casting a float that doesn't fit is undefined in C, so it's clamped first.
+static inline RiVmValue
+rivm_float_to_int_(double d, RiVmValueType type)
+{
+    RiVmValue r = {0};
+    if (d != d) {
+        return r;
+    }
+    switch (type)
+    {
+        case RiVmValue_I32:
+            r.i32 = d <= (double)INT32_MIN ? INT32_MIN : d >= (double)INT32_MAX ? INT32_MAX : (int32_t)d;
+            break;
+        case RiVmValue_I64:
+            // 2^63 is the first double above INT64_MAX.
+            r.i64 = d <= (double)INT64_MIN ? INT64_MIN : d >= 9223372036854775808.0 ? INT64_MAX : (int64_t)d;
+            break;
+        case RiVmValue_U32:
+            r.u32 = d <= 0 ? 0 : d >= (double)UINT32_MAX ? UINT32_MAX : (uint32_t)d;
+            break;
+        case RiVmValue_U64:
+            r.u64 = d <= 0 ? 0 : d >= 18446744073709551616.0 ? UINT64_MAX : (uint64_t)d;
+            break;
+        default: RI_UNREACHABLE; break;
+    }
+    return r;
+}
+
 RiVmValue
-rivm_exec_(RiVmExec* context, RiVmValue* stack, RiVmFunc* func)
+rivm_exec_(RiVmExec* context, RiVmModule* module, RiVmValue* stack, RiVmInst* code, RiVmValue* outputs)
 {
     RiVmInst* inst;
     int64_t i = 0;
 
     RiVmValue result;
     RiVmValue* callee_stack = NULL;
-    uint64_t locals_count = 0;
+    RiVmValue* inputs_end = context->stack.it;
+    bool overflow = false;
 
     for (;;)
     {
-        inst = &array_at(&func->code, i);
+        inst = &code[i];
         ++i;
 
         switch (inst->op)
         {
             case RiVmOp_Enter:
-                locals_count = inst->param0.imm.u64;
-                rivm_stack_push(&context->stack, locals_count);
+                rivm_stack_push(&context->stack, inst->param0.imm.u64);
                 callee_stack = context->stack.it;
                 break;
 
             case RiVmOp_Ret:
+                check_overflow();
                 switch (inst->param0.kind)
                 {
+                    case RiVmParam_None:
+                        result.u64 = 0;
+                        break;
                     case RiVmParam_Imm:
                         result.u64 = inst->param0.imm.u64;
                         break;
@@ -113,9 +309,23 @@ rivm_exec_(RiVmExec* context, RiVmValue* stack, RiVmFunc* func)
                         break;
                     default: RI_UNREACHABLE; break;
                 }
-                rivm_stack_pop(&context->stack, locals_count);
+                context->stack.it = inputs_end;
                 goto end;
 
+            case RiVmOp_Output:
+                check_overflow();
+                switch (inst->param1.kind)
+                {
+                    case RiVmParam_Imm:
+                        outputs[inst->param0.imm.u64].u64 = inst->param1.imm.u64;
+                        break;
+                    case RiVmParam_Slot:
+                        outputs[inst->param0.imm.u64].u64 = get_local(inst->param1).u64;
+                        break;
+                    default: RI_UNREACHABLE; break;
+                }
+                break;
+
             case RiVmOp_Assign:
                 switch (inst->param1.kind)
                 {
@@ -129,6 +339,33 @@ rivm_exec_(RiVmExec* context, RiVmValue* stack, RiVmFunc* func)
                 }
                 break;
 
+            case RiVmOp_AddrOf:
+                get_local(inst->param0).ptr = &get_local(inst->param1);
+                break;
+
+            case RiVmOp_Load_I8: load_op(int8_t, i32); break;
+            case RiVmOp_Load_U8: load_op(uint8_t, u32); break;
+            case RiVmOp_Load_I16: load_op(int16_t, i32); break;
+            case RiVmOp_Load_U16: load_op(uint16_t, u32); break;
+            case RiVmOp_Load_32: load_op(uint32_t, u32); break;
+            case RiVmOp_Load_64: load_op(uint64_t, u64); break;
+
+            case RiVmOp_Store_8: store_op(uint8_t, u32); break;
+            case RiVmOp_Store_16: store_op(uint16_t, u32); break;
+            case RiVmOp_Store_32: store_op(uint32_t, u32); break;
+            case RiVmOp_Store_64: store_op(uint64_t, u64); break;
+
+            case RiVmOp_MemCopy:
+                check_overflow();
+                // A struct can be assigned to itself.
+                memmove(get_local(inst->param0).ptr, get_local(inst->param1).ptr, inst->param2.imm.u64);
+                break;
+
+            case RiVmOp_MemZero:
+                check_overflow();
+                memset(get_local(inst->param0).ptr, 0, inst->param1.imm.u64);
+                break;
+
             case RiVmOp_ArgPush: {
                 switch (inst->param0.kind)
                 {
@@ -147,12 +384,30 @@ rivm_exec_(RiVmExec* context, RiVmValue* stack, RiVmFunc* func)
             } break;
 
             case RiVmOp_Call: {
-                RiVmFunc* callee_func = inst->param1.func;
-                RiVmValue callee_result = rivm_exec_(context, callee_stack, callee_func);
+                check_overflow();
+                RiVmFuncRef* callee_ref = rivm_module_ref(module, inst->param1.func_slot);
+                RiVmInst* callee_code = rivm_module_code(module, atomic_load_i64(&callee_ref->offset));
+                // Without outputs after the first, C is none and its index is 0, the callee
+                // doesn't write there.
+                RiVmValue callee_result = rivm_exec_(context, module, callee_stack, callee_code, stack + inst->param2.slot.index);
+                if (context->trap) {
+                    goto trap;
+                }
                 get_local(inst->param0).u64 = callee_result.u64;
             } break;
 
+            case RiVmOp_TailCall: {
+                check_overflow();
+                uint64_t count = inst->param0.imm.u64;
+                memmove(stack, context->stack.it - count, count * sizeof(RiVmValue));
+                context->stack.it = stack + count;
+                RiVmFuncRef* callee_ref = rivm_module_ref(module, inst->param1.func_slot);
+                code = rivm_module_code(module, atomic_load_i64(&callee_ref->offset));
+                i = 0;
+            } break;
+
             case RiVmOp_If: {
+                check_overflow();
                 switch (inst->param0.kind)
                 {
                     case RiVmParam_Imm:
@@ -163,7 +418,8 @@ rivm_exec_(RiVmExec* context, RiVmValue* stack, RiVmFunc* func)
                         }
                         break;
                     case RiVmParam_Slot:
-                        if (get_local(inst->param0).u64) {
+                        // Only the low half of a 32-bit value is set.
+                        if (rivm_type_is_32bit_(inst->param0.type) ? get_local(inst->param0).u32 : get_local(inst->param0).u64) {
                             i = inst->param1.imm.i64;
                         } else {
                             i = inst->param2.imm.i64;
@@ -173,14 +429,254 @@ rivm_exec_(RiVmExec* context, RiVmValue* stack, RiVmFunc* func)
                 }
             } break;
 
+            case RiVmOp_Switch: {
+                check_overflow();
+                RiVmValue value;
+                switch (inst->param0.kind)
+                {
+                    case RiVmParam_Imm: value = inst->param0.imm; break;
+                    case RiVmParam_Slot: value = get_local(inst->param0); break;
+                    default: RI_UNREACHABLE; break;
+                }
+                int64_t v;
+                switch (inst->param0.type)
+                {
+                    case RiVmValue_I32: v = value.i32; break;
+                    case RiVmValue_U32: v = value.u32; break;
+                    default: v = value.i64; break;
+                }
+                // Out of the table on both sides, as unsigned.
+                uint64_t k = (uint64_t)v - inst->param1.imm.u64;
+                uint64_t count = inst->param2.imm.u64;
+                i = code[i + (k < count ? k : count)].param0.imm.i64;
+            } break;
+
+            case RiVmOp_GoTo:
+                check_overflow();
+                i = inst->param0.imm.i64;
+                break;
+
+            case RiVmOp_Unary_Neg: {
+                RiVmValue a = get_value(inst->param1);
+                RiVmValue* r = &get_local(inst->param0);
+                switch (inst->param0.type)
+                {
+                    case RiVmValue_I32:
+                    case RiVmValue_U32: r->u32 = 0u - a.u32; break;
+                    case RiVmValue_I64:
+                    case RiVmValue_U64: r->u64 = 0u - a.u64; break;
+                    case RiVmValue_F32: r->f32 = -a.f32; break;
+                    case RiVmValue_F64: r->f64 = -a.f64; break;
+                    default: RI_UNREACHABLE; break;
+                }
+            } break;
+
+            case RiVmOp_Unary_BNot: {
+                RiVmValue a = get_value(inst->param1);
+                RiVmValue* r = &get_local(inst->param0);
+                switch (inst->param0.type)
+                {
+                    case RiVmValue_I32:
+                    case RiVmValue_U32: r->u32 = ~a.u32; break;
+                    case RiVmValue_I64:
+                    case RiVmValue_U64: r->u64 = ~a.u64; break;
+                    default: RI_UNREACHABLE; break;
+                }
+            } break;
+
+            case RiVmOp_Unary_Not: {
+                RiVmValue a = get_value(inst->param1);
+                get_local(inst->param0).u64 = rivm_type_is_32bit_(inst->param1.type) ? !a.u32 : !a.u64;
+            } break;
+
+            case RiVmOp_Unary_Convert_Int: {
+                RiVmValue a = get_value(inst->param1);
+                uint64_t v;
+                switch (inst->param1.type)
+                {
+                    case RiVmValue_I32: v = (uint64_t)(int64_t)a.i32; break;
+                    case RiVmValue_U32: v = a.u32; break;
+                    case RiVmValue_I64:
+                    case RiVmValue_U64: v = a.u64; break;
+                    default: RI_UNREACHABLE; v = 0; break;
+                }
+                // The slot is set whole, truncating is reading its low half.
+                get_local(inst->param0).u64 = v;
+            } break;
+
+            case RiVmOp_Unary_Convert_IntToFloat: {
+                RiVmValue a = get_value(inst->param1);
+                RiVmValue* r = &get_local(inst->param0);
+                // Each pair is converted directly, as going through double would round twice.
+                #define convert_to_float(Member) \
+                    switch (inst->param1.type) { \
+                        case RiVmValue_I32: r->Member = a.i32; break; \
+                        case RiVmValue_U32: r->Member = a.u32; break; \
+                        case RiVmValue_I64: r->Member = a.i64; break; \
+                        case RiVmValue_U64: r->Member = a.u64; break; \
+                        default: RI_UNREACHABLE; break; \
+                    }
+                if (inst->param0.type == RiVmValue_F32) {
+                    convert_to_float(f32);
+                } else {
+                    convert_to_float(f64);
+                }
+                #undef convert_to_float
+            } break;
+
+            case RiVmOp_Unary_Convert_FloatToInt: {
+                RiVmValue a = get_value(inst->param1);
+                double d = inst->param1.type == RiVmValue_F32 ? a.f32 : a.f64;
+                get_local(inst->param0) = rivm_float_to_int_(d, inst->param0.type);
+            } break;
+
+            case RiVmOp_Unary_Convert_Narrow_I8:
+            case RiVmOp_Unary_Convert_Narrow_I16:
+            case RiVmOp_Unary_Convert_Narrow_U8:
+            case RiVmOp_Unary_Convert_Narrow_U16:
+                get_local(inst->param0) = rivm_narrow(inst->op, get_value(inst->param1));
+                break;
+
+            case RiVmOp_Unary_Checked_Narrow_I8:
+            case RiVmOp_Unary_Checked_Narrow_I16:
+            case RiVmOp_Unary_Checked_Narrow_U8:
+            case RiVmOp_Unary_Checked_Narrow_U16: {
+                RiVmValue a = get_value(inst->param1);
+                RiVmValue r = rivm_narrow(inst->op, a);
+                overflow |= r.u32 != a.u32;
+                get_local(inst->param0) = r;
+            } break;
+
+            case RiVmOp_Unary_Convert_Float: {
+                RiVmValue a = get_value(inst->param1);
+                RiVmValue* r = &get_local(inst->param0);
+                if (inst->param0.type == RiVmValue_F32) {
+                    r->f32 = (float)a.f64;
+                } else {
+                    r->f64 = a.f32;
+                }
+            } break;
+
             case RiVmOp_Binary_Add: binary_op(+); break;
             case RiVmOp_Binary_Sub: binary_op(-); break;
-            case RiVmOp_Binary_Comparison_Lt: binary_op(<); break;
-            case RiVmOp_Binary_Comparison_Gt: binary_op(<); break;
-            case RiVmOp_Binary_Comparison_LtEq: binary_op(<=); break;
-            case RiVmOp_Binary_Comparison_GtEq: binary_op(>=); break;
-            case RiVmOp_Binary_Comparison_Eq: binary_op(==); break;
-            case RiVmOp_Binary_Comparison_NotEq: binary_op(!=); break;
+            case RiVmOp_Binary_Mul: binary_op(*); break;
+            case RiVmOp_Binary_BXor: bitwise_op(^); break;
+            case RiVmOp_Binary_BAnd: bitwise_op(&); break;
+            case RiVmOp_Binary_BOr: bitwise_op(|); break;
+
+            // Division is slow anyway, so checking the divisor doesn't add much.
+            case RiVmOp_Binary_Div: {
+                RiVmValue a = get_value(inst->param1);
+                RiVmValue b = get_value(inst->param2);
+                RiVmValue* r = &get_local(inst->param0);
+                switch (inst->param0.type)
+                {
+                    case RiVmValue_I32:
+                        if (b.i32 == 0) goto trap_divide_by_zero;
+                        if (b.i32 == -1 && a.i32 == INT32_MIN) goto trap_overflow;
+                        r->i32 = a.i32 / b.i32;
+                        break;
+                    case RiVmValue_I64:
+                        if (b.i64 == 0) goto trap_divide_by_zero;
+                        if (b.i64 == -1 && a.i64 == INT64_MIN) goto trap_overflow;
+                        r->i64 = a.i64 / b.i64;
+                        break;
+                    case RiVmValue_U32:
+                        if (b.u32 == 0) goto trap_divide_by_zero;
+                        r->u32 = a.u32 / b.u32;
+                        break;
+                    case RiVmValue_U64:
+                        if (b.u64 == 0) goto trap_divide_by_zero;
+                        r->u64 = a.u64 / b.u64;
+                        break;
+                    case RiVmValue_F32: r->f32 = a.f32 / b.f32; break;
+                    case RiVmValue_F64: r->f64 = a.f64 / b.f64; break;
+                    default: RI_UNREACHABLE; break;
+                }
+            } break;
+
+            // Remainder of the division by -1 is 0, even for the lowest signed integer.
+            case RiVmOp_Binary_Mod: {
+                RiVmValue a = get_value(inst->param1);
+                RiVmValue b = get_value(inst->param2);
+                RiVmValue* r = &get_local(inst->param0);
+                switch (inst->param0.type)
+                {
+                    case RiVmValue_I32:
+                        if (b.i32 == 0) goto trap_divide_by_zero;
+                        r->i32 = b.i32 == -1 ? 0 : a.i32 % b.i32;
+                        break;
+                    case RiVmValue_I64:
+                        if (b.i64 == 0) goto trap_divide_by_zero;
+                        r->i64 = b.i64 == -1 ? 0 : a.i64 % b.i64;
+                        break;
+                    case RiVmValue_U32:
+                        if (b.u32 == 0) goto trap_divide_by_zero;
+                        r->u32 = a.u32 % b.u32;
+                        break;
+                    case RiVmValue_U64:
+                        if (b.u64 == 0) goto trap_divide_by_zero;
+                        r->u64 = a.u64 % b.u64;
+                        break;
+                    case RiVmValue_F32: r->f32 = fmodf(a.f32, b.f32); break;
+                    case RiVmValue_F64: r->f64 = fmod(a.f64, b.f64); break;
+                    default: RI_UNREACHABLE; break;
+                }
+            } break;
+
+            case RiVmOp_Binary_BShL: {
+                RiVmValue a = get_value(inst->param1);
+                RiVmValue b = get_value(inst->param2);
+                RiVmValue* r = &get_local(inst->param0);
+                switch (inst->param0.type)
+                {
+                    case RiVmValue_I32:
+                    case RiVmValue_U32: r->u32 = a.u32 << (b.u32 & 31); break;
+                    case RiVmValue_I64:
+                    case RiVmValue_U64: r->u64 = a.u64 << (b.u64 & 63); break;
+                    default: RI_UNREACHABLE; break;
+                }
+            } break;
+
+            // Arithmetic for signed integers.
+            case RiVmOp_Binary_BShR: {
+                RiVmValue a = get_value(inst->param1);
+                RiVmValue b = get_value(inst->param2);
+                RiVmValue* r = &get_local(inst->param0);
+                switch (inst->param0.type)
+                {
+                    case RiVmValue_I32: r->i32 = a.i32 >> (b.u32 & 31); break;
+                    case RiVmValue_U32: r->u32 = a.u32 >> (b.u32 & 31); break;
+                    case RiVmValue_I64: r->i64 = a.i64 >> (b.u64 & 63); break;
+                    case RiVmValue_U64: r->u64 = a.u64 >> (b.u64 & 63); break;
+                    default: RI_UNREACHABLE; break;
+                }
+            } break;
+
+            case RiVmOp_Binary_And: {
+                RiVmValue a = get_value(inst->param1);
+                RiVmValue b = get_value(inst->param2);
+                bool is_32bit = rivm_type_is_32bit_(inst->param1.type);
+                get_local(inst->param0).u64 = (is_32bit ? a.u32 : a.u64) && (is_32bit ? b.u32 : b.u64);
+            } break;
+
+            case RiVmOp_Binary_Or: {
+                RiVmValue a = get_value(inst->param1);
+                RiVmValue b = get_value(inst->param2);
+                bool is_32bit = rivm_type_is_32bit_(inst->param1.type);
+                get_local(inst->param0).u64 = (is_32bit ? a.u32 : a.u64) || (is_32bit ? b.u32 : b.u64);
+            } break;
+
+            case RiVmOp_Binary_Checked_Add: checked_op(add); break;
+            case RiVmOp_Binary_Checked_Sub: checked_op(sub); break;
+            case RiVmOp_Binary_Checked_Mul: checked_op(mul); break;
+
+            case RiVmOp_Binary_Comparison_Lt: compare_op(<); break;
+            case RiVmOp_Binary_Comparison_Gt: compare_op(>); break;
+            case RiVmOp_Binary_Comparison_LtEq: compare_op(<=); break;
+            case RiVmOp_Binary_Comparison_GtEq: compare_op(>=); break;
+            case RiVmOp_Binary_Comparison_Eq: compare_op(==); break;
+            case RiVmOp_Binary_Comparison_NotEq: compare_op(!=); break;
 
             default:
                 RI_UNREACHABLE;
@@ -188,20 +684,53 @@ rivm_exec_(RiVmExec* context, RiVmValue* stack, RiVmFunc* func)
         }
     }
 
+trap_overflow:
+    context->trap = RiVmTrap_Overflow;
+    goto trap;
+trap_divide_by_zero:
+    context->trap = RiVmTrap_DivideByZero;
+trap:
+    // Callers return right away, each restoring the stack.
+    context->stack.it = inputs_end;
+    result.u64 = 0;
+
 end:;
     return result;
 }
 
+#undef store_op
+#undef checked_op
+#undef check_overflow
+#undef load_op
+#undef get_value
 #undef get_local
 
-RiVmValue
-rivm_exec(RiVmExec* context, RiVmFunc* func, RiVmValue* args, int args_count)
+static RiVmValue
+rivm_exec_args_(RiVmExec* context, RiVmModule* module, RiVmInst* code, RiVmValue* args, int args_count)
 {
-    RI_ASSERT(args_count == func->debug_inputs_count);
-
     RiVmValue* stack = rivm_stack_push(&context->stack, args_count);
     memcpy(stack, args, args_count * sizeof(RiVmValue));
-    RiVmValue r = rivm_exec_(context, stack, func);
+    context->trap = RiVmTrap_None;
+    RiVmValue r = rivm_exec_(context, module, stack, code, context->outputs);
     rivm_stack_pop(&context->stack, args_count);
     return r;
+}
+
+RiVmValue
+rivm_exec(RiVmExec* context, RiVmModule* module, uint32_t func, RiVmValue* args, int args_count)
+{
+    RI_ASSERT(args_count == array_at(&module->func.inputs_count, func));
+    RI_ASSERT(array_at(&module->func.count, func) > 0);
+    RiVmInst* code = rivm_module_code(module, array_at(&module->func.offset, func));
+    return rivm_exec_args_(context, module, code, args, args_count);
+}
+
+RiVmValue
+rivm_exec_module(RiVmExec* context, RiVmModule* module, uint32_t slot, RiVmValue* args, int args_count)
+{
+    int64_t generation = rivm_module_enter(module);
+    RiVmInst* code = rivm_module_code(module, atomic_load_i64(&rivm_module_ref(module, slot)->offset));
+    RiVmValue r = rivm_exec_args_(context, module, code, args, args_count);
+    rivm_module_leave(module, generation);
+    return r;
 }
\ No newline at end of file
@@ -4,6 +4,16 @@
 
 typedef struct RiVmExec RiVmExec;
 typedef struct RiVmStack RiVmStack;
+typedef enum RiVmTrap RiVmTrap;
+
+// Error that stopped a run.
+enum RiVmTrap
+{
+    RiVmTrap_None = 0,
+    // Checked arithmetic overflowed, or the lowest signed integer was divided by -1.
+    RiVmTrap_Overflow,
+    RiVmTrap_DivideByZero,
+};
 
 struct RiVmStack
 {
@@ -15,9 +25,16 @@ struct RiVmStack
 struct RiVmExec
 {
     RiVmStack stack;
+    // Set if the last run trapped, its result is 0 then.
+    RiVmTrap trap;
+    // Outputs of the last run after the first one, which is its result.
+    RiVmValue outputs[RIVM_OUTPUTS_MAX - 1];
 };
 
 void rivm_exec_init(RiVmExec* context);
 void rivm_exec_purge(RiVmExec* context);
 
-RiVmValue rivm_exec(RiVmExec* context, RiVmFunc* func, RiVmValue* args, int args_count);
\ No newline at end of file
+// Runs function `func` of `module`, which must not change meanwhile.
+RiVmValue rivm_exec(RiVmExec* context, RiVmModule* module, uint32_t func, RiVmValue* args, int args_count);
+// Runs the function in `slot` while other threads may replace functions in `module`.
+RiVmValue rivm_exec_module(RiVmExec* context, RiVmModule* module, uint32_t slot, RiVmValue* args, int args_count);
\ No newline at end of file
@@ -0,0 +1,642 @@
+#include "rivm-ir.h"
+
+void
+rivm_ir_init(RiVmIrFunc* func, Arena* arena, uint32_t inputs_count)
+{
+    memset(func, 0, sizeof(RiVmIrFunc));
+    func->arena = arena;
+    func->inputs_count = inputs_count;
+    // Value 0 is no value.
+    arena_array_push(arena, &func->inst, (RiVmIrInst){0});
+    rivm_ir_block(func);
+    rivm_ir_block_at(func, 0)->sealed = true;
+}
+
+//
+//
+//
+
+uint32_t
+rivm_ir_block(RiVmIrFunc* func)
+{
+    arena_array_push(func->arena, &func->block, (RiVmIrBlock){
+        .order = RIVM_IR_UNREACHABLE,
+        .idom = RIVM_IR_UNREACHABLE,
+    });
+    return (uint32_t)(func->block.count - 1);
+}
+
+static uint32_t
+rivm_ir_push_(RiVmIrFunc* func, RiVmIrInst inst)
+{
+    arena_array_push(func->arena, &func->inst, inst);
+    return (uint32_t)(func->inst.count - 1);
+}
+
+static RiVmIrIndexArray
+rivm_ir_args_(RiVmIrFunc* func, uint32_t* args, iptr count)
+{
+    RiVmIrIndexArray r = {0};
+    if (count) {
+        r.items = arena_push_nt(func->arena, uint32_t, count);
+        memcpy(r.items, args, count * sizeof(uint32_t));
+        r.count = r.capacity = count;
+    }
+    return r;
+}
+
+uint32_t
+rivm_ir_emit(RiVmIrFunc* func, uint32_t block, RiVmIrInst inst)
+{
+    RI_CHECK(!rivm_ir_is_terminated(func, block));
+    inst.block = block;
+    uint32_t value = rivm_ir_push_(func, inst);
+    RiVmIrBlock* b = rivm_ir_block_at(func, block);
+    arena_array_push(func->arena, &b->inst, value);
+    return value;
+}
+
+uint32_t
+rivm_ir_const(RiVmIrFunc* func, RiVmValueType type, RiVmValue imm)
+{
+    return rivm_ir_push_(func, (RiVmIrInst){
+        .op = RiVmIr_Const,
+        .type = type,
+        .imm = imm,
+    });
+}
+
+uint32_t
+rivm_ir_param(RiVmIrFunc* func, uint32_t index, RiVmValueType type)
+{
+    RI_CHECK(index < func->inputs_count);
+    return rivm_ir_emit(func, 0, (RiVmIrInst){
+        .op = RiVmIr_Param,
+        .type = type,
+        .param = index,
+    });
+}
+
+uint32_t
+rivm_ir_copy(RiVmIrFunc* func, uint32_t block, uint32_t value)
+{
+    return rivm_ir_emit(func, block, (RiVmIrInst){
+        .op = RiVmIr_Copy,
+        .type = rivm_ir_inst(func, value)->type,
+        .args = rivm_ir_args_(func, &value, 1),
+    });
+}
+
+uint32_t
+rivm_ir_unary(RiVmIrFunc* func, uint32_t block, RiVmOp op, RiVmValueType type, uint32_t a)
+{
+    RI_CHECK(rivm_op_is_in(op, Unary));
+    return rivm_ir_emit(func, block, (RiVmIrInst){
+        .op = RiVmIr_Unary,
+        .type = type,
+        .args = rivm_ir_args_(func, &a, 1),
+        .unary = op,
+    });
+}
+
+uint32_t
+rivm_ir_binary(RiVmIrFunc* func, uint32_t block, RiVmOp op, RiVmValueType type, uint32_t a, uint32_t b)
+{
+    RI_CHECK(rivm_op_is_in(op, Binary));
+    uint32_t args[] = { a, b };
+    return rivm_ir_emit(func, block, (RiVmIrInst){
+        .op = RiVmIr_Binary,
+        .type = type,
+        .args = rivm_ir_args_(func, args, COUNTOF(args)),
+        .binary = op,
+    });
+}
+
+uint32_t
+rivm_ir_call(RiVmIrFunc* func, uint32_t block, RiVmValueType type, void* ast_func, uint32_t* args, iptr args_count)
+{
+    RI_CHECK(ast_func);
+    return rivm_ir_emit(func, block, (RiVmIrInst){
+        .op = RiVmIr_Call,
+        .type = type,
+        .args = rivm_ir_args_(func, args, args_count),
+        .func = ast_func,
+    });
+}
+
+uint32_t
+rivm_ir_result(RiVmIrFunc* func, uint32_t block, RiVmValueType type, uint32_t call, uint32_t output)
+{
+    RI_CHECK(rivm_ir_inst(func, call)->op == RiVmIr_Call);
+    RI_CHECK(output > 0);
+    return rivm_ir_emit(func, block, (RiVmIrInst){
+        .op = RiVmIr_Result,
+        .type = type,
+        .args = rivm_ir_args_(func, &call, 1),
+        .output = output,
+    });
+}
+
+uint32_t
+rivm_ir_local(RiVmIrFunc* func, uint32_t block, uint32_t size)
+{
+    return rivm_ir_emit(func, block, (RiVmIrInst){
+        .op = RiVmIr_Local,
+        .type = RiVmValue_U64,
+        .size = size,
+    });
+}
+
+uint32_t
+rivm_ir_load(RiVmIrFunc* func, uint32_t block, RiVmOp op, RiVmValueType type, uint32_t address, uint32_t offset)
+{
+    RI_CHECK(rivm_op_is_in(op, Load));
+    return rivm_ir_emit(func, block, (RiVmIrInst){
+        .op = RiVmIr_Load,
+        .type = type,
+        .args = rivm_ir_args_(func, &address, 1),
+        .memory.op = op,
+        .memory.offset = offset,
+    });
+}
+
+void
+rivm_ir_store(RiVmIrFunc* func, uint32_t block, RiVmOp op, uint32_t address, uint32_t offset, uint32_t value)
+{
+    RI_CHECK(rivm_op_is_in(op, Store));
+    uint32_t args[] = { address, value };
+    rivm_ir_emit(func, block, (RiVmIrInst){
+        .op = RiVmIr_Store,
+        .args = rivm_ir_args_(func, args, COUNTOF(args)),
+        .memory.op = op,
+        .memory.offset = offset,
+    });
+}
+
+void
+rivm_ir_mem_copy(RiVmIrFunc* func, uint32_t block, uint32_t to, uint32_t from, uint32_t size)
+{
+    uint32_t args[] = { to, from };
+    rivm_ir_emit(func, block, (RiVmIrInst){
+        .op = RiVmIr_MemCopy,
+        .args = rivm_ir_args_(func, args, COUNTOF(args)),
+        .size = size,
+    });
+}
+
+void
+rivm_ir_mem_zero(RiVmIrFunc* func, uint32_t block, uint32_t address, uint32_t size)
+{
+    rivm_ir_emit(func, block, (RiVmIrInst){
+        .op = RiVmIr_MemZero,
+        .args = rivm_ir_args_(func, &address, 1),
+        .size = size,
+    });
+}
+
+static void
+rivm_ir_add_pred_(RiVmIrFunc* func, uint32_t block, uint32_t pred)
+{
+    RiVmIrBlock* b = rivm_ir_block_at(func, block);
+    RI_CHECK(!b->sealed);
+    arena_array_push(func->arena, &b->pred, pred);
+}
+
+void
+rivm_ir_jump(RiVmIrFunc* func, uint32_t block, uint32_t target)
+{
+    rivm_ir_emit(func, block, (RiVmIrInst){
+        .op = RiVmIr_Jump,
+        .target = rivm_ir_args_(func, &target, 1),
+    });
+    rivm_ir_add_pred_(func, target, block);
+}
+
+void
+rivm_ir_branch(RiVmIrFunc* func, uint32_t block, uint32_t condition, uint32_t then, uint32_t otherwise)
+{
+    RI_CHECK(then != otherwise);
+    uint32_t target[] = { then, otherwise };
+    rivm_ir_emit(func, block, (RiVmIrInst){
+        .op = RiVmIr_Branch,
+        .args = rivm_ir_args_(func, &condition, 1),
+        .target = rivm_ir_args_(func, target, COUNTOF(target)),
+    });
+    rivm_ir_add_pred_(func, then, block);
+    rivm_ir_add_pred_(func, otherwise, block);
+}
+
+void
+rivm_ir_switch(RiVmIrFunc* func, uint32_t block, uint32_t value, int64_t min, uint32_t* blocks, iptr count, uint32_t otherwise)
+{
+    RiVmIrInst inst = {
+        .op = RiVmIr_Switch,
+        .args = rivm_ir_args_(func, &value, 1),
+        .cases.min = min,
+        .cases.table = rivm_ir_args_(func, blocks, count),
+    };
+    // Table refers to targets, which are distinct.
+    arena_array_push(func->arena, &inst.target, otherwise);
+    for (iptr i = 0; i < count; ++i) {
+        iptr j = 0;
+        while (j < inst.target.count && inst.target.items[j] != blocks[i]) {
+            ++j;
+        }
+        if (j == inst.target.count) {
+            arena_array_push(func->arena, &inst.target, blocks[i]);
+        }
+        inst.cases.table.items[i] = (uint32_t)j;
+    }
+    rivm_ir_emit(func, block, inst);
+    for (iptr j = 0; j < inst.target.count; ++j) {
+        rivm_ir_add_pred_(func, inst.target.items[j], block);
+    }
+}
+
+void
+rivm_ir_ret(RiVmIrFunc* func, uint32_t block, uint32_t value)
+{
+    rivm_ir_ret_values(func, block, &value, value != RIVM_IR_NONE);
+}
+
+void
+rivm_ir_ret_values(RiVmIrFunc* func, uint32_t block, uint32_t* values, iptr count)
+{
+    RI_CHECK(count <= RIVM_OUTPUTS_MAX);
+    rivm_ir_emit(func, block, (RiVmIrInst){
+        .op = RiVmIr_Ret,
+        .args = rivm_ir_args_(func, values, count),
+    });
+}
+
+void
+rivm_ir_tail_call(RiVmIrFunc* func, uint32_t block, void* ast_func, uint32_t* args, iptr args_count)
+{
+    RI_CHECK(ast_func);
+    rivm_ir_emit(func, block, (RiVmIrInst){
+        .op = RiVmIr_TailCall,
+        .args = rivm_ir_args_(func, args, args_count),
+        .func = ast_func,
+    });
+}
+
+bool
+rivm_ir_is_terminated(RiVmIrFunc* func, uint32_t block)
+{
+    RiVmIrBlock* b = rivm_ir_block_at(func, block);
+    return b->inst.count && rivm_ir_is_terminator(rivm_ir_inst(func, b->inst.items[b->inst.count - 1])->op);
+}
+
+//
+// Variables
+//
+
+uint32_t
+rivm_ir_var(RiVmIrFunc* func, RiVmValueType type)
+{
+    arena_array_push(func->arena, &func->var_def, (RiVmIrIndexArray){0});
+    arena_array_push(func->arena, &func->var_type, type);
+    return (uint32_t)(func->var_def.count - 1);
+}
+
+void
+rivm_ir_write_var(RiVmIrFunc* func, uint32_t var, uint32_t block, uint32_t value)
+{
+    RiVmIrIndexArray* def = &array_at(&func->var_def, var);
+    if (def->count <= block) {
+        iptr count = def->count;
+        arena_array_resize(func->arena, def, func->block.count);
+        memset(def->items + count, 0, (def->count - count) * sizeof(uint32_t));
+    }
+    def->items[block] = value;
+}
+
+// Phi for `var` at the start of `block`, without arguments.
+static uint32_t
+rivm_ir_phi_(RiVmIrFunc* func, uint32_t var, uint32_t block)
+{
+    uint32_t value = rivm_ir_push_(func, (RiVmIrInst){
+        .op = RiVmIr_Phi,
+        .type = array_at(&func->var_type, var),
+        .block = block,
+        .var = var,
+    });
+    RiVmIrBlock* b = rivm_ir_block_at(func, block);
+    arena_array_push(func->arena, &b->inst, value);
+    memmove(b->inst.items + 1, b->inst.items, (b->inst.count - 1) * sizeof(uint32_t));
+    b->inst.items[0] = value;
+    return value;
+}
+
+static void
+rivm_ir_add_phi_args_(RiVmIrFunc* func, uint32_t phi)
+{
+    uint32_t var = rivm_ir_inst(func, phi)->var;
+    RiVmIrBlock* b = rivm_ir_block_at(func, rivm_ir_inst(func, phi)->block);
+    for (iptr i = 0; i < b->pred.count; ++i) {
+        uint32_t arg = rivm_ir_read_var(func, var, b->pred.items[i]);
+        // Reading can add instructions.
+        RiVmIrInst* inst = rivm_ir_inst(func, phi);
+        arena_array_push(func->arena, &inst->args, arg);
+    }
+}
+
+static uint32_t
+rivm_ir_read_var_recursive_(RiVmIrFunc* func, uint32_t var, uint32_t block)
+{
+    RiVmIrBlock* b = rivm_ir_block_at(func, block);
+    uint32_t value;
+    if (!b->sealed) {
+        value = rivm_ir_phi_(func, var, block);
+        arena_array_push(func->arena, &b->incomplete, value);
+    } else if (b->pred.count == 1) {
+        value = rivm_ir_read_var(func, var, b->pred.items[0]);
+    } else if (b->pred.count == 0) {
+        // Read before it's assigned.
+        value = rivm_ir_const(func, array_at(&func->var_type, var), (RiVmValue){0});
+    } else {
+        // Defined before its arguments are read, which ends cycles through loops.
+        value = rivm_ir_phi_(func, var, block);
+        rivm_ir_write_var(func, var, block, value);
+        rivm_ir_add_phi_args_(func, value);
+    }
+    rivm_ir_write_var(func, var, block, value);
+    return value;
+}
+
+uint32_t
+rivm_ir_read_var(RiVmIrFunc* func, uint32_t var, uint32_t block)
+{
+    RiVmIrIndexArray* def = &array_at(&func->var_def, var);
+    if (block < def->count && def->items[block]) {
+        return def->items[block];
+    }
+    return rivm_ir_read_var_recursive_(func, var, block);
+}
+
+void
+rivm_ir_seal(RiVmIrFunc* func, uint32_t block)
+{
+    RiVmIrBlock* b = rivm_ir_block_at(func, block);
+    RI_CHECK(!b->sealed);
+    b->sealed = true;
+    for (iptr i = 0; i < b->incomplete.count; ++i) {
+        rivm_ir_add_phi_args_(func, b->incomplete.items[i]);
+    }
+    b->incomplete = (RiVmIrIndexArray){0};
+}
+
+void
+rivm_ir_finish(RiVmIrFunc* func)
+{
+    rivm_ir_analyze(func);
+
+    for (iptr i = 0; i < func->block.count; ++i) {
+        RiVmIrBlock* b = rivm_ir_block_at(func, i);
+        RI_CHECK(b->sealed);
+        if (b->order == RIVM_IR_UNREACHABLE) {
+            for (iptr j = 0; j < b->inst.count; ++j) {
+                rivm_ir_inst(func, b->inst.items[j])->op = RiVmIr_None;
+            }
+            b->inst.count = 0;
+            b->pred.count = 0;
+            continue;
+        }
+
+        // Predecessors that can't be reached are dropped, along with their phi arguments.
+        iptr kept = 0;
+        for (iptr j = 0; j < b->pred.count; ++j) {
+            if (rivm_ir_block_at(func, b->pred.items[j])->order == RIVM_IR_UNREACHABLE) {
+                continue;
+            }
+            for (iptr k = 0; k < b->inst.count; ++k) {
+                RiVmIrInst* phi = rivm_ir_inst(func, b->inst.items[k]);
+                if (phi->op != RiVmIr_Phi) {
+                    break;
+                }
+                phi->args.items[kept] = phi->args.items[j];
+            }
+            b->pred.items[kept] = b->pred.items[j];
+            kept++;
+        }
+        for (iptr k = 0; k < b->inst.count; ++k) {
+            RiVmIrInst* phi = rivm_ir_inst(func, b->inst.items[k]);
+            if (phi->op != RiVmIr_Phi) {
+                break;
+            }
+            phi->args.count = kept;
+        }
+        b->pred.count = kept;
+    }
+
+}
+
+//
+// Analysis
+//
+
+RiVmIrIndexSlice
+rivm_ir_succ(RiVmIrFunc* func, uint32_t block)
+{
+    RiVmIrBlock* b = rivm_ir_block_at(func, block);
+    if (b->inst.count == 0) {
+        return (RiVmIrIndexSlice){0};
+    }
+    return rivm_ir_inst(func, b->inst.items[b->inst.count - 1])->target.slice;
+}
+
+iptr
+rivm_ir_pred_index(RiVmIrFunc* func, uint32_t block, uint32_t pred)
+{
+    RiVmIrBlock* b = rivm_ir_block_at(func, block);
+    for (iptr i = 0; i < b->pred.count; ++i) {
+        if (b->pred.items[i] == pred) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static uint32_t
+rivm_ir_intersect_(RiVmIrFunc* func, uint32_t a, uint32_t b)
+{
+    while (a != b) {
+        while (rivm_ir_block_at(func, a)->order > rivm_ir_block_at(func, b)->order) {
+            a = rivm_ir_block_at(func, a)->idom;
+        }
+        while (rivm_ir_block_at(func, b)->order > rivm_ir_block_at(func, a)->order) {
+            b = rivm_ir_block_at(func, b)->idom;
+        }
+    }
+    return a;
+}
+
+// Dominators are computed as in Cooper, Harvey, Kennedy: A Simple, Fast Dominance Algorithm.
+void
+rivm_ir_analyze(RiVmIrFunc* func)
+{
+    Arena* arena = func->arena;
+    for (iptr i = 0; i < func->block.count; ++i) {
+        RiVmIrBlock* b = rivm_ir_block_at(func, i);
+        b->order = RIVM_IR_UNREACHABLE;
+        b->idom = RIVM_IR_UNREACHABLE;
+    }
+
+    // Depth-first search with pairs of block and the number of its successors visited.
+    // Successors are visited last to first, so blocks come in source order.
+    RiVmIrIndexArray post = {0};
+    RiVmIrIndexArray stack = {0};
+    arena_array_push(arena, &stack, 0);
+    arena_array_push(arena, &stack, 0);
+    rivm_ir_block_at(func, 0)->order = 0;
+    while (stack.count) {
+        uint32_t block = stack.items[stack.count - 2];
+        uint32_t visited = stack.items[stack.count - 1];
+        RiVmIrIndexSlice succ = rivm_ir_succ(func, block);
+        if (visited < succ.count) {
+            stack.items[stack.count - 1]++;
+            uint32_t next = succ.items[succ.count - 1 - visited];
+            RiVmIrBlock* b = rivm_ir_block_at(func, next);
+            if (b->order == RIVM_IR_UNREACHABLE) {
+                b->order = 0;
+                arena_array_push(arena, &stack, next);
+                arena_array_push(arena, &stack, 0);
+            }
+        } else {
+            stack.count -= 2;
+            arena_array_push(arena, &post, block);
+        }
+    }
+
+    arena_array_resize(arena, &func->order, post.count);
+    for (iptr i = 0; i < post.count; ++i) {
+        uint32_t block = post.items[post.count - 1 - i];
+        func->order.items[i] = block;
+        rivm_ir_block_at(func, block)->order = (uint32_t)i;
+    }
+
+    rivm_ir_block_at(func, 0)->idom = 0;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (iptr i = 1; i < func->order.count; ++i) {
+            RiVmIrBlock* b = rivm_ir_block_at(func, func->order.items[i]);
+            uint32_t idom = RIVM_IR_UNREACHABLE;
+            for (iptr j = 0; j < b->pred.count; ++j) {
+                uint32_t pred = b->pred.items[j];
+                if (rivm_ir_block_at(func, pred)->idom == RIVM_IR_UNREACHABLE) {
+                    continue;
+                }
+                idom = idom == RIVM_IR_UNREACHABLE ? pred : rivm_ir_intersect_(func, pred, idom);
+            }
+            if (b->idom != idom) {
+                b->idom = idom;
+                changed = true;
+            }
+        }
+    }
+
+    for (iptr i = 0; i < func->order.count; ++i) {
+        RiVmIrBlock* b = rivm_ir_block_at(func, func->order.items[i]);
+        b->depth = i ? rivm_ir_block_at(func, b->idom)->depth + 1 : 0;
+    }
+}
+
+bool
+rivm_ir_dominates(RiVmIrFunc* func, uint32_t a, uint32_t b)
+{
+    uint32_t depth = rivm_ir_block_at(func, a)->depth;
+    while (rivm_ir_block_at(func, b)->depth > depth) {
+        b = rivm_ir_block_at(func, b)->idom;
+    }
+    return a == b;
+}
+
+void
+rivm_ir_compact(RiVmIrFunc* func)
+{
+    for (iptr i = 0; i < func->block.count; ++i) {
+        RiVmIrBlock* b = rivm_ir_block_at(func, i);
+        iptr kept = 0;
+        for (iptr j = 0; j < b->inst.count; ++j) {
+            if (rivm_ir_inst(func, b->inst.items[j])->op != RiVmIr_None) {
+                b->inst.items[kept++] = b->inst.items[j];
+            }
+        }
+        b->inst.count = kept;
+    }
+}
+
+#define RIVM_IR_VERIFY_(Condition, ...) \
+    if (!(Condition)) { \
+        RI_LOG("ir: " __VA_ARGS__); \
+        return false; \
+    }
+
+bool
+rivm_ir_verify(RiVmIrFunc* func)
+{
+    // Position of each instruction in its block, to check that values are defined before used.
+    uint32_t* position = arena_push_nt(func->arena, uint32_t, func->inst.count);
+    for (iptr k = 0; k < func->order.count; ++k) {
+        RiVmIrBlock* b = rivm_ir_block_at(func, func->order.items[k]);
+        for (iptr i = 0; i < b->inst.count; ++i) {
+            position[b->inst.items[i]] = (uint32_t)i;
+        }
+    }
+
+    for (iptr k = 0; k < func->order.count; ++k) {
+        uint32_t block = func->order.items[k];
+        RiVmIrBlock* b = rivm_ir_block_at(func, block);
+        RIVM_IR_VERIFY_(rivm_ir_is_terminated(func, block), "b%d isn't terminated", block);
+
+        for (iptr j = 0; j < b->pred.count; ++j) {
+            RiVmIrIndexSlice succ = rivm_ir_succ(func, b->pred.items[j]);
+            iptr found = 0;
+            for (iptr i = 0; i < succ.count; ++i) {
+                found += succ.items[i] == block;
+            }
+            RIVM_IR_VERIFY_(found == 1, "b%d isn't a successor of its predecessor b%d once", block, b->pred.items[j]);
+        }
+
+        bool phis = true;
+        for (iptr i = 0; i < b->inst.count; ++i) {
+            uint32_t value = b->inst.items[i];
+            RiVmIrInst* inst = rivm_ir_inst(func, value);
+            RIVM_IR_VERIFY_(inst->op != RiVmIr_None && inst->op != RiVmIr_Const, "v%d can't be in b%d", value, block);
+            RIVM_IR_VERIFY_(inst->block == block, "v%d in b%d is marked as in b%d", value, block, inst->block);
+            RIVM_IR_VERIFY_(rivm_ir_is_terminator(inst->op) == (i == b->inst.count - 1),
+                "v%d in b%d is a misplaced terminator", value, block);
+            RIVM_IR_VERIFY_(phis || inst->op != RiVmIr_Phi, "phi v%d in b%d isn't at the start", value, block);
+            phis = inst->op == RiVmIr_Phi;
+            if (inst->op == RiVmIr_Phi) {
+                RIVM_IR_VERIFY_(inst->args.count == b->pred.count,
+                    "phi v%d in b%d has %d arguments for %d predecessors", value, block, (int)inst->args.count, (int)b->pred.count);
+            }
+
+            for (iptr j = 0; j < inst->args.count; ++j) {
+                uint32_t arg = inst->args.items[j];
+                RIVM_IR_VERIFY_(arg > 0 && arg < func->inst.count, "v%d uses invalid value %d", value, arg);
+                RiVmIrInst* def = rivm_ir_inst(func, arg);
+                RIVM_IR_VERIFY_(def->op != RiVmIr_None && !rivm_ir_is_terminator(def->op) && !rivm_ir_is_store(def->op),
+                    "v%d uses v%d, which isn't a value", value, arg);
+                if (def->op == RiVmIr_Const) {
+                    continue;
+                }
+                RIVM_IR_VERIFY_(rivm_ir_block_at(func, def->block)->order != RIVM_IR_UNREACHABLE,
+                    "v%d uses v%d from an unreachable block", value, arg);
+                if (inst->op == RiVmIr_Phi) {
+                    RIVM_IR_VERIFY_(rivm_ir_dominates(func, def->block, b->pred.items[j]),
+                        "phi v%d uses v%d, which doesn't dominate its predecessor b%d", value, arg, b->pred.items[j]);
+                } else if (def->block == block) {
+                    RIVM_IR_VERIFY_(position[arg] < i, "v%d uses v%d before it's defined", value, arg);
+                } else {
+                    RIVM_IR_VERIFY_(rivm_ir_dominates(func, def->block, block),
+                        "v%d uses v%d, which doesn't dominate it", value, arg);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+#undef RIVM_IR_VERIFY_
@@ -0,0 +1,240 @@
+#pragma once
+
+#include "rivm.h"
+
+typedef enum RiVmIrOp RiVmIrOp;
+typedef enum RiVmOptLevel RiVmOptLevel;
+typedef struct RiVmIrInst RiVmIrInst;
+typedef struct RiVmIrBlock RiVmIrBlock;
+typedef struct RiVmIrFunc RiVmIrFunc;
+
+//
+//
+//
+
+// Optimizations done by `rivm_ir_optimize`.
+enum RiVmOptLevel
+{
+    // None, code is generated as written.
+    RiVmOpt_O0 = 0,
+    // Copy propagation, strength reduction, fewer wraps of 8 and 16-bit integers, dead code
+    // elimination.
+    RiVmOpt_O1,
+    // O1 with inlining of small functions, common subexpression elimination and loop-invariant
+    // code motion.
+    RiVmOpt_O2,
+};
+
+enum RiVmIrOp
+{
+    // Removed instruction.
+    RiVmIr_None = 0,
+
+    RiVmIr_Const,
+    // Input argument `param`.
+    RiVmIr_Param,
+    RiVmIr_Copy,
+    RiVmIr_Phi,
+    RiVmIr_Unary,
+    RiVmIr_Binary,
+    RiVmIr_Call,
+    // Output `output` of the call `args[0]`, whose value is its first output.
+    RiVmIr_Result,
+    // Address of `size` bytes in the frame of the function, for a struct.
+    RiVmIr_Local,
+    // Field at `memory.offset` from the address `args[0]`, loaded by `memory.op`.
+    RiVmIr_Load,
+    // Stores `args[1]` to the field at `memory.offset` from the address `args[0]` by `memory.op`.
+    RiVmIr_Store,
+    // Copies `size` bytes from the address `args[1]` to the address `args[0]`.
+    RiVmIr_MemCopy,
+    // Sets `size` bytes at the address `args[0]` to 0.
+    RiVmIr_MemZero,
+
+    // Terminators.
+    RiVmIr_Jump,
+    RiVmIr_Branch,
+    RiVmIr_Switch,
+    RiVmIr_Ret,
+    // Returns the result of a call in place of the current function.
+    RiVmIr_TailCall,
+
+    RiVmIr_COUNT__
+};
+
+#define RIVM_IR_NONE 0
+#define RIVM_IR_UNREACHABLE UINT32_MAX
+
+typedef Slice(uint32_t) RiVmIrIndexSlice;
+typedef ArrayWithSlice(RiVmIrIndexSlice) RiVmIrIndexArray;
+
+// Instruction of a function in SSA form, defining the value with its index.
+// Value 0 (`RIVM_IR_NONE`) is no value.
+struct RiVmIrInst
+{
+    RiVmIrOp op;
+    RiVmValueType type;
+    // Constants aren't in any block's `inst`, they're available everywhere.
+    uint32_t block;
+    // Values used. Phi has one for each predecessor of its block, in the same order.
+    RiVmIrIndexArray args;
+    // Blocks a terminator goes to, each once.
+    // RiVmIr_Jump goes to `target[0]`, RiVmIr_Branch to `target[0]` if `args[0]` isn't 0,
+    // otherwise to `target[1]`. RiVmIr_Switch is below. RiVmIr_Ret returns `args`, one for each
+    // output of the function.
+    RiVmIrIndexArray target;
+    union {
+        // RiVmIr_Const
+        RiVmValue imm;
+        // RiVmIr_Param
+        uint32_t param;
+        // RiVmIr_Phi, variable it was created for, while building.
+        uint32_t var;
+        // RiVmIr_Unary
+        RiVmOp unary;
+        // RiVmIr_Binary
+        RiVmOp binary;
+        // RiVmIr_Call and RiVmIr_TailCall, AST of the called function, like `RiVmParam.func`.
+        void* func;
+        // RiVmIr_Result
+        uint32_t output;
+        // RiVmIr_Local, RiVmIr_MemCopy and RiVmIr_MemZero
+        uint32_t size;
+        // RiVmIr_Load and RiVmIr_Store
+        struct {
+            RiVmOp op;
+            uint32_t offset;
+        } memory;
+        // RiVmIr_Switch goes to `target[table[args[0] - min]]`, to `target[0]` if it's out of the table.
+        struct {
+            int64_t min;
+            RiVmIrIndexArray table;
+        } cases;
+    };
+};
+
+typedef Slice(RiVmIrInst) RiVmIrInstSlice;
+typedef ArrayWithSlice(RiVmIrInstSlice) RiVmIrInstArray;
+
+struct RiVmIrBlock
+{
+    // Phis first, the terminator last.
+    RiVmIrIndexArray inst;
+    RiVmIrIndexArray pred;
+
+    // Set by `rivm_ir_analyze`.
+    // Index in `order`, `RIVM_IR_UNREACHABLE` if the block can't be reached from the entry.
+    uint32_t order;
+    // Immediate dominator and depth in the dominator tree (the entry is its own, at 0).
+    uint32_t idom;
+    uint32_t depth;
+
+    // While building, phis wait for the variables in unsealed blocks.
+    bool sealed;
+    RiVmIrIndexArray incomplete;
+};
+
+typedef Slice(RiVmIrBlock) RiVmIrBlockSlice;
+typedef ArrayWithSlice(RiVmIrBlockSlice) RiVmIrBlockArray;
+
+// Function in SSA form, built with the variables of the source: `rivm_ir_write_var` defines a
+// variable in a block and `rivm_ir_read_var` looks its definition up through the predecessors,
+// adding phis where definitions merge. Phis are completed once a block is sealed, that is when
+// all of its predecessors are known (Braun et al., Simple and Efficient Construction of SSA Form).
+// Block 0 is the entry. Everything is in `arena`.
+struct RiVmIrFunc
+{
+    Arena* arena;
+    RiVmIrInstArray inst;
+    RiVmIrBlockArray block;
+    uint32_t inputs_count;
+
+    // Reachable blocks in reverse postorder, set by `rivm_ir_analyze`.
+    RiVmIrIndexArray order;
+
+    // Definition of each variable in each block, and its type, while building.
+    Array(RiVmIrIndexArray) var_def;
+    Array(RiVmValueType) var_type;
+};
+
+void rivm_ir_init(RiVmIrFunc* func, Arena* arena, uint32_t inputs_count);
+
+uint32_t rivm_ir_block(RiVmIrFunc* func);
+// Appends `inst` to `block`, returns its value.
+uint32_t rivm_ir_emit(RiVmIrFunc* func, uint32_t block, RiVmIrInst inst);
+uint32_t rivm_ir_const(RiVmIrFunc* func, RiVmValueType type, RiVmValue imm);
+uint32_t rivm_ir_param(RiVmIrFunc* func, uint32_t index, RiVmValueType type);
+uint32_t rivm_ir_copy(RiVmIrFunc* func, uint32_t block, uint32_t value);
+uint32_t rivm_ir_unary(RiVmIrFunc* func, uint32_t block, RiVmOp op, RiVmValueType type, uint32_t a);
+uint32_t rivm_ir_binary(RiVmIrFunc* func, uint32_t block, RiVmOp op, RiVmValueType type, uint32_t a, uint32_t b);
+uint32_t rivm_ir_call(RiVmIrFunc* func, uint32_t block, RiVmValueType type, void* ast_func, uint32_t* args, iptr args_count);
+// Output `output` of `call`, after the first one.
+uint32_t rivm_ir_result(RiVmIrFunc* func, uint32_t block, RiVmValueType type, uint32_t call, uint32_t output);
+uint32_t rivm_ir_local(RiVmIrFunc* func, uint32_t block, uint32_t size);
+// `op` is one of `RiVmOp_Load`.
+uint32_t rivm_ir_load(RiVmIrFunc* func, uint32_t block, RiVmOp op, RiVmValueType type, uint32_t address, uint32_t offset);
+// `op` is one of `RiVmOp_Store`.
+void rivm_ir_store(RiVmIrFunc* func, uint32_t block, RiVmOp op, uint32_t address, uint32_t offset, uint32_t value);
+void rivm_ir_mem_copy(RiVmIrFunc* func, uint32_t block, uint32_t to, uint32_t from, uint32_t size);
+void rivm_ir_mem_zero(RiVmIrFunc* func, uint32_t block, uint32_t address, uint32_t size);
+void rivm_ir_jump(RiVmIrFunc* func, uint32_t block, uint32_t target);
+void rivm_ir_branch(RiVmIrFunc* func, uint32_t block, uint32_t condition, uint32_t then, uint32_t otherwise);
+// Goes to `blocks[value - min]`, or to `otherwise` if it's out of `blocks`.
+void rivm_ir_switch(RiVmIrFunc* func, uint32_t block, uint32_t value, int64_t min, uint32_t* blocks, iptr count, uint32_t otherwise);
+// `value` can be `RIVM_IR_NONE`.
+void rivm_ir_ret(RiVmIrFunc* func, uint32_t block, uint32_t value);
+// Returns `values`, one for each output.
+void rivm_ir_ret_values(RiVmIrFunc* func, uint32_t block, uint32_t* values, iptr count);
+void rivm_ir_tail_call(RiVmIrFunc* func, uint32_t block, void* ast_func, uint32_t* args, iptr args_count);
+bool rivm_ir_is_terminated(RiVmIrFunc* func, uint32_t block);
+
+uint32_t rivm_ir_var(RiVmIrFunc* func, RiVmValueType type);
+void rivm_ir_write_var(RiVmIrFunc* func, uint32_t var, uint32_t block, uint32_t value);
+uint32_t rivm_ir_read_var(RiVmIrFunc* func, uint32_t var, uint32_t block);
+void rivm_ir_seal(RiVmIrFunc* func, uint32_t block);
+// Drops unreachable blocks and analyzes the function, once all blocks are sealed.
+void rivm_ir_finish(RiVmIrFunc* func);
+
+// Computes `order` and the dominator tree.
+void rivm_ir_analyze(RiVmIrFunc* func);
+bool rivm_ir_dominates(RiVmIrFunc* func, uint32_t a, uint32_t b);
+// Blocks the terminator of `block` goes to.
+RiVmIrIndexSlice rivm_ir_succ(RiVmIrFunc* func, uint32_t block);
+// Index of `pred` in predecessors of `block`, -1 if it's not one.
+iptr rivm_ir_pred_index(RiVmIrFunc* func, uint32_t block, uint32_t pred);
+// Removes instructions marked `RiVmIr_None` from their blocks.
+void rivm_ir_compact(RiVmIrFunc* func);
+// Checks that the function is in valid SSA form, returns false and logs the problem otherwise.
+bool rivm_ir_verify(RiVmIrFunc* func);
+
+static inline bool
+rivm_ir_is_terminator(RiVmIrOp op)
+{
+    return op == RiVmIr_Jump || op == RiVmIr_Branch || op == RiVmIr_Switch || op == RiVmIr_Ret || op == RiVmIr_TailCall;
+}
+
+// Writes to memory, which is its only effect, so it defines no value.
+static inline bool
+rivm_ir_is_store(RiVmIrOp op)
+{
+    return op == RiVmIr_Store || op == RiVmIr_MemCopy || op == RiVmIr_MemZero;
+}
+
+static inline RiVmIrInst*
+rivm_ir_inst(RiVmIrFunc* func, uint32_t value)
+{
+    return &array_at(&func->inst, value);
+}
+
+static inline RiVmIrBlock*
+rivm_ir_block_at(RiVmIrFunc* func, uint32_t block)
+{
+    return &array_at(&func->block, block);
+}
+
+//
+//
+//
+
+// Runs the passes of `level` until none of them changes anything.
+void rivm_ir_optimize(RiVmIrFunc* func, RiVmOptLevel level);
@@ -4,17 +4,40 @@ RIVM_INST(Nop, "nop")
 
 RIVM_INST(Enter, "enter")
 RIVM_INST(Ret, "ret")
+// Output(Index A, Value B)
+// Sets output A + 1 of the current function to B, before Ret returns the first one.
+RIVM_INST(Output, "output")
 
 // Assign(A = B)
 RIVM_INST(Assign, "assign")
-// Store(Memory[A + B] = C)
-// Stores sizeof(B) bytes to memory address A + C.
-RIVM_INST(Store, "store")
-// Load(C = Memory[A + B])
-// Loads sizeof(B) bytes from memory address A + C.
-RIVM_INST(Load, "load")
 // A = AddrOf(B)
+// Address of slot B, where a struct in the frame of the function starts.
 RIVM_INST(AddrOf, "addr-of")
+// A = Memory[B + imm C]
+// Loads a field at the constant offset C from the address B, which is the whole access. Narrow
+// integers are sign or zero extended to the 32 bits of A, like `Unary_Convert_Narrow`.
+RIVM_GROUP_START(Load)
+    RIVM_INST(Load_I8, "load-i8")
+    RIVM_INST(Load_U8, "load-u8")
+    RIVM_INST(Load_I16, "load-i16")
+    RIVM_INST(Load_U16, "load-u16")
+    RIVM_INST(Load_32, "load-32")
+    RIVM_INST(Load_64, "load-64")
+RIVM_GROUP_END(Load)
+// Memory[A + imm B] = C
+// Stores the low bytes of C to a field at the constant offset B from the address A.
+RIVM_GROUP_START(Store)
+    RIVM_INST(Store_8, "store-8")
+    RIVM_INST(Store_16, "store-16")
+    RIVM_INST(Store_32, "store-32")
+    RIVM_INST(Store_64, "store-64")
+RIVM_GROUP_END(Store)
+// MemCopy(A, B, imm C)
+// Copies C bytes from the address B to the address A, for structs assigned as a whole.
+RIVM_INST(MemCopy, "mem-copy")
+// MemZero(A, imm B)
+// Sets B bytes at the address A to 0, for structs declared without a value.
+RIVM_INST(MemZero, "mem-zero")
 
 // Arg(Value)
 // Pushes Value to the stack.
@@ -23,16 +46,57 @@ RIVM_INST(ArgPush, "arg-push")
 // Pops A count of arguments.
 RIVM_INST(ArgPopN, "arg-pop-n")
 
-// A = Call(Func B)
+// A = Call(Func B, Slot C)
 // Calls function B and sets result to A.
 // If A.Type == None, result is ignored.
+// Outputs after the first are set by the callee to C, C + 1 and so on.
 RIVM_INST(Call, "call")
+// TailCall(Count A, Func B)
+// Calls function B with the last A pushed arguments in the frame of the current function, and
+// returns its result.
+RIVM_INST(TailCall, "tail-call")
 
 // (goto A)
 RIVM_INST(GoTo, "goto")
 // (if (A == 0) goto B else goto C)
 RIVM_INST(If, "if")
+// (switch A - B < C goto table[A - B] else goto table[C])
+// The table is the C + 1 GoTo instructions that follow, only their targets are read.
+RIVM_INST(Switch, "switch")
 
+// A = Op B
+RIVM_GROUP_START(Unary)
+    RIVM_INST(Unary_Neg, "neg")
+    RIVM_INST(Unary_BNot, "~")
+    RIVM_INST(Unary_Not, "!")
+    // B converted to the type of A.
+    RIVM_GROUP_START(Unary_Convert)
+        // Sign or zero extended from the type of B, or truncated.
+        RIVM_INST(Unary_Convert_Int, "itoi")
+        RIVM_INST(Unary_Convert_IntToFloat, "itof")
+        // Rounded toward zero. Out of range values saturate, NaN is 0.
+        RIVM_INST(Unary_Convert_FloatToInt, "ftoi")
+        RIVM_INST(Unary_Convert_Float, "ftof")
+        // Low bits of B to a narrow integer, extended to the 32 bits of A (see `rivm_narrow`).
+        RIVM_GROUP_START(Unary_Convert_Narrow)
+            RIVM_INST(Unary_Convert_Narrow_I8, "i8")
+            RIVM_INST(Unary_Convert_Narrow_I16, "i16")
+            RIVM_INST(Unary_Convert_Narrow_U8, "u8")
+            RIVM_INST(Unary_Convert_Narrow_U16, "u16")
+        RIVM_GROUP_END(Unary_Convert_Narrow)
+    RIVM_GROUP_END(Unary_Convert)
+    // Same as `Unary_Convert_Narrow`, and overflow traps like `Binary_Checked` if B was out of range.
+    RIVM_GROUP_START(Unary_Checked_Narrow)
+        RIVM_INST(Unary_Checked_Narrow_I8, "i8?")
+        RIVM_INST(Unary_Checked_Narrow_I16, "i16?")
+        RIVM_INST(Unary_Checked_Narrow_U8, "u8?")
+        RIVM_INST(Unary_Checked_Narrow_U16, "u16?")
+    RIVM_GROUP_END(Unary_Checked_Narrow)
+RIVM_GROUP_END(Unary)
+
+// A = B Op C
+// Integers wrap around. Division by zero traps, and so does the division of the lowest signed
+// integer by -1. Shifts use the low bits of C, up to the width of A.
 RIVM_GROUP_START(Binary)
     RIVM_INST(Binary_Add, "+")
     RIVM_INST(Binary_Sub, "-")
@@ -46,6 +110,13 @@ RIVM_GROUP_START(Binary)
     RIVM_INST(Binary_BShR, ">>")
     RIVM_INST(Binary_And, "&&")
     RIVM_INST(Binary_Or, "||")
+    // Integers only, overflow traps at the next jump, store, output, call or return.
+    RIVM_GROUP_START(Binary_Checked)
+        RIVM_INST(Binary_Checked_Add, "+?")
+        RIVM_INST(Binary_Checked_Sub, "-?")
+        RIVM_INST(Binary_Checked_Mul, "*?")
+    RIVM_GROUP_END(Binary_Checked)
+    // A is 1 or 0, B and C are of the same type, but not necessarily the type of A.
     RIVM_GROUP_START(Binary_Comparison)
         RIVM_INST(Binary_Comparison_Lt, "<")
         RIVM_INST(Binary_Comparison_Gt, ">")
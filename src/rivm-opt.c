@@ -0,0 +1,650 @@
+#include "rivm-ir.h"
+
+// Returns true if it changed the function.
+#define RIVM_PASS_F(Name) bool Name(RiVmIrFunc* func)
+typedef RIVM_PASS_F(RiVmPassF);
+
+typedef struct RiVmPass_ {
+    const char* name;
+    RiVmPassF* run;
+} RiVmPass_;
+
+// Follows values replaced by a pass to the one they were replaced with (0 is not replaced).
+static uint32_t
+rivm_opt_resolve_(uint32_t* replace, uint32_t value)
+{
+    while (replace[value]) {
+        value = replace[value];
+    }
+    return value;
+}
+
+// Makes instructions use the values they were replaced with and drops the replaced ones.
+static void
+rivm_opt_replace_(RiVmIrFunc* func, uint32_t* replace)
+{
+    for (iptr k = 0; k < func->order.count; ++k) {
+        RiVmIrBlock* b = rivm_ir_block_at(func, func->order.items[k]);
+        for (iptr i = 0; i < b->inst.count; ++i) {
+            uint32_t value = b->inst.items[i];
+            RiVmIrInst* inst = rivm_ir_inst(func, value);
+            if (replace[value]) {
+                inst->op = RiVmIr_None;
+                continue;
+            }
+            for (iptr j = 0; j < inst->args.count; ++j) {
+                inst->args.items[j] = rivm_opt_resolve_(replace, inst->args.items[j]);
+            }
+        }
+    }
+    rivm_ir_compact(func);
+}
+
+static bool
+rivm_opt_is_int_(RiVmValueType type)
+{
+    return type == RiVmValue_I32 || type == RiVmValue_I64 || type == RiVmValue_U32 || type == RiVmValue_U64;
+}
+
+static bool
+rivm_opt_is_pure_(RiVmIrInst* inst)
+{
+    return inst->op == RiVmIr_Const || inst->op == RiVmIr_Unary || inst->op == RiVmIr_Binary;
+}
+
+// Integer division and checked arithmetic, which can trap. They're kept even if their result
+// isn't used, as the trap is their effect.
+static bool
+rivm_opt_can_trap_(RiVmIrInst* inst)
+{
+    if (inst->op == RiVmIr_Unary) {
+        return rivm_op_is_in(inst->unary, Unary_Checked_Narrow);
+    }
+    if (inst->op != RiVmIr_Binary) {
+        return false;
+    }
+    return rivm_op_is_in(inst->binary, Binary_Checked) || (
+        (inst->binary == RiVmOp_Binary_Div || inst->binary == RiVmOp_Binary_Mod) &&
+        rivm_opt_is_int_(inst->type)
+    );
+}
+
+// Pure instructions that can't fail, so they can run even where the source wouldn't run them.
+static bool
+rivm_opt_is_speculatable_(RiVmIrInst* inst)
+{
+    return rivm_opt_is_pure_(inst) && !rivm_opt_can_trap_(inst);
+}
+
+static bool
+rivm_opt_is_commutative_(RiVmOp op)
+{
+    switch (op)
+    {
+        case RiVmOp_Binary_Add:
+        case RiVmOp_Binary_Mul:
+        case RiVmOp_Binary_Checked_Add:
+        case RiVmOp_Binary_Checked_Mul:
+        case RiVmOp_Binary_BXor:
+        case RiVmOp_Binary_BAnd:
+        case RiVmOp_Binary_BOr:
+        case RiVmOp_Binary_And:
+        case RiVmOp_Binary_Or:
+        case RiVmOp_Binary_Comparison_Eq:
+        case RiVmOp_Binary_Comparison_NotEq:
+            return true;
+        default: break;
+    }
+    return false;
+}
+
+// Bits of `imm` that belong to a value of `type`.
+static uint64_t
+rivm_opt_imm_bits_(RiVmValueType type, RiVmValue imm)
+{
+    switch (type)
+    {
+        case RiVmValue_I32:
+        case RiVmValue_U32:
+        case RiVmValue_F32:
+            return imm.u32;
+        default: break;
+    }
+    return imm.u64;
+}
+
+//
+// Copy propagation
+//
+
+// Replaces copies and phis whose arguments are all the same value with the value.
+static RIVM_PASS_F(rivm_opt_copy_propagation_)
+{
+    uint32_t* replace = arena_push_nt(func->arena, uint32_t, func->inst.count);
+    memset(replace, 0, func->inst.count * sizeof(uint32_t));
+    bool changed = false;
+
+    // Phis in loops can be left with one value only after the others are replaced.
+    for (bool again = true; again;) {
+        again = false;
+        for (iptr k = 0; k < func->order.count; ++k) {
+            RiVmIrBlock* b = rivm_ir_block_at(func, func->order.items[k]);
+            for (iptr i = 0; i < b->inst.count; ++i) {
+                uint32_t value = b->inst.items[i];
+                RiVmIrInst* inst = rivm_ir_inst(func, value);
+                if (replace[value]) {
+                    continue;
+                }
+                uint32_t same = RIVM_IR_NONE;
+                if (inst->op == RiVmIr_Copy) {
+                    same = rivm_opt_resolve_(replace, inst->args.items[0]);
+                } else if (inst->op == RiVmIr_Phi) {
+                    for (iptr j = 0; j < inst->args.count; ++j) {
+                        uint32_t arg = rivm_opt_resolve_(replace, inst->args.items[j]);
+                        if (arg == value || arg == same) {
+                            continue;
+                        }
+                        if (same != RIVM_IR_NONE) {
+                            same = RIVM_IR_NONE;
+                            break;
+                        }
+                        same = arg;
+                    }
+                }
+                if (same != RIVM_IR_NONE) {
+                    replace[value] = same;
+                    again = changed = true;
+                }
+            }
+        }
+    }
+
+    if (changed) {
+        rivm_opt_replace_(func, replace);
+    }
+    return changed;
+}
+
+//
+// Strength reduction
+//
+
+// Replaces unsigned division and remainder by a power of two with a shift and a mask.
+// NOTE: Other divisors would take a multiplication, shifts and a correction, and signed division
+// a correction too, which is more instructions than the one division they save in the interpreter.
+static RIVM_PASS_F(rivm_opt_strength_)
+{
+    bool changed = false;
+    for (iptr k = 0; k < func->order.count; ++k) {
+        RiVmIrBlock* b = rivm_ir_block_at(func, func->order.items[k]);
+        for (iptr i = 0; i < b->inst.count; ++i) {
+            uint32_t value = b->inst.items[i];
+            RiVmIrInst* inst = rivm_ir_inst(func, value);
+            if (inst->op != RiVmIr_Binary ||
+                (inst->binary != RiVmOp_Binary_Div && inst->binary != RiVmOp_Binary_Mod) ||
+                (inst->type != RiVmValue_U32 && inst->type != RiVmValue_U64)
+            ) {
+                continue;
+            }
+            RiVmIrInst* divisor = rivm_ir_inst(func, inst->args.items[1]);
+            uint64_t bits = divisor->op == RiVmIr_Const ? rivm_opt_imm_bits_(inst->type, divisor->imm) : 0;
+            if (bits == 0 || (bits & (bits - 1))) {
+                continue;
+            }
+
+            RiVmValue imm = {0};
+            RiVmOp op;
+            if (inst->binary == RiVmOp_Binary_Div) {
+                op = RiVmOp_Binary_BShR;
+                while (bits >>= 1) {
+                    ++imm.u64;
+                }
+            } else {
+                op = RiVmOp_Binary_BAnd;
+                imm.u64 = bits - 1;
+            }
+            // Adding the constant can move the instructions.
+            uint32_t arg = rivm_ir_const(func, inst->type, imm);
+            inst = rivm_ir_inst(func, value);
+            inst->binary = op;
+            inst->args.items[1] = arg;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+//
+// Narrow integers
+//
+
+static int
+rivm_opt_narrow_bits_(RiVmIrInst* inst)
+{
+    if (inst->op != RiVmIr_Unary) {
+        return 0;
+    }
+    switch (inst->unary)
+    {
+        case RiVmOp_Unary_Convert_Narrow_I8:
+        case RiVmOp_Unary_Convert_Narrow_U8:
+            return 8;
+        case RiVmOp_Unary_Convert_Narrow_I16:
+        case RiVmOp_Unary_Convert_Narrow_U16:
+            return 16;
+        default: break;
+    }
+    return 0;
+}
+
+// Low bits of a sum, difference, product or left shift only depend on the low bits of the
+// arguments, so wrapping them is left to the result: `u8(u8(a * 31) + b)` is `u8(a * 31 + b)`.
+// The argument is only changed when the result is its one use.
+static RIVM_PASS_F(rivm_opt_narrow_)
+{
+    uint32_t* uses = arena_push_nt(func->arena, uint32_t, func->inst.count);
+    memset(uses, 0, func->inst.count * sizeof(uint32_t));
+    for (iptr k = 0; k < func->order.count; ++k) {
+        RiVmIrBlock* b = rivm_ir_block_at(func, func->order.items[k]);
+        for (iptr i = 0; i < b->inst.count; ++i) {
+            RiVmIrInst* inst = rivm_ir_inst(func, b->inst.items[i]);
+            for (iptr j = 0; j < inst->args.count; ++j) {
+                ++uses[inst->args.items[j]];
+            }
+        }
+    }
+
+    bool changed = false;
+    for (iptr k = 0; k < func->order.count; ++k) {
+        RiVmIrBlock* b = rivm_ir_block_at(func, func->order.items[k]);
+        for (iptr i = 0; i < b->inst.count; ++i) {
+            RiVmIrInst* inst = rivm_ir_inst(func, b->inst.items[i]);
+            int bits = rivm_opt_narrow_bits_(inst);
+            uint32_t value = bits ? inst->args.items[0] : RIVM_IR_NONE;
+            RiVmIrInst* arith = value ? rivm_ir_inst(func, value) : NULL;
+            if (!arith || arith->op != RiVmIr_Binary || uses[value] != 1) {
+                continue;
+            }
+            iptr count;
+            switch (arith->binary)
+            {
+                case RiVmOp_Binary_Add:
+                case RiVmOp_Binary_Sub:
+                case RiVmOp_Binary_Mul:
+                    count = 2;
+                    break;
+                case RiVmOp_Binary_BShL:
+                    count = 1;
+                    break;
+                default:
+                    count = 0;
+                    break;
+            }
+            for (iptr j = 0; j < count; ++j) {
+                RiVmIrInst* arg = rivm_ir_inst(func, arith->args.items[j]);
+                if (rivm_opt_narrow_bits_(arg) < bits) {
+                    continue;
+                }
+                // The arithmetic is 32-bit, only its low half is read.
+                RiVmValueType type = rivm_ir_inst(func, arg->args.items[0])->type;
+                if (type == RiVmValue_I32 || type == RiVmValue_U32) {
+                    arith->args.items[j] = arg->args.items[0];
+                    changed = true;
+                }
+            }
+        }
+    }
+    return changed;
+}
+
+//
+// Dead code elimination
+//
+
+// Removes instructions whose values aren't used by anything with an effect.
+// NOTE: Loads aren't pure, stores between two of them can change what they read, so CSE and LICM
+// leave them where they are, but an unused one is removed.
+static RIVM_PASS_F(rivm_opt_dce_)
+{
+    bool* live = arena_push_nt(func->arena, bool, func->inst.count);
+    memset(live, 0, func->inst.count * sizeof(bool));
+    RiVmIrIndexArray work = {0};
+
+    for (iptr k = 0; k < func->order.count; ++k) {
+        RiVmIrBlock* b = rivm_ir_block_at(func, func->order.items[k]);
+        for (iptr i = 0; i < b->inst.count; ++i) {
+            uint32_t value = b->inst.items[i];
+            RiVmIrInst* inst = rivm_ir_inst(func, value);
+            if (inst->op == RiVmIr_Call || rivm_ir_is_terminator(inst->op) || rivm_ir_is_store(inst->op) || rivm_opt_can_trap_(inst)) {
+                live[value] = true;
+                arena_array_push(func->arena, &work, value);
+            }
+        }
+    }
+    while (work.count) {
+        RiVmIrInst* inst = rivm_ir_inst(func, work.items[--work.count]);
+        for (iptr j = 0; j < inst->args.count; ++j) {
+            uint32_t arg = inst->args.items[j];
+            if (!live[arg]) {
+                live[arg] = true;
+                arena_array_push(func->arena, &work, arg);
+            }
+        }
+    }
+
+    bool changed = false;
+    for (iptr k = 0; k < func->order.count; ++k) {
+        RiVmIrBlock* b = rivm_ir_block_at(func, func->order.items[k]);
+        for (iptr i = 0; i < b->inst.count; ++i) {
+            uint32_t value = b->inst.items[i];
+            if (!live[value]) {
+                rivm_ir_inst(func, value)->op = RiVmIr_None;
+                changed = true;
+            }
+        }
+    }
+    if (changed) {
+        rivm_ir_compact(func);
+    }
+    return changed;
+}
+
+//
+// Common subexpression elimination
+//
+
+static uint64_t
+rivm_opt_hash_(RiVmIrInst* inst)
+{
+    uint64_t h = hash_mix(inst->op, inst->type);
+    if (inst->op == RiVmIr_Const) {
+        h = hash_mix(h, rivm_opt_imm_bits_(inst->type, inst->imm));
+    } else if (inst->op == RiVmIr_Unary) {
+        h = hash_mix(h, inst->unary);
+    } else if (inst->op == RiVmIr_Binary) {
+        h = hash_mix(h, inst->binary);
+    }
+    for (iptr j = 0; j < inst->args.count; ++j) {
+        h = hash_mix(h, inst->args.items[j]);
+    }
+    return h;
+}
+
+static bool
+rivm_opt_is_equal_(RiVmIrInst* a, RiVmIrInst* b)
+{
+    if (a->op != b->op || a->type != b->type || a->args.count != b->args.count) {
+        return false;
+    }
+    if (a->op == RiVmIr_Const) {
+        return rivm_opt_imm_bits_(a->type, a->imm) == rivm_opt_imm_bits_(b->type, b->imm);
+    }
+    if (a->op == RiVmIr_Unary && a->unary != b->unary) {
+        return false;
+    }
+    if (a->op == RiVmIr_Binary && a->binary != b->binary) {
+        return false;
+    }
+    return memcmp(a->args.items, b->args.items, a->args.count * sizeof(uint32_t)) == 0;
+}
+
+// Replaces pure instructions with an equal one that dominates them. Blocks are visited in reverse
+// postorder, so instructions are replaced before they're looked up as arguments of others.
+static RIVM_PASS_F(rivm_opt_cse_)
+{
+    uint32_t* replace = arena_push_nt(func->arena, uint32_t, func->inst.count);
+    memset(replace, 0, func->inst.count * sizeof(uint32_t));
+    // Open addressing, values of instructions already visited.
+    iptr capacity = (iptr)u64_next_power_of_two(MAXIMUM(func->inst.count * 2, 16));
+    uint32_t* table = arena_push_nt(func->arena, uint32_t, capacity);
+    memset(table, 0, capacity * sizeof(uint32_t));
+    bool changed = false;
+
+    // Constants first, they don't depend on anything and are available everywhere.
+    for (int pass = 0; pass < 2; ++pass) {
+        for (iptr k = 0; k < (pass ? func->order.count : 1); ++k) {
+            RiVmIrBlock* b = pass ? rivm_ir_block_at(func, func->order.items[k]) : NULL;
+            iptr count = pass ? b->inst.count : func->inst.count;
+            for (iptr i = pass ? 0 : 1; i < count; ++i) {
+                uint32_t value = pass ? b->inst.items[i] : (uint32_t)i;
+                RiVmIrInst* inst = rivm_ir_inst(func, value);
+                if ((inst->op == RiVmIr_Const) == (pass == 1)) {
+                    continue;
+                }
+                for (iptr j = 0; j < inst->args.count; ++j) {
+                    inst->args.items[j] = rivm_opt_resolve_(replace, inst->args.items[j]);
+                }
+                if (!rivm_opt_is_pure_(inst)) {
+                    continue;
+                }
+                if (inst->op == RiVmIr_Binary && rivm_opt_is_commutative_(inst->binary) &&
+                    inst->args.items[0] > inst->args.items[1]) {
+                    uint32_t arg = inst->args.items[0];
+                    inst->args.items[0] = inst->args.items[1];
+                    inst->args.items[1] = arg;
+                }
+
+                iptr slot = (iptr)(rivm_opt_hash_(inst) & (capacity - 1));
+                for (; table[slot]; slot = (slot + 1) & (capacity - 1)) {
+                    RiVmIrInst* other = rivm_ir_inst(func, table[slot]);
+                    if (rivm_opt_is_equal_(inst, other) &&
+                        (inst->op == RiVmIr_Const || rivm_ir_dominates(func, other->block, inst->block))) {
+                        break;
+                    }
+                }
+                if (table[slot]) {
+                    replace[value] = table[slot];
+                    changed = true;
+                } else {
+                    table[slot] = value;
+                }
+            }
+        }
+    }
+
+    if (changed) {
+        rivm_opt_replace_(func, replace);
+    }
+    return changed;
+}
+
+//
+// Loop-invariant code motion
+//
+
+// Block the loop with `header` is entered from, ending with a jump to the header.
+// If the loop is entered from a block that also goes elsewhere, a block is added between them.
+// Returns `RIVM_IR_UNREACHABLE` if the loop is entered from more than one block.
+static uint32_t
+rivm_opt_preheader_(RiVmIrFunc* func, uint32_t header, uint32_t* loop, iptr blocks_count, uint32_t stamp)
+{
+    RiVmIrBlock* h = rivm_ir_block_at(func, header);
+    iptr outside = -1;
+    for (iptr i = 0; i < h->pred.count; ++i) {
+        if (h->pred.items[i] >= blocks_count || loop[h->pred.items[i]] != stamp) {
+            if (outside >= 0) {
+                return RIVM_IR_UNREACHABLE;
+            }
+            outside = i;
+        }
+    }
+    RI_CHECK(outside >= 0);
+
+    uint32_t pred = h->pred.items[outside];
+    RiVmIrBlock* p = rivm_ir_block_at(func, pred);
+    RiVmIrInst* jump = rivm_ir_inst(func, p->inst.items[p->inst.count - 1]);
+    if (jump->op == RiVmIr_Jump) {
+        return pred;
+    }
+
+    uint32_t preheader = rivm_ir_block(func);
+    for (iptr i = 0; i < jump->target.count; ++i) {
+        if (jump->target.items[i] == header) {
+            jump->target.items[i] = preheader;
+        }
+    }
+    rivm_ir_block_at(func, header)->pred.items[outside] = preheader;
+    RiVmIrBlock* b = rivm_ir_block_at(func, preheader);
+    b->sealed = true;
+    arena_array_push(func->arena, &b->pred, pred);
+    rivm_ir_emit(func, preheader, (RiVmIrInst){
+        .op = RiVmIr_Jump,
+        .target = rivm_ir_args_(func, &header, 1),
+    });
+    return preheader;
+}
+
+// Moves instructions whose arguments are all defined outside of a loop before the loop.
+// Loops are found from their back edges, edges to a block that dominates the block they're from.
+static RIVM_PASS_F(rivm_opt_licm_)
+{
+    iptr blocks_count = func->block.count;
+    // Stamp of the last loop each block was found to be in, preheaders added meanwhile are in none.
+    uint32_t* loop = arena_push_nt(func->arena, uint32_t, blocks_count);
+    memset(loop, 0, blocks_count * sizeof(uint32_t));
+    RiVmIrIndexArray work = {0};
+    RiVmIrIndexArray kept = {0};
+    bool changed = false;
+    bool changed_blocks = false;
+
+    for (iptr k = 0; k < func->order.count; ++k) {
+        uint32_t header = func->order.items[k];
+        uint32_t stamp = header + 1;
+        RiVmIrBlock* h = rivm_ir_block_at(func, header);
+
+        work.count = 0;
+        for (iptr i = 0; i < h->pred.count; ++i) {
+            uint32_t pred = h->pred.items[i];
+            if (pred < blocks_count && rivm_ir_dominates(func, header, pred)) {
+                arena_array_push(func->arena, &work, pred);
+            }
+        }
+        if (work.count == 0) {
+            continue;
+        }
+
+        // Blocks of the loop reach a back edge without going through the header.
+        loop[header] = stamp;
+        while (work.count) {
+            uint32_t block = work.items[--work.count];
+            RI_CHECK(block < blocks_count);
+            if (loop[block] == stamp) {
+                continue;
+            }
+            loop[block] = stamp;
+            RiVmIrBlock* b = rivm_ir_block_at(func, block);
+            for (iptr i = 0; i < b->pred.count; ++i) {
+                arena_array_push(func->arena, &work, b->pred.items[i]);
+            }
+        }
+
+        iptr blocks_before = func->block.count;
+        uint32_t preheader = rivm_opt_preheader_(func, header, loop, blocks_count, stamp);
+        if (preheader == RIVM_IR_UNREACHABLE) {
+            continue;
+        }
+        changed_blocks |= func->block.count != blocks_before;
+
+        // In reverse postorder, so arguments hoisted before are outside of the loop already.
+        for (iptr m = k; m < func->order.count; ++m) {
+            uint32_t block = func->order.items[m];
+            if (loop[block] != stamp) {
+                continue;
+            }
+            RiVmIrBlock* b = rivm_ir_block_at(func, block);
+            kept.count = 0;
+            for (iptr i = 0; i < b->inst.count; ++i) {
+                uint32_t value = b->inst.items[i];
+                RiVmIrInst* inst = rivm_ir_inst(func, value);
+                bool invariant = rivm_opt_is_speculatable_(inst);
+                for (iptr j = 0; invariant && j < inst->args.count; ++j) {
+                    RiVmIrInst* arg = rivm_ir_inst(func, inst->args.items[j]);
+                    invariant = arg->op == RiVmIr_Const ||
+                        arg->block >= blocks_count || loop[arg->block] != stamp;
+                }
+                if (!invariant) {
+                    arena_array_push(func->arena, &kept, value);
+                    continue;
+                }
+
+                // Goes right before the preheader's jump.
+                RiVmIrBlock* p = rivm_ir_block_at(func, preheader);
+                uint32_t jump = p->inst.items[p->inst.count - 1];
+                arena_array_push(func->arena, &p->inst, jump);
+                p->inst.items[p->inst.count - 2] = value;
+                inst->block = preheader;
+                changed = true;
+            }
+            memcpy(b->inst.items, kept.items, kept.count * sizeof(uint32_t));
+            b->inst.count = kept.count;
+        }
+    }
+
+    if (changed_blocks) {
+        rivm_ir_analyze(func);
+    }
+    return changed || changed_blocks;
+}
+
+//
+// Pass manager
+//
+
+static const RiVmPass_ RIVM_OPT_PASSES_O1_[] = {
+    { "copy-propagation", &rivm_opt_copy_propagation_ },
+    { "strength", &rivm_opt_strength_ },
+    { "narrow", &rivm_opt_narrow_ },
+    { "dce", &rivm_opt_dce_ },
+};
+
+static const RiVmPass_ RIVM_OPT_PASSES_O2_[] = {
+    { "copy-propagation", &rivm_opt_copy_propagation_ },
+    { "strength", &rivm_opt_strength_ },
+    { "narrow", &rivm_opt_narrow_ },
+    { "cse", &rivm_opt_cse_ },
+    { "licm", &rivm_opt_licm_ },
+    { "dce", &rivm_opt_dce_ },
+};
+
+// Passes expose work for each other, but rarely for more than a couple of rounds.
+#define RIVM_OPT_ROUNDS_ 4
+
+void
+rivm_ir_optimize(RiVmIrFunc* func, RiVmOptLevel level)
+{
+    const RiVmPass_* passes = NULL;
+    iptr passes_count = 0;
+    switch (level)
+    {
+        case RiVmOpt_O0:
+            return;
+        case RiVmOpt_O1:
+            passes = RIVM_OPT_PASSES_O1_;
+            passes_count = COUNTOF(RIVM_OPT_PASSES_O1_);
+            break;
+        case RiVmOpt_O2:
+            passes = RIVM_OPT_PASSES_O2_;
+            passes_count = COUNTOF(RIVM_OPT_PASSES_O2_);
+            break;
+        default:
+            RI_UNREACHABLE;
+            break;
+    }
+
+    for (int round = 0; round < RIVM_OPT_ROUNDS_; ++round) {
+        bool changed = false;
+        for (iptr i = 0; i < passes_count; ++i) {
+            if (passes[i].run(func)) {
+                changed = true;
+#if !defined(BUILD_RELEASE)
+                if (!rivm_ir_verify(func)) {
+                    RI_ABORT("ir: invalid after pass '%s'", passes[i].name);
+                }
+#endif
+            }
+        }
+        if (!changed) {
+            break;
+        }
+    }
+}
@@ -2,20 +2,49 @@
 #include "rivm.h"
 
 //
+// Segment
 //
-//
+
+#ifndef RIVM_CODE_RESERVE
+    #define RIVM_CODE_RESERVE GIGABYTES((iptr)1)
+#endif
+#ifndef RIVM_SLOT_RESERVE
+    #define RIVM_SLOT_RESERVE MEGABYTES(64)
+#endif
+#define RIVM_SEGMENT_COMMIT KILOBYTES(64)
+
+static void
+rivm_segment_init_(RiVmSegment* segment, iptr reserved)
+{
+    segment->reserved = reserved;
+    segment->base = virtual_reserve(0, segment->reserved);
+    segment->committed = 0;
+    segment->used = 0;
+}
+
+static void
+rivm_segment_purge_(RiVmSegment* segment)
+{
+    virtual_free(segment->base, segment->reserved);
+    memset(segment, 0, sizeof(RiVmSegment));
+}
 
 static void*
-rivm_module_push__(RiVmModule* module, int64_t size)
+rivm_segment_push_(RiVmSegment* segment, iptr size)
 {
-    void* ptr = arena_push(&module->arena, size, 8);
-    memset(ptr, 0, size);
+    iptr used = segment->used + size;
+    if (used > segment->committed) {
+        RI_ASSERT(used <= segment->reserved);
+        iptr committed = MINIMUM(segment->reserved,
+            (used + RIVM_SEGMENT_COMMIT - 1) & ~(iptr)(RIVM_SEGMENT_COMMIT - 1));
+        virtual_commit(segment->base + segment->committed, committed - segment->committed);
+        segment->committed = committed;
+    }
+    void* ptr = segment->base + segment->used;
+    segment->used = used;
     return ptr;
 }
 
-#define rivm_module_push_(RiVmModule, Type) \
-    rivm_module_push__(RiVmModule, sizeof(Type))
-
 //
 //
 //
@@ -24,25 +53,178 @@ void
 rivm_module_init(RiVmModule* module)
 {
     memset(module, 0, sizeof(RiVmModule));
-    arena_init(&module->arena, KILOBYTES(64));
+    // Offsets are 32-bit.
+    RI_CHECK(RIVM_CODE_RESERVE / sizeof(RiVmInst) <= UINT32_MAX);
+    rivm_segment_init_(&module->code, RIVM_CODE_RESERVE);
+    rivm_segment_init_(&module->ref, RIVM_SLOT_RESERVE);
 }
 
 void
 rivm_module_purge(RiVmModule* module)
 {
-    RiVmFunc* it;
-    array_each(&module->func, &it) {
-        heap_free(it->code.items);
+    RI_CHECK(module->running[0] == 0 && module->running[1] == 0);
+    rivm_segment_purge_(&module->code);
+    rivm_segment_purge_(&module->ref);
+    array_purge(&module->code_free);
+    array_purge(&module->func.offset);
+    array_purge(&module->func.count);
+    array_purge(&module->func.inputs_count);
+    array_purge(&module->func.outputs_count);
+    array_purge(&module->func.free);
+    array_purge(&module->slot);
+    array_purge(&module->retired);
+}
+
+// Space for `count` instructions, in a released range if one fits (first fit).
+static uint32_t
+rivm_module_push_code_(RiVmModule* module, iptr count)
+{
+    for (iptr i = 0; i < module->code_free.count; ++i) {
+        RiVmCodeRange* range = &array_at(&module->code_free, i);
+        if (range->count >= count) {
+            uint32_t offset = range->offset;
+            range->offset += (uint32_t)count;
+            range->count -= (uint32_t)count;
+            if (range->count == 0) {
+                array_remove(&module->code_free, i, 1);
+            }
+            return offset;
+        }
+    }
+    RiVmInst* code = rivm_segment_push_(&module->code, count * sizeof(RiVmInst));
+    return (uint32_t)(code - (RiVmInst*)module->code.base);
+}
+
+// Adds `range` to the released code, merged with the ranges right before and after it.
+static void
+rivm_module_free_code_(RiVmModule* module, RiVmCodeRange range)
+{
+    RiVmCodeRangeArray* code_free = &module->code_free;
+    iptr i = 0;
+    while (i < code_free->count && array_at(code_free, i).offset < range.offset) {
+        ++i;
+    }
+    if (i > 0) {
+        RiVmCodeRange before = array_at(code_free, i - 1);
+        if (before.offset + before.count == range.offset) {
+            range.offset = before.offset;
+            range.count += before.count;
+            --i;
+            array_remove(code_free, i, 1);
+        }
+    }
+    if (i < code_free->count) {
+        RiVmCodeRange after = array_at(code_free, i);
+        if (range.offset + range.count == after.offset) {
+            range.count += after.count;
+            array_remove(code_free, i, 1);
+        }
+    }
+    array_insert(code_free, i, range);
+}
+
+uint32_t
+rivm_module_add_func(RiVmModule* module, RiVmInstSlice code, int inputs_count, int outputs_count)
+{
+    RI_CHECK(code.count > 0);
+    uint32_t offset = rivm_module_push_code_(module, code.count);
+    memcpy(rivm_module_code(module, offset), code.items, code.count * sizeof(RiVmInst));
+
+    if (module->func.free.count > 0) {
+        uint32_t func = array_pop(&module->func.free);
+        array_at(&module->func.offset, func) = offset;
+        array_at(&module->func.count, func) = (uint32_t)code.count;
+        array_at(&module->func.inputs_count, func) = inputs_count;
+        array_at(&module->func.outputs_count, func) = outputs_count;
+        return func;
+    }
+    array_push(&module->func.offset, offset);
+    array_push(&module->func.count, (uint32_t)code.count);
+    array_push(&module->func.inputs_count, inputs_count);
+    array_push(&module->func.outputs_count, outputs_count);
+    return (uint32_t)(module->func.offset.count - 1);
+}
+
+uint32_t
+rivm_module_push_slot(RiVmModule* module)
+{
+    rivm_segment_push_(&module->ref, sizeof(RiVmFuncRef));
+    array_push(&module->slot, RIVM_INVALID_FUNC);
+    return (uint32_t)(module->slot.count - 1);
+}
+
+void
+rivm_module_replace_func(RiVmModule* module, uint32_t slot, uint32_t func)
+{
+    uint32_t old = array_at(&module->slot, slot);
+    if (old == func) {
+        return;
+    }
+    array_at(&module->slot, slot) = func;
+    atomic_store_i64(&rivm_module_ref(module, slot)->offset, array_at(&module->func.offset, func));
+    if (old == RIVM_INVALID_FUNC) {
+        return;
+    }
+    // Code entering from now on can't load `old`, but code already running in this generation can.
+    array_push(&module->retired, (RiVmFuncRetired){
+        .func = old,
+        .generation = atomic_load_i64(&module->generation),
+    });
+}
+
+iptr
+rivm_module_reclaim(RiVmModule* module)
+{
+    if (module->retired.count == 0) {
+        return 0;
+    }
+
+    int64_t generation = atomic_load_i64(&module->generation);
+    if (atomic_load_i64(&module->running[(generation - 1) & 1]) != 0) {
+        return module->retired.count;
+    }
+
+    // All running code entered in `generation`, after everything retired before it was replaced.
+    iptr kept = 0;
+    for (iptr i = 0; i < module->retired.count; ++i) {
+        RiVmFuncRetired retired = array_at(&module->retired, i);
+        if (retired.generation < generation) {
+            rivm_module_free_code_(module, (RiVmCodeRange){
+                .offset = array_at(&module->func.offset, retired.func),
+                .count = array_at(&module->func.count, retired.func),
+            });
+            array_at(&module->func.count, retired.func) = 0;
+            array_push(&module->func.free, retired.func);
+        } else {
+            array_at(&module->retired, kept) = retired;
+            ++kept;
+        }
+    }
+    module->retired.count = kept;
+
+    // Counter of the next generation is the one that just drained.
+    if (kept) {
+        atomic_add_i64(&module->generation, 1);
+    }
+    return kept;
+}
+
+int64_t
+rivm_module_enter(RiVmModule* module)
+{
+    for (;;) {
+        int64_t generation = atomic_load_i64(&module->generation);
+        atomic_add_i64(&module->running[generation & 1], 1);
+        // If the generation changed meanwhile, its counter might have been checked before the increment.
+        if (atomic_load_i64(&module->generation) == generation) {
+            return generation;
+        }
+        atomic_add_i64(&module->running[generation & 1], -1);
     }
-    array_purge(&module->func);
-    arena_purge(&module->arena);
 }
 
-RiVmFunc*
-rivm_module_push_func(RiVmModule* module, RiVmInstSlice code)
+void
+rivm_module_leave(RiVmModule* module, int64_t generation)
 {
-    RiVmFunc* func = rivm_module_push_(module, RiVmFunc);
-    func->code = code;
-    array_push(&module->func, func);
-    return func;
+    atomic_add_i64(&module->running[generation & 1], -1);
 }
\ No newline at end of file
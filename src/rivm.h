@@ -10,7 +10,11 @@ typedef struct RiVmInst RiVmInst;
 typedef enum RiVmParamKind RiVmParamKind;
 typedef enum RiVmParamSlotKind RiVmParamSlotKind;
 typedef struct RiVmParam RiVmParam;
-typedef struct RiVmFunc RiVmFunc;
+typedef struct RiVmSegment RiVmSegment;
+typedef struct RiVmCodeRange RiVmCodeRange;
+typedef struct RiVmFuncTable RiVmFuncTable;
+typedef struct RiVmFuncRef RiVmFuncRef;
+typedef struct RiVmFuncRetired RiVmFuncRetired;
 typedef struct RiVmModule RiVmModule;
 
 enum RiVmValueType
@@ -99,13 +103,37 @@ struct RiVmParam
         } slot;
         RiVmValue imm;
         uint32_t label;
+        // AST of the called function, until it's linked.
         void* func;
+        uint32_t func_slot;
     };
 };
 
 #define rivm_make_param(Kind, ...) \
     (RiVmParam){ .kind = RiVmParam_ ## Kind, __VA_ARGS__ }
 
+// 8 and 16-bit integers are kept in 32-bit slots, sign or zero extended, so they're compared and
+// computed on like 32-bit ones. Results that can leave their range are wrapped back by one of
+// `RiVmOp_Unary_Convert_Narrow`, which this does.
+static inline RiVmValue
+rivm_narrow(RiVmOp op, RiVmValue v)
+{
+    RiVmValue r = {0};
+    switch (op)
+    {
+        case RiVmOp_Unary_Convert_Narrow_I8:
+        case RiVmOp_Unary_Checked_Narrow_I8: r.i32 = (int8_t)v.u32; break;
+        case RiVmOp_Unary_Convert_Narrow_I16:
+        case RiVmOp_Unary_Checked_Narrow_I16: r.i32 = (int16_t)v.u32; break;
+        case RiVmOp_Unary_Convert_Narrow_U8:
+        case RiVmOp_Unary_Checked_Narrow_U8: r.u32 = (uint8_t)v.u32; break;
+        case RiVmOp_Unary_Convert_Narrow_U16:
+        case RiVmOp_Unary_Checked_Narrow_U16: r.u32 = (uint16_t)v.u32; break;
+        default: RI_UNREACHABLE; break;
+    }
+    return r;
+}
+
 //
 //
 //
@@ -125,29 +153,124 @@ typedef ArrayWithSlice(RiVmInstSlice) RiVmInstArray;
 //
 //
 
-struct RiVmFunc
+// Range of address space that's reserved up front and committed as it's used, so it never moves.
+struct RiVmSegment
+{
+    uint8_t* base;
+    iptr used;
+    iptr committed;
+    iptr reserved;
+};
+
+// Instructions `[offset, offset + count)` of the module's code.
+struct RiVmCodeRange
+{
+    uint32_t offset;
+    uint32_t count;
+};
+
+typedef Slice(RiVmCodeRange) RiVmCodeRangeSlice;
+typedef ArrayWithSlice(RiVmCodeRangeSlice) RiVmCodeRangeArray;
+
+// Functions, indexed by function. A replaced function keeps its index until it's released, then
+// functions added later reuse its index and its code.
+struct RiVmFuncTable
 {
-    RiVmInstSlice code;
-    int debug_inputs_count;
-    int debug_outputs_count;
+    // Code of the function, `count` is 0 once it's released.
+    Array(uint32_t) offset;
+    Array(uint32_t) count;
+    Array(uint32_t) inputs_count;
+    Array(uint32_t) outputs_count;
+    // Indices of released functions.
+    Array(uint32_t) free;
 };
 
-typedef Slice(RiVmFunc*) RiVmFuncSlice;
-typedef ArrayWithSlice(RiVmFuncSlice) RiVmFuncArray;
+// Entry of a module's indirection table, indexed by slot. `RiVmOp_Call` calls through it, so
+// replacing the function changes what its callers call without recompiling them.
+struct RiVmFuncRef
+{
+    // Offset of the function's code. Running code reads it with `atomic_load_i64`,
+    // it's set by `rivm_module_replace_func`.
+    volatile int64_t offset;
+};
+
+struct RiVmFuncRetired
+{
+    uint32_t func;
+    int64_t generation;
+};
+
+#define RIVM_INVALID_FUNC UINT32_MAX
+// Most outputs of a function. The first one is returned, the callee sets the others in slots
+// of the caller (see `RiVmOp_Output`).
+#define RIVM_OUTPUTS_MAX RI_OUTPUTS_MAX
 
 //
 //
 //
 
+// Code of all functions is in one segment, functions one after another, each in one piece.
+// Functions and calls refer to code by offset, so the module is one region that doesn't depend on
+// where it's loaded.
+// Functions can be replaced while other threads run the module:
+// - Code is entered with `rivm_module_enter`, which registers it in the current generation.
+// - `rivm_module_replace_func` publishes the new function in the indirection table and retires the
+//   old one. Calls made from then on run the new function, calls in progress finish the old one.
+// - `rivm_module_reclaim` releases retired functions once the generation they were retired in has
+//   no code running (quiescent point), and starts a new generation for the ones left.
+//   Released code is reused by functions added later.
+// Only two generations can have running code, so a counter for each is enough.
+// NOTE: Adding, replacing and reclaiming must not run concurrently with each other.
 struct RiVmModule
 {
-    Arena arena;
-    RiVmFuncArray func;
+    RiVmSegment code;
+    // Released code, by offset, adjacent ranges merged.
+    RiVmCodeRangeArray code_free;
+    RiVmFuncTable func;
+    // Function in each slot, as seen by the thread building the module.
+    Array(uint32_t) slot;
+    // `RiVmFuncRef` of each slot, as seen by running code.
+    RiVmSegment ref;
+
+    volatile int64_t generation;
+    volatile int64_t running[2];
+    Array(RiVmFuncRetired) retired;
 };
 
 void rivm_module_init(RiVmModule* module);
 void rivm_module_purge(RiVmModule* module);
 
-uint32_t rivm_module_emit(RiVmModule* module, const RiVmInst inst);
+// Copies `code` to the module as a new function that's not in any slot yet, returns its index.
+uint32_t rivm_module_add_func(RiVmModule* module, RiVmInstSlice code, int inputs_count, int outputs_count);
+// Adds a slot without a function, returns its index.
+uint32_t rivm_module_push_slot(RiVmModule* module);
+// Makes `func` the function in `slot`. Calls made from now on run it.
+void rivm_module_replace_func(RiVmModule* module, uint32_t slot, uint32_t func);
+// Releases functions replaced before the last quiescent point. Returns the number left for later.
+iptr rivm_module_reclaim(RiVmModule* module);
+
+// Returns the generation to pass to `rivm_module_leave`.
+// Code loaded from `RiVmFuncRef` in between stays valid until then.
+int64_t rivm_module_enter(RiVmModule* module);
+void rivm_module_leave(RiVmModule* module, int64_t generation);
 
-RiVmFunc* rivm_module_push_func(RiVmModule* module, RiVmInstSlice code);
\ No newline at end of file
+static inline RiVmInst*
+rivm_module_code(RiVmModule* module, int64_t offset)
+{
+    return (RiVmInst*)module->code.base + offset;
+}
+
+static inline RiVmFuncRef*
+rivm_module_ref(RiVmModule* module, uint32_t slot)
+{
+    return (RiVmFuncRef*)module->ref.base + slot;
+}
+
+static inline RiVmInstSlice
+rivm_module_func_code(RiVmModule* module, uint32_t func)
+{
+    return (RiVmInstSlice){
+        .items = rivm_module_code(module, array_at(&module->func.offset, func)),
+        .count = array_at(&module->func.count, func),
+    };
+}
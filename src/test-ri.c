@@ -49,6 +49,360 @@ testri_lex() {
     ri_purge(&ri);
 }
 
+void
+testri_lex_keywords() {
+    Ri ri;
+    ri_init(&ri);
+    ri_stream_set_(&ri, S(
+        "func var const type struct union enum return if else for switch case default "
+        "break continue fallthrough true false nil "
+        "fun funcs Func iff els _if nil_ fallthroug fallthroughs"
+    ));
+
+    testri_next_token_equals(&ri, RiToken_Keyword_Func, S("func"));
+    testri_next_token_equals(&ri, RiToken_Keyword_Variable, S("var"));
+    testri_next_token_equals(&ri, RiToken_Keyword_Const, S("const"));
+    testri_next_token_equals(&ri, RiToken_Keyword_Type, S("type"));
+    testri_next_token_equals(&ri, RiToken_Keyword_Struct, S("struct"));
+    testri_next_token_equals(&ri, RiToken_Keyword_Union, S("union"));
+    testri_next_token_equals(&ri, RiToken_Keyword_Enum, S("enum"));
+    testri_next_token_equals(&ri, RiToken_Keyword_Return, S("return"));
+    testri_next_token_equals(&ri, RiToken_Keyword_If, S("if"));
+    testri_next_token_equals(&ri, RiToken_Keyword_Else, S("else"));
+    testri_next_token_equals(&ri, RiToken_Keyword_For, S("for"));
+    testri_next_token_equals(&ri, RiToken_Keyword_Switch, S("switch"));
+    testri_next_token_equals(&ri, RiToken_Keyword_Case, S("case"));
+    testri_next_token_equals(&ri, RiToken_Keyword_Default, S("default"));
+    testri_next_token_equals(&ri, RiToken_Keyword_Break, S("break"));
+    testri_next_token_equals(&ri, RiToken_Keyword_Continue, S("continue"));
+    testri_next_token_equals(&ri, RiToken_Keyword_Fallthrough, S("fallthrough"));
+    testri_next_token_equals(&ri, RiToken_Keyword_True, S("true"));
+    testri_next_token_equals(&ri, RiToken_Keyword_False, S("false"));
+    ASSERT(ri.token.id.items == ri.id_nil);
+    testri_next_token_equals(&ri, RiToken_Keyword_Nil, S("nil"));
+
+    testri_next_token_equals(&ri, RiToken_Identifier, S("fun"));
+    testri_next_token_equals(&ri, RiToken_Identifier, S("funcs"));
+    testri_next_token_equals(&ri, RiToken_Identifier, S("Func"));
+    testri_next_token_equals(&ri, RiToken_Identifier, S("iff"));
+    testri_next_token_equals(&ri, RiToken_Identifier, S("els"));
+    testri_next_token_equals(&ri, RiToken_Identifier, S("_if"));
+    testri_next_token_equals(&ri, RiToken_Identifier, S("nil_"));
+    testri_next_token_equals(&ri, RiToken_Identifier, S("fallthroug"));
+    testri_next_token_equals(&ri, RiToken_Identifier, S("fallthroughs"));
+    testri_next_token_equals(&ri, RiToken_End, S(""));
+
+    ri_purge(&ri);
+}
+
+// Compares vectorized scanners against the scalar ones for every start offset and length.
+void
+testri_lex_scan() {
+#ifdef RI_LEX_SSE2
+    static const char alphabet[] = "  \t\t\r\n\n\r\nabzAZ_09/@[`{(;\x80\xff";
+    char buffer[256];
+    uint32_t seed = 1;
+    for (int round = 0; round < 64; ++round) {
+        for (int i = 0; i < COUNTOF(buffer); ++i) {
+            seed = seed * 1664525u + 1013904223u;
+            // Make long runs of the same class, so the vector loops get exercised.
+            int run = (seed >> 24) & 3;
+            char c = alphabet[(seed >> 16) % (COUNTOF(alphabet) - 1)];
+            if (run == 0) {
+                c = ((round + i / 32) & 1) ? ' ' : 'x';
+            } else if (run == 1 && i > 0) {
+                c = buffer[i - 1];
+            }
+            buffer[i] = c;
+        }
+
+        for (int start = 0; start < 64; ++start)
+        for (int count = 0; start + count <= COUNTOF(buffer); count += 7)
+        {
+            char* it = buffer + start;
+            char* end = it + count;
+
+            ASSERT(ri_scan_id_simd_(it, end) == ri_scan_id_scalar_(it, end));
+            ASSERT(ri_scan_line_simd_(it, end) == ri_scan_line_scalar_(it, end));
+
+            iptr line_index_simd = 0, line_index_scalar = 0;
+            char* line_simd = it;
+            char* line_scalar = it;
+            ASSERT(ri_scan_space_simd_(it, end, &line_index_simd, &line_simd)
+                == ri_scan_space_scalar_(it, end, &line_index_scalar, &line_scalar));
+            ASSERT(line_index_simd == line_index_scalar);
+            ASSERT(line_simd == line_scalar);
+        }
+    }
+#endif
+}
+
+// Token buffer must produce the same tokens and the same AST as streaming.
+void
+testri_lex_buffered_file_(const char* path)
+{
+    ByteArray source = {0};
+    ASSERT(file_read(&source, path, 0));
+    String stream = S((char*)source.items, source.count);
+
+    Ri ri;
+    ri_init(&ri);
+
+    RiTokens tokens = {0};
+    ASSERT(ri_lex(&ri, stream, &tokens));
+    ASSERT(ri_stream_set_(&ri, stream));
+    for (iptr i = 0; i < tokens.kind.count; ++i) {
+        RiToken expected = ri.token;
+        ri.tokens = &tokens;
+        ri.tokens_index = i;
+        ASSERT(ri_lex_next_(&ri));
+        ri.tokens = NULL;
+
+        ASSERT(ri.token.kind == expected.kind);
+        ASSERT(ri.token.start == expected.start);
+        ASSERT(ri.token.end == expected.end);
+        ASSERT(ri.token.pos.row == expected.pos.row);
+        ASSERT(ri.token.pos.col == expected.pos.col);
+        switch (expected.kind) {
+            case RiToken_Integer: ASSERT(ri.token.integer == expected.integer); break;
+            case RiToken_Real: ASSERT(ri.token.real == expected.real); break;
+            case RiToken_Identifier: ASSERT(ri.token.id.items == expected.id.items); break;
+            default: break;
+        }
+
+        ri.token = expected;
+        if (expected.kind != RiToken_End) {
+            ASSERT(ri_lex_next_(&ri));
+        }
+    }
+    ASSERT(ri.token.kind == RiToken_End);
+    ri_tokens_purge(&tokens);
+    ri_purge(&ri);
+
+    CharArray dump[2] = {0};
+    for (int buffered = 0; buffered < 2; ++buffered) {
+        ri_init(&ri);
+        ri.lex_buffered = buffered;
+        RiNode* node = ri_parse(&ri, stream, S((char*)path, strlen(path)));
+        if (node) {
+            ri_dump(&ri, node, &dump[buffered]);
+        } else {
+            chararray_push_f(&dump[buffered], "%d %d %S",
+                ri.error.pos.row, ri.error.pos.col, ri.error.message.slice);
+        }
+        ri_purge(&ri);
+    }
+    ASSERT(string_is_equal(dump[0].slice, dump[1].slice));
+    array_purge(&dump[0]);
+    array_purge(&dump[1]);
+
+    array_purge(&source);
+}
+
+void
+testri_lex_buffered() {
+    testri_lex_buffered_file_("./src/test/vmi/fib34.ri");
+    testri_lex_buffered_file_("./src/test/vmc/func.ri");
+    testri_lex_buffered_file_("./src/test/vmc/if-else.ri");
+    testri_lex_buffered_file_("./src/test/vmc/op-binary.ri");
+    testri_lex_buffered_file_("./src/test/ast/parse/const-real.ri");
+    testri_lex_buffered_file_("./src/test/ast/parse/func-no-input-arguments.ri");
+    testri_lex_buffered_file_("./src/test/ast/resolve/op-arithmetic.ri");
+}
+
+void
+testri_scope_table() {
+    Ri ri;
+    ri_init(&ri);
+
+    RiNode* decls[200];
+    const char* ids[COUNTOF(decls)];
+    RiScopeTable table = {0};
+    for (int i = 0; i < COUNTOF(decls); ++i) {
+        CharArray name = {0};
+        chararray_push_f(&name, "id%d", i);
+        ids[i] = ri_make_id_(&ri, name.slice).items;
+        decls[i] = ri_make_node_(&ri, RI_POS_OUTSIDE, RiNode_Decl);
+        array_purge(&name);
+
+        ASSERT(ri_scope_table_put_(&ri, &table, ids[i], decls[i]));
+        ASSERT(!ri_scope_table_put_(&ri, &table, ids[i], decls[i]));
+        ASSERT(table.count == i + 1);
+        if (i < RI_SCOPE_TABLE_LINEAR) {
+            ASSERT(table.capacity == RI_SCOPE_TABLE_LINEAR);
+        } else {
+            ASSERT(table.count <= table.capacity / 2);
+        }
+
+        for (int j = 0; j <= i; ++j) {
+            ASSERT(ri_node_(&ri, ri_scope_table_get_(&ri, &table, ids[j])) == decls[j]);
+        }
+        ASSERT(ri_scope_table_get_(&ri, &table, ri.id_func) == 0);
+    }
+
+    RiScopeTable presized = {0};
+    ri_scope_table_reserve_(&ri, &presized, 100);
+    uint32_t capacity = presized.capacity;
+    for (int i = 0; i < 100; ++i) {
+        ASSERT(ri_scope_table_put_(&ri, &presized, ids[i], decls[i]));
+    }
+    ASSERT(presized.capacity == capacity);
+
+    ri_purge(&ri);
+}
+
+static RiNode*
+testri_make_decl_(Ri* ri, const char* name)
+{
+    String id = ri_make_id_(ri, S((char*)name, strlen(name)));
+    RiNode* spec = ri_make_spec_var_(ri, RI_POS_OUTSIDE, id, NULL, RiVar_Local);
+    RiNode* decl = ri_make_decl_(ri, RI_POS_OUTSIDE, spec);
+    ASSERT(ri_scope_set_(ri, decl));
+    return decl;
+}
+
+// Lookups through a deep scope chain with shadowing, uncached and cached.
+void
+testri_lookup() {
+    Ri ri;
+    ri_init(&ri);
+
+    RiNode* scopes[24];
+    RiNode* a_outer = NULL;
+    RiNode* a_inner = NULL;
+    RiNode* b = NULL;
+    for (int i = 0; i < COUNTOF(scopes); ++i) {
+        scopes[i] = ri_make_scope_(&ri, RI_POS_OUTSIDE);
+        ri.scope = ri_node_ref_(&ri, scopes[i]);
+        if (i == 0) {
+            a_outer = testri_make_decl_(&ri, "a");
+            b = testri_make_decl_(&ri, "b");
+        } else if (i == 12) {
+            a_inner = testri_make_decl_(&ri, "a");
+        }
+    }
+
+    const char* a = ri_make_id_(&ri, S("a")).items;
+    const char* c = ri_make_id_(&ri, S("c")).items;
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int k = 0; k < COUNTOF(scopes); ++k) {
+            // Deepest first, so the first pass fills the cache on the way up.
+            int i = pass == 0 ? COUNTOF(scopes) - 1 - k : k;
+            RiNodeRef scope = ri_node_ref_(&ri, scopes[i]);
+            ASSERT(ri_lookup_(&ri, scope, a) == (i < 12 ? a_outer : a_inner));
+            ASSERT(ri_lookup_(&ri, scope, ri_node_(&ri, b->decl.spec)->spec.id.items) == b);
+            ASSERT(ri_lookup_(&ri, scope, c) == NULL);
+        }
+    }
+
+    ri_purge(&ri);
+}
+
+// Builds `stream` serially and in parallel and compares the results.
+static void
+testri_build_parallel_source_(String stream, const char* path, bool expect_error)
+{
+    CharArray dump[2] = {0};
+    for (int parallel = 0; parallel < 2; ++parallel) {
+        Ri ri;
+        ri_init(&ri);
+        ri.threads = parallel ? 4 : 1;
+        RiNode* node = ri_build(&ri, stream, S((char*)path, strlen(path)));
+        ASSERT((node == NULL) == expect_error);
+        if (node) {
+            ri_dump(&ri, node, &dump[parallel]);
+        } else {
+            chararray_push_f(&dump[parallel], "%d %d %d %S",
+                ri.error.kind, ri.error.pos.row, ri.error.pos.col, ri.error.message.slice);
+        }
+        ri_purge(&ri);
+    }
+    ASSERT(string_is_equal(dump[0].slice, dump[1].slice));
+    array_purge(&dump[0]);
+    array_purge(&dump[1]);
+}
+
+static void
+testri_build_parallel_file_(const char* path)
+{
+    ByteArray source = {0};
+    ASSERT(file_read(&source, path, 0));
+    testri_build_parallel_source_(S((char*)source.items, source.count), path, false);
+    array_purge(&source);
+}
+
+void
+testri_build_parallel() {
+    testri_build_parallel_file_("./src/test/vmi/fib34.ri");
+    testri_build_parallel_file_("./src/test/vmi/test1.ri");
+
+    // Many bodies, so every thread gets some.
+    CharArray source = {0};
+    for (int i = 0; i < 64; ++i) {
+        chararray_push_f(&source,
+            "func f%d(a int32) int32 {\n"
+            "    var b = a + %d;\n"
+            "    if b <= 0 {\n"
+            "        return f%d(b);\n"
+            "    }\n"
+            "    return b;\n"
+            "}\n",
+            i, i, (i + 1) % 64
+        );
+    }
+    testri_build_parallel_source_(source.slice, "generated.ri", false);
+
+    // The error reported is the first one in source order, whichever body fails first.
+    chararray_push_f(&source, "func g0() int32 { var x int32; x = undeclared0; return x; }\n");
+    chararray_push_f(&source, "func g1() int32 { var x int32; x = undeclared1; return x; }\n");
+    testri_build_parallel_source_(source.slice, "generated-error.ri", true);
+    array_purge(&source);
+}
+
+// Parses, then resolves and typechecks a copy of the heap with the original freed, which has to
+// give the same tree as without the copy.
+static void
+testri_nodes_copy_file_(const char* path)
+{
+    ByteArray source = {0};
+    ASSERT(file_read(&source, path, 0));
+    String stream = S((char*)source.items, source.count);
+    String name = S((char*)path, strlen(path));
+
+    CharArray dump[2] = {0};
+    for (int copy = 0; copy < 2; ++copy) {
+        Ri ri;
+        ri_init(&ri);
+        RiNode* node = ri_parse(&ri, stream, name);
+        ASSERT(node);
+        if (copy) {
+            RiNodeRef ref = ri_node_ref_(&ri, node);
+            RiNodeHeap nodes;
+            ri_nodes_copy(&ri.nodes, &nodes);
+            ASSERT(nodes.base != ri.nodes.base);
+            ASSERT(nodes.used == ri.nodes.used);
+            ri_nodes_purge(&ri.nodes);
+            ri.nodes = nodes;
+            node = ri_node_(&ri, ref);
+        }
+        node = ri_resolve(&ri, node);
+        ASSERT(node);
+        ASSERT(ri_typecheck(&ri, node));
+        ri_dump(&ri, node, &dump[copy]);
+        ri_purge(&ri);
+    }
+    ASSERT(string_is_equal(dump[0].slice, dump[1].slice));
+    array_purge(&dump[0]);
+    array_purge(&dump[1]);
+    array_purge(&source);
+}
+
+void
+testri_nodes_copy() {
+    testri_nodes_copy_file_("./src/test/vmi/fib34.ri");
+    testri_nodes_copy_file_("./src/test/vmi/test1.ri");
+}
+
 void
 testri_parse() {
     Ri ri;
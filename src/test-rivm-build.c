@@ -0,0 +1,270 @@
+#include "rivm-build.h"
+#include "rivm-interpreter.h"
+
+static int32_t
+testrivm_build_exec_(RiVmModule* module)
+{
+    RiVmExec context;
+    rivm_exec_init(&context);
+    RiVmValue value = rivm_exec_module(&context, module, 0, 0, 0);
+    rivm_exec_purge(&context);
+    return value.i32;
+}
+
+void
+testrivm_build_update() {
+    RiVmModule module;
+    rivm_module_init(&module);
+    RiVmBuild build;
+    rivm_build_init(&build, &module, S("testrivm_build.ri"));
+
+    const char* main_ =
+        "func main() int32 {\n"
+        "    var a int32;\n"
+        "    a = add(20);\n"
+        "    return twice(a);\n"
+        "}\n";
+    const char* twice =
+        "func twice(a int32) int32 {\n"
+        "    return a + a;\n"
+        "}\n";
+    const char* unused =
+        "func unused(a int32) int32 {\n"
+        "    return a;\n"
+        "}\n";
+
+    CharArray source = {0};
+    chararray_push_f(&source, "%s%s%s%s", main_, "func add(a int32) int32 {\n    return a + 1;\n}\n", twice, unused);
+    ASSERT(rivm_build_update(&build, source.slice));
+    ASSERT(build.compiled_count == 4);
+    ASSERT(testrivm_build_exec_(&module) == 42);
+
+    // Same source.
+    ASSERT(rivm_build_update(&build, source.slice));
+    ASSERT(build.compiled_count == 0);
+    ASSERT(testrivm_build_exec_(&module) == 42);
+
+    // Body of `add` changed, its callers call the new code.
+    array_clear(&source);
+    chararray_push_f(&source, "%s%s%s%s", main_, "func add(a int32) int32 {\n    return a + 2;\n}\n", twice, unused);
+    ASSERT(rivm_build_update(&build, source.slice));
+    ASSERT(build.compiled_count == 1);
+    ASSERT(testrivm_build_exec_(&module) == 44);
+    // Reused declarations are in the module scope too.
+    ASSERT(ri_node_(&build.ri, build.ast_module->module.scope)->scope.decl.count == 4);
+
+    // Signature of `add` changed, so `main` is compiled again too.
+    array_clear(&source);
+    chararray_push_f(&source, "%s%s%s%s", main_, "func add(b int32) int32 {\n    return b + 2;\n}\n", twice, unused);
+    ASSERT(rivm_build_update(&build, source.slice));
+    ASSERT(build.compiled_count == 2);
+    ASSERT(testrivm_build_exec_(&module) == 44);
+
+    // Errors leave the module as it was.
+    array_clear(&source);
+    chararray_push_f(&source, "%s%s%s%s", main_, "func add(b int32) int32 {\n    return c + 2;\n}\n", twice, unused);
+    ASSERT(!rivm_build_update(&build, source.slice));
+    ASSERT(build.ri.error.kind == RiError_NotDeclared);
+    ASSERT(testrivm_build_exec_(&module) == 44);
+
+    // Removed function keeps its slot when it comes back.
+    array_clear(&source);
+    chararray_push_f(&source, "%s%s%s", main_, "func add(b int32) int32 {\n    return b + 3;\n}\n", twice);
+    ASSERT(rivm_build_update(&build, source.slice));
+    ASSERT(build.compiled_count == 1);
+    ASSERT(testrivm_build_exec_(&module) == 46);
+    array_clear(&source);
+    chararray_push_f(&source, "%s%s%s%s", unused, main_, "func add(b int32) int32 {\n    return b + 3;\n}\n", twice);
+    ASSERT(rivm_build_update(&build, source.slice));
+    ASSERT(build.compiled_count == 1);
+
+    // Other top-level statements changed, so everything is compiled, into the same slots.
+    array_clear(&source);
+    chararray_push_f(&source, "var g int32;\n%s%s%s%s", main_, "func add(b int32) int32 {\n    return b + 3;\n}\n", twice, unused);
+    ASSERT(rivm_build_update(&build, source.slice));
+    ASSERT(build.compiled_count == 4);
+    ASSERT(module.slot.count == 4);
+    for (iptr i = 0; i < module.slot.count; ++i) {
+        uint32_t func = array_at(&module.slot, i);
+        ASSERT(func != RIVM_INVALID_FUNC);
+        ASSERT(rivm_module_func_code(&module, func).count != 0);
+    }
+    ASSERT(testrivm_build_exec_(&module) == 46);
+
+    // Replaced declarations don't pile up.
+    for (int i = 0; i < 1000; ++i) {
+        array_clear(&source);
+        chararray_push_f(&source, "%s%s%s%s", main_, (i & 1)
+            ? "func add(a int32) int32 {\n    return a + 2;\n}\n"
+            : "func add(a int32) int32 {\n    return a + 3;\n}\n", twice, unused);
+        ASSERT(rivm_build_update(&build, source.slice));
+        ASSERT(testrivm_build_exec_(&module) == ((i & 1) ? 44 : 46));
+        ASSERT(build.ri.nodes.used <= RIVM_BUILD_NODES_MIN_ + KILOBYTES(64));
+    }
+
+    array_purge(&source);
+    rivm_build_purge(&build);
+    rivm_module_purge(&module);
+}
+
+void
+testrivm_build_inline() {
+    RiVmModule module;
+    rivm_module_init(&module);
+    RiVmBuild build;
+    rivm_build_init(&build, &module, S("testrivm_build.ri"));
+    build.compiler.opt_level = RiVmOpt_O2;
+
+    const char* main_ =
+        "func main() int32 {\n"
+        "    return add(40) + keep(1);\n"
+        "}\n";
+    const char* noinline = "//ri:noinline\n";
+
+    CharArray source = {0};
+    chararray_push_f(&source, "%s%s%s%s", main_, "func add(a int32) int32 {\n    return a + 1;\n}\n",
+        noinline, "func keep(a int32) int32 {\n    return a;\n}\n");
+    ASSERT(rivm_build_update(&build, source.slice));
+    ASSERT(build.compiled_count == 3);
+    ASSERT(testrivm_build_exec_(&module) == 42);
+
+    // Body of the inlined `add` changed, so `main` is compiled again too.
+    array_clear(&source);
+    chararray_push_f(&source, "%s%s%s%s", main_, "func add(a int32) int32 {\n    return a + 2;\n}\n",
+        noinline, "func keep(a int32) int32 {\n    return a;\n}\n");
+    ASSERT(rivm_build_update(&build, source.slice));
+    ASSERT(build.compiled_count == 2);
+    ASSERT(testrivm_build_exec_(&module) == 43);
+
+    // `keep` is called.
+    array_clear(&source);
+    chararray_push_f(&source, "%s%s%s%s", main_, "func add(a int32) int32 {\n    return a + 2;\n}\n",
+        noinline, "func keep(a int32) int32 {\n    return a + 1;\n}\n");
+    ASSERT(rivm_build_update(&build, source.slice));
+    ASSERT(build.compiled_count == 1);
+    ASSERT(testrivm_build_exec_(&module) == 44);
+
+    // Without the directive, which is in the source of `add`, `keep` is inlined too.
+    array_clear(&source);
+    chararray_push_f(&source, "%s%s%s", main_, "func add(a int32) int32 {\n    return a + 2;\n}\n",
+        "func keep(a int32) int32 {\n    return a + 1;\n}\n");
+    ASSERT(rivm_build_update(&build, source.slice));
+    ASSERT(build.compiled_count == 3);
+    ASSERT(testrivm_build_exec_(&module) == 44);
+    array_clear(&source);
+    chararray_push_f(&source, "%s%s%s", main_, "func add(a int32) int32 {\n    return a + 2;\n}\n",
+        "func keep(a int32) int32 {\n    return a + 2;\n}\n");
+    ASSERT(rivm_build_update(&build, source.slice));
+    ASSERT(build.compiled_count == 2);
+    ASSERT(testrivm_build_exec_(&module) == 45);
+
+    array_purge(&source);
+    rivm_build_purge(&build);
+    rivm_module_purge(&module);
+}
+
+typedef struct TestRiVmBuildSwap_ {
+    RiVmModule* module;
+    RiVmBuild* build;
+    volatile int64_t done;
+    int64_t calls;
+} TestRiVmBuildSwap_;
+
+static THREAD_FOR_F(testrivm_build_swap_)
+{
+    TestRiVmBuildSwap_* T = user;
+    if (index == 0) {
+        // Alternates the body of `add` while the other thread runs `main`.
+        CharArray source = {0};
+        for (int i = 0; i < 100; ++i) {
+            array_clear(&source);
+            chararray_push_f(&source,
+                "func main() int32 {\n    return add(40);\n}\n"
+                "func add(a int32) int32 {\n    return a + %d;\n}\n", 3 - (i & 1));
+            ASSERT(rivm_build_update(T->build, source.slice));
+            ASSERT(T->build->compiled_count == 1);
+        }
+        array_purge(&source);
+        atomic_add_i64(&T->done, 1);
+    } else {
+        RiVmExec context;
+        rivm_exec_init(&context);
+        do {
+            int32_t value = rivm_exec_module(&context, T->module, 0, 0, 0).i32;
+            ASSERT(value == 42 || value == 43);
+            ++T->calls;
+        } while (!atomic_load_i64(&T->done));
+        rivm_exec_purge(&context);
+    }
+}
+
+void
+testrivm_build_replace() {
+    RiVmModule module;
+    rivm_module_init(&module);
+    RiVmBuild build;
+    rivm_build_init(&build, &module, S("testrivm_build.ri"));
+    RiVmExec context;
+    rivm_exec_init(&context);
+
+    ASSERT(rivm_build_update(&build, S(
+        "func main() int32 {\n    return add(40);\n}\n"
+        "func add(a int32) int32 {\n    return a + 1;\n}\n")));
+
+    // Code running since before the replacement keeps the old function, new calls get the new one.
+    int64_t generation = rivm_module_enter(&module);
+    uint32_t add_old = array_at(&module.slot, 1);
+    ASSERT(rivm_build_update(&build, S(
+        "func main() int32 {\n    return add(40);\n}\n"
+        "func add(a int32) int32 {\n    return a + 2;\n}\n")));
+    uint32_t add = array_at(&module.slot, 1);
+    ASSERT(add != add_old);
+    ASSERT(rivm_exec(&context, &module, add_old, &(RiVmValue){ .i32 = 1 }, 1).i32 == 2);
+    ASSERT(rivm_exec(&context, &module, add, &(RiVmValue){ .i32 = 1 }, 1).i32 == 3);
+    ASSERT(rivm_exec_module(&context, &module, 0, 0, 0).i32 == 42);
+    ASSERT(rivm_module_reclaim(&module) == 1);
+    ASSERT(array_at(&module.func.count, add_old) != 0);
+
+    // Freed once nothing from before the replacement runs.
+    rivm_module_leave(&module, generation);
+    ASSERT(rivm_module_reclaim(&module) == 0);
+    ASSERT(array_at(&module.func.count, add_old) == 0);
+
+    // Released code and function indices are reused.
+    iptr used = module.code.used;
+    iptr funcs = module.func.offset.count;
+    for (int i = 0; i < 4; ++i) {
+        CharArray source = {0};
+        chararray_push_f(&source,
+            "func main() int32 {\n    return add(40);\n}\n"
+            "func add(a int32) int32 {\n    return a + %d;\n}\n", 3 - (i & 1));
+        ASSERT(rivm_build_update(&build, source.slice));
+        ASSERT(rivm_module_reclaim(&module) == 0);
+        // Next to the code of the function that replaced it.
+        ASSERT(module.code_free.count <= 1);
+        array_purge(&source);
+    }
+    ASSERT(module.code.used == used);
+    ASSERT(module.func.offset.count == funcs);
+
+    // Replaced while running on another thread.
+    TestRiVmBuildSwap_ T = {
+        .module = &module,
+        .build = &build,
+    };
+    thread_for(2, 2, &testrivm_build_swap_, &T);
+    ASSERT(T.calls > 0);
+    rivm_module_reclaim(&module);
+    ASSERT(rivm_module_reclaim(&module) == 0);
+
+    rivm_exec_purge(&context);
+    rivm_build_purge(&build);
+    rivm_module_purge(&module);
+}
+
+void
+testrivm_build_main() {
+    testrivm_build_update();
+    testrivm_build_inline();
+    testrivm_build_replace();
+}
@@ -75,6 +75,79 @@ testrivm_compiler_compile()
     testrivm_compiler_compile_file_("op-binary");
 }
 
+static void
+testrivm_compiler_parallel_source_(String source)
+{
+    RiVmModule module[2];
+    Ri ri[2];
+    for (int parallel = 0; parallel < 2; ++parallel) {
+        ri_init(&ri[parallel]);
+        RiNode* ast_module = ri_build(&ri[parallel], source, S("generated.ri"));
+        ASSERT(ast_module);
+
+        rivm_module_init(&module[parallel]);
+        RiVmCompiler compiler;
+        rivm_init(&compiler, &ri[parallel]);
+        compiler.threads = parallel ? 4 : 1;
+        ASSERT(rivm_compile(&compiler, ast_module, &module[parallel]));
+        rivm_purge(&compiler);
+    }
+
+    // Same code at the same offsets, calls to the same function slots.
+    ASSERT(module[0].slot.count == module[1].slot.count);
+    ASSERT(module[0].code.used == module[1].code.used);
+    for (iptr i = 0; i < module[0].slot.count; ++i) {
+        uint32_t f0 = array_at(&module[0].slot, i);
+        uint32_t f1 = array_at(&module[1].slot, i);
+        ASSERT(array_at(&module[0].func.offset, f0) == array_at(&module[1].func.offset, f1));
+        RiVmInstSlice code0 = rivm_module_func_code(&module[0], f0);
+        RiVmInstSlice code1 = rivm_module_func_code(&module[1], f1);
+        ASSERT(code0.count == code1.count);
+        for (iptr j = 0; j < code0.count; ++j) {
+            RiVmInst i0 = code0.items[j];
+            RiVmInst i1 = code1.items[j];
+            if (i0.op == RiVmOp_Call || i0.op == RiVmOp_TailCall) {
+                ASSERT(i0.param1.func_slot < module[0].slot.count);
+            }
+            ASSERT(i0.op == i1.op);
+            ASSERT(memcmp(&i0.param0, &i1.param0, sizeof(RiVmParam)) == 0);
+            ASSERT(memcmp(&i0.param1, &i1.param1, sizeof(RiVmParam)) == 0);
+            ASSERT(memcmp(&i0.param2, &i1.param2, sizeof(RiVmParam)) == 0);
+        }
+    }
+
+    for (int parallel = 0; parallel < 2; ++parallel) {
+        rivm_module_purge(&module[parallel]);
+        ri_purge(&ri[parallel]);
+    }
+}
+
+void
+testrivm_compiler_parallel()
+{
+    ByteArray source = {0};
+    ASSERT(file_read(&source, "./src/test/vmi/fib34.ri", 0));
+    testrivm_compiler_parallel_source_(S((char*)source.items, source.count));
+    array_purge(&source);
+
+    CharArray generated = {0};
+    for (int i = 0; i < 64; ++i) {
+        chararray_push_f(&generated,
+            "func f%d(a int32, b int32) int32 {\n"
+            "    var c int32;\n"
+            "    c = a * %d + b;\n"
+            "    if (c <= b) {\n"
+            "        return f%d(c, b);\n"
+            "    }\n"
+            "    return c - a;\n"
+            "}\n",
+            i, i, (i * 7 + 3) % 64
+        );
+    }
+    testrivm_compiler_parallel_source_(generated.slice);
+    array_purge(&generated);
+}
+
 void
 testrivm_compiler_main() {
     testrivm_compiler_compile();
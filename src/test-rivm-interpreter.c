@@ -19,7 +19,8 @@ testrivm_interpreter_exec_file_(const char* name)
     double t = perf_get();
     RiVmValue value = rivm_exec(
         &context,
-        array_at(&module.func, 0),
+        &module,
+        array_at(&module.slot, 0),
         0, // args,
         0 // COUNTOF(args)
     );
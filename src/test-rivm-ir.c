@@ -0,0 +1,1146 @@
+#include "rivm-ir.h"
+#include "rivm-interpreter.h"
+
+// Sum of `a * a` over `n` iterations, written with copies and a repeated invariant expression.
+static void
+testrivm_ir_build_loop_(RiVmIrFunc* func, Arena* arena)
+{
+    rivm_ir_init(func, arena, 2);
+    RiVmValue zero = { .i32 = 0 };
+    RiVmValue one = { .i32 = 1 };
+
+    uint32_t a = rivm_ir_var(func, RiVmValue_I32);
+    uint32_t n = rivm_ir_var(func, RiVmValue_I32);
+    uint32_t i = rivm_ir_var(func, RiVmValue_I32);
+    uint32_t s = rivm_ir_var(func, RiVmValue_I32);
+    rivm_ir_write_var(func, a, 0, rivm_ir_param(func, 0, RiVmValue_I32));
+    rivm_ir_write_var(func, n, 0, rivm_ir_param(func, 1, RiVmValue_I32));
+    rivm_ir_write_var(func, i, 0, rivm_ir_copy(func, 0, rivm_ir_const(func, RiVmValue_I32, zero)));
+    rivm_ir_write_var(func, s, 0, rivm_ir_copy(func, 0, rivm_ir_const(func, RiVmValue_I32, zero)));
+
+    uint32_t header = rivm_ir_block(func);
+    uint32_t body = rivm_ir_block(func);
+    uint32_t exit = rivm_ir_block(func);
+    rivm_ir_jump(func, 0, header);
+
+    uint32_t condition = rivm_ir_binary(func, header, RiVmOp_Binary_Comparison_Lt, RiVmValue_I32,
+        rivm_ir_read_var(func, i, header), rivm_ir_read_var(func, n, header));
+    rivm_ir_branch(func, header, condition, body, exit);
+    rivm_ir_seal(func, body);
+    rivm_ir_seal(func, exit);
+
+    for (int k = 0; k < 2; ++k) {
+        uint32_t square = rivm_ir_binary(func, body, RiVmOp_Binary_Mul, RiVmValue_I32,
+            rivm_ir_read_var(func, a, body), rivm_ir_read_var(func, a, body));
+        uint32_t sum = rivm_ir_binary(func, body, RiVmOp_Binary_Add, RiVmValue_I32,
+            rivm_ir_read_var(func, s, body), square);
+        rivm_ir_write_var(func, s, body, rivm_ir_copy(func, body, sum));
+    }
+    uint32_t next = rivm_ir_binary(func, body, RiVmOp_Binary_Add, RiVmValue_I32,
+        rivm_ir_read_var(func, i, body), rivm_ir_const(func, RiVmValue_I32, one));
+    rivm_ir_write_var(func, i, body, rivm_ir_copy(func, body, next));
+    rivm_ir_jump(func, body, header);
+    rivm_ir_seal(func, header);
+
+    rivm_ir_ret(func, exit, rivm_ir_read_var(func, s, exit));
+    rivm_ir_finish(func);
+}
+
+static iptr
+testrivm_ir_count_(RiVmIrFunc* func, RiVmIrOp op, uint32_t* block)
+{
+    iptr count = 0;
+    for (iptr k = 0; k < func->order.count; ++k) {
+        RiVmIrBlock* b = rivm_ir_block_at(func, func->order.items[k]);
+        for (iptr i = 0; i < b->inst.count; ++i) {
+            RiVmIrInst* inst = rivm_ir_inst(func, b->inst.items[i]);
+            if (inst->op == op && (op != RiVmIr_Binary || inst->binary == RiVmOp_Binary_Mul)) {
+                *block = inst->block;
+                ++count;
+            }
+        }
+    }
+    return count;
+}
+
+void
+testrivm_ir_optimize()
+{
+    Arena arena;
+    arena_init(&arena, MEGABYTES(1));
+    RiVmIrFunc func;
+    uint32_t block;
+
+    testrivm_ir_build_loop_(&func, &arena);
+    ASSERT(rivm_ir_verify(&func));
+    ASSERT(testrivm_ir_count_(&func, RiVmIr_Copy, &block) == 5);
+    ASSERT(testrivm_ir_count_(&func, RiVmIr_Binary, &block) == 2);
+
+    rivm_ir_optimize(&func, RiVmOpt_O2);
+    ASSERT(rivm_ir_verify(&func));
+    ASSERT(testrivm_ir_count_(&func, RiVmIr_Copy, &block) == 0);
+    // `a * a` is computed once, before the loop.
+    ASSERT(testrivm_ir_count_(&func, RiVmIr_Binary, &block) == 1);
+    ASSERT(block == 0);
+    // Only `i` and `s` change in the loop.
+    ASSERT(testrivm_ir_count_(&func, RiVmIr_Phi, &block) == 2);
+    ASSERT(block == 1);
+
+    arena_purge(&arena);
+}
+
+// Runs the first function of `source`, counts the instructions of the module, and those that are `op`.
+static int32_t
+testrivm_ir_exec_checked_(String source, RiVmOptLevel level, bool checked, RiVmTrap* trap, iptr* code_count, RiVmOp op, iptr* op_count)
+{
+    Ri ri;
+    ri_init(&ri);
+    RiNode* ast_module = ri_build(&ri, source, S("testrivm_ir.ri"));
+    ASSERT(ast_module);
+
+    RiVmModule module;
+    rivm_module_init(&module);
+    RiVmCompiler compiler;
+    rivm_init(&compiler, &ri);
+    compiler.opt_level = level;
+    compiler.checked = checked;
+    ASSERT(rivm_compile(&compiler, ast_module, &module));
+    rivm_purge(&compiler);
+
+    *code_count = 0;
+    *op_count = 0;
+    uint32_t it;
+    slice_each(&module.slot, &it) {
+        RiVmInstSlice code = rivm_module_func_code(&module, it);
+        *code_count += code.count;
+        for (iptr i = 0; i < code.count; ++i) {
+            *op_count += code.items[i].op == op;
+        }
+    }
+
+    RiVmExec context;
+    rivm_exec_init(&context);
+    RiVmValue value = rivm_exec_module(&context, &module, 0, 0, 0);
+    *trap = context.trap;
+    rivm_exec_purge(&context);
+
+    rivm_module_purge(&module);
+    ri_purge(&ri);
+    return value.i32;
+}
+
+static int32_t
+testrivm_ir_exec_op_(String source, RiVmOptLevel level, iptr* code_count, RiVmOp op, iptr* op_count)
+{
+    RiVmTrap trap;
+    int32_t result = testrivm_ir_exec_checked_(source, level, false, &trap, code_count, op, op_count);
+    ASSERT(trap == RiVmTrap_None);
+    return result;
+}
+
+static int32_t
+testrivm_ir_exec_level_(String source, RiVmOptLevel level, iptr* code_count)
+{
+    iptr op_count;
+    return testrivm_ir_exec_op_(source, level, code_count, RiVmOp_None, &op_count);
+}
+
+void
+testrivm_ir_levels()
+{
+    String source = S(
+        "func main() int32 {\n"
+        "    return f(10, 3) - f(1, 5) + f(7, 7);\n"
+        "}\n"
+        "func f(a int32, b int32) int32 {\n"
+        "    var x int32;\n"
+        "    var y int32;\n"
+        "    x = a + b;\n"
+        "    y = a + b;\n"
+        "    if (a < b) {\n"
+        "        x = x - 1;\n"
+        "    } else {\n"
+        "        y = y + 1;\n"
+        "        if (y >= 16) {\n"
+        "            y = a - b;\n"
+        "        }\n"
+        "    }\n"
+        "    return x + y + (a + b);\n"
+        "}\n"
+    );
+
+    iptr count[3];
+    int32_t result[3];
+    for (int level = RiVmOpt_O0; level <= RiVmOpt_O2; ++level) {
+        result[level] = testrivm_ir_exec_level_(source, level, &count[level]);
+    }
+    // f(10, 3) = 13 + 14 + 13, f(1, 5) = 5 + 6 + 6, f(7, 7) = 14 + 15 + 14.
+    ASSERT(result[0] == 40 - 17 + 43);
+    ASSERT(result[1] == result[0]);
+    ASSERT(result[2] == result[0]);
+    ASSERT(count[0] > count[1]);
+    ASSERT(count[1] > count[2]);
+}
+
+void
+testrivm_ir_loops()
+{
+    String source = S(
+        "func main() int32 {\n"
+        "    return fib(20) - count(6) + until(3) + swap(5);\n"
+        "}\n"
+        "func fib(n int32) int32 {\n"
+        "    var a int32;\n"
+        "    var b int32;\n"
+        "    var t int32;\n"
+        "    var i int32;\n"
+        "    a = 0;\n"
+        "    b = 1;\n"
+        "    for i = 0; i < n; i += 1 {\n"
+        "        t = a + b;\n"
+        "        a = b;\n"
+        "        b = t;\n"
+        "    }\n"
+        "    return a;\n"
+        "}\n"
+        "func count(n int32) int32 {\n"
+        "    var s int32;\n"
+        "    var i int32;\n"
+        "    var j int32;\n"
+        "    s = 0;\n"
+        "    for i = 0; i < n; i += 1 {\n"
+        "        if (i == 2) {\n"
+        "            continue;\n"
+        "        }\n"
+        "        for j = 0; ; j += 1 {\n"
+        "            if (j >= i) {\n"
+        "                break;\n"
+        "            }\n"
+        "            s += j;\n"
+        "        }\n"
+        "    }\n"
+        "    return s;\n"
+        "}\n"
+        "func until(n int32) int32 {\n"
+        "    var s int32;\n"
+        "    s = n;\n"
+        "    for s < 100 {\n"
+        "        s += 7;\n"
+        "    }\n"
+        "    return s;\n"
+        "}\n"
+        // Phis of the loop are set from each other.
+        "func swap(n int32) int32 {\n"
+        "    var a int32;\n"
+        "    var b int32;\n"
+        "    var t int32;\n"
+        "    var i int32;\n"
+        "    a = 1;\n"
+        "    b = 20;\n"
+        "    for i = 0; i < n; i += 1 {\n"
+        "        t = a;\n"
+        "        a = b;\n"
+        "        b = t;\n"
+        "    }\n"
+        "    return a - b;\n"
+        "}\n"
+    );
+
+    for (int level = RiVmOpt_O0; level <= RiVmOpt_O2; ++level) {
+        iptr count;
+        ASSERT(testrivm_ir_exec_level_(source, level, &count) == 6765 - 19 + 101 + 19);
+    }
+}
+
+void
+testrivm_ir_switch()
+{
+    String source = S(
+        "func main() int32 {\n"
+        "    var s int32;\n"
+        "    var i int32;\n"
+        "    s = 0;\n"
+        "    for i = 0; i < 8; i += 1 {\n"
+        "        s += dense(i);\n"
+        "    }\n"
+        "    s += sparse(1000) + sparse(10) + sparse(500) + sparse(7) + sparse(90000) + sparse(3) + sparse(64) + sparse(11);\n"
+        "    return s + other(4, 4) + other(5, 4) + other(6, 4) + cycle(100);\n"
+        "}\n"
+        // Jump table.
+        "func dense(x int32) int32 {\n"
+        "    var r int32;\n"
+        "    r = 0;\n"
+        "    switch x {\n"
+        "    case 1:\n"
+        "        r = 10;\n"
+        "    case 2:\n"
+        "        r = 20;\n"
+        "        fallthrough;\n"
+        "    case 3:\n"
+        "        r += 30;\n"
+        "    case 5:\n"
+        "        r = 50;\n"
+        "        break;\n"
+        "    case 4:\n"
+        "        r = 40;\n"
+        "    default:\n"
+        "        r = 99;\n"
+        "    }\n"
+        "    return r;\n"
+        "}\n"
+        // Searched by halves, the first of equal cases wins.
+        "func sparse(x int64) int32 {\n"
+        "    var r int32;\n"
+        "    r = 1;\n"
+        "    switch x {\n"
+        "    case 1000:\n"
+        "        r = 1;\n"
+        "    case 10:\n"
+        "        r = 2;\n"
+        "    case 500:\n"
+        "        r = 3;\n"
+        "    case 7:\n"
+        "        r = 4;\n"
+        "    case 90000:\n"
+        "        r = 5;\n"
+        "    case 3:\n"
+        "        r = 6;\n"
+        "    case 10:\n"
+        "        r = 100;\n"
+        "    case 64:\n"
+        "        r = 7;\n"
+        "    }\n"
+        "    return r;\n"
+        "}\n"
+        // Cases that aren't constant are compared in order.
+        "func other(x int32, y int32) int32 {\n"
+        "    var r int32;\n"
+        "    r = 5;\n"
+        "    switch x {\n"
+        "    case y:\n"
+        "        r = 1;\n"
+        "    case y + 1:\n"
+        "        r = 2;\n"
+        "    default:\n"
+        "        r = 3;\n"
+        "    }\n"
+        "    return r;\n"
+        "}\n"
+        // In a loop, `break` leaves the switch and `continue` the iteration.
+        "func cycle(n int32) int32 {\n"
+        "    var s int32;\n"
+        "    var i int32;\n"
+        "    var k int32;\n"
+        "    s = 0;\n"
+        "    k = 0;\n"
+        "    for i = 0; i < n; i += 1 {\n"
+        "        switch k {\n"
+        "        case 0:\n"
+        "            s += 1;\n"
+        "        case 1:\n"
+        "            s += 2;\n"
+        "            if s >= 50 {\n"
+        "                break;\n"
+        "            }\n"
+        "            s += 1;\n"
+        "        case 2:\n"
+        "            k += 1;\n"
+        "            continue;\n"
+        "        case 3:\n"
+        "            s -= 1;\n"
+        "            fallthrough;\n"
+        "        default:\n"
+        "            s += 3;\n"
+        "        }\n"
+        "        k += 1;\n"
+        "        if k >= 5 {\n"
+        "            k = 0;\n"
+        "        }\n"
+        "    }\n"
+        "    return s;\n"
+        "}\n"
+    );
+
+    for (int level = RiVmOpt_O0; level <= RiVmOpt_O2; ++level) {
+        iptr count;
+        iptr switches;
+        // dense: 99 + 10 + 50 + 30 + 40 + 50 + 99 + 99, sparse: 1 + 2 + ... + 7 + 1.
+        ASSERT(testrivm_ir_exec_op_(source, level, &count, RiVmOp_Switch, &switches) == 477 + 29 + 6 + 166);
+        ASSERT(switches == 2);
+    }
+}
+
+void
+testrivm_ir_switch_const()
+{
+    String source = S(
+        "func main() int32 {\n"
+        "    var s int32;\n"
+        "    var i int32;\n"
+        "    var u uint8;\n"
+        "    s = 0;\n"
+        "    for i = -3; i < 3; i += 1 {\n"
+        "        s += signs(i);\n"
+        "    }\n"
+        "    for u = 0; u < 8; u += 1 {\n"
+        "        s += narrow(u);\n"
+        "    }\n"
+        "    return s + wide(4) + wide(3000000000) + wide(5);\n"
+        "}\n"
+        // Signed constants are folded, so they still make a jump table.
+        "func signs(x int32) int32 {\n"
+        "    var r int32;\n"
+        "    r = 0;\n"
+        "    switch x {\n"
+        "    case -2:\n"
+        "        r = 1;\n"
+        "    case -1:\n"
+        "        r = 2;\n"
+        "    case 0:\n"
+        "        r = 3;\n"
+        "    case +1:\n"
+        "        r = 4;\n"
+        "    }\n"
+        "    return r;\n"
+        "}\n"
+        "func narrow(x uint8) int32 {\n"
+        "    var r int32;\n"
+        "    r = 0;\n"
+        "    switch x {\n"
+        "    case 1:\n"
+        "        r = 10;\n"
+        "    case 2:\n"
+        "        r = 20;\n"
+        "    case 3:\n"
+        "        r = 30;\n"
+        "    case 5:\n"
+        "        r = 50;\n"
+        "    }\n"
+        "    return r;\n"
+        "}\n"
+        // Searched by halves as unsigned.
+        "func wide(x uint32) int32 {\n"
+        "    var r int32;\n"
+        "    r = 0;\n"
+        "    switch x {\n"
+        "    case 3000000000:\n"
+        "        r = 100;\n"
+        "    case 1:\n"
+        "        r = 200;\n"
+        "    case 4:\n"
+        "        r = 300;\n"
+        "    case 2:\n"
+        "        r = 400;\n"
+        "    }\n"
+        "    return r;\n"
+        "}\n"
+    );
+
+    for (int level = RiVmOpt_O0; level <= RiVmOpt_O2; ++level) {
+        iptr count;
+        iptr switches;
+        // signs: 0 + 1 + 2 + 3 + 4 + 0, narrow: 10 + 20 + 30 + 50, wide: 300 + 100.
+        ASSERT(testrivm_ir_exec_op_(source, level, &count, RiVmOp_Switch, &switches) == 10 + 110 + 400);
+        // Inlining at O2 copies one of them.
+        ASSERT(switches == (level == RiVmOpt_O2 ? 3 : 2));
+    }
+}
+
+void
+testrivm_ir_logical()
+{
+    String source = S(
+        "func main() int32 {\n"
+        "    var s int32;\n"
+        "    var i int32;\n"
+        "    var b bool;\n"
+        "    s = depth(5) + any(2) + any(5) + any(12);\n"
+        "    for i = 0; i < 100 && s < 230; i += 1 {\n"
+        "        b = i < 3 || i >= 10;\n"
+        "        if b && !(i == 11) {\n"
+        "            s += 2;\n"
+        "        }\n"
+        "        s += 1;\n"
+        "    }\n"
+        "    return s;\n"
+        "}\n"
+        // Recurses forever unless the call is skipped at 0.
+        "func depth(n int32) int32 {\n"
+        "    var r int32;\n"
+        "    r = 0;\n"
+        "    if n >= 1 && depth(n - 1) >= 0 {\n"
+        "        r = n;\n"
+        "    }\n"
+        "    return r;\n"
+        "}\n"
+        "func any(n int32) int32 {\n"
+        "    var r int32;\n"
+        "    r = 0;\n"
+        "    if n == 1 || n == 2 || (n >= 10 && !(n >= 20)) {\n"
+        "        r = 100;\n"
+        "    }\n"
+        "    return r;\n"
+        "}\n"
+    );
+
+    for (int level = RiVmOpt_O0; level <= RiVmOpt_O2; ++level) {
+        iptr count;
+        iptr ands;
+        // 5 + 100 + 0 + 100, then 3 for i < 3, 1 up to 10, 3, 1 for 11, and 3 until past 230.
+        ASSERT(testrivm_ir_exec_op_(source, level, &count, RiVmOp_Binary_And, &ands) == 231);
+        ASSERT(ands == 0);
+    }
+}
+
+void
+testrivm_ir_inline()
+{
+    String source = S(
+        "func main() int32 {\n"
+        "    var s int32;\n"
+        "    var i int32;\n"
+        "    s = fact(4) + keep(1);\n"
+        "    for i = 0; i < 10; i += 1 {\n"
+        "        s = add(s, get(i));\n"
+        "    }\n"
+        "    return s;\n"
+        "}\n"
+        "func get(x int32) int32 {\n"
+        "    if x < 5 {\n"
+        "        return x;\n"
+        "    }\n"
+        "    return add(x, x);\n"
+        "}\n"
+        "func add(a int32, b int32) int32 {\n"
+        "    return a + b;\n"
+        "}\n"
+        // Inlined once, then called.
+        "func fact(n int32) int32 {\n"
+        "    var r int32;\n"
+        "    r = 1;\n"
+        "    if n >= 2 {\n"
+        "        r = n + fact(n - 1);\n"
+        "    }\n"
+        "    return r;\n"
+        "}\n"
+        "//ri:noinline\n"
+        "func keep(x int32) int32 {\n"
+        "    return x;\n"
+        "}\n"
+    );
+
+    iptr count;
+    iptr calls[3];
+    for (int level = RiVmOpt_O0; level <= RiVmOpt_O2; ++level) {
+        // 10 + 1, then 0 + 1 + 2 + 3 + 4 and 2 * (5 + 6 + 7 + 8 + 9).
+        ASSERT(testrivm_ir_exec_op_(source, level, &count, RiVmOp_Call, &calls[level]) == 11 + 10 + 70);
+    }
+    // main calls fact, keep, add and get, fact calls itself. get returns add, a tail call.
+    ASSERT(calls[0] == 5);
+    ASSERT(calls[1] == calls[0]);
+    // Only keep and fact in main and in fact.
+    ASSERT(calls[2] == 3);
+}
+
+void
+testrivm_ir_tail_call()
+{
+    // A million steps deep, and the frames of `step` and `skip` have different sizes.
+    String source = S(
+        "func main() int32 {\n"
+        "    var s int32;\n"
+        "    s = step(0, 0);\n"
+        "    return s;\n"
+        "}\n"
+        "func step(n int32, s int32) int32 {\n"
+        "    if n >= 1000000 {\n"
+        "        return s;\n"
+        "    }\n"
+        "    if n == 500000 {\n"
+        "        return skip(n + 1);\n"
+        "    }\n"
+        "    return step(n + 1, s + 2);\n"
+        "}\n"
+        "func skip(n int32) int32 {\n"
+        "    var s int32;\n"
+        "    var t int32;\n"
+        "    s = 0;\n"
+        "    t = 1000000 - n;\n"
+        "    return step(n, s - t);\n"
+        "}\n"
+    );
+
+    for (int level = RiVmOpt_O0; level <= RiVmOpt_O2; ++level) {
+        iptr count;
+        iptr tail_calls;
+        // 2 for each step but the ones from 500000 to 1000000, which start at -499999.
+        ASSERT(testrivm_ir_exec_op_(source, level, &count, RiVmOp_TailCall, &tail_calls) == 499999);
+        // At O2 `skip` and `step` are inlined into each other, keeping the tail calls in their bodies.
+        ASSERT(tail_calls == (level == RiVmOpt_O2 ? 4 : 3));
+    }
+}
+
+void
+testrivm_ir_arith()
+{
+    String source = S(
+        "func main() int32 {\n"
+        "    var a int32;\n"
+        "    var b int32;\n"
+        "    var s int32;\n"
+        "    var u uint32;\n"
+        "    var w int64;\n"
+        "    a = 1000;\n"
+        "    b = -7;\n"
+        "    s = a * b;\n"
+        "    s = s + a / b;\n"
+        "    s = s + a % b;\n"
+        "    s = s + (a ^ 255);\n"
+        "    s = s + (a & 255);\n"
+        "    s = s + (a | 3);\n"
+        "    s = s + (b << 4);\n"
+        "    s = s + (b >> 1);\n"
+        "    s = s + -a;\n"
+        "    s = s + ~b;\n"
+        "    if a > b {\n"
+        "        s = s + 1;\n"
+        "    }\n"
+        "    u = 4000000000;\n"
+        "    u = u / 16 + u % 16;\n"
+        "    if u > 200000000 {\n"
+        "        s = s + 10;\n"
+        "    }\n"
+        "    w = 5000000000;\n"
+        "    if w > 4000000000 {\n"
+        "        s = s + 100;\n"
+        "    }\n"
+        "    return s;\n"
+        "}\n"
+    );
+
+    for (int level = RiVmOpt_O0; level <= RiVmOpt_O2; ++level) {
+        iptr count;
+        iptr divs;
+        ASSERT(testrivm_ir_exec_op_(source, level, &count, RiVmOp_Binary_Div, &divs) == -6109);
+        // The unsigned division by 16 becomes a shift.
+        ASSERT(divs == (level == RiVmOpt_O0 ? 2 : 1));
+    }
+
+    // Overflow of a callee traps the whole call, unless the module isn't checked, then it wraps.
+    String overflow = S(
+        "func main() int32 {\n"
+        "    var a int32;\n"
+        "    var s int32;\n"
+        "    a = 2147483000;\n"
+        "    s = f(a);\n"
+        "    return s;\n"
+        "}\n"
+        "func f(a int32) int32 {\n"
+        "    return a + 1000;\n"
+        "}\n"
+    );
+    // Traps in the loop, which would go on forever if it wrapped.
+    String loop = S(
+        "func main() int32 {\n"
+        "    var x int32 = 1;\n"
+        "    for x != 0 {\n"
+        "        x = x * 3;\n"
+        "    }\n"
+        "    return x;\n"
+        "}\n"
+    );
+    String divide = S(
+        "func main() int32 {\n"
+        "    var a int32;\n"
+        "    var z int32;\n"
+        "    a = 5;\n"
+        "    z = 0;\n"
+        "    return a / z;\n"
+        "}\n"
+    );
+    for (int level = RiVmOpt_O0; level <= RiVmOpt_O2; ++level) {
+        iptr count;
+        iptr ops;
+        RiVmTrap trap;
+        ASSERT(testrivm_ir_exec_checked_(overflow, level, true, &trap, &count, RiVmOp_Binary_Checked_Add, &ops) == 0);
+        ASSERT(trap == RiVmTrap_Overflow);
+        // At O2 `f` is inlined, and still traps in place.
+        ASSERT(ops == (level == RiVmOpt_O2 ? 2 : 1));
+        ASSERT(testrivm_ir_exec_checked_(overflow, level, false, &trap, &count, RiVmOp_Binary_Checked_Add, &ops) == -2147483296);
+        ASSERT(trap == RiVmTrap_None);
+        ASSERT(ops == 0);
+        testrivm_ir_exec_checked_(loop, level, true, &trap, &count, RiVmOp_None, &ops);
+        ASSERT(trap == RiVmTrap_Overflow);
+        testrivm_ir_exec_checked_(divide, level, false, &trap, &count, RiVmOp_None, &ops);
+        ASSERT(trap == RiVmTrap_DivideByZero);
+    }
+}
+
+void
+testrivm_ir_float()
+{
+    // A body falling for a second, then conversions between all kinds of numbers.
+    String source = S(
+        "func main() int32 {\n"
+        "    var x float64;\n"
+        "    var v float64;\n"
+        "    var dt float64;\n"
+        "    var i int32;\n"
+        "    var f float32;\n"
+        "    var w int64;\n"
+        "    var s int32;\n"
+        "    x = 0.0;\n"
+        "    v = 10.0;\n"
+        "    dt = 0.01;\n"
+        "    for i = 0; i < 100; i += 1 {\n"
+        "        v = v - 9.8 * dt;\n"
+        "        x = x + v * dt;\n"
+        "    }\n"
+        "    f = float32(x);\n"
+        "    f = -(f * 2);\n"
+        "    w = int64(-5 * i);\n"
+        "    s = int32(x * 1000.0) + int32(float64(i) / 3.0);\n"
+        "    s = s + int32(uint32(f)) + int32(w) + int32(f);\n"
+        "    if f < -1.5 {\n"
+        "        s = s + 1000000;\n"
+        "    }\n"
+        "    s = s + int32(half(3));\n"
+        "    return s;\n"
+        "}\n"
+        "func half(a int32) float32 {\n"
+        "    return float32(a) / 2.0;\n"
+        "}\n"
+    );
+    // Out of range conversions saturate, NaN is 0.
+    String saturate = S(
+        "func main() int32 {\n"
+        "    var big float64;\n"
+        "    var z float64;\n"
+        "    var s int32;\n"
+        "    big = 10000000000.0;\n"
+        "    z = 0.0;\n"
+        "    s = 0;\n"
+        "    if int32(big) == 2147483647 {\n"
+        "        s += 1;\n"
+        "    }\n"
+        "    if int32(-big) == -2147483648 {\n"
+        "        s += 2;\n"
+        "    }\n"
+        "    if uint32(-big) == 0 {\n"
+        "        s += 4;\n"
+        "    }\n"
+        "    if int32(z / z) == 0 {\n"
+        "        s += 8;\n"
+        "    }\n"
+        "    if int64(big) == 10000000000 {\n"
+        "        s += 16;\n"
+        "    }\n"
+        "    return s;\n"
+        "}\n"
+    );
+
+    for (int level = RiVmOpt_O0; level <= RiVmOpt_O2; ++level) {
+        iptr count;
+        iptr converts;
+        // 5051 + 33 + 0 - 500 - 10 + 1000000 + 1
+        ASSERT(testrivm_ir_exec_op_(source, level, &count, RiVmOp_Unary_Convert_FloatToInt, &converts) == 1004574);
+        ASSERT(converts >= 4);
+        ASSERT(testrivm_ir_exec_level_(saturate, level, &count) == 31);
+    }
+}
+
+void
+testrivm_ir_narrow()
+{
+    // Wraps around in the loop, on assignment, in casts and in constants.
+    String source = S(
+        "func main() int32 {\n"
+        "    var h uint8;\n"
+        "    var i int32;\n"
+        "    var c int8;\n"
+        "    var w uint16;\n"
+        "    var k int16;\n"
+        "    var b uint8;\n"
+        "    var s int32;\n"
+        "    h = 0;\n"
+        "    for i = 0; i < 1000; i += 1 {\n"
+        "        h = h * 31 + uint8(i);\n"
+        "    }\n"
+        "    c = 127;\n"
+        "    c += 1;\n"
+        "    w = 65535;\n"
+        "    w = w + 2;\n"
+        "    k = int16(-30000) - 10000;\n"
+        "    b = ~uint8(5);\n"
+        "    s = int32(h) + int32(c) * 1000 + int32(w) * 100000 + int32(k);\n"
+        "    s = s + int32(b) * 7 + int32(int8(200)) + int32(uint8(-1.0)) + int32(int16(b << 9));\n"
+        "    if c < 0 {\n"
+        "        s = s + 3;\n"
+        "    }\n"
+        "    return s + sum(250, 10);\n"
+        "}\n"
+        "func sum(a uint8, b uint8) int32 {\n"
+        "    return int32(a + b);\n"
+        "}\n"
+    );
+
+    iptr wraps[3];
+    for (int level = RiVmOpt_O0; level <= RiVmOpt_O2; ++level) {
+        iptr count;
+        ASSERT(testrivm_ir_exec_op_(source, level, &count, RiVmOp_Unary_Convert_Narrow_U8, &wraps[level]) == -275);
+    }
+    // The loop wraps its sum only, not the product and the index it's made of.
+    ASSERT(wraps[1] == wraps[0] - 2);
+    ASSERT(wraps[2] == wraps[1]);
+
+    // Shift counts are taken modulo 8 and 16 too.
+    String shifts = S(
+        "func main() int32 {\n"
+        "    var a uint8 = 1;\n"
+        "    var c int8 = -128;\n"
+        "    var k int16 = 1;\n"
+        "    var n uint8 = 9;\n"
+        "    var m int8 = 9;\n"
+        "    var l int16 = 17;\n"
+        "    return int32(a << n) * 1000 + int32(c >> m) + int32(k << l) * 100000;\n"
+        "}\n"
+    );
+    // Out of range results trap where wider integers would: checked `+`, `-` and `*`, also on
+    // fields, and the lowest signed integer divided by -1 in any case.
+    String add = S(
+        "func main() int32 {\n"
+        "    var c int8 = 100;\n"
+        "    c = c + 100;\n"
+        "    return int32(c);\n"
+        "}\n"
+    );
+    String mul = S(
+        "type Pair struct {\n"
+        "    lo uint8;\n"
+        "    hi int16;\n"
+        "}\n"
+        "func main() int32 {\n"
+        "    var p Pair;\n"
+        "    p.lo = 16;\n"
+        "    p.lo *= 16;\n"
+        "    return int32(p.lo);\n"
+        "}\n"
+    );
+    String divide = S(
+        "func main() int32 {\n"
+        "    var c int8 = -128;\n"
+        "    var d int8 = -1;\n"
+        "    return int32(c / d);\n"
+        "}\n"
+    );
+    for (int level = RiVmOpt_O0; level <= RiVmOpt_O2; ++level) {
+        iptr count;
+        iptr ops;
+        RiVmTrap trap;
+        ASSERT(testrivm_ir_exec_op_(shifts, level, &count, RiVmOp_None, &ops) == 2000 - 64 + 200000);
+        ASSERT(testrivm_ir_exec_checked_(add, level, false, &trap, &count, RiVmOp_None, &ops) == -56);
+        ASSERT(trap == RiVmTrap_None);
+        testrivm_ir_exec_checked_(add, level, true, &trap, &count, RiVmOp_None, &ops);
+        ASSERT(trap == RiVmTrap_Overflow);
+        ASSERT(testrivm_ir_exec_checked_(mul, level, false, &trap, &count, RiVmOp_None, &ops) == 0);
+        ASSERT(trap == RiVmTrap_None);
+        testrivm_ir_exec_checked_(mul, level, true, &trap, &count, RiVmOp_None, &ops);
+        ASSERT(trap == RiVmTrap_Overflow);
+        testrivm_ir_exec_checked_(divide, level, false, &trap, &count, RiVmOp_None, &ops);
+        ASSERT(trap == RiVmTrap_Overflow);
+    }
+}
+
+static void
+testrivm_ir_outputs()
+{
+    // Error and value, in a loop so results are set again, and forwarded by a tail call.
+    String source = S(
+        "func main() int32 {\n"
+        "    var q int32;\n"
+        "    var r int32;\n"
+        "    var e int32;\n"
+        "    var s int32;\n"
+        "    var i int32;\n"
+        "    var a int32;\n"
+        "    var b int64;\n"
+        "    s = 0;\n"
+        "    for i = 0; i < 10; i += 1 {\n"
+        "        q, r, e = divmod(100 + i, i);\n"
+        "        if e != 0 {\n"
+        "            s += 1000;\n"
+        "        } else {\n"
+        "            s += q * 10 + r;\n"
+        "        }\n"
+        "    }\n"
+        "    a, b = forward(7);\n"
+        "    return s + a + int32(b);\n"
+        "}\n"
+        "func divmod(a int32, b int32) (int32, int32, int32) {\n"
+        "    if b == 0 {\n"
+        "        return 0, 0, 1;\n"
+        "    }\n"
+        "    return a / b, a % b, 0;\n"
+        "}\n"
+        "func pair(x int32) (int32, int64) {\n"
+        "    return x * 2, int64(x) * 100;\n"
+        "}\n"
+        "func forward(x int32) (int32, int64) {\n"
+        "    return pair(x + 1);\n"
+        "}\n"
+    );
+    for (int level = RiVmOpt_O0; level <= RiVmOpt_O2; ++level) {
+        iptr count;
+        iptr outputs;
+        ASSERT(testrivm_ir_exec_op_(source, level, &count, RiVmOp_Output, &outputs) == 4728);
+        // Two returns of `divmod` and one of `pair`, `forward` sets none of its own.
+        ASSERT(outputs == 5);
+    }
+
+    // The host gets outputs after the first one in the context.
+    Ri ri;
+    ri_init(&ri);
+    RiNode* ast_module = ri_build(&ri, S(
+        "func main() (int32, int64, float64) {\n"
+        "    return 1, -2, 0.5;\n"
+        "}\n"
+    ), S("testrivm_ir.ri"));
+    ASSERT(ast_module);
+    RiVmModule module;
+    rivm_module_init(&module);
+    RiVmCompiler compiler;
+    rivm_init(&compiler, &ri);
+    ASSERT(rivm_compile(&compiler, ast_module, &module));
+    rivm_purge(&compiler);
+
+    RiVmExec context;
+    rivm_exec_init(&context);
+    ASSERT(rivm_exec_module(&context, &module, 0, 0, 0).i32 == 1);
+    ASSERT(context.outputs[0].i64 == -2);
+    ASSERT(context.outputs[1].f64 == 0.5);
+    rivm_exec_purge(&context);
+    rivm_module_purge(&module);
+    ri_purge(&ri);
+
+    // More outputs than the VM has slots for is a type error.
+    ri_init(&ri);
+    ASSERT(!ri_build(&ri, S(
+        "func main() (int32, int32, int32, int32, int32, int32, int32, int32, int32) {\n"
+        "    return 1, 2, 3, 4, 5, 6, 7, 8, 9;\n"
+        "}\n"
+    ), S("testrivm_ir.ri")));
+    ASSERT(ri.error.kind == RiError_Type);
+    ri_purge(&ri);
+}
+
+// Laid out like `Record` in the scripts of `testrivm_ir_structs`.
+typedef struct TestRiVmRecord_ TestRiVmRecord_;
+struct TestRiVmRecord_ {
+    int8_t tag;
+    int64_t total;
+    uint16_t count;
+    struct {
+        float scale;
+        int8_t bias;
+    } inner;
+    double mean;
+    TestRiVmRecord_* next;
+};
+
+#define TESTRIVM_RECORD_ \
+    "type Inner struct {\n" \
+    "    scale float32;\n" \
+    "    bias int8;\n" \
+    "}\n" \
+    "type Record struct {\n" \
+    "    tag int8;\n" \
+    "    total int64;\n" \
+    "    count uint16;\n" \
+    "    inner Inner;\n" \
+    "    mean float64;\n" \
+    "    next *Record;\n" \
+    "}\n"
+
+static void
+testrivm_ir_structs()
+{
+    // Structs in the frame, copied whole and by field, fields wrapping like variables, and
+    // `return f(...)` from a function with a struct, which calls instead.
+    String source = S(
+        "func main() int32 {\n"
+        "    var a Record;\n"
+        "    var b Record;\n"
+        "    var i int32;\n"
+        "    a.tag = 127;\n"
+        "    a.tag += 2;\n"
+        "    a.count = 65535;\n"
+        "    a.count += 3;\n"
+        "    a.inner.bias = -3;\n"
+        "    a.inner.scale = 1.5;\n"
+        "    a.next = &b;\n"
+        "    for i = 0; i < 10; i += 1 {\n"
+        "        a.next.total += int64(i);\n"
+        "    }\n"
+        "    b.inner = a.inner;\n"
+        "    var c Record = b;\n"
+        "    c.inner.bias *= 2;\n"
+        "    return int32(a.tag) * 1000 + int32(a.count) * 100 + int32(b.total) + int32(b.inner.scale * 2.0) + int32(c.inner.bias) + sum(&c);\n"
+        "}\n"
+        "func sum(r *Record) int32 {\n"
+        "    var copy Record;\n"
+        "    copy.total = r.total;\n"
+        "    copy.inner = r.inner;\n"
+        "    return total(&copy);\n"
+        "}\n"
+        "//ri:noinline\n"
+        "func total(r *Record) int32 {\n"
+        "    return int32(r.total) + int32(r.inner.bias);\n"
+        "}\n"
+        TESTRIVM_RECORD_
+    );
+    for (int level = RiVmOpt_O0; level <= RiVmOpt_O2; ++level) {
+        iptr count;
+        iptr tail_calls;
+        ASSERT(testrivm_ir_exec_op_(source, level, &count, RiVmOp_TailCall, &tail_calls) == -126719);
+        ASSERT(tail_calls == 0);
+    }
+
+    // Host structs are used in place, at the offsets C gives their fields.
+    for (int level = RiVmOpt_O0; level <= RiVmOpt_O2; ++level) {
+        Ri ri;
+        ri_init(&ri);
+        RiNode* ast_module = ri_build(&ri, S(
+            "func update(r *Record, x float64) int64 {\n"
+            "    r.count += 1;\n"
+            "    r.total += int64(r.tag) + r.next.total;\n"
+            "    r.mean = (r.mean * float64(r.count - 1) + x) / float64(r.count);\n"
+            "    r.next.inner = r.inner;\n"
+            "    r.next.next = r;\n"
+            "    return r.total;\n"
+            "}\n"
+            TESTRIVM_RECORD_
+        ), S("testrivm_ir.ri"));
+        ASSERT(ast_module);
+        RiVmModule module;
+        rivm_module_init(&module);
+        RiVmCompiler compiler;
+        rivm_init(&compiler, &ri);
+        compiler.opt_level = level;
+        ASSERT(rivm_compile(&compiler, ast_module, &module));
+        rivm_purge(&compiler);
+
+        TestRiVmRecord_ b = { .total = 20 };
+        TestRiVmRecord_ a = { .tag = -5, .total = 100, .count = 3, .inner = { 2.5f, 7 }, .mean = 4.0, .next = &b };
+        RiVmValue args[2] = { { .ptr = &a }, { .f64 = 8.0 } };
+        RiVmExec context;
+        rivm_exec_init(&context);
+        ASSERT(rivm_exec_module(&context, &module, 0, args, COUNTOF(args)).i64 == 115);
+        ASSERT(context.trap == RiVmTrap_None);
+        ASSERT(a.tag == -5 && a.total == 115 && a.count == 4 && a.mean == 5.0);
+        ASSERT(b.inner.scale == 2.5f && b.inner.bias == 7 && b.next == &a && b.total == 20);
+        rivm_exec_purge(&context);
+        rivm_module_purge(&module);
+        ri_purge(&ri);
+    }
+
+    // Overflow traps before the host struct is written.
+    for (int level = RiVmOpt_O0; level <= RiVmOpt_O2; ++level) {
+        Ri ri;
+        ri_init(&ri);
+        RiNode* ast_module = ri_build(&ri, S(
+            "func bump(r *Record) int64 {\n"
+            "    r.total = r.total + 9223372036854775807;\n"
+            "    r.count = 1;\n"
+            "    return r.total;\n"
+            "}\n"
+            TESTRIVM_RECORD_
+        ), S("testrivm_ir.ri"));
+        ASSERT(ast_module);
+        RiVmModule module;
+        rivm_module_init(&module);
+        RiVmCompiler compiler;
+        rivm_init(&compiler, &ri);
+        compiler.opt_level = level;
+        compiler.checked = true;
+        ASSERT(rivm_compile(&compiler, ast_module, &module));
+        rivm_purge(&compiler);
+
+        TestRiVmRecord_ a = { .total = 100, .count = 3 };
+        RiVmValue args[1] = { { .ptr = &a } };
+        RiVmExec context;
+        rivm_exec_init(&context);
+        rivm_exec_module(&context, &module, 0, args, COUNTOF(args));
+        ASSERT(context.trap == RiVmTrap_Overflow);
+        ASSERT(a.total == 100 && a.count == 3);
+        rivm_exec_purge(&context);
+        rivm_module_purge(&module);
+        ri_purge(&ri);
+    }
+}
+
+// Slots the first function of `source` enters with.
+static iptr
+testrivm_ir_frame_(String source, RiVmOptLevel level)
+{
+    Ri ri;
+    ri_init(&ri);
+    RiNode* ast_module = ri_build(&ri, source, S("testrivm_ir.ri"));
+    ASSERT(ast_module);
+
+    RiVmModule module;
+    rivm_module_init(&module);
+    RiVmCompiler compiler;
+    rivm_init(&compiler, &ri);
+    compiler.opt_level = level;
+    ASSERT(rivm_compile(&compiler, ast_module, &module));
+    rivm_purge(&compiler);
+
+    RiVmInstSlice code = rivm_module_func_code(&module, array_at(&module.slot, 0));
+    ASSERT(code.items[0].op == RiVmOp_Enter);
+    iptr frame = (iptr)code.items[0].param0.imm.u64;
+
+    rivm_module_purge(&module);
+    ri_purge(&ri);
+    return frame;
+}
+
+// IR and code of a function can outgrow the compiler's arena blocks, its frame can't.
+void
+testrivm_ir_large()
+{
+    CharArray source = {0};
+    chararray_push(&source, S("func main() int32 {\n    var a int32;\n    a = 0;\n"));
+    for (int i = 0; i < 40000; ++i) {
+        chararray_push_f(&source, "    a = a + %d;\n", i % 7);
+    }
+    chararray_push(&source, S("    return a;\n}\n"));
+
+    for (int level = RiVmOpt_O0; level <= RiVmOpt_O2; ++level) {
+        iptr count;
+        // 5714 times 0 to 6, then 0 and 1.
+        ASSERT(testrivm_ir_exec_level_(source.slice, level, &count) == 5714 * 21 + 1);
+        ASSERT(count > 0);
+        // Values share slots once they're dead.
+        ASSERT(testrivm_ir_frame_(source.slice, level) <= 4);
+    }
+    array_purge(&source);
+}
+
+void
+testrivm_ir_main()
+{
+    testrivm_ir_optimize();
+    testrivm_ir_levels();
+    testrivm_ir_loops();
+    testrivm_ir_switch();
+    testrivm_ir_switch_const();
+    testrivm_ir_logical();
+    testrivm_ir_inline();
+    testrivm_ir_tail_call();
+    testrivm_ir_arith();
+    testrivm_ir_float();
+    testrivm_ir_narrow();
+    testrivm_ir_outputs();
+    testrivm_ir_structs();
+    testrivm_ir_large();
+}